@@ -0,0 +1,358 @@
+// Front-end benchmark: lexer, parser and optimizer throughput and peak heap
+// use on deterministic synthetic programs. Prints a table and writes the
+// same numbers as JSON for diffing runs.
+#include "../include/lexer.hpp"
+#include "../include/parser.hpp"
+#include "../include/optimizer.hpp"
+#include "../include/arena.hpp"
+#include "../include/atoms.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifndef JS_COMPILER_VERSION
+#define JS_COMPILER_VERSION "unknown"
+#endif
+
+// Every heap allocation of the process, arena chunks included, goes through
+// these counters. Each block carries its size in a header in front of it.
+namespace {
+
+std::atomic<size_t> liveBytes{0};
+std::atomic<size_t> peakBytes{0};
+std::atomic<size_t> allocations{0};
+
+constexpr size_t MinHeader = 2 * sizeof(size_t);
+
+void* countedAllocate(size_t size, size_t alignment) {
+    size_t header = std::max(alignment, MinHeader);
+#ifdef _WIN32
+    void* base = _aligned_malloc(size + header, header);
+#else
+    void* base = alignment > alignof(std::max_align_t)
+        ? std::aligned_alloc(header, (size + header + header - 1) / header * header)
+        : std::malloc(size + header);
+#endif
+    if (!base) throw std::bad_alloc();
+    auto* block = static_cast<char*>(base) + header;
+    reinterpret_cast<size_t*>(block)[-1] = size;
+    reinterpret_cast<size_t*>(block)[-2] = header;
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    return block;
+}
+
+void countedFree(void* ptr) noexcept {
+    if (!ptr) return;
+    auto* block = static_cast<char*>(ptr);
+    liveBytes.fetch_sub(reinterpret_cast<size_t*>(block)[-1], std::memory_order_relaxed);
+#ifdef _WIN32
+    _aligned_free(block - reinterpret_cast<size_t*>(block)[-2]);
+#else
+    std::free(block - reinterpret_cast<size_t*>(block)[-2]);
+#endif
+}
+
+} // namespace
+
+void* operator new(size_t size) { return countedAllocate(size, 0); }
+void* operator new[](size_t size) { return countedAllocate(size, 0); }
+void* operator new(size_t size, std::align_val_t a) { return countedAllocate(size, static_cast<size_t>(a)); }
+void* operator new[](size_t size, std::align_val_t a) { return countedAllocate(size, static_cast<size_t>(a)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try { return countedAllocate(size, 0); } catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try { return countedAllocate(size, 0); } catch (...) { return nullptr; }
+}
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+void operator delete(void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { countedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { countedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { countedFree(p); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Deterministic xorshift, so every run benchmarks the same programs.
+class Random {
+public:
+    explicit Random(uint64_t seed) : state_(seed) {}
+    uint64_t next() {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 7;
+        state_ ^= state_ << 17;
+        return state_;
+    }
+    size_t below(size_t n) { return next() % n; }
+
+private:
+    uint64_t state_;
+};
+
+const char* const binaryOps[] = {"+", "-", "*", "/", "<", "==", "&&", "||", "&", "|"};
+
+// Nested parenthesized expressions mixing literals and variables.
+void deepExpression(std::string& out, Random& random, int depth) {
+    if (depth == 0) {
+        if (random.below(3) == 0) {
+            out += "v";
+            out += std::to_string(random.below(8));
+        } else {
+            out += std::to_string(random.below(100));
+        }
+        return;
+    }
+    if (random.below(8) == 0) {
+        out += random.below(2) ? "-" : "!";
+    }
+    out += '(';
+    deepExpression(out, random, depth - 1);
+    out += ' ';
+    out += binaryOps[random.below(std::size(binaryOps))];
+    out += ' ';
+    deepExpression(out, random, random.below(4) ? depth - 1 : 0);
+    out += ')';
+}
+
+std::string deepExpressions(size_t scale) {
+    Random random(1);
+    std::string out;
+    for (int i = 0; i < 8; i++) {
+        out += "let v" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+    }
+    for (size_t i = 0; i < 400 * scale; i++) {
+        out += "let e" + std::to_string(i) + " = ";
+        deepExpression(out, random, 12);
+        out += ";\n";
+    }
+    return out;
+}
+
+std::string stringChains(size_t scale) {
+    Random random(2);
+    std::string out;
+    for (size_t i = 0; i < 200 * scale; i++) {
+        out += "let s" + std::to_string(i) + " = \"start\"";
+        for (int j = 0; j < 200; j++) {
+            out += random.below(4) ? " + \"part" + std::to_string(random.below(1000)) + "\""
+                                   : " + " + std::to_string(random.below(100));
+        }
+        out += ";\n";
+    }
+    return out;
+}
+
+std::string manyFunctions(size_t scale) {
+    Random random(3);
+    std::string out;
+    size_t count = 4000 * scale;
+    for (size_t i = 0; i < count; i++) {
+        std::string n = std::to_string(i);
+        if (random.below(4) == 0) {
+            out += "function f" + n + "() {\n    return " + std::to_string(random.below(1000)) + " * 2 + 1;\n}\n";
+        } else {
+            out += "function f" + n + "(a, b) {\n    let t = a * " + n + " + b;\n    return t - f" +
+                   std::to_string(random.below(i + 1)) + "();\n}\n";
+        }
+    }
+    for (size_t i = 0; i < count; i += 16) {
+        out += "console.log(f" + std::to_string(i) + "(1, 2));\n";
+    }
+    return out;
+}
+
+std::string literalTables(size_t scale) {
+    Random random(4);
+    std::string out;
+    for (size_t i = 0; i < 20000 * scale; i++) {
+        std::string n = std::to_string(i);
+        switch (random.below(4)) {
+            case 0: out += "let n" + n + " = " + std::to_string(random.below(1000000)) + "." +
+                           std::to_string(random.below(1000)) + ";\n"; break;
+            case 1: out += "let s" + n + " = \"entry " + std::to_string(random.next() % 100000) + "\";\n"; break;
+            case 2: out += "let b" + n + " = " + (random.below(2) ? "true" : "false") + ";\n"; break;
+            default: out += "let u" + n + " = null;\n"; break;
+        }
+    }
+    return out;
+}
+
+struct Workload {
+    const char* name;
+    std::string (*generate)(size_t scale);
+};
+
+const Workload workloads[] = {
+    {"deep_expressions", deepExpressions},
+    {"string_chains", stringChains},
+    {"many_functions", manyFunctions},
+    {"literal_tables", literalTables},
+};
+
+struct Phase {
+    double seconds = 0;
+    size_t peakBytes = 0;
+};
+
+struct Result {
+    const char* name;
+    size_t sourceBytes = 0;
+    size_t tokens = 0;
+    size_t nodes = 0;
+    Phase lexer, parser, optimizer;
+    // Heap allocations of optimizing the optimized program again, where
+    // nothing changes.
+    size_t fixpointAllocations = 0;
+};
+
+// Heap bytes the phase needed beyond what was live when it started.
+class PeakScope {
+public:
+    PeakScope() : base_(liveBytes.load()) { peakBytes.store(base_); }
+    size_t bytes() const { return peakBytes.load() - base_; }
+
+private:
+    size_t base_;
+};
+
+template<typename F>
+void measure(Phase& phase, bool first, F&& f) {
+    PeakScope peak;
+    auto start = Clock::now();
+    f();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (first || seconds < phase.seconds) phase.seconds = seconds;
+    if (first) phase.peakBytes = peak.bytes();
+}
+
+// Best of `repeat` runs per phase. Every run starts from a fresh arena and
+// atom table, so no run profits from atoms interned by an earlier one.
+Result run(const Workload& workload, size_t scale, int repeat) {
+    Result result;
+    result.name = workload.name;
+    std::string source = workload.generate(scale);
+    result.sourceBytes = source.size();
+
+    for (int i = 0; i < repeat; i++) {
+        bool first = i == 0;
+        js::Arena arena;
+        js::ArenaScope arenaScope(arena);
+        js::AtomTable atoms;
+        js::AtomScope atomScope(atoms);
+
+        std::vector<js::Token> tokens;
+        measure(result.lexer, first, [&] { tokens = js::Lexer(source).tokenize(); });
+        result.tokens = tokens.size();
+
+        js::NodePtr ast;
+        size_t nodes = 0;
+        measure(result.parser, first, [&] {
+            js::Parser parser(std::move(tokens));
+            ast = parser.parse();
+            nodes = parser.nodes_created();
+        });
+        result.nodes = nodes;
+
+        measure(result.optimizer, first, [&] {
+            js::Optimizer optimizer;
+            ast = optimizer.optimizeProgram(std::move(ast));
+        });
+        size_t before = allocations.load();
+        ast = js::Optimizer().optimizeProgram(std::move(ast));
+        result.fixpointAllocations = allocations.load() - before;
+        arena.adopt(std::move(ast));
+    }
+    return result;
+}
+
+void writePhase(std::ofstream& out, const char* name, const Phase& phase, const char* rateName, double rate,
+                bool last) {
+    out << "      \"" << name << "\": {\"seconds\": " << phase.seconds << ", \"" << rateName << "\": " << rate
+        << ", \"peak_bytes\": " << phase.peakBytes << "}" << (last ? "\n" : ",\n");
+}
+
+void writeJson(const std::string& path, const std::vector<Result>& results, size_t scale, int repeat) {
+    std::ofstream out(path);
+    if (!out) {
+        std::fprintf(stderr, "Could not write %s\n", path.c_str());
+        std::exit(1);
+    }
+    out.precision(6);
+    out << "{\n  \"compiler_version\": \"" << JS_COMPILER_VERSION << "\",\n  \"scale\": " << scale
+        << ",\n  \"repeat\": " << repeat << ",\n  \"workloads\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        out << "    {\n      \"name\": \"" << r.name << "\",\n      \"source_bytes\": " << r.sourceBytes
+            << ",\n      \"tokens\": " << r.tokens << ",\n      \"nodes\": " << r.nodes << ",\n";
+        writePhase(out, "lexer", r.lexer, "mb_per_s", r.sourceBytes / r.lexer.seconds / 1e6, false);
+        writePhase(out, "parser", r.parser, "nodes_per_s", r.nodes / r.parser.seconds, false);
+        writePhase(out, "optimizer", r.optimizer, "nodes_per_s", r.nodes / r.optimizer.seconds, false);
+        out << "      \"fixpoint_allocations\": " << r.fixpointAllocations << "\n";
+        out << "    }" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t scale = 1;
+    int repeat = 5;
+    std::string json = "js_bench.json";
+    std::string only;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--scale=", 8) == 0) {
+            scale = std::strtoul(argv[i] + 8, nullptr, 10);
+        } else if (std::strncmp(argv[i], "--repeat=", 9) == 0) {
+            repeat = std::atoi(argv[i] + 9);
+        } else if (std::strncmp(argv[i], "--json=", 7) == 0) {
+            json = argv[i] + 7;
+        } else if (std::strncmp(argv[i], "--workload=", 11) == 0) {
+            only = argv[i] + 11;
+        } else {
+            scale = 0;
+            break;
+        }
+    }
+    if (scale == 0 || repeat <= 0) {
+        std::fprintf(stderr, "Usage: %s [--scale=<n>] [--repeat=<n>] [--workload=<name>] [--json=<file>]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Result> results;
+    std::printf("%-18s %10s %10s %12s %14s %14s %10s %10s %10s %10s\n", "workload", "KiB", "nodes", "lexer MB/s",
+                "parser node/s", "optim node/s", "lex KiB", "parse KiB", "opt KiB", "fix allocs");
+    for (const auto& workload : workloads) {
+        if (!only.empty() && only != workload.name) continue;
+        Result r = run(workload, scale, repeat);
+        std::printf("%-18s %10zu %10zu %12.1f %14.3e %14.3e %10zu %10zu %10zu %10zu\n", r.name,
+                    r.sourceBytes / 1024, r.nodes, r.sourceBytes / r.lexer.seconds / 1e6, r.nodes / r.parser.seconds,
+                    r.nodes / r.optimizer.seconds, r.lexer.peakBytes / 1024, r.parser.peakBytes / 1024,
+                    r.optimizer.peakBytes / 1024, r.fixpointAllocations);
+        results.push_back(r);
+    }
+    if (results.empty()) {
+        std::fprintf(stderr, "Unknown workload: %s\n", only.c_str());
+        return 1;
+    }
+    writeJson(json, results, scale, repeat);
+    std::printf("Wrote %s\n", json.c_str());
+    return 0;
+}
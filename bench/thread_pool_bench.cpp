@@ -0,0 +1,203 @@
+// Contention benchmark for ThreadPool: throughput of fine-grained tasks at
+// 1 to 64 threads, next to a pool built on one locked queue (the design the
+// work-stealing pool replaced). Also runs MemoryPool against new/delete on
+// the same threads, freeing most objects on another thread than the one
+// that allocated them.
+#include "../include/memory_pool.hpp"
+#include "../include/thread_pool.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// One shared queue, one mutex, one condition variable and a heap-allocated
+// std::function per task.
+class LockedQueuePool {
+public:
+    explicit LockedQueuePool(size_t numThreads) {
+        for (size_t i = 0; i < numThreads; i++) {
+            workers_.emplace_back([this] {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        ready_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                        if (stop_ && tasks_.empty()) return;
+                        task = std::move(tasks_.front());
+                        tasks_.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    ~LockedQueuePool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        ready_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push(std::move(task));
+        }
+        ready_.notify_one();
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    bool stop_ = false;
+};
+
+uint64_t work(uint64_t x) {
+    for (int i = 0; i < 16; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    return x;
+}
+
+template<typename F>
+double seconds(F&& f) {
+    auto start = Clock::now();
+    f();
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Tasks spawned from inside the pool, one per index.
+double spawnTasks(js::ThreadPool& pool, std::vector<uint64_t>& out) {
+    return seconds([&] {
+        std::promise<void> done;
+        pool.submit([&] {
+            js::TaskGroup group(pool);
+            for (size_t i = 0; i < out.size(); i++) {
+                group.run([&out, i] { out[i] = work(i); });
+            }
+            group.wait();
+            done.set_value();
+        });
+        done.get_future().wait();
+    });
+}
+
+double parallelFor(js::ThreadPool& pool, std::vector<uint64_t>& out) {
+    return seconds([&] {
+        pool.parallel_for(0, out.size(), 64, [&out](size_t i) { out[i] = work(i); });
+    });
+}
+
+double lockedQueue(size_t threads, std::vector<uint64_t>& out) {
+    LockedQueuePool pool(threads);
+    return seconds([&] {
+        std::atomic<size_t> remaining{out.size()};
+        std::promise<void> done;
+        for (size_t i = 0; i < out.size(); i++) {
+            pool.submit([&, i] {
+                out[i] = work(i);
+                if (remaining.fetch_sub(1) == 1) done.set_value();
+            });
+        }
+        done.get_future().wait();
+    });
+}
+
+struct PoolObject {
+    uint64_t value;
+    char payload[56];
+};
+
+// Allocates one object per index, then frees them in reverse order, so a
+// free mostly runs on another thread than its allocation. Objects that do
+// not hold the value they were given count as errors.
+template<typename Allocate, typename Free>
+double allocateAndFree(js::ThreadPool& pool, std::vector<PoolObject*>& objects, std::atomic<size_t>& errors,
+                       Allocate allocate, Free free) {
+    return seconds([&] {
+        pool.parallel_for(0, objects.size(), 64, [&](size_t i) {
+            objects[i] = allocate();
+            objects[i]->value = i;
+        });
+        pool.parallel_for(0, objects.size(), 64, [&](size_t i) {
+            size_t index = objects.size() - 1 - i;
+            if (objects[index]->value != index) errors.fetch_add(1, std::memory_order_relaxed);
+            free(objects[index]);
+        });
+    });
+}
+
+// A positive decimal count, with nothing after it.
+bool parseCount(const char* text, size_t& value) {
+    char* end;
+    unsigned long parsed = std::strtoul(text, &end, 10);
+    if (*text < '0' || *text > '9' || *end || parsed == 0) return false;
+    value = parsed;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t tasks = 1 << 18;
+    size_t maxThreads = 64;
+    for (int i = 1; i < argc; i++) {
+        bool valid = false;
+        if (std::strncmp(argv[i], "--tasks=", 8) == 0) {
+            valid = parseCount(argv[i] + 8, tasks);
+        } else if (std::strncmp(argv[i], "--max-threads=", 14) == 0) {
+            valid = parseCount(argv[i] + 14, maxThreads);
+        }
+        if (!valid) {
+            std::fprintf(stderr, "Usage: %s [--tasks=<n>] [--max-threads=<n>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<uint64_t> out(tasks);
+    std::vector<PoolObject*> objects(tasks);
+    std::printf("%zu tasks per run, %u hardware threads; millions of tasks (parallel_for: iterations, "
+                "pools: objects allocated and freed) per second\n",
+                tasks, std::thread::hardware_concurrency());
+    std::printf("%8s %14s %14s %14s %14s %14s\n", "threads", "spawn", "parallel_for", "locked queue", "MemoryPool",
+                "new/delete");
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        // Outlives the thread pool, so exiting workers hand their caches back.
+        js::MemoryPool<PoolObject> objectPool;
+        std::atomic<size_t> errors{0};
+        double spawn, loop, locked, pooled, heap;
+        {
+            js::ThreadPool pool(threads);
+            spawn = spawnTasks(pool, out);
+            loop = parallelFor(pool, out);
+            locked = lockedQueue(threads, out);
+            pooled = allocateAndFree(pool, objects, errors, [&] { return objectPool.allocate(); },
+                                     [&](PoolObject* object) { objectPool.deallocate(object); });
+            heap = allocateAndFree(pool, objects, errors, [] { return new PoolObject; },
+                                   [](PoolObject* object) { delete object; });
+        }
+        std::printf("%8zu %14.2f %14.2f %14.2f %14.2f %14.2f\n", threads, tasks / spawn / 1e6, tasks / loop / 1e6,
+                    tasks / locked / 1e6, tasks / pooled / 1e6, tasks / heap / 1e6);
+        js::MemoryPoolStats stats = objectPool.stats();
+        if (errors.load() != 0 || stats.inUse != 0 || stats.highWater < tasks) {
+            std::fprintf(stderr, "MemoryPool check failed at %zu threads: %zu bad objects, %zu in use, high water %zu\n",
+                         threads, errors.load(), stats.inUse, stats.highWater);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+
+namespace js {
+
+// Compilation-scoped bump allocator.
+//
+// Memory is carved out of ChunkSize-aligned chunks, so the arena that owns any
+// pointer it handed out can be recovered by masking the address. Small blocks
+// are rounded up to 16-byte size classes and recycled through per-class free
+// lists when they are deallocated; everything else is reclaimed in bulk by
+// reset() or the destructor without touching individual objects.
+//
+// An arena is current on at most one thread at a time, and only that thread
+// allocates from it; debug builds check this. An arena that is current
+// nowhere, like an AtomTable's, may serve one thread at a time as a plain
+// allocator. Blocks may be deallocated from
+// any thread: frees from a thread the arena is not current on go to a
+// lock-free remote list, which the allocating thread drains into its free
+// lists when they run dry.
+class Arena : public std::pmr::memory_resource {
+public:
+    static constexpr size_t ChunkSize = 64 * 1024;
+    static constexpr size_t Granularity = 16;
+    static constexpr size_t NumSizeClasses = 16;
+    static constexpr size_t MaxSmallSize = Granularity * NumSizeClasses;
+
+    Arena() noexcept;
+    ~Arena() override;
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Frees every chunk at once. Objects living in the arena are not destroyed.
+    void reset() noexcept;
+
+    // Hands ownership of a heap object to the arena without running its
+    // destructor. Its memory is reclaimed together with the arena.
+    template<typename T, typename D>
+    void adopt(std::unique_ptr<T, D> ptr) noexcept {
+        ptr.release();
+    }
+
+    // Takes over every chunk of other, which is left empty. Blocks other had
+    // handed out stay valid and now belong to this arena, and containers
+    // that allocate from other allocate from this arena from then on, so
+    // other must live as long as they do. Neither arena may be in use on
+    // another thread.
+    void absorb(Arena& other) noexcept;
+
+    size_t bytesAllocated() const noexcept { return bytesAllocated_; }
+    size_t bytesReserved() const noexcept { return bytesReserved_; }
+    size_t bytesRecycled() const noexcept { return bytesRecycled_; }
+
+    // The arena the calling thread currently allocates AST nodes from.
+    static Arena* current() noexcept;
+    // The arena that owns a pointer previously returned by allocate().
+    static Arena* owner(const void* ptr) noexcept;
+
+private:
+    friend class ArenaScope;
+
+    struct ChunkHeader {
+        Arena* owner;
+        ChunkHeader* next;
+    };
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static constexpr size_t HeaderSize =
+        (sizeof(ChunkHeader) + Granularity - 1) & ~(Granularity - 1);
+
+    char* cursor_;
+    char* limit_;
+    Arena* absorbedBy_;
+    ChunkHeader* chunks_;
+    FreeBlock* freeLists_[NumSizeClasses];
+    std::atomic<FreeBlock*> remoteFrees_[NumSizeClasses];
+    // Live ArenaScopes making this arena current.
+    std::atomic<uint32_t> scopes_;
+    size_t bytesAllocated_;
+    size_t bytesReserved_;
+    size_t bytesRecycled_;
+
+    static thread_local Arena* current_;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    ChunkHeader* newChunk(size_t payload);
+    FreeBlock* drainRemoteFrees(size_t sizeClass, size_t bytes) noexcept;
+    void* allocateLarge(size_t bytes, size_t alignment);
+};
+
+// Makes an arena the current allocation target for the calling thread for the
+// lifetime of the scope.
+class ArenaScope {
+public:
+    explicit ArenaScope(Arena& arena) noexcept : previous_(Arena::current_) {
+        Arena::current_ = &arena;
+        arena.scopes_.fetch_add(1, std::memory_order_relaxed);
+    }
+    ~ArenaScope() {
+        Arena::current_->scopes_.fetch_sub(1, std::memory_order_relaxed);
+        Arena::current_ = previous_;
+    }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    Arena* previous_;
+};
+
+} // namespace js
@@ -1,13 +1,18 @@
 #pragma once
+#include "arena.hpp"
+#include "atoms.hpp"
+#include "value.hpp"
 #include <memory>
+#include <cstdint>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <variant>
 #include <iostream>
 
 namespace js {
 
-enum class NodeType {
+enum class NodeType : uint8_t {
     PROGRAM,
     VARIABLE_DECLARATION,
     FUNCTION_DECLARATION,
@@ -17,25 +22,56 @@ enum class NodeType {
     IDENTIFIER,
     LITERAL,
     UNARY_EXPRESSION,
-    MEMBER_EXPRESSION
+    MEMBER_EXPRESSION,
+    BLOCK_STATEMENT,
+    IF_STATEMENT,
+    WHILE_STATEMENT,
+    ASSIGNMENT_EXPRESSION
 };
 
+enum class BinaryOp : uint8_t {
+    ADD, SUB, MUL, DIV, POW,
+    LT, GT, LE, GE, EQ, NE,
+    AND, OR, BIT_AND, BIT_OR,
+    COUNT
+};
+
+enum class UnaryOp : uint8_t {
+    NOT, NEG, PLUS,
+    COUNT
+};
+
+inline constexpr const char* binaryOpNames[] = {
+    "+", "-", "*", "/", "**", "<", ">", "<=", ">=", "==", "!=", "&&", "||", "&", "|"
+};
+
+inline constexpr const char* unaryOpNames[] = {"!", "-", "+"};
+
+inline const char* opName(BinaryOp op) { return binaryOpNames[static_cast<size_t>(op)]; }
+inline const char* opName(UnaryOp op) { return unaryOpNames[static_cast<size_t>(op)]; }
+
 class ASTNode {
 public:
     NodeType type;
     explicit ASTNode(NodeType t) : type(t) {}
     virtual ~ASTNode() = default;
-    virtual void print(int indent = 0) const {
+    virtual void print(int indent = 0, std::ostream& out = std::cout) const {
         std::string indentation(indent * 2, ' ');
-        std::cout << indentation << "ASTNode" << std::endl;
+        out << indentation << "ASTNode" << std::endl;
     }
     
+    // Nodes live in the calling thread's current Arena; see ArenaScope.
     void* operator new(size_t size);
-    void operator delete(void* ptr) noexcept;
+    void operator delete(void* ptr, size_t size) noexcept;
 };
 
 using NodePtr = std::unique_ptr<ASTNode>;
 
+// Child lists are allocated from the same arena as the node itself, so a whole
+// tree can be dropped with Arena::adopt/reset. Names and string literals are
+// atoms of the current AtomTable.
+using NodeList = std::pmr::vector<NodePtr>;
+
 class Expression : public ASTNode {
 public:
     explicit Expression(NodeType t) : ASTNode(t) {}
@@ -43,82 +79,105 @@ public:
 
 class Literal : public Expression {
 public:
-    std::variant<double, std::string, bool> value;
+    static constexpr NodeType Kind = NodeType::LITERAL;
+    Value value;
     Literal() : Expression(NodeType::LITERAL) {}
-    void print(int indent = 0) const override {
+    explicit Literal(Value v) : Expression(NodeType::LITERAL), value(v) {}
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
         std::string indentation(indent * 2, ' ');
-        std::cout << indentation << "Literal: ";
-        if (std::holds_alternative<double>(value)) {
-            std::cout << std::get<double>(value);
-        } else if (std::holds_alternative<std::string>(value)) {
-            std::cout << std::get<std::string>(value);
-        } else if (std::holds_alternative<bool>(value)) {
-            std::cout << std::get<bool>(value);
+        out << indentation << "Literal: ";
+        if (value.isNumber()) {
+            out << value.asNumber();
+        } else if (value.isString()) {
+            out << AtomTable::current().text(value.asAtom());
+        } else if (value.isBoolean()) {
+            out << value.asBool();
+        } else {
+            out << toString(value);
         }
-        std::cout << std::endl;
+        out << std::endl;
     }
 };
 
 class Identifier : public Expression {
 public:
-    std::string name;
+    static constexpr NodeType Kind = NodeType::IDENTIFIER;
+    Atom name;
     Identifier() : Expression(NodeType::IDENTIFIER) {}
-    void print(int indent = 0) const override {
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
         std::string indentation(indent * 2, ' ');
-        std::cout << indentation << "Identifier: " << name << std::endl;
+        out << indentation << "Identifier: " << AtomTable::current().text(name) << std::endl;
     }
 };
 
 class UnaryExpression : public Expression {
 public:
-    std::string op;
+    static constexpr NodeType Kind = NodeType::UNARY_EXPRESSION;
+    UnaryOp op = UnaryOp::NOT;
     NodePtr argument;
     UnaryExpression() : Expression(NodeType::UNARY_EXPRESSION) {}
-    void print(int indent = 0) const override {
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
         std::string indentation(indent * 2, ' ');
-        std::cout << indentation << "UnaryExpression: " << op << std::endl;
-        if (argument) argument->print(indent + 1);
+        out << indentation << "UnaryExpression: " << opName(op) << std::endl;
+        if (argument) argument->print(indent + 1, out);
     }
 };
 
 class BinaryExpression : public Expression {
 public:
+    static constexpr NodeType Kind = NodeType::BINARY_EXPRESSION;
     NodePtr left;
     NodePtr right;
-    std::string op;
+    BinaryOp op = BinaryOp::ADD;
     BinaryExpression() : Expression(NodeType::BINARY_EXPRESSION) {}
-    void print(int indent = 0) const override {
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
         std::string indentation(indent * 2, ' ');
-        std::cout << indentation << "BinaryExpression: " << op << std::endl;
-        if (left) left->print(indent + 1);
-        if (right) right->print(indent + 1);
+        out << indentation << "BinaryExpression: " << opName(op) << std::endl;
+        if (left) left->print(indent + 1, out);
+        if (right) right->print(indent + 1, out);
     }
 };
 
 class CallExpression : public Expression {
 public:
+    static constexpr NodeType Kind = NodeType::CALL_EXPRESSION;
     NodePtr callee;
-    std::vector<NodePtr> arguments;
+    NodeList arguments{Arena::current()};
     CallExpression() : Expression(NodeType::CALL_EXPRESSION) {}
-    void print(int indent = 0) const override {
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
         std::string indentation(indent * 2, ' ');
-        std::cout << indentation << "CallExpression" << std::endl;
-        if (callee) callee->print(indent + 1);
+        out << indentation << "CallExpression" << std::endl;
+        if (callee) callee->print(indent + 1, out);
         for (const auto& arg : arguments) {
-            arg->print(indent + 1);
+            arg->print(indent + 1, out);
         }
     }
 };
 
 class MemberExpression : public Expression {
 public:
+    static constexpr NodeType Kind = NodeType::MEMBER_EXPRESSION;
     NodePtr object;
-    std::string property;
+    Atom property;
     MemberExpression() : Expression(NodeType::MEMBER_EXPRESSION) {}
-    void print(int indent = 0) const override {
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
         std::string indentation(indent * 2, ' ');
-        std::cout << indentation << "MemberExpression: " << property << std::endl;
-        if (object) object->print(indent + 1);
+        out << indentation << "MemberExpression: " << AtomTable::current().text(property) << std::endl;
+        if (object) object->print(indent + 1, out);
+    }
+};
+
+// `name = value`. Compound assignments and ++/-- are parsed into this form.
+class AssignmentExpression : public Expression {
+public:
+    static constexpr NodeType Kind = NodeType::ASSIGNMENT_EXPRESSION;
+    Atom name;
+    NodePtr value;
+    AssignmentExpression() : Expression(NodeType::ASSIGNMENT_EXPRESSION) {}
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
+        std::string indentation(indent * 2, ' ');
+        out << indentation << "AssignmentExpression: " << AtomTable::current().text(name) << std::endl;
+        if (value) value->print(indent + 1, out);
     }
 };
 
@@ -127,14 +186,62 @@ public:
     explicit Statement(NodeType t) : ASTNode(t) {}
 };
 
+// Declarations inside a block are only visible until its end.
+class BlockStatement : public Statement {
+public:
+    static constexpr NodeType Kind = NodeType::BLOCK_STATEMENT;
+    NodeList body{Arena::current()};
+    BlockStatement() : Statement(NodeType::BLOCK_STATEMENT) {}
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
+        std::string indentation(indent * 2, ' ');
+        out << indentation << "BlockStatement" << std::endl;
+        for (const auto& stmt : body) {
+            stmt->print(indent + 1, out);
+        }
+    }
+};
+
+class IfStatement : public Statement {
+public:
+    static constexpr NodeType Kind = NodeType::IF_STATEMENT;
+    NodePtr test;
+    NodePtr consequent;
+    NodePtr alternate; // null without an else branch
+    IfStatement() : Statement(NodeType::IF_STATEMENT) {}
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
+        std::string indentation(indent * 2, ' ');
+        out << indentation << "IfStatement" << std::endl;
+        if (test) test->print(indent + 1, out);
+        if (consequent) consequent->print(indent + 1, out);
+        if (alternate) alternate->print(indent + 1, out);
+    }
+};
+
+// `for` loops are parsed into a block holding the initializer and a while
+// loop whose body ends with the update.
+class WhileStatement : public Statement {
+public:
+    static constexpr NodeType Kind = NodeType::WHILE_STATEMENT;
+    NodePtr test;
+    NodePtr body;
+    WhileStatement() : Statement(NodeType::WHILE_STATEMENT) {}
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
+        std::string indentation(indent * 2, ' ');
+        out << indentation << "WhileStatement" << std::endl;
+        if (test) test->print(indent + 1, out);
+        if (body) body->print(indent + 1, out);
+    }
+};
+
 class ReturnStatement : public Statement {
 public:
+    static constexpr NodeType Kind = NodeType::RETURN_STATEMENT;
     NodePtr argument;
     ReturnStatement() : Statement(NodeType::RETURN_STATEMENT) {}
-    void print(int indent = 0) const override {
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
         std::string indentation(indent * 2, ' ');
-        std::cout << indentation << "ReturnStatement" << std::endl;
-        if (argument) argument->print(indent + 1);
+        out << indentation << "ReturnStatement" << std::endl;
+        if (argument) argument->print(indent + 1, out);
     }
 };
 
@@ -145,30 +252,46 @@ public:
 
 class VariableDeclaration : public Declaration {
 public:
-    std::string name;
+    static constexpr NodeType Kind = NodeType::VARIABLE_DECLARATION;
+    Atom name;
     NodePtr init;
     VariableDeclaration() : Declaration(NodeType::VARIABLE_DECLARATION) {}
-    void print(int indent = 0) const override {
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
         std::string indentation(indent * 2, ' ');
-        std::cout << indentation << "VariableDeclaration: " << name << std::endl;
-        if (init) init->print(indent + 1);
+        out << indentation << "VariableDeclaration: " << AtomTable::current().text(name) << std::endl;
+        if (init) init->print(indent + 1, out);
+    }
+};
+
+class Program : public ASTNode {
+public:
+    static constexpr NodeType Kind = NodeType::PROGRAM;
+    NodeList body{Arena::current()};
+    Program() : ASTNode(NodeType::PROGRAM) {}
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
+        std::string indentation(indent * 2, ' ');
+        out << indentation << "Program" << std::endl;
+        for (const auto& stmt : body) {
+            stmt->print(indent + 1, out);
+        }
     }
 };
 
 class FunctionDeclaration : public Declaration {
 public:
-    std::string name;
-    std::vector<std::string> params;
-    std::vector<NodePtr> body;
+    static constexpr NodeType Kind = NodeType::FUNCTION_DECLARATION;
+    Atom name;
+    std::pmr::vector<Atom> params{Arena::current()};
+    NodeList body{Arena::current()};
     FunctionDeclaration() : Declaration(NodeType::FUNCTION_DECLARATION) {}
-    void print(int indent = 0) const override {
+    void print(int indent = 0, std::ostream& out = std::cout) const override {
         std::string indentation(indent * 2, ' ');
-        std::cout << indentation << "FunctionDeclaration: " << name << std::endl;
+        out << indentation << "FunctionDeclaration: " << AtomTable::current().text(name) << std::endl;
         for (const auto& param : params) {
-            std::cout << indentation << "  " << param << std::endl;
+            out << indentation << "  " << AtomTable::current().text(param) << std::endl;
         }
         for (const auto& stmt : body) {
-            stmt->print(indent + 1);
+            stmt->print(indent + 1, out);
         }
     }
 };
@@ -0,0 +1,145 @@
+#pragma once
+#include "arena.hpp"
+#include "keywords.hpp"
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+namespace js {
+
+// Interned name or string literal. Equal atoms from the same table always
+// denote equal text, so comparing names is an integer compare.
+struct Atom {
+    uint32_t id = 0;
+
+    constexpr bool operator==(Atom other) const { return id == other.id; }
+    constexpr bool operator!=(Atom other) const { return id != other.id; }
+};
+
+// Atoms every table interns up front, in this order: the empty string, every
+// keyword at the id of its Keyword value, then names the optimizer knows.
+namespace atoms {
+inline constexpr Atom empty{0};
+inline constexpr Atom console{static_cast<uint32_t>(Keyword::COUNT)};
+inline constexpr Atom log{static_cast<uint32_t>(Keyword::COUNT) + 1};
+inline constexpr Atom undefined{static_cast<uint32_t>(Keyword::COUNT) + 2};
+inline constexpr uint32_t PredefinedCount = static_cast<uint32_t>(Keyword::COUNT) + 3;
+
+constexpr Atom fromKeyword(Keyword keyword) {
+    return Atom{static_cast<uint32_t>(keyword)};
+}
+} // namespace atoms
+
+class AtomTable {
+public:
+    AtomTable();
+
+    AtomTable(const AtomTable&) = delete;
+    AtomTable& operator=(const AtomTable&) = delete;
+
+    Atom intern(std::string_view text);
+    std::string_view text(Atom atom) const {
+        if (concurrent_) {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            return entryText(atom);
+        }
+        return entryText(atom);
+    }
+
+    size_t size() const noexcept { return entries_.size(); }
+    size_t bytesUsed() const noexcept;
+
+    // The table the calling thread interns into; see AtomScope.
+    static AtomTable& current() noexcept;
+
+private:
+    friend class AtomScope;
+    friend class ConcurrentAtomScope;
+
+    struct Entry {
+        const char* data;
+        uint32_t length;
+        uint32_t hash;
+    };
+
+    std::vector<Entry> entries_;
+    // Open-addressed with linear probing; each slot holds id + 1, 0 is empty.
+    std::vector<uint32_t> slots_;
+    Arena storage_;
+    // Only set while a ConcurrentAtomScope is alive.
+    bool concurrent_ = false;
+    mutable std::shared_mutex mutex_;
+
+    static thread_local AtomTable* current_;
+
+    std::string_view entryText(Atom atom) const {
+        const Entry& entry = entries_[atom.id];
+        return std::string_view(entry.data, entry.length);
+    }
+    uint32_t find(std::string_view text, uint32_t hash) const;
+    Atom insert(std::string_view text, uint32_t hash);
+    void grow();
+};
+
+class AtomScope {
+public:
+    explicit AtomScope(AtomTable& table) noexcept : previous_(AtomTable::current_) {
+        AtomTable::current_ = &table;
+    }
+    ~AtomScope() { AtomTable::current_ = previous_; }
+
+    AtomScope(const AtomScope&) = delete;
+    AtomScope& operator=(const AtomScope&) = delete;
+
+private:
+    AtomTable* previous_;
+};
+
+// Lets several threads intern into and read from one table for the lifetime
+// of the scope, at the cost of a lock per access. Ids are handed out in
+// interning order, so the ids of atoms created under it depend on thread
+// scheduling; their text does not.
+class ConcurrentAtomScope {
+public:
+    explicit ConcurrentAtomScope(AtomTable& table) noexcept : table_(table), previous_(table.concurrent_) {
+        table.concurrent_ = true;
+    }
+    ~ConcurrentAtomScope() { table_.concurrent_ = previous_; }
+
+    ConcurrentAtomScope(const ConcurrentAtomScope&) = delete;
+    ConcurrentAtomScope& operator=(const ConcurrentAtomScope&) = delete;
+
+private:
+    AtomTable& table_;
+    bool previous_;
+};
+
+// A set of atoms as a bitmap by id. Clearing only touches the members, so a
+// set kept around does not allocate again.
+class NameSet {
+public:
+    bool contains(Atom name) const { return name.id < bits_.size() && bits_[name.id]; }
+    bool empty() const { return members_.empty(); }
+    // In insertion order.
+    const std::vector<Atom>& members() const { return members_; }
+    void insert(Atom name);
+    void clear();
+
+private:
+    std::vector<bool> bits_;
+    std::vector<Atom> members_;
+};
+
+} // namespace js
+
+namespace std {
+template<>
+struct hash<js::Atom> {
+    size_t operator()(js::Atom atom) const noexcept {
+        return atom.id;
+    }
+};
+} // namespace std
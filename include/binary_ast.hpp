@@ -0,0 +1,138 @@
+#pragma once
+#include "flat_ast.hpp"
+#include "source_buffer.hpp"
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+namespace js {
+
+// Binary AST file, designed to be mapped and read where it lies. All fields
+// are little-endian and every section starts 8-byte aligned:
+//
+//   Header
+//   Node[nodeCount]          pre-order, node 0 is the root
+//   Function[functionCount]
+//   String[stringCount]      slices of the string bytes
+//   double[numberCount]
+//   char[stringBytes]
+//
+// A node's firstChild and nextSibling are forward distances in nodes from
+// the node itself, 0 meaning none; pre-order makes both always positive.
+// Payloads are as in FlatAST, except that names and string literals index
+// the string table instead of an AtomTable, and FUNCTION_DECLARATION
+// indexes the function table whose name is again a string index.
+namespace binary_ast {
+
+inline constexpr char Magic[4] = {'J', 'S', 'A', 'B'};
+inline constexpr uint16_t Version = 1;
+inline constexpr uint16_t ByteOrderMark = 0x0102;
+
+struct Header {
+    char magic[4];
+    uint16_t version;
+    uint16_t byteOrder;
+    uint32_t nodeCount;
+    uint32_t functionCount;
+    uint32_t stringCount;
+    uint32_t numberCount;
+    uint32_t stringBytes;
+    uint32_t reserved;
+};
+
+struct Node {
+    NodeType kind;
+    uint8_t op;
+    uint16_t reserved;
+    uint32_t payload;
+    uint32_t firstChild;
+    uint32_t nextSibling;
+};
+
+struct Function {
+    uint32_t name;
+    uint32_t paramCount;
+};
+
+struct String {
+    uint32_t offset;
+    uint32_t length;
+};
+
+static_assert(sizeof(Header) == 32 && sizeof(Node) == 16 && sizeof(Function) == 8 && sizeof(String) == 8,
+              "binary AST records have a fixed layout");
+
+} // namespace binary_ast
+
+// Serializes a flat AST; names are looked up in the current AtomTable.
+void writeBinaryAST(const FlatAST& ast, std::ostream& out);
+
+// Read-only view over a binary AST in memory. The constructor checks the
+// header and that every offset and index stays inside the buffer, then all
+// access reads the buffer in place. Throws std::runtime_error for malformed
+// input. The buffer must be 8-byte aligned and outlive the view.
+class BinaryASTView {
+public:
+    using LiteralKind = FlatAST::LiteralKind;
+
+    BinaryASTView(const void* data, size_t size);
+
+    static bool matches(const void* data, size_t size) noexcept;
+
+    size_t size() const noexcept { return header_->nodeCount; }
+    bool empty() const noexcept { return header_->nodeCount == 0; }
+
+    NodeType kind(NodeIndex node) const { return nodes_[node].kind; }
+    BinaryOp binaryOp(NodeIndex node) const { return static_cast<BinaryOp>(nodes_[node].op); }
+    UnaryOp unaryOp(NodeIndex node) const { return static_cast<UnaryOp>(nodes_[node].op); }
+    LiteralKind literalKind(NodeIndex node) const { return static_cast<LiteralKind>(nodes_[node].op); }
+
+    // Name of an IDENTIFIER, VARIABLE_DECLARATION or MEMBER_EXPRESSION (the
+    // property), or the text of a string literal.
+    std::string_view text(NodeIndex node) const { return string(nodes_[node].payload); }
+    double number(NodeIndex node) const { return numbers_[nodes_[node].payload]; }
+    bool boolean(NodeIndex node) const { return nodes_[node].payload != 0; }
+    std::string_view functionName(NodeIndex node) const {
+        return string(functions_[nodes_[node].payload].name);
+    }
+    uint32_t paramCount(NodeIndex node) const { return functions_[nodes_[node].payload].paramCount; }
+
+    NodeIndex firstChild(NodeIndex node) const { return relative(node, nodes_[node].firstChild); }
+    NodeIndex nextSibling(NodeIndex node) const { return relative(node, nodes_[node].nextSibling); }
+    // The n-th child, or NoNode.
+    NodeIndex child(NodeIndex node, size_t n = 0) const;
+
+    // Same output as FlatAST::print.
+    void print(NodeIndex node = 0, int indent = 0, std::ostream& out = std::cout) const;
+
+private:
+    const binary_ast::Header* header_;
+    const binary_ast::Node* nodes_;
+    const binary_ast::Function* functions_;
+    const binary_ast::String* strings_;
+    const double* numbers_;
+    const char* stringBytes_;
+
+    static NodeIndex relative(NodeIndex node, uint32_t offset) {
+        return offset ? node + offset : NoNode;
+    }
+    std::string_view string(uint32_t index) const {
+        return std::string_view(stringBytes_ + strings_[index].offset, strings_[index].length);
+    }
+    void validate() const;
+};
+
+// A binary AST file mapped into memory.
+class BinaryASTFile {
+public:
+    explicit BinaryASTFile(const std::string& path) : buffer_(path), view_(buffer_.data(), buffer_.size()) {}
+
+    const BinaryASTView& view() const noexcept { return view_; }
+
+private:
+    SourceBuffer buffer_;
+    BinaryASTView view_;
+};
+
+} // namespace js
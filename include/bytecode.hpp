@@ -0,0 +1,70 @@
+#pragma once
+#include "ast.hpp"
+#include "value.hpp"
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace js {
+
+// Register-machine instruction set. Operands a, b, c are register numbers
+// unless noted; target() combines b and c into a 32-bit jump target.
+#define JS_OPCODES(X)                                                      \
+    X(LOAD_CONST)      /* R[a] = K[b]                               */ \
+    X(LOAD_UNDEFINED)  /* R[a] = undefined                          */ \
+    X(LOAD_FUNCTION)   /* R[a] = function #b                        */ \
+    X(MOVE)            /* R[a] = R[b]                               */ \
+    X(GET_GLOBAL)      /* R[a] = G[b]                               */ \
+    X(SET_GLOBAL)      /* G[b] = R[a]                               */ \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(POW)                                     \
+    X(LT) X(GT) X(LE) X(GE) X(EQ) X(NE)                                    \
+    X(BIT_AND) X(BIT_OR)  /* R[a] = R[b] op R[c]                    */ \
+    X(NOT) X(NEG) X(PLUS) /* R[a] = op R[b]                         */ \
+    X(JUMP)            /* goto target                               */ \
+    X(JUMP_IF_FALSE)   /* if !R[a] goto target                      */ \
+    X(JUMP_IF_TRUE)    /* if R[a] goto target                       */ \
+    X(CALL)            /* R[a] = R[b](R[b+1] .. R[b+c])             */ \
+    X(PRINT)           /* console.log(R[a] .. R[a+b-1])             */ \
+    X(THROW_REFERENCE) /* ReferenceError for atom (b << 16 | c)     */ \
+    X(RETURN)          /* return R[a]                               */
+
+enum class Opcode : uint8_t {
+#define JS_OPCODE_ENUM(name) name,
+    JS_OPCODES(JS_OPCODE_ENUM)
+#undef JS_OPCODE_ENUM
+    COUNT
+};
+
+const char* opcodeName(Opcode op);
+
+struct Instruction {
+    Opcode op;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+
+    uint32_t target() const { return static_cast<uint32_t>(b) << 16 | c; }
+};
+
+struct BytecodeFunction {
+    Atom name;
+    uint16_t paramCount = 0;
+    uint16_t registerCount = 0;
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+};
+
+// Function 0 is the top-level code. Top-level declarations live in global
+// slots so that function bodies can reach them.
+struct BytecodeModule {
+    std::vector<BytecodeFunction> functions;
+    std::vector<Atom> globals;
+
+    void disassemble(std::ostream& out) const;
+};
+
+// Lowers a Program (or any single statement) to bytecode. Throws
+// std::runtime_error for constructs the backend does not support.
+BytecodeModule compileToBytecode(const ASTNode* program);
+
+} // namespace js
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace js {
+
+// On-disk cache of per-file compilation output. An entry is keyed by the
+// hash of the file's contents combined with the configuration: the compiler
+// build and every option that changes the output. A manifest remembers the
+// content hash of each path together with its size and modification time,
+// so unchanged files are not even read on the next run.
+//
+// Every method may be called from several threads. Failing to read or write
+// the cache only turns hits into misses.
+class CompileCache {
+public:
+    struct Key {
+        uint64_t hash;
+        uint64_t size;
+    };
+
+    CompileCache(std::filesystem::path directory, std::string_view configuration);
+
+    CompileCache(const CompileCache&) = delete;
+    CompileCache& operator=(const CompileCache&) = delete;
+
+    // Throws std::runtime_error if the file cannot be read.
+    Key keyFor(const std::string& path);
+    std::optional<std::string> load(Key key) const;
+    void store(Key key, std::string_view output);
+
+    // Writes the manifest back for the next run.
+    void save();
+
+private:
+    struct FileState {
+        uint64_t size;
+        int64_t modified;
+        uint64_t hash;
+    };
+
+    std::filesystem::path directory_;
+    uint64_t configuration_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, FileState> manifest_;
+    bool dirty_ = false;
+
+    std::filesystem::path entryPath(Key key) const;
+    std::filesystem::path manifestPath() const { return directory_ / "manifest"; }
+    void loadManifest();
+};
+
+// Identifies the running compiler build: its version and a hash of its own
+// executable where the platform exposes it.
+std::string compilerBuildId();
+
+} // namespace js
@@ -0,0 +1,73 @@
+#pragma once
+#include "ast.hpp"
+#include "value.hpp"
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace js {
+
+// Per atom id, the top-level function a call of that name reaches, or null.
+using FunctionTargets = std::vector<const FunctionDeclaration*>;
+
+// Sets pure[f] for each of the function declarations: whether it reads and
+// assigns only its parameters and locals, and calls only pure functions.
+// `callable` maps an atom id to the index of the function a call of that
+// name reaches, or UINT32_MAX. Such a call depends on its arguments alone
+// and has no effects, although it may still throw or never end.
+void findPureFunctions(const std::vector<NodePtr*>& functions, const std::vector<uint32_t>& callable,
+                       std::vector<bool>& pure);
+
+// Runs calls of pure functions with literal arguments at compile time, on
+// the AST. Results are memoized per function and argument values: the
+// calls one evaluation makes share a memo, so a recursion like fib costs
+// linear fuel, and the outcomes of the calls being folded are kept in a
+// memo shared by every thread optimizing the program. An evaluation never
+// reads another's nested results, so whether a call fits in the limits does
+// not depend on which thread got to it first. Each thread keeps its
+// evaluation state between calls, so evaluating again allocates nothing.
+class CallEvaluator {
+public:
+    // Nodes one call may evaluate, nested calls included, and how deeply
+    // calls may nest. A call that needs more is left for run time.
+    static constexpr size_t Fuel = 10000;
+    static constexpr size_t MaxDepth = 64;
+    // Longer strings are not built at compile time.
+    static constexpr size_t MaxStringLength = 1024;
+
+    // `targets` holds the functions whose calls may be evaluated; it may
+    // change between calls of call(), but not during one.
+    explicit CallEvaluator(const FunctionTargets& targets) : targets_(targets) {}
+
+    // The value `function` returns for `arguments`, or nothing if the call
+    // throws, reaches something impure or runs out of fuel.
+    std::optional<Value> call(const FunctionDeclaration& function, const std::vector<Value>& arguments);
+
+    const FunctionTargets& targets() const { return targets_; }
+
+private:
+    friend class Evaluation;
+
+    struct CallKey {
+        const FunctionDeclaration* function;
+        std::pmr::vector<Value> arguments;
+        bool operator==(const CallKey& other) const {
+            return function == other.function && arguments == other.arguments;
+        }
+    };
+    struct CallKeyHash {
+        size_t operator()(const CallKey& key) const;
+    };
+    using Memo = std::pmr::unordered_map<CallKey, std::optional<Value>, CallKeyHash>;
+
+    const FunctionTargets& targets_;
+    std::mutex mutex_;
+    // Only used under the mutex, so any thread may allocate from it.
+    Arena storage_;
+    Memo memo_{&storage_};
+};
+
+} // namespace js
@@ -0,0 +1,106 @@
+#pragma once
+#include "ast.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace js {
+
+using NodeIndex = uint32_t;
+inline constexpr NodeIndex NoNode = UINT32_MAX;
+
+// Struct-of-arrays AST. Node i is described by kinds[i], ops[i], payloads[i],
+// firstChild[i] and nextSibling[i]; nodes are stored in pre-order, so every
+// child has a larger index than its parent and a reverse scan over the arrays
+// visits children before parents.
+//
+// Children per kind:
+//   PROGRAM               statements
+//   VARIABLE_DECLARATION  [init]
+//   FUNCTION_DECLARATION  one IDENTIFIER per parameter, then the body
+//   RETURN_STATEMENT      [argument]
+//   BINARY_EXPRESSION     left, right
+//   UNARY_EXPRESSION      argument
+//   CALL_EXPRESSION       callee, arguments
+//   MEMBER_EXPRESSION     object
+//   BLOCK_STATEMENT       statements
+//   IF_STATEMENT          test, consequent, [alternate]
+//   WHILE_STATEMENT       test, body
+//   ASSIGNMENT_EXPRESSION value
+//
+// ops holds the BinaryOp/UnaryOp of operator nodes and the LiteralKind of
+// literals. Payloads: the atom id for IDENTIFIER, VARIABLE_DECLARATION,
+// ASSIGNMENT_EXPRESSION (the target) and MEMBER_EXPRESSION (the property);
+// for LITERAL an index into numbers, the
+// string's atom id, 0/1 for booleans or 0 for null and undefined; an index
+// into functions for FUNCTION_DECLARATION.
+class FlatAST {
+public:
+    enum class LiteralKind : uint8_t { NUMBER, STRING, BOOLEAN, NULL_VALUE, UNDEFINED };
+
+    struct Function {
+        Atom name;
+        uint32_t paramCount;
+    };
+
+    std::vector<NodeType> kinds;
+    std::vector<uint8_t> ops;
+    std::vector<uint32_t> payloads;
+    std::vector<NodeIndex> firstChild;
+    std::vector<NodeIndex> nextSibling;
+    std::vector<double> numbers;
+    std::vector<Function> functions;
+
+    static FlatAST fromTree(const ASTNode* root);
+    NodePtr toTree(NodeIndex index = 0) const;
+
+    size_t size() const noexcept { return kinds.size(); }
+    bool empty() const noexcept { return kinds.empty(); }
+    size_t bytesUsed() const noexcept;
+
+    NodeType kind(NodeIndex node) const { return kinds[node]; }
+    BinaryOp binaryOp(NodeIndex node) const { return static_cast<BinaryOp>(ops[node]); }
+    UnaryOp unaryOp(NodeIndex node) const { return static_cast<UnaryOp>(ops[node]); }
+    Atom atom(NodeIndex node) const { return Atom{payloads[node]}; }
+    LiteralKind literalKind(NodeIndex node) const { return static_cast<LiteralKind>(ops[node]); }
+    Value literal(NodeIndex node) const;
+    const Function& function(NodeIndex node) const { return functions[payloads[node]]; }
+
+    // The n-th child, or NoNode.
+    NodeIndex child(NodeIndex node, size_t n = 0) const;
+    size_t childCount(NodeIndex node) const;
+
+    class ChildIterator {
+    public:
+        ChildIterator(const FlatAST* ast, NodeIndex node) : ast_(ast), node_(node) {}
+        NodeIndex operator*() const { return node_; }
+        ChildIterator& operator++() {
+            node_ = ast_->nextSibling[node_];
+            return *this;
+        }
+        bool operator!=(const ChildIterator& other) const { return node_ != other.node_; }
+
+    private:
+        const FlatAST* ast_;
+        NodeIndex node_;
+    };
+
+    struct ChildRange {
+        ChildIterator first;
+        ChildIterator last;
+        ChildIterator begin() const { return first; }
+        ChildIterator end() const { return last; }
+    };
+
+    ChildRange children(NodeIndex node) const {
+        return {ChildIterator(this, firstChild[node]), ChildIterator(this, NoNode)};
+    }
+
+    void print(NodeIndex node = 0, int indent = 0, std::ostream& out = std::cout) const;
+
+private:
+    NodeIndex append(NodeType kind, uint8_t op, uint32_t payload);
+    NodeIndex appendTree(const ASTNode* node);
+    void link(NodeIndex parent, NodeIndex& last, NodeIndex child);
+};
+
+} // namespace js
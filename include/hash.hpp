@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace js {
+
+namespace detail {
+
+// 64x64->128 multiply folded back to 64 bits.
+inline uint64_t foldedMultiply(uint64_t a, uint64_t b) {
+#ifdef _MSC_VER
+    uint64_t high;
+    uint64_t low = _umul128(a, b, &high);
+    return low ^ high;
+#else
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#endif
+}
+
+inline uint64_t load64(const unsigned char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+} // namespace detail
+
+// Fast non-cryptographic 64-bit hash, consuming eight bytes per step.
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0) {
+    constexpr uint64_t K0 = 0xa0761d6478bd642full;
+    constexpr uint64_t K1 = 0xe7037ed1a0b428dbull;
+    auto* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed ^ K0 ^ (size * K1);
+
+    while (size >= 16) {
+        h = detail::foldedMultiply(detail::load64(p) ^ K1, detail::load64(p + 8) ^ h);
+        p += 16;
+        size -= 16;
+    }
+    if (size >= 8) {
+        h = detail::foldedMultiply(detail::load64(p) ^ K1, h ^ K0);
+        p += 8;
+        size -= 8;
+    }
+    uint64_t tail = 0;
+    // An empty range may come with a null pointer, which memcpy may not get.
+    if (size) std::memcpy(&tail, p, size);
+    return detail::foldedMultiply(tail ^ K1, h ^ K0);
+}
+
+inline uint64_t hashString(std::string_view text, uint64_t seed = 0) {
+    return hashBytes(text.data(), text.size(), seed);
+}
+
+} // namespace js
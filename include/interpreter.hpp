@@ -0,0 +1,46 @@
+#pragma once
+#include "bytecode.hpp"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace js {
+
+class Jit;
+struct JitEntry;
+
+// Executes a BytecodeModule. Calls push frames onto an explicit stack rather
+// than recursing, and every frame's registers live in one fixed-size block.
+class Interpreter {
+public:
+    static constexpr size_t StackSize = 1 << 20;
+    static constexpr size_t MaxFrames = 1 << 16;
+
+    explicit Interpreter(const BytecodeModule& module, std::ostream& out = std::cout);
+
+    // Runs the top-level code and returns its completion value. Throws
+    // std::runtime_error for JavaScript errors raised at run time.
+    Value run();
+
+    // Hands calls to hot functions to the JIT once it has compiled them.
+    void setJit(Jit* jit);
+
+private:
+    struct Frame {
+        const BytecodeFunction* function;
+        const Instruction* returnPc;
+        Value* registers;
+        uint16_t resultRegister;
+    };
+
+    const BytecodeModule& module_;
+    std::ostream& out_;
+    std::unique_ptr<Value[]> stack_;
+    std::vector<Value> globals_;
+    std::vector<Frame> frames_;
+    Jit* jit_;
+    std::vector<uint32_t> callCounts_;
+    std::vector<const JitEntry*> native_;
+};
+
+} // namespace js
@@ -0,0 +1,69 @@
+#pragma once
+#include "numeric_analysis.hpp"
+#include "value.hpp"
+#include <csetjmp>
+#include <cstdint>
+#include <vector>
+
+namespace js {
+
+struct JitEntry {
+    const void* code;
+    uint16_t paramCount;
+    TypeSet returns;
+};
+
+// In-process x86-64 JIT for the interpreter. Functions that NumericAnalysis
+// can lower and that touch neither globals nor strings are encoded directly
+// into machine code, which lives in pages that are never writable and
+// executable at the same time. Everything else stays interpreted.
+//
+// Bytecode function i + 1 is the program's i-th top-level function
+// declaration, as laid out by compileToBytecode.
+class Jit {
+public:
+    // Calls to a function before it is compiled.
+    static constexpr uint32_t HotCallCount = 100;
+    // Native stack a single interpreter-to-native call may use.
+    static constexpr size_t StackBudget = 1 << 20;
+
+    // True on SysV x86-64 hosts that can map executable memory.
+    static bool supported();
+
+    explicit Jit(const Program& program);
+    ~Jit();
+
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    // Native code for bytecode function #function. The first request compiles
+    // every eligible function at once. Null when the function must stay
+    // interpreted.
+    const JitEntry* entry(uint32_t function);
+
+    // Calls native code with number arguments. Returns false and leaves
+    // result untouched if the native stack budget runs out; the caller should
+    // then interpret the call.
+    bool invoke(const JitEntry& entry, const Value* args, Value& result);
+
+    size_t compiledFunctions() const noexcept { return compiledFunctions_; }
+    size_t codeBytes() const noexcept { return codeBytes_; }
+
+private:
+    const Program& program_;
+    bool compiled_;
+    std::vector<JitEntry> entries_; // code is null for interpreted functions
+    void* memory_;
+    size_t memorySize_;
+    size_t compiledFunctions_;
+    size_t codeBytes_;
+
+    // Read by every native prologue; see StackBudget.
+    uintptr_t stackLimit_;
+    std::jmp_buf overflow_;
+
+    void compile();
+    static void onStackOverflow(Jit* jit);
+};
+
+} // namespace js
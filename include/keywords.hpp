@@ -0,0 +1,91 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace js {
+
+// The JavaScript reserved words, including the strict-mode and future
+// reserved words and the literal keywords.
+enum class Keyword : uint8_t {
+    NONE,
+    AWAIT, BREAK, CASE, CATCH, CLASS, CONST, CONTINUE, DEBUGGER, DEFAULT,
+    DELETE, DO, ELSE, ENUM, EXPORT, EXTENDS, FALSE_LITERAL, FINALLY, FOR,
+    FUNCTION, IF, IMPLEMENTS, IMPORT, IN, INSTANCEOF, INTERFACE, LET, NEW,
+    NULL_LITERAL, PACKAGE, PRIVATE, PROTECTED, PUBLIC, RETURN, STATIC, SUPER,
+    SWITCH, THIS, THROW, TRUE_LITERAL, TRY, TYPEOF, VAR, VOID, WHILE, WITH,
+    YIELD,
+    COUNT
+};
+
+inline constexpr std::array<std::string_view, static_cast<size_t>(Keyword::COUNT)> keywordNames = {
+    "",
+    "await", "break", "case", "catch", "class", "const", "continue", "debugger", "default",
+    "delete", "do", "else", "enum", "export", "extends", "false", "finally", "for",
+    "function", "if", "implements", "import", "in", "instanceof", "interface", "let", "new",
+    "null", "package", "private", "protected", "public", "return", "static", "super",
+    "switch", "this", "throw", "true", "try", "typeof", "var", "void", "while", "with",
+    "yield"
+};
+
+namespace detail {
+
+constexpr size_t KeywordMinLength = 2;
+constexpr size_t KeywordMaxLength = 10;
+constexpr unsigned KeywordHashBits = 8;
+
+// Every keyword is at least two characters long, so the length plus the
+// first, second and last characters always exist.
+constexpr uint32_t keywordKey(std::string_view word) {
+    return static_cast<uint32_t>(word.size()) |
+           static_cast<uint32_t>(static_cast<unsigned char>(word[0])) << 8 |
+           static_cast<uint32_t>(static_cast<unsigned char>(word[1])) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(word[word.size() - 1])) << 24;
+}
+
+constexpr uint32_t keywordSlot(uint32_t key, uint32_t seed) {
+    return (key * seed) >> (32 - KeywordHashBits);
+}
+
+struct KeywordTable {
+    uint32_t seed = 0;
+    std::array<Keyword, 1u << KeywordHashBits> slots{};
+};
+
+// Searches for a multiplier that maps every keyword to its own slot.
+constexpr KeywordTable makeKeywordTable() {
+    for (uint32_t seed = 0x9E3779B1u;; seed += 2) {
+        KeywordTable table;
+        table.seed = seed;
+        bool collision = false;
+        for (size_t i = 1; i < keywordNames.size() && !collision; i++) {
+            auto& slot = table.slots[keywordSlot(keywordKey(keywordNames[i]), seed)];
+            collision = slot != Keyword::NONE;
+            slot = static_cast<Keyword>(i);
+        }
+        if (!collision) {
+            return table;
+        }
+    }
+}
+
+inline constexpr KeywordTable keywordTable = makeKeywordTable();
+
+} // namespace detail
+
+// Classifies an identifier with one multiply, one table load and at most one
+// string compare.
+constexpr Keyword lookupKeyword(std::string_view word) {
+    if (word.size() < detail::KeywordMinLength || word.size() > detail::KeywordMaxLength) {
+        return Keyword::NONE;
+    }
+    uint32_t slot = detail::keywordSlot(detail::keywordKey(word), detail::keywordTable.seed);
+    Keyword keyword = detail::keywordTable.slots[slot];
+    return keywordNames[static_cast<size_t>(keyword)] == word ? keyword : Keyword::NONE;
+}
+
+static_assert(lookupKeyword("instanceof") == Keyword::INSTANCEOF, "keyword hash is not perfect");
+static_assert(lookupKeyword("let") == Keyword::LET, "keyword hash is not perfect");
+static_assert(lookupKeyword("lets") == Keyword::NONE, "keyword hash accepts non-keywords");
+
+} // namespace js
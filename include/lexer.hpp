@@ -1,11 +1,14 @@
 #pragma once
+#include "atoms.hpp"
+#include "keywords.hpp"
+#include "scan.hpp"
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
 
 namespace js {
 
-enum class TokenType {
+enum class TokenType : uint8_t {
     NUMBER,
     STRING,
     IDENTIFIER,
@@ -18,27 +21,37 @@ enum class TokenType {
     EOF_TOKEN
 };
 
+// Token text points into the source buffer; only string literals containing
+// escapes are copied, into the current Arena. Identifiers, keywords and string
+// literals also carry their atom in the current AtomTable.
 struct Token {
     TokenType type;
-    std::string value;
-    Token(TokenType t, std::string v) : type(t), value(v) {}
+    Keyword keyword;
+    Atom atom;
+    std::string_view value;
+    Token(TokenType t, std::string_view v, Keyword k = Keyword::NONE, Atom a = Atom())
+        : type(t), keyword(k), atom(a), value(v) {}
 };
 
 class Lexer {
 private:
-    std::string input;
+    std::string_view input;
     size_t position;
     char current_char;
-    std::unordered_map<std::string, TokenType> keywords;
+    const ScanKernels& kernels;
+    AtomTable& atoms;
 
     void advance();
+    void seek(const char* p);
     void skip_whitespace();
-    std::string get_number();
-    std::string get_identifier();
-    std::string get_string();
+    std::string_view get_number();
+    std::string_view get_identifier();
+    std::string_view get_string();
+    std::string_view unescape(size_t start, size_t end);
+    size_t count_tokens() const;
 
 public:
-    Lexer(const std::string& source);
+    explicit Lexer(std::string_view source);
     std::vector<Token> tokenize();
 };
 
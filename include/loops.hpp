@@ -0,0 +1,28 @@
+#pragma once
+#include "ast.hpp"
+#include <cstddef>
+
+namespace js {
+
+// What optimizeLoops() changed.
+struct LoopRewrites {
+    size_t hoisted = 0;  // expressions replaced by a variable set before the loop
+    size_t reduced = 0;  // products replaced by a variable stepped by addition
+    size_t unrolled = 0; // loops replaced by copies of their body
+
+    bool any() const { return hoisted + reduced + unrolled > 0; }
+};
+
+// Rewrites the while loops of one unit, innermost first. A loop counting a
+// variable from a literal with a known, small trip count becomes that many
+// copies of its body. Otherwise, expressions that cannot change while the
+// loop runs are computed once in front of it, and products of a counter and
+// a positive integer become a variable that steps along with the counter.
+// New variables are block-scoped lets named %tN. `params` is null for the
+// top level. `globals` holds the names declared at the top level, which
+// can be read without throwing, and `clobbered` those a call of a user
+// function may assign; null means any.
+LoopRewrites optimizeLoops(NodeList& body, const std::pmr::vector<Atom>* params, const NameSet* globals,
+                           const NameSet* clobbered);
+
+} // namespace js
@@ -1,11 +1,136 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
-#include <vector>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 namespace js {
 
+struct MemoryPoolStats {
+    size_t slotSize;
+    size_t blocks;
+    size_t bytesReserved;
+    // Slots handed out and not freed yet.
+    size_t inUse;
+    // Most slots ever held outside the shared depot at once. Slots move in
+    // batches, so this is an upper bound on the peak of inUse.
+    size_t highWater;
+    size_t depotSlots;
+    // Frees from threads whose cache was already torn down.
+    size_t remoteFrees;
+    bool hugePages;
+};
+
+// Thread-safe allocator for fixed-size slots.
+//
+// Every thread has its own cache per pool: a free list and a run of slots
+// that have never been handed out. Slots are carved from blocks lazily, so a
+// block's pages are first touched when its slots are used. A cache whose free
+// list grows past two batches returns one batch to the shared depot, and an
+// empty cache refills from the depot before carving fresh slots, so memory
+// freed on one thread is reused by the others. Only these batch moves take
+// the pool's lock.
+//
+// A slot may be freed on any thread. Frees that arrive while the freeing
+// thread is exiting go to a lock-free list that allocating threads drain.
+// When a thread exits, its caches go back to their pools for reuse.
+class FixedSizePool {
+public:
+    static constexpr size_t BatchSize = 64;
+
+    // With hugePages, blocks are mapped with huge pages where the platform
+    // offers them, and with ordinary pages otherwise.
+    FixedSizePool(size_t slotSize, size_t slotAlignment, size_t slotsPerBlock, bool hugePages = false);
+    ~FixedSizePool();
+
+    FixedSizePool(const FixedSizePool&) = delete;
+    FixedSizePool& operator=(const FixedSizePool&) = delete;
+
+    void* allocate();
+    void deallocate(void* ptr) noexcept;
+
+    // Exact when no other thread is allocating or freeing.
+    MemoryPoolStats stats() const;
+
+private:
+    friend struct PoolThreadCaches;
+
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    struct Batch {
+        FreeSlot* head;
+        size_t count;
+    };
+
+    struct Run {
+        char* cursor;
+        char* limit;
+    };
+
+    // Written only by the thread that owns it; counters are atomics so that
+    // stats() may read them from anywhere.
+    struct alignas(64) Cache {
+        FreeSlot* free = nullptr;
+        size_t freeCount = 0;
+        Run run{nullptr, nullptr};
+        std::atomic<size_t> allocations{0};
+        std::atomic<size_t> frees{0};
+        bool orphaned = false; // guarded by mutex_
+    };
+
+    struct Block {
+        void* memory;
+        size_t bytes;
+        bool mapped;
+    };
+
+    size_t slotSize_;
+    size_t slotAlignment_;
+    size_t blockBytes_;
+    bool hugePages_;
+    uint64_t id_;
+
+    mutable std::mutex mutex_;
+    std::vector<Batch> depot_;
+    size_t depotSlots_ = 0;
+    std::vector<Run> spareRuns_;
+    std::vector<Block> blocks_;
+    Run block_{nullptr, nullptr};
+    bool hugePagesUsed_ = false;
+    std::vector<std::unique_ptr<Cache>> caches_;
+
+    std::atomic<FreeSlot*> remoteFrees_{nullptr};
+    std::atomic<size_t> remoteFreeCount_{0};
+    std::atomic<size_t> directAllocations_{0};
+    std::atomic<size_t> outstanding_{0};
+    std::atomic<size_t> highWater_{0};
+
+    Cache* cache();
+    Cache* adoptCache();
+    void releaseCache(Cache* cache) noexcept;
+    void* refill(Cache& cache);
+    void returnBatch(Cache& cache);
+    void* allocateDirect();
+    Run carve(size_t slots);
+    void newBlock();
+    FreeSlot* takeRemoteFrees(size_t& count) noexcept;
+    void pushRemote(void* ptr) noexcept;
+    void addOutstanding(size_t slots) noexcept;
+    void subOutstanding(size_t slots) noexcept {
+        outstanding_.fetch_sub(slots, std::memory_order_relaxed);
+    }
+};
+
+// Typed front end of FixedSizePool for one kind of hot object. Allocates a
+// single object at a time.
 template<typename T, size_t BlockSize = 4096>
 class MemoryPool {
 public:
@@ -14,45 +139,20 @@ public:
     using const_pointer = const T*;
     using size_type = std::size_t;
 
-    MemoryPool() noexcept : currentBlock_(nullptr), currentSlot_(nullptr), lastSlot_(nullptr), freeSlots_(nullptr) {}
-
-    ~MemoryPool() noexcept {
-        for (auto block : blocks_) {
-            if (block) {
-                ::operator delete(block);
-            }
-        }
-    }
+    explicit MemoryPool(bool hugePages = false)
+        : pool_(SlotSize, SlotAlignment, BlockSize, hugePages) {}
 
     pointer allocate(size_type n = 1) {
-        if (n > 1) {
-            return static_cast<pointer>(::operator new(n * sizeof(value_type)));
-        }
-
-        if (freeSlots_) {
-            pointer result = reinterpret_cast<pointer>(freeSlots_);
-            freeSlots_ = freeSlots_->next;
-            return result;
+        if (n != 1) {
+            throw std::runtime_error("MemoryPool allocates one object at a time");
         }
-
-        if (currentSlot_ >= lastSlot_) {
-            allocateBlock();
-        }
-
-        return reinterpret_cast<pointer>(currentSlot_++);
+        return static_cast<pointer>(pool_.allocate());
     }
 
-    void deallocate(pointer p, size_type n = 1) noexcept {
-        if (!p) return;
-        
-        if (n > 1) {
-            ::operator delete(p);
-            return;
+    void deallocate(pointer p, size_type = 1) noexcept {
+        if (p) {
+            pool_.deallocate(p);
         }
-
-        auto slot = reinterpret_cast<slot_pointer_>(p);
-        slot->next = freeSlots_;
-        freeSlots_ = slot;
     }
 
     template<typename U, typename... Args>
@@ -67,37 +167,14 @@ public:
         }
     }
 
+    MemoryPoolStats stats() const { return pool_.stats(); }
+
 private:
-    struct Slot_ {
-        union {
-            value_type element;
-            Slot_* next;
-        };
-        
-        Slot_() noexcept : next(nullptr) {}
-        ~Slot_() noexcept {}
-    };
+    static constexpr size_t SlotAlignment = std::max(alignof(T), alignof(void*));
+    static constexpr size_t SlotSize =
+        (std::max(sizeof(T), sizeof(void*)) + SlotAlignment - 1) / SlotAlignment * SlotAlignment;
 
-    using slot_pointer_ = Slot_*;
-
-    slot_pointer_ currentBlock_;
-    slot_pointer_ currentSlot_;
-    slot_pointer_ lastSlot_;
-    slot_pointer_ freeSlots_;
-    std::vector<slot_pointer_> blocks_;
-
-    void allocateBlock() {
-        auto newBlock = reinterpret_cast<slot_pointer_>(
-            ::operator new(BlockSize * sizeof(Slot_)));
-        blocks_.push_back(newBlock);
-        currentBlock_ = newBlock;
-        currentSlot_ = newBlock;
-        lastSlot_ = newBlock + BlockSize;
-        
-        for (size_t i = 0; i < BlockSize; ++i) {
-            new (&newBlock[i]) Slot_();
-        }
-    }
+    FixedSizePool pool_;
 };
 
-} 
+} // namespace js
@@ -0,0 +1,87 @@
+#pragma once
+#include "ast.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace js {
+
+// Static value types for native code, as a bit set. Native code keeps every
+// value in one double: numbers as themselves, booleans as 1.0/0.0, undefined
+// as NaN and strings as a pointer to their text. The type only matters where
+// those encodings would print differently.
+enum : uint8_t {
+    TYPE_NUMBER = 1 << 0,
+    TYPE_TRUE = 1 << 1,
+    TYPE_FALSE = 1 << 2,
+    TYPE_UNDEFINED = 1 << 3,
+    TYPE_STRING = 1 << 4,
+    TYPE_BOOLEAN = TYPE_TRUE | TYPE_FALSE
+};
+
+using TypeSet = uint8_t;
+
+struct NumericFunction {
+    const FunctionDeclaration* decl = nullptr;
+    std::vector<Atom> locals; // parameters first, then let bindings
+    std::vector<uint32_t> callees; // indices of the functions it calls
+    TypeSet returns = 0;
+    bool lowerable = true;
+    bool leaf = true; // makes no calls, including to pow
+    bool usesGlobals = false;
+    bool usesStrings = false;
+    std::string reason; // why the function cannot be lowered
+};
+
+// Decides which parts of a program can run as straight-line double
+// arithmetic: functions whose parameters are numbers and whose bodies consist
+// of let bindings, returns and numeric expressions, plus top-level code
+// calling them. Parameters are assumed to be numbers, so callers must only
+// pass numbers.
+class NumericAnalysis {
+public:
+    static constexpr size_t MaxParameters = 8;
+    // Expression temporaries are allocated by depth; no expression needs more
+    // registers than this.
+    static constexpr int MaxTemporaries = 8;
+
+    explicit NumericAnalysis(const Program& program);
+
+    const std::vector<NumericFunction>& functions() const { return functions_; }
+    // Index of the top-level function with that name, or -1.
+    int functionIndex(Atom name) const;
+
+    const std::vector<Atom>& globals() const { return globals_; }
+    int globalIndex(Atom name) const;
+
+    bool topLevelLowerable() const { return topLevelReason_.empty(); }
+    const std::string& topLevelReason() const { return topLevelReason_; }
+
+    // Type of a console.log argument at the top level.
+    TypeSet argumentType(const ASTNode* argument) const;
+
+private:
+    friend class NumericTyper;
+
+    const Program& program_;
+    std::vector<NumericFunction> functions_;
+    std::unordered_map<Atom, int> functionIndex_;
+    std::vector<Atom> globals_;
+    std::vector<TypeSet> globalTypes_;
+    std::unordered_map<Atom, int> globalIndex_;
+    std::unordered_map<const ASTNode*, TypeSet> argumentTypes_;
+    std::string topLevelReason_;
+
+    bool analyzeFunction(NumericFunction& function);
+    bool analyzeTopLevel();
+};
+
+// Returns true when values of the type all print the same way; native code
+// can then print them without knowing more.
+inline bool isPrintable(TypeSet type) {
+    return type == TYPE_NUMBER || type == TYPE_UNDEFINED || type == TYPE_STRING ||
+           (type != 0 && (type & ~TYPE_BOOLEAN) == 0);
+}
+
+} // namespace js
@@ -0,0 +1,13 @@
+#pragma once
+#include "ast.hpp"
+#include "value.hpp"
+
+namespace js {
+
+// JavaScript semantics of the operators on values, shared by constant folding
+// and the interpreter's slow paths so that both agree on every corner case.
+// && and || yield one of their operands without converting it.
+Value evaluateBinary(BinaryOp op, Value left, Value right);
+Value evaluateUnary(UnaryOp op, Value argument);
+
+} // namespace js
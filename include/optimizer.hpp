@@ -1,27 +1,151 @@
 #pragma once
 #include "ast.hpp"
+#include "evaluator.hpp"
+#include "ssa.hpp"
+#include "visitor.hpp"
+#include <array>
 #include <memory>
-#include <unordered_map>
+#include <vector>
 
 namespace js {
 
-class Optimizer {
+class ThreadPool;
+
+// The kinds of rewrite the optimizer makes, counted separately.
+enum class Pass : uint8_t {
+    FOLD,      // operators applied to literals
+    SIMPLIFY,  // algebraic identities, && and || with a literal left side
+    INLINE,    // calls of small functions replaced by their body, arguments substituted
+    EVALUATE,  // calls of pure functions with literal arguments, run at compile time
+    PROPAGATE, // constants and available values found on the SSA form
+    PRUNE,     // declarations of literals that nothing reads
+    HOIST,     // loop-invariant expressions moved in front of the loop
+    REDUCE,    // induction variable products turned into additions
+    UNROLL,    // loops with a small known trip count
+    COUNT
+};
+
+inline constexpr const char* passNames[] = {"fold",  "simplify", "inline", "evaluate", "propagate",
+                                            "prune", "hoist",    "reduce", "unroll"};
+
+inline const char* passName(Pass pass) { return passNames[static_cast<size_t>(pass)]; }
+
+using PassCounts = std::array<size_t, static_cast<size_t>(Pass::COUNT)>;
+
+// Rewrites the AST in place. Expression rewrites run bottom-up, and each
+// slot is retried until no rewrite applies; folds and evaluated calls reuse
+// a literal operand as the result, so only inlining allocates and an
+// unchanged node allocates nothing. Top-level functions are optimized
+// callees first, so a call is inlined from an already optimized body.
+// Nothing on this path throws.
+class Optimizer : public ASTRewriter<Optimizer> {
 private:
-    std::unordered_map<std::string, NodePtr> functionMap;
+    // Per atom id, the top-level function a call of that name may be
+    // replaced with, or null. Only changes between levels of the call graph,
+    // so every worker can share it. Null outside optimizeProgram().
+    using InlineTargets = FunctionTargets;
+    const InlineTargets* inlineTargets = nullptr;
+    // Runs calls of pure functions whose bodies are already optimized;
+    // shared by every worker. Null outside optimizeProgram().
+    CallEvaluator* evaluator = nullptr;
+    // Names declared at the top level; reading one never throws.
+    const NameSet* globalNames = nullptr;
+    // Names assigned anywhere, and those a function body assigns, which a
+    // call may change.
+    const NameSet* assignedNames = nullptr;
+    const NameSet* clobberedNames = nullptr;
+    // Top-level constants every function body may assume; null until the
+    // top level has been through constant propagation.
+    const ConstantBindings* globalConstants = nullptr;
+    // Names the function being rewritten declares; they hide top-level ones.
+    std::vector<Atom> localNames;
+    ThreadPool* pool = nullptr;
+    PassCounts counts{};
+    // Scratch for prune() and optimizeProgram().
+    NameSet readNames;
+    NameSet knownNames;
+    NameSet declaredNames;
+    NameSet programAssigned;
+    NameSet programClobbered;
+    std::vector<uint32_t> callableFunctions;
+    std::vector<bool> pureFunctions;
+    FunctionTargets evaluableFunctions;
+
+    // A parameter or `let` local of a function being inlined, in
+    // declaration order. `value` is the argument or initializer, if any.
+    struct InlineBinding {
+        Atom name;
+        const ASTNode* value;
+        uint32_t argument; // index into the call's arguments, for parameters
+        uint32_t size;     // nodes of a parameter's value
+        uint32_t uses;
+        bool pure;         // a parameter whose value can be dropped or repeated
+        bool local;
+    };
+    std::vector<InlineBinding> inlineBindings;
+    // Functions whose bodies are being inlined, innermost last; a call of
+    // one of them is left alone so that inlining always ends.
+    std::vector<const FunctionDeclaration*> inlineStack;
+    // Nodes the inlines nested in the outermost one may still add.
+    size_t inlineBudget = 0;
+
+    void optimizeFunctions(const std::vector<NodePtr*>& functions);
+    void rewriteTopLevel(Program& program);
+    // Drops declarations of a literal whose name is never read in `scope`.
+    void prune(NodeList& body, const ASTNode& scope);
+    void simplify(NodePtr& slot);
+    bool isLocal(Atom name) const;
+    // Evaluating it can neither throw nor call anything.
+    bool hasNoEffects(const ASTNode* node) const;
+    // Reads a top-level variable that something assigns.
+    bool readsAssignedGlobal(const ASTNode* node) const;
+    // Runs the loop passes on a unit; returns whether they changed it.
+    bool optimizeLoops(NodeList& body, const std::pmr::vector<Atom>* params);
+    size_t resolveBinding(Atom name, size_t visible) const;
+    bool scanInline(const ASTNode* node, size_t visible, size_t origin, bool conditional, size_t& size,
+                    size_t& lastOrigin, size_t& events);
+    NodePtr substitute(const ASTNode* node, size_t visible, NodeList& arguments);
+    void count(Pass pass) { counts[static_cast<size_t>(pass)]++; }
 
 public:
+    // Fewer top-level functions than this are optimized on the calling thread.
+    static constexpr size_t MinParallelFunctions = 8;
+    // Inlining budget, in AST nodes. Larger bodies are never inlined, and
+    // inlining may grow a call by MaxInlineGrowth nodes, plus
+    // LiteralArgumentBonus for each literal argument since those fold.
+    // Calls inside an inlined body are retried with the arguments
+    // substituted, and may add MaxInlineBody nodes at most between them.
+    static constexpr size_t MaxInlineBody = 32;
+    static constexpr size_t MaxInlineGrowth = 8;
+    static constexpr size_t LiteralArgumentBonus = 4;
+
     Optimizer() = default;
-    
+    // Optimizes independent function bodies concurrently on the pool.
+    explicit Optimizer(ThreadPool* pool) : pool(pool) {}
+
+    NodePtr optimizeProgram(NodePtr node);
     NodePtr optimizeExpression(NodePtr node);
     NodePtr optimizeStatement(NodePtr node);
     NodePtr optimizeDeclaration(NodePtr node);
-    
-    void constantFolding(NodePtr& node);
-    void deadCodeElimination(NodePtr& node);
-    void inlineSimpleFunctions(NodePtr& node);
-    void optimizeUnary(NodePtr& node);
-    bool isTruthy(const Literal* lit);
-    std::string toString(const Literal* lit);
+
+    // Rewrites made so far, by pass.
+    const PassCounts& passCounts() const { return counts; }
+
+    // ASTRewriter hooks.
+    void rewriteUnaryExpression(NodePtr& slot, UnaryExpression& node);
+    void rewriteBinaryExpression(NodePtr& slot, BinaryExpression& node);
+    void rewriteCallExpression(NodePtr& slot, CallExpression& node);
+    void rewriteFunctionDeclaration(NodePtr& slot, FunctionDeclaration& node);
+    void rewriteBlockStatement(NodePtr& slot, BlockStatement& node);
+    void rewriteIfStatement(NodePtr& slot, IfStatement& node);
+    void rewriteWhileStatement(NodePtr& slot, WhileStatement& node);
+
+    // Each returns whether it rewrote the slot.
+    bool constantFolding(NodePtr& node);
+    bool deadCodeElimination(NodePtr& node);
+    bool inlineFunctionCall(NodePtr& node);
+    bool evaluateCall(NodePtr& node);
+    bool optimizeUnary(NodePtr& node);
 };
 
-} 
+}
@@ -6,25 +6,52 @@
 
 namespace js {
 
+// Single-pass precedence-climbing parser. Tokens are only ever inspected in
+// place; the token vector always ends with EOF_TOKEN, which peek() never
+// moves past.
 class Parser {
 private:
     std::vector<Token> tokens;
     size_t current;
+    size_t nodeCount;
+    // Postfix ++ and -- parsed since the last check.
+    std::vector<const ASTNode*> postfixUpdates;
     
-    Token peek();
-    Token advance();
+    const Token& peek() const;
+    const Token& advance();
     bool match(TokenType type);
+    bool matchOperator(std::string_view op);
+    void expect(TokenType type, const char* message);
+    void expectOperator(std::string_view op, const char* message);
+    void skipSemicolon();
+    
+    template<typename T>
+    std::unique_ptr<T> make() {
+        nodeCount++;
+        return std::make_unique<T>();
+    }
+    
     NodePtr parse_statement();
-    NodePtr parse_expression();
+    NodePtr parse_expression(int minPrecedence = 0);
+    NodePtr parse_unary();
+    NodePtr parse_postfix(NodePtr expr);
     NodePtr parse_primary();
     NodePtr parse_variable_declaration();
     NodePtr parse_function_declaration();
+    NodePtr parse_substatement();
+    NodePtr parse_block();
+    NodePtr parse_if_statement();
+    NodePtr parse_while_statement();
+    NodePtr parse_for_statement();
+    NodePtr parseUpdate(NodePtr target, bool increment);
+    void checkPostfixUpdates(const ASTNode* statement);
     NodePtr parseCallExpression(NodePtr callee);
     NodePtr parseMemberExpression(NodePtr object);
     
 public:
     explicit Parser(std::vector<Token> tokens);
     NodePtr parse();
+    size_t nodes_created() const { return nodeCount; }
 };
 
 } 
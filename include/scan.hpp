@@ -0,0 +1,54 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+namespace js {
+
+// Character classes used by the lexer. A byte may belong to several classes.
+enum CharClass : uint8_t {
+    CHAR_SPACE = 1 << 0,
+    CHAR_IDENT_START = 1 << 1,
+    CHAR_IDENT = 1 << 2,
+    CHAR_DIGIT = 1 << 3,
+    CHAR_OPERATOR = 1 << 4,
+    CHAR_QUOTE = 1 << 5
+};
+
+constexpr std::array<uint8_t, 256> makeCharClassTable() {
+    std::array<uint8_t, 256> table{};
+    for (int c = 0; c < 256; c++) {
+        uint8_t bits = 0;
+        if (c == ' ' || (c >= '\t' && c <= '\r')) bits |= CHAR_SPACE;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') bits |= CHAR_IDENT_START | CHAR_IDENT;
+        if (c >= '0' && c <= '9') bits |= CHAR_DIGIT | CHAR_IDENT;
+        if (c == '"' || c == '\'') bits |= CHAR_QUOTE;
+        table[c] = bits;
+    }
+    for (const char* op = "+-*/()=;{}[],<>!&|"; *op; op++) {
+        table[static_cast<unsigned char>(*op)] |= CHAR_OPERATOR;
+    }
+    return table;
+}
+
+inline constexpr std::array<uint8_t, 256> charClassTable = makeCharClassTable();
+
+inline uint8_t charClass(char c) {
+    return charClassTable[static_cast<unsigned char>(c)];
+}
+
+// Run scanners used by the lexer. Each returns the first position in
+// [begin, end) that does not continue the run, or end.
+struct ScanKernels {
+    const char* name;
+    const char* (*whitespace)(const char* begin, const char* end);
+    const char* (*identifier)(const char* begin, const char* end);
+    const char* (*digits)(const char* begin, const char* end);
+    // Stops at the closing quote or at a backslash.
+    const char* (*stringBody)(const char* begin, const char* end, char quote);
+};
+
+// The fastest kernels supported by the running CPU, picked on first use.
+// Setting JS_SCAN_KERNELS=scalar|sse2|avx2 forces a particular set.
+const ScanKernels& scanKernels();
+
+} // namespace js
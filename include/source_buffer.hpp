@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace js {
+
+// Read-only view of a source file mapped into memory. Tokens and other
+// string_views produced from the buffer stay valid for its lifetime.
+class SourceBuffer {
+public:
+    explicit SourceBuffer(const std::string& path);
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    std::string_view view() const noexcept { return std::string_view(data_, size_); }
+    const char* data() const noexcept { return data_; }
+    size_t size() const noexcept { return size_; }
+
+private:
+    const char* data_;
+    size_t size_;
+};
+
+} // namespace js
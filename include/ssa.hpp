@@ -0,0 +1,205 @@
+#pragma once
+#include "ast.hpp"
+#include <cstdint>
+#include <initializer_list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace js {
+
+// Top-level names whose value is known wherever a function body can read them.
+using ConstantBindings = std::unordered_map<Atom, Value>;
+
+namespace ssa {
+
+using ValueId = uint32_t;
+using BlockId = uint32_t;
+inline constexpr ValueId NoValue = UINT32_MAX;
+inline constexpr BlockId NoBlock = UINT32_MAX;
+
+enum class Op : uint8_t {
+    CONST,  // constant
+    PARAM,  // index-th parameter
+    GLOBAL, // read of a name the unit does not bind (yet); subop VolatileGlobal
+            // if a call can assign it between two reads
+    OPAQUE, // anything the IR does not model, such as member reads
+    UNARY,  // subop is the UnaryOp
+    BINARY, // subop is the BinaryOp; never && or ||, which become branches
+    CALL,   // operands: callee, then the arguments
+    // One operand per predecessor, in predecessor order. A phi joining the
+    // two sides of a && or || has that operator as its subop and is a pure
+    // function of its operands: [left, right]. One joining the arms of an if
+    // or the entry and back edge of a loop has subop ControlPhi.
+    PHI
+};
+
+inline constexpr uint8_t VolatileGlobal = 1;
+inline constexpr uint8_t ControlPhi = static_cast<uint8_t>(BinaryOp::COUNT);
+
+// Operands and users are ranges of arrays owned by the Function.
+struct Instr {
+    Op op;
+    uint8_t subop = 0;
+    BlockId block = NoBlock;
+    Atom name{};
+    Value constant{};
+    uint32_t index = 0;
+    uint32_t firstOperand = 0;
+    uint32_t operandCount = 0;
+    uint32_t firstUser = 0;
+    uint32_t userCount = 0;
+};
+
+enum class Exit : uint8_t { NONE, JUMP, BRANCH, RETURN };
+
+// The values of a block are [first, end). A branch goes to succs[0] when its
+// condition is truthy and to succs[1] otherwise. A return's value is in
+// `value`.
+struct Block {
+    ValueId first = 0;
+    ValueId end = 0;
+    BlockId preds[2] = {NoBlock, NoBlock};
+    BlockId succs[2] = {NoBlock, NoBlock};
+    uint8_t predCount = 0;
+    uint8_t succCount = 0;
+    Exit exit = Exit::NONE;
+    ValueId value = NoValue;
+};
+
+// One unit in SSA form: the top-level statements or a function body. Block
+// 0 is the entry. Every name binding is a new value; where control flow
+// from an if, a loop, && or || joins, a phi picks the value that arrived.
+//
+// Values are only added to the newest block, so a block's values are
+// consecutive. clear() keeps the memory, so a Function reused for unit
+// after unit stops allocating once it has seen the largest one.
+class Function {
+public:
+    std::vector<Instr> values;
+    std::vector<Block> blocks;
+    // Filled by finish().
+    std::vector<BlockId> order;       // reverse postorder of the reachable blocks
+    std::vector<BlockId> idom;        // immediate dominators; the entry's is itself
+    std::vector<uint32_t> childStart; // the dominator tree children of b are
+    std::vector<BlockId> children;    // children[childStart[b], childStart[b + 1])
+
+    void clear();
+    // The new block receives the values added from now on.
+    BlockId addBlock();
+    ValueId add(Instr instr, const ValueId* operands, size_t count);
+    ValueId add(Instr instr, std::initializer_list<ValueId> operands = {}) {
+        return add(instr, operands.begin(), operands.size());
+    }
+    void addEdge(BlockId from, BlockId to);
+    // For a loop phi, whose back edge value is only known after the body.
+    void setOperand(ValueId id, uint32_t k, ValueId operand) {
+        operandList_[values[id].firstOperand + k] = operand;
+    }
+    // Builds the def-use chains, the block order and the dominator tree once
+    // every value is in.
+    void finish();
+
+    const ValueId* operands(const Instr& instr) const { return operandList_.data() + instr.firstOperand; }
+    const ValueId* users(const Instr& instr) const { return userList_.data() + instr.firstUser; }
+
+private:
+    std::vector<ValueId> operandList_;
+    std::vector<ValueId> userList_;
+    std::vector<uint32_t> position_;
+    std::vector<std::pair<BlockId, uint8_t>> stack_;
+
+    void computeOrder();
+    void computeDominators();
+};
+
+// Sparse conditional constant propagation (Wegman and Zadeck): values start
+// unknown and only ever move down to constant, then varying, and only edges
+// found executable contribute to phis.
+struct Lattice {
+    enum Kind : uint8_t { UNKNOWN, CONSTANT, VARYING };
+    Kind kind = UNKNOWN;
+    Value value;
+};
+
+class ConstantSolver {
+public:
+    // GLOBAL reads of names in `globals` are constant, all others varying.
+    void solve(const Function& function, const ConstantBindings* globals);
+
+    const Lattice& value(ValueId id) const { return values_[id]; }
+    bool reachable(BlockId block) const { return reachable_[block]; }
+
+private:
+    std::vector<Lattice> values_;
+    std::vector<bool> reachable_;
+    std::vector<uint8_t> liveEdges_;   // bit k: the edge from preds[k] runs
+    std::vector<BlockId> branchFirst_; // per value: a block branching on it
+    std::vector<BlockId> branchNext_;  // per block: the next such block
+    std::vector<std::pair<BlockId, BlockId>> flowWork_;
+    std::vector<ValueId> ssaWork_;
+
+    Lattice evaluate(const Function& function, const ConstantBindings* globals, ValueId id) const;
+    void update(const Function& function, const ConstantBindings* globals, ValueId id);
+    void visitExit(const Function& function, BlockId block);
+};
+
+// Dominator-based global value numbering over the reachable code. The
+// leader of a value is the first value, in a dominating position, that is
+// known to compute the same thing. Constants are congruent by value.
+class ValueNumbering {
+public:
+    void number(const Function& function, const ConstantSolver& constants);
+
+    ValueId leader(ValueId id) const { return leaders_[id]; }
+
+private:
+    struct Key {
+        uint64_t payload;
+        ValueId operands[2];
+        Op op;
+        uint8_t subop;
+
+        bool operator==(const Key& other) const {
+            return payload == other.payload && operands[0] == other.operands[0] &&
+                   operands[1] == other.operands[1] && op == other.op && subop == other.subop;
+        }
+    };
+
+    std::vector<ValueId> leaders_;
+    // Open addressing with linear probing. Entries leave in the reverse order
+    // they came in, which restores the table exactly, so emptying the slot
+    // is enough.
+    std::vector<ValueId> table_;
+    std::vector<Key> keys_;
+    std::vector<uint32_t> undo_;
+    // Dominator tree walk: the block, its next child, and the undo_ size to
+    // go back to when leaving it.
+    struct Frame {
+        BlockId block;
+        uint32_t next;
+        uint32_t mark;
+    };
+    std::vector<Frame> stack_;
+
+    bool keyOf(const Function& function, const ConstantSolver& constants, ValueId id, Key& key) const;
+    void enter(const Function& function, const ConstantSolver& constants, BlockId block);
+};
+
+} // namespace ssa
+
+// Lowers one unit to SSA, solves constants, numbers values, and writes the
+// results back: expressions with a constant value become literals, and
+// recomputations of a value that a variable in scope already holds become
+// that variable. `params` is null for the top level, and `globals` holds
+// the top-level constants a function body may assume. `clobbered` holds the
+// top-level names a call of a user function may assign; null means any.
+// For the top level, `exported` receives the bindings that every function
+// body may assume: names bound once, to a constant, before any user
+// function can run. Returns the number of expressions replaced. Works in
+// memory kept per thread, so it stops allocating once the thread has seen
+// a unit as large.
+size_t propagateConstants(NodeList& body, const std::pmr::vector<Atom>* params, const ConstantBindings* globals,
+                          const NameSet* clobbered, ConstantBindings* exported);
+
+} // namespace js
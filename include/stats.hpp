@@ -0,0 +1,66 @@
+#pragma once
+#include "ast.hpp"
+#include "optimizer.hpp"
+#include "trace.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+namespace js {
+
+enum class Phase : uint8_t { READ, LEX, PARSE, OPTIMIZE, BYTECODE, RUN, PRINT, COUNT };
+
+inline constexpr const char* phaseNames[] = {"read", "lex", "parse", "optimize", "bytecode", "run", "print"};
+
+inline const char* phaseName(Phase phase) { return phaseNames[static_cast<size_t>(phase)]; }
+
+inline constexpr size_t NodeTypeCount = static_cast<size_t>(NodeType::ASSIGNMENT_EXPRESSION) + 1;
+
+using NodeCounts = std::array<size_t, NodeTypeCount>;
+
+NodeCounts countNodes(const ASTNode* root);
+
+// What --stats reports for one compilation, or the sum over a batch.
+struct CompileStats {
+    std::array<uint64_t, static_cast<size_t>(Phase::COUNT)> phaseNanos{};
+    size_t files = 0;
+    size_t sourceBytes = 0;
+    size_t tokens = 0;
+    NodeCounts parsedNodes{};
+    NodeCounts optimizedNodes{};
+    PassCounts passRewrites{};
+    size_t arenaAllocated = 0;
+    size_t arenaReserved = 0;
+    size_t arenaRecycled = 0;
+    size_t atomBytes = 0;
+
+    uint64_t& nanos(Phase phase) { return phaseNanos[static_cast<size_t>(phase)]; }
+    uint64_t nanos(Phase phase) const { return phaseNanos[static_cast<size_t>(phase)]; }
+
+    void add(const CompileStats& other);
+    void print(std::ostream& out) const;
+};
+
+// Adds the time spent in the enclosing scope to one phase of the stats and
+// records it as a span of the trace, if there is one.
+class PhaseTimer {
+public:
+    PhaseTimer(CompileStats& stats, Phase phase, Trace* trace = nullptr)
+        : stats_(stats), phase_(phase), span_(trace, phaseName(phase)), begin_(Trace::Clock::now()) {}
+    ~PhaseTimer() {
+        stats_.nanos(phase_) += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Trace::Clock::now() - begin_).count());
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    CompileStats& stats_;
+    Phase phase_;
+    TraceSpan span_;
+    Trace::Clock::time_point begin_;
+};
+
+} // namespace js
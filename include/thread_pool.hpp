@@ -1,88 +1,466 @@
 #pragma once
-#include <vector>
-#include <queue>
-#include <thread>
-#include <mutex>
+#include "memory_pool.hpp"
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <future>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace js {
 
+namespace detail {
+
+// A type-erased, move-only unit of work. Callables of up to InlineSize bytes
+// are stored in place, so submitting one does not allocate; larger ones are
+// boxed on the heap.
+struct TaskNode {
+    static constexpr size_t InlineSize = 48;
+
+    alignas(std::max_align_t) unsigned char storage[InlineSize];
+    void (*run)(TaskNode& node) = nullptr; // invokes, then destroys the callable
+
+    template<typename F>
+    void emplace(F&& f) {
+        using Fn = std::decay_t<F>;
+        if constexpr (sizeof(Fn) <= InlineSize && alignof(Fn) <= alignof(std::max_align_t)) {
+            new (storage) Fn(std::forward<F>(f));
+            run = [](TaskNode& node) {
+                Fn* fn = std::launder(reinterpret_cast<Fn*>(node.storage));
+                struct Destroy {
+                    Fn* fn;
+                    ~Destroy() { fn->~Fn(); }
+                } destroy{fn};
+                (*fn)();
+            };
+        } else {
+            Fn* boxed = new Fn(std::forward<F>(f));
+            new (storage) Fn*(boxed);
+            run = [](TaskNode& node) {
+                std::unique_ptr<Fn> fn(*std::launder(reinterpret_cast<Fn**>(node.storage)));
+                (*fn)();
+            };
+        }
+    }
+};
+
+// Chase-Lev work-stealing deque. The owning worker pushes and pops at the
+// bottom without taking a lock; other workers steal from the top. Arrays that
+// were outgrown stay alive until the deque dies, since a thief may still be
+// reading one.
+class WorkDeque {
+public:
+    static constexpr size_t InitialCapacity = 256;
+
+    WorkDeque() {
+        arrays_.push_back(std::make_unique<Array>(InitialCapacity));
+        array_.store(arrays_.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkDeque(const WorkDeque&) = delete;
+    WorkDeque& operator=(const WorkDeque&) = delete;
+
+    // Owner only.
+    void push(TaskNode* node) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array* array = array_.load(std::memory_order_relaxed);
+        if (b - t >= static_cast<int64_t>(array->capacity())) {
+            array = grow(array, t, b);
+        }
+        array->put(b, node);
+        bottom_.store(b + 1, std::memory_order_release);
+    }
+
+    // Owner only. Takes the most recently pushed task, or returns null.
+    TaskNode* pop() {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* array = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_seq_cst);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        TaskNode* node = array->get(b);
+        if (t == b) {
+            // Last task: race the thieves for it.
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+                node = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return node;
+    }
+
+    // Any thread. Takes the oldest task; returns null when the deque is empty
+    // or another thread won the race for it.
+    TaskNode* steal() {
+        int64_t t = top_.load(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_seq_cst);
+        if (t >= b) {
+            return nullptr;
+        }
+        TaskNode* node = array_.load(std::memory_order_acquire)->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return node;
+    }
+
+private:
+    struct Array {
+        size_t mask;
+        std::unique_ptr<std::atomic<TaskNode*>[]> slots;
+
+        explicit Array(size_t capacity) : mask(capacity - 1), slots(new std::atomic<TaskNode*>[capacity]) {}
+
+        size_t capacity() const { return mask + 1; }
+        TaskNode* get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, TaskNode* node) { slots[i & mask].store(node, std::memory_order_relaxed); }
+    };
+
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    std::atomic<Array*> array_;
+    std::vector<std::unique_ptr<Array>> arrays_;
+
+    Array* grow(Array* old, int64_t top, int64_t bottom) {
+        arrays_.push_back(std::make_unique<Array>(old->capacity() * 2));
+        Array* array = arrays_.back().get();
+        for (int64_t i = top; i < bottom; i++) {
+            array->put(i, old->get(i));
+        }
+        array_.store(array, std::memory_order_release);
+        return array;
+    }
+};
+
+} // namespace detail
+
+class TaskGroup;
+
+// Work-stealing thread pool. Each worker owns a Chase-Lev deque: tasks
+// submitted from a worker go to the bottom of its own deque, and idle workers
+// steal from the top of the others, so fine-grained tasks spawned inside the
+// pool never meet on a shared lock. Tasks submitted from outside the pool go
+// through a small injection queue. Small tasks are stored inline in nodes
+// from a FixedSizePool and cost no heap allocation; a node finished on
+// another thread goes back through that thread's pool cache.
 class ThreadPool {
 public:
     explicit ThreadPool(size_t numThreads = std::thread::hardware_concurrency()) {
-        start(numThreads);
+        start(std::max<size_t>(numThreads, 1));
     }
 
     ~ThreadPool() {
         stop();
     }
 
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const noexcept { return workers_.size(); }
+
     template<class F, class... Args>
-    auto enqueue(F&& f, Args&&... args) 
+    auto enqueue(F&& f, Args&&... args)
         -> std::future<typename std::invoke_result<F, Args...>::type> {
         using return_type = typename std::invoke_result<F, Args...>::type;
 
-        auto task = std::make_shared<std::packaged_task<return_type()>>(
+        std::packaged_task<return_type()> task(
             std::bind(std::forward<F>(f), std::forward<Args>(args)...)
         );
-        
-        std::future<return_type> res = task->get_future();
-        {
-            std::unique_lock<std::mutex> lock(queueMutex);
-            if (stop_) {
+        std::future<return_type> res = task.get_future();
+        submit(std::move(task));
+        return res;
+    }
+
+    // Runs f() on some worker. f must not throw; use a TaskGroup or enqueue
+    // to observe failures.
+    template<class F>
+    void submit(F&& f) {
+        if (Worker* worker = currentWorker()) {
+            detail::TaskNode* node = allocateNode();
+            node->emplace(std::forward<F>(f));
+            worker->deque.push(node);
+        } else {
+            if (stop_.load(std::memory_order_relaxed)) {
                 throw std::runtime_error("enqueue on stopped ThreadPool");
             }
-            tasks.emplace([task](){ (*task)(); });
+            std::lock_guard<std::mutex> lock(injectorMutex_);
+            detail::TaskNode* node = allocateNode();
+            node->emplace(std::forward<F>(f));
+            injector_.push_back(node);
+            injected_.fetch_add(1, std::memory_order_seq_cst);
         }
-        condition.notify_one();
-        return res;
+        wakeOne();
     }
 
+    // Calls body(i) for every i in [begin, end). The range is split in halves
+    // down to grain indices, and idle workers steal the halves. Returns once
+    // every call has finished and rethrows the first exception one threw.
+    template<class F>
+    void parallel_for(size_t begin, size_t end, size_t grain, F&& body);
+
 private:
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
-    
-    std::mutex queueMutex;
-    std::condition_variable condition;
-    bool stop_;
+    friend class TaskGroup;
+
+    struct Worker {
+        ThreadPool* owner;
+        detail::WorkDeque deque;
+        uint64_t seed;
+        std::thread thread;
+    };
+
+    static constexpr int SpinRounds = 64;
+    static constexpr size_t NodesPerBlock = 1024;
+
+    // Declared first, so it outlives the workers that cache its slots.
+    FixedSizePool nodes_{sizeof(detail::TaskNode), alignof(detail::TaskNode), NodesPerBlock};
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    std::mutex injectorMutex_;
+    std::deque<detail::TaskNode*> injector_;
+    std::atomic<size_t> injected_{0};
+
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> sleepers_{0};
+    uint64_t epoch_ = 0; // bumped under sleepMutex_ whenever work arrives
+    std::atomic<bool> stop_{false};
+
+    inline static thread_local Worker* currentWorker_ = nullptr;
+
+    Worker* currentWorker() const noexcept {
+        Worker* worker = currentWorker_;
+        return worker && worker->owner == this ? worker : nullptr;
+    }
+
+    static uint64_t nextRandom(uint64_t& state) noexcept {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
 
     void start(size_t numThreads) {
-        stop_ = false;
-        for(size_t i = 0; i < numThreads; ++i) {
-            workers.emplace_back([this] {
-                while(true) {
-                    std::function<void()> task;
-                    {
-                        std::unique_lock<std::mutex> lock(queueMutex);
-                        condition.wait(lock,
-                            [this]{ return stop_ || !tasks.empty(); });
-                        
-                        if(stop_ && tasks.empty()) {
-                            return;
-                        }
-                        
-                        task = std::move(tasks.front());
-                        tasks.pop();
-                    }
-                    task();
-                }
-            });
+        for (size_t i = 0; i < numThreads; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+            workers_.back()->owner = this;
+            workers_.back()->seed = 0x9E3779B97F4A7C15ull * (i + 1);
+        }
+        for (auto& worker : workers_) {
+            worker->thread = std::thread([this, w = worker.get()] { run(*w); });
         }
     }
 
     void stop() {
         {
-            std::unique_lock<std::mutex> lock(queueMutex);
-            stop_ = true;
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            stop_.store(true, std::memory_order_seq_cst);
+            ++epoch_;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) {
+            worker->thread.join();
+        }
+    }
+
+    void wakeOne() {
+        // A read-modify-write, not a load: it orders the task we just
+        // published against the sleeper count a worker bumps before its last
+        // look for work, so either it sees the task or we see it sleeping.
+        if (sleepers_.fetch_add(0, std::memory_order_seq_cst) == 0) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            ++epoch_;
+        }
+        wake_.notify_one();
+    }
+
+    detail::TaskNode* findWork(Worker* self) {
+        if (self) {
+            if (detail::TaskNode* node = self->deque.pop()) return node;
+        }
+        if (injected_.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lock(injectorMutex_);
+            if (!injector_.empty()) {
+                detail::TaskNode* node = injector_.front();
+                injector_.pop_front();
+                injected_.fetch_sub(1, std::memory_order_relaxed);
+                return node;
+            }
+        }
+        static thread_local uint64_t externalSeed =
+            0x2545F4914F6CDD1Dull ^ std::hash<std::thread::id>()(std::this_thread::get_id());
+        size_t count = workers_.size();
+        size_t first = nextRandom(self ? self->seed : externalSeed) % count;
+        for (size_t i = 0; i < count; i++) {
+            Worker* victim = workers_[(first + i) % count].get();
+            if (victim == self) continue;
+            if (detail::TaskNode* node = victim->deque.steal()) return node;
+        }
+        return nullptr;
+    }
+
+    void execute(detail::TaskNode* node) {
+        node->run(*node);
+        nodes_.deallocate(node);
+    }
+
+    detail::TaskNode* allocateNode() { return new (nodes_.allocate()) detail::TaskNode; }
+
+    // Runs one pending task on the calling thread; false if none was found.
+    bool runPendingTask() {
+        Worker* self = currentWorker();
+        detail::TaskNode* node = findWork(self);
+        if (!node) return false;
+        execute(node);
+        return true;
+    }
+
+    detail::TaskNode* sleep(Worker& self) {
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        uint64_t epoch = epoch_;
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        lock.unlock();
+        detail::TaskNode* node = findWork(&self);
+        lock.lock();
+        if (!node) {
+            wake_.wait(lock, [&] { return epoch_ != epoch || stop_.load(std::memory_order_relaxed); });
+        }
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        return node;
+    }
+
+    void run(Worker& self) {
+        currentWorker_ = &self;
+        while (true) {
+            detail::TaskNode* node = findWork(&self);
+            for (int spin = 0; !node && spin < SpinRounds; spin++) {
+                std::this_thread::yield();
+                node = findWork(&self);
+            }
+            if (!node && !stop_.load(std::memory_order_acquire)) {
+                node = sleep(self);
+            }
+            if (node) {
+                execute(node);
+            } else if (stop_.load(std::memory_order_acquire)) {
+                return;
+            }
+        }
+    }
+};
+
+// Tasks that can be waited for together. wait() runs pending pool tasks on
+// the calling thread instead of blocking, so groups may nest inside tasks.
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool) : pool_(pool) {}
+
+    ~TaskGroup() {
+        help();
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template<class F>
+    void run(F&& f) {
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        pool_.submit([this, fn = std::forward<F>(f)]() mutable {
+            {
+                // Destroy the callable before the group can see it finish.
+                auto task = std::move(fn);
+                try {
+                    task();
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+            }
+            pending_.fetch_sub(1, std::memory_order_acq_rel);
+        });
+    }
+
+    // Returns once every task has finished and rethrows the first exception
+    // one of them threw.
+    void wait() {
+        help();
+        if (error_) {
+            failing_.store(false, std::memory_order_relaxed);
+            std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+    }
+
+private:
+    ThreadPool& pool_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<bool> failing_{false};
+    std::exception_ptr error_; // published by the pending_ decrement
+
+    void help() {
+        while (pending_.load(std::memory_order_acquire) != 0) {
+            if (!pool_.runPendingTask()) {
+                std::this_thread::yield();
+            }
         }
-        condition.notify_all();
-        for(auto& worker: workers) {
-            worker.join();
+    }
+
+    void fail(std::exception_ptr error) {
+        bool expected = false;
+        if (failing_.compare_exchange_strong(expected, true, std::memory_order_relaxed)) {
+            error_ = std::move(error);
         }
     }
 };
 
+namespace detail {
+
+template<class F>
+struct RangeSplitter {
+    TaskGroup& group;
+    F& body;
+    size_t grain;
+
+    void operator()(size_t lo, size_t hi) const {
+        while (hi - lo > grain) {
+            size_t mid = lo + (hi - lo) / 2;
+            group.run([this, mid, hi] { (*this)(mid, hi); });
+            hi = mid;
+        }
+        for (size_t i = lo; i < hi; i++) {
+            body(i);
+        }
+    }
+};
+
+} // namespace detail
+
+template<class F>
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain, F&& body) {
+    if (begin >= end) {
+        return;
+    }
+    TaskGroup group(*this);
+    detail::RangeSplitter<std::remove_reference_t<F>> split{group, body, std::max<size_t>(grain, 1)};
+    split(begin, end);
+    group.wait();
+}
+
 } // namespace js
@@ -0,0 +1,59 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace js {
+
+// Collects timed spans from any thread and writes them in the Chrome
+// trace-event format, for chrome://tracing or Perfetto.
+class Trace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Trace() : start_(Clock::now()) {}
+
+    Trace(const Trace&) = delete;
+    Trace& operator=(const Trace&) = delete;
+
+    void record(std::string name, const char* category, Clock::time_point begin, Clock::time_point end);
+    void write(std::ostream& out) const;
+
+private:
+    struct Event {
+        std::string name;
+        const char* category;
+        uint64_t begin; // ns since start_
+        uint64_t duration;
+        uint32_t thread;
+    };
+
+    Clock::time_point start_;
+    mutable std::mutex mutex_;
+    std::vector<Event> events_;
+};
+
+// Times the enclosing scope and records it into a trace, if there is one.
+class TraceSpan {
+public:
+    TraceSpan(Trace* trace, std::string name, const char* category = "phase")
+        : trace_(trace), name_(trace ? std::move(name) : std::string()), category_(category),
+          begin_(Trace::Clock::now()) {}
+    ~TraceSpan() {
+        if (trace_) trace_->record(std::move(name_), category_, begin_, Trace::Clock::now());
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    Trace* trace_;
+    std::string name_;
+    const char* category_;
+    Trace::Clock::time_point begin_;
+};
+
+} // namespace js
@@ -0,0 +1,94 @@
+#pragma once
+#include "atoms.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace js {
+
+// A JavaScript value in 8 bytes, NaN-boxed. Numbers are stored as their own
+// double bits, with every NaN canonicalized to one positive quiet NaN.
+// Everything else lives in the payload of a negative quiet NaN, which no
+// canonical number uses:
+//
+//   sign, exponent, quiet bit   tag      payload
+//   1 11111111111 1             3 bits   48 bits
+//
+// Strings are atoms of the current AtomTable (their id is the payload),
+// functions are indices into the module's function table, and objects are
+// pointers to heap cells.
+class Value {
+public:
+    enum class Tag : uint8_t { NUMBER, UNDEFINED, NULL_VALUE, BOOLEAN, STRING, FUNCTION, OBJECT };
+
+    constexpr Value() : bits_(box(Tag::UNDEFINED, 0)) {}
+
+    static Value fromNumber(double n) {
+        uint64_t bits;
+        std::memcpy(&bits, &n, sizeof(bits));
+        return Value(n == n ? bits : CanonicalNaN);
+    }
+    static constexpr Value undefined() { return Value(); }
+    static constexpr Value null() { return Value(box(Tag::NULL_VALUE, 0)); }
+    static constexpr Value fromBool(bool b) { return Value(box(Tag::BOOLEAN, b)); }
+    static constexpr Value fromAtom(Atom a) { return Value(box(Tag::STRING, a.id)); }
+    static constexpr Value fromFunction(uint32_t index) { return Value(box(Tag::FUNCTION, index)); }
+    static Value fromObject(const void* cell) {
+        return Value(box(Tag::OBJECT, reinterpret_cast<uintptr_t>(cell)));
+    }
+    static constexpr Value fromBits(uint64_t bits) { return Value(bits); }
+
+    constexpr bool isNumber() const { return (bits_ & BoxMask) != BoxMask; }
+    constexpr Tag tag() const {
+        return isNumber() ? Tag::NUMBER : static_cast<Tag>((bits_ >> TagShift) & 7);
+    }
+    constexpr bool is(Tag t) const { return bits_ >> TagShift == (BoxMask >> TagShift | static_cast<uint64_t>(t)); }
+    constexpr bool isUndefined() const { return bits_ == box(Tag::UNDEFINED, 0); }
+    constexpr bool isNull() const { return bits_ == box(Tag::NULL_VALUE, 0); }
+    constexpr bool isBoolean() const { return is(Tag::BOOLEAN); }
+    constexpr bool isString() const { return is(Tag::STRING); }
+    constexpr bool isFunction() const { return is(Tag::FUNCTION); }
+
+    double asNumber() const {
+        double n;
+        std::memcpy(&n, &bits_, sizeof(n));
+        return n;
+    }
+    constexpr bool asBool() const { return (bits_ & PayloadMask) != 0; }
+    constexpr Atom asAtom() const { return Atom{static_cast<uint32_t>(bits_)}; }
+    constexpr uint32_t asFunction() const { return static_cast<uint32_t>(bits_); }
+    void* asObject() const { return reinterpret_cast<void*>(static_cast<uintptr_t>(bits_ & PayloadMask)); }
+
+    constexpr uint64_t bits() const { return bits_; }
+
+    // Same encoding: identical values, with NaN equal to itself.
+    constexpr bool operator==(Value other) const { return bits_ == other.bits_; }
+    constexpr bool operator!=(Value other) const { return bits_ != other.bits_; }
+
+private:
+    static constexpr uint64_t BoxMask = 0xFFF8000000000000ull;
+    static constexpr uint64_t CanonicalNaN = 0x7FF8000000000000ull;
+    static constexpr int TagShift = 48;
+    static constexpr uint64_t PayloadMask = (uint64_t{1} << TagShift) - 1;
+
+    uint64_t bits_;
+
+    explicit constexpr Value(uint64_t bits) : bits_(bits) {}
+
+    static constexpr uint64_t box(Tag tag, uint64_t payload) {
+        return BoxMask | static_cast<uint64_t>(tag) << TagShift | payload;
+    }
+};
+
+static_assert(sizeof(Value) == 8, "Value must stay NaN-boxed");
+
+bool isTruthy(Value value);
+double toNumber(Value value);
+int32_t toInt32(double number);
+std::string toString(Value value);
+// Formats a number the way JavaScript's Number.prototype.toString does for
+// the common cases (integers without a fraction, NaN, Infinity, -0 as 0).
+std::string numberToString(double number);
+bool looselyEquals(Value left, Value right);
+
+} // namespace js
@@ -0,0 +1,209 @@
+#pragma once
+#include "ast.hpp"
+
+namespace js {
+
+// Checked downcast on the node's type tag instead of RTTI.
+template<typename T>
+T* node_cast(ASTNode* node) {
+    return node && node->type == T::Kind ? static_cast<T*>(node) : nullptr;
+}
+
+template<typename T>
+const T* node_cast(const ASTNode* node) {
+    return node && node->type == T::Kind ? static_cast<const T*>(node) : nullptr;
+}
+
+inline bool isDeclaration(NodeType type) {
+    return type == NodeType::VARIABLE_DECLARATION || type == NodeType::FUNCTION_DECLARATION;
+}
+
+// Read-only traversal. Derived classes override the visitX hooks they care
+// about; the defaults visit every child in source order.
+template<typename Derived, typename R = void>
+class ASTVisitor {
+public:
+    R visit(const ASTNode* node) {
+        switch (node->type) {
+            case NodeType::PROGRAM:
+                return self().visitProgram(static_cast<const Program&>(*node));
+            case NodeType::VARIABLE_DECLARATION:
+                return self().visitVariableDeclaration(static_cast<const VariableDeclaration&>(*node));
+            case NodeType::FUNCTION_DECLARATION:
+                return self().visitFunctionDeclaration(static_cast<const FunctionDeclaration&>(*node));
+            case NodeType::RETURN_STATEMENT:
+                return self().visitReturnStatement(static_cast<const ReturnStatement&>(*node));
+            case NodeType::BINARY_EXPRESSION:
+                return self().visitBinaryExpression(static_cast<const BinaryExpression&>(*node));
+            case NodeType::CALL_EXPRESSION:
+                return self().visitCallExpression(static_cast<const CallExpression&>(*node));
+            case NodeType::IDENTIFIER:
+                return self().visitIdentifier(static_cast<const Identifier&>(*node));
+            case NodeType::LITERAL:
+                return self().visitLiteral(static_cast<const Literal&>(*node));
+            case NodeType::UNARY_EXPRESSION:
+                return self().visitUnaryExpression(static_cast<const UnaryExpression&>(*node));
+            case NodeType::MEMBER_EXPRESSION:
+                return self().visitMemberExpression(static_cast<const MemberExpression&>(*node));
+            case NodeType::BLOCK_STATEMENT:
+                return self().visitBlockStatement(static_cast<const BlockStatement&>(*node));
+            case NodeType::IF_STATEMENT:
+                return self().visitIfStatement(static_cast<const IfStatement&>(*node));
+            case NodeType::WHILE_STATEMENT:
+                return self().visitWhileStatement(static_cast<const WhileStatement&>(*node));
+            case NodeType::ASSIGNMENT_EXPRESSION:
+                return self().visitAssignmentExpression(static_cast<const AssignmentExpression&>(*node));
+        }
+        return R();
+    }
+
+    R visitProgram(const Program& node) { return visitList(node.body); }
+    R visitVariableDeclaration(const VariableDeclaration& node) { return visitChild(node.init); }
+    R visitFunctionDeclaration(const FunctionDeclaration& node) { return visitList(node.body); }
+    R visitReturnStatement(const ReturnStatement& node) { return visitChild(node.argument); }
+    R visitBinaryExpression(const BinaryExpression& node) {
+        visitChild(node.left);
+        return visitChild(node.right);
+    }
+    R visitCallExpression(const CallExpression& node) {
+        visitChild(node.callee);
+        return visitList(node.arguments);
+    }
+    R visitIdentifier(const Identifier&) { return R(); }
+    R visitLiteral(const Literal&) { return R(); }
+    R visitUnaryExpression(const UnaryExpression& node) { return visitChild(node.argument); }
+    R visitMemberExpression(const MemberExpression& node) { return visitChild(node.object); }
+    R visitBlockStatement(const BlockStatement& node) { return visitList(node.body); }
+    R visitIfStatement(const IfStatement& node) {
+        visitChild(node.test);
+        visitChild(node.consequent);
+        return visitChild(node.alternate);
+    }
+    R visitWhileStatement(const WhileStatement& node) {
+        visitChild(node.test);
+        return visitChild(node.body);
+    }
+    R visitAssignmentExpression(const AssignmentExpression& node) { return visitChild(node.value); }
+
+protected:
+    R visitChild(const NodePtr& child) {
+        return child ? visit(child.get()) : R();
+    }
+
+    R visitList(const NodeList& list) {
+        for (const auto& child : list) {
+            visitChild(child);
+        }
+        return R();
+    }
+
+private:
+    Derived& self() { return static_cast<Derived&>(*this); }
+};
+
+class AssignmentFinder : public ASTVisitor<AssignmentFinder> {
+public:
+    bool found = false;
+    void visitAssignmentExpression(const AssignmentExpression&) { found = true; }
+};
+
+inline bool containsAssignment(const ASTNode* node) {
+    AssignmentFinder finder;
+    finder.visit(node);
+    return finder.found;
+}
+
+// Bottom-up in-place rewriting. Each rewriteX hook receives the owning slot
+// and the node; it may replace the slot's contents. The defaults only
+// recurse, so an override usually calls the base hook first and then folds.
+template<typename Derived>
+class ASTRewriter {
+public:
+    void rewrite(NodePtr& slot) {
+        if (!slot) return;
+        switch (slot->type) {
+            case NodeType::PROGRAM:
+                self().rewriteProgram(slot, static_cast<Program&>(*slot));
+                break;
+            case NodeType::VARIABLE_DECLARATION:
+                self().rewriteVariableDeclaration(slot, static_cast<VariableDeclaration&>(*slot));
+                break;
+            case NodeType::FUNCTION_DECLARATION:
+                self().rewriteFunctionDeclaration(slot, static_cast<FunctionDeclaration&>(*slot));
+                break;
+            case NodeType::RETURN_STATEMENT:
+                self().rewriteReturnStatement(slot, static_cast<ReturnStatement&>(*slot));
+                break;
+            case NodeType::BINARY_EXPRESSION:
+                self().rewriteBinaryExpression(slot, static_cast<BinaryExpression&>(*slot));
+                break;
+            case NodeType::CALL_EXPRESSION:
+                self().rewriteCallExpression(slot, static_cast<CallExpression&>(*slot));
+                break;
+            case NodeType::IDENTIFIER:
+                self().rewriteIdentifier(slot, static_cast<Identifier&>(*slot));
+                break;
+            case NodeType::LITERAL:
+                self().rewriteLiteral(slot, static_cast<Literal&>(*slot));
+                break;
+            case NodeType::UNARY_EXPRESSION:
+                self().rewriteUnaryExpression(slot, static_cast<UnaryExpression&>(*slot));
+                break;
+            case NodeType::MEMBER_EXPRESSION:
+                self().rewriteMemberExpression(slot, static_cast<MemberExpression&>(*slot));
+                break;
+            case NodeType::BLOCK_STATEMENT:
+                self().rewriteBlockStatement(slot, static_cast<BlockStatement&>(*slot));
+                break;
+            case NodeType::IF_STATEMENT:
+                self().rewriteIfStatement(slot, static_cast<IfStatement&>(*slot));
+                break;
+            case NodeType::WHILE_STATEMENT:
+                self().rewriteWhileStatement(slot, static_cast<WhileStatement&>(*slot));
+                break;
+            case NodeType::ASSIGNMENT_EXPRESSION:
+                self().rewriteAssignmentExpression(slot, static_cast<AssignmentExpression&>(*slot));
+                break;
+        }
+    }
+
+    void rewriteProgram(NodePtr&, Program& node) { rewriteList(node.body); }
+    void rewriteVariableDeclaration(NodePtr&, VariableDeclaration& node) { rewrite(node.init); }
+    void rewriteFunctionDeclaration(NodePtr&, FunctionDeclaration& node) { rewriteList(node.body); }
+    void rewriteReturnStatement(NodePtr&, ReturnStatement& node) { rewrite(node.argument); }
+    void rewriteBinaryExpression(NodePtr&, BinaryExpression& node) {
+        rewrite(node.left);
+        rewrite(node.right);
+    }
+    void rewriteCallExpression(NodePtr&, CallExpression& node) {
+        rewrite(node.callee);
+        rewriteList(node.arguments);
+    }
+    void rewriteIdentifier(NodePtr&, Identifier&) {}
+    void rewriteLiteral(NodePtr&, Literal&) {}
+    void rewriteUnaryExpression(NodePtr&, UnaryExpression& node) { rewrite(node.argument); }
+    void rewriteMemberExpression(NodePtr&, MemberExpression& node) { rewrite(node.object); }
+    void rewriteBlockStatement(NodePtr&, BlockStatement& node) { rewriteList(node.body); }
+    void rewriteIfStatement(NodePtr&, IfStatement& node) {
+        rewrite(node.test);
+        rewrite(node.consequent);
+        rewrite(node.alternate);
+    }
+    void rewriteWhileStatement(NodePtr&, WhileStatement& node) {
+        rewrite(node.test);
+        rewrite(node.body);
+    }
+    void rewriteAssignmentExpression(NodePtr&, AssignmentExpression& node) { rewrite(node.value); }
+
+protected:
+    void rewriteList(NodeList& list) {
+        for (auto& child : list) {
+            rewrite(child);
+        }
+    }
+
+private:
+    Derived& self() { return static_cast<Derived&>(*this); }
+};
+
+} // namespace js
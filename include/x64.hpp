@@ -0,0 +1,130 @@
+#pragma once
+#include "numeric_analysis.hpp"
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+namespace js {
+
+// x86-64 code generation for the numeric subset found by NumericAnalysis.
+// X64Codegen decides what to emit; an X64Emitter decides how, either as GNU
+// assembler text or as machine code.
+//
+// Values live in SSE registers. Expression temporaries are allocated by
+// depth starting at xmm0; xmm14 and xmm15 are scratch. Leaf functions with few
+// locals keep them pinned in xmm8..xmm13, everything else keeps locals in
+// 8-byte frame slots below rbp. Calls follow the SysV convention: arguments in
+// xmm0..xmm7, result in xmm0, every xmm register caller-saved.
+namespace x64 {
+
+struct Xmm {
+    uint8_t id;
+};
+
+inline constexpr Xmm Scratch0{14};
+inline constexpr Xmm Scratch1{15};
+inline constexpr uint8_t FirstPinned = 8;
+inline constexpr uint8_t MaxPinned = 6;
+
+enum class SseOp : uint8_t { MOVE, ADD, SUB, MUL, DIV, AND, OR, XOR };
+
+// cmpsd predicates; the destination becomes an all-ones mask when
+// dst <predicate> src holds.
+enum class Predicate : uint8_t { EQ = 0, LT = 1, LE = 2, UNORD = 3, NEQ = 4 };
+
+// Branch conditions after ucomisd. EQUAL also holds for unordered operands.
+enum class Condition : uint8_t { EQUAL, NOT_EQUAL };
+
+// Runtime support. POW takes xmm0/xmm1; the print helpers take xmm0.
+enum class Helper : uint8_t {
+    POW,
+    PRINT_NUMBER,
+    PRINT_BOOLEAN,
+    PRINT_UNDEFINED,
+    PRINT_STRING,
+    PRINT_SPACE,
+    PRINT_NEWLINE
+};
+
+using Label = uint32_t;
+
+// Index passed to beginFunction for the top-level code.
+inline constexpr uint32_t TopLevel = UINT32_MAX;
+
+class X64Emitter {
+public:
+    virtual ~X64Emitter() = default;
+
+    // Prologue: push rbp; mov rbp, rsp; sub rsp, frameBytes.
+    virtual void beginFunction(uint32_t index, uint32_t frameBytes) = 0;
+    virtual void endFunction() = 0;
+    // Epilogue and return. The top level returns 0 from main.
+    virtual void ret() = 0;
+
+    virtual Label newLabel() = 0;
+    virtual void bind(Label label) = 0;
+    virtual void jump(Label label) = 0;
+    virtual void jumpIf(Condition condition, Label label) = 0;
+
+    virtual void sse(SseOp op, Xmm dst, Xmm src) = 0;
+    virtual void compare(Predicate predicate, Xmm dst, Xmm src) = 0;
+    virtual void ucomisd(Xmm left, Xmm right) = 0;
+    // dst = ToInt32(dst) & or | ToInt32(src), as a double.
+    virtual void bitwise(bool isOr, Xmm dst, Xmm src) = 0;
+
+    virtual void loadConstant(Xmm dst, uint64_t bits) = 0;
+    virtual void loadString(Xmm dst, Atom text) = 0;
+    virtual void loadSlot(Xmm dst, uint32_t slot) = 0;
+    virtual void storeSlot(uint32_t slot, Xmm src) = 0;
+    virtual void loadGlobal(Xmm dst, uint32_t global) = 0;
+    virtual void storeGlobal(uint32_t global, Xmm src) = 0;
+
+    virtual void callFunction(uint32_t index) = 0;
+    virtual void callHelper(Helper helper) = 0;
+};
+
+class X64Codegen {
+public:
+    X64Codegen(const NumericAnalysis& analysis, X64Emitter& emitter)
+        : analysis_(analysis), emitter_(emitter) {}
+
+    // Emits function #index of the analysis; it must be lowerable.
+    void function(uint32_t index);
+    // Emits the top-level statements as main(); the top level must be lowerable.
+    void topLevel(const Program& program);
+
+private:
+    struct Location {
+        bool pinned;
+        uint8_t index; // register when pinned, frame slot otherwise
+    };
+
+    const NumericAnalysis& analysis_;
+    X64Emitter& emitter_;
+    std::unordered_map<Atom, Location> locals_;
+    uint32_t spillBase_ = 0;
+
+    void load(Xmm dst, Location location);
+    void store(Location location, Xmm src);
+    void expression(const ASTNode* node, uint8_t depth);
+    void binary(const BinaryExpression& node, uint8_t depth);
+    void logicalNot(Xmm value);
+    void call(uint8_t depth, uint8_t argc, bool helper, uint32_t target);
+    void statement(const ASTNode* node);
+};
+
+} // namespace x64
+
+struct AssemblyReport {
+    size_t functionsLowered = 0;
+    size_t functionsSkipped = 0;
+    bool hasMain = false;
+    std::string mainSkippedReason;
+};
+
+// Writes GNU assembler source for every lowerable function and, if the top
+// level is lowerable, a main() that runs it. The output links against libc
+// and libm with the system C compiler driver.
+AssemblyReport emitGasAssembly(const Program& program, std::ostream& out);
+
+} // namespace js
@@ -0,0 +1,189 @@
+#include "../include/arena.hpp"
+#include <cassert>
+#include <new>
+
+namespace js {
+
+thread_local Arena* Arena::current_ = nullptr;
+
+namespace {
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+size_t sizeClass(size_t bytes) {
+    return (bytes - 1) / Arena::Granularity;
+}
+
+} // namespace
+
+Arena::Arena() noexcept
+    : cursor_(nullptr), limit_(nullptr), absorbedBy_(nullptr), chunks_(nullptr), freeLists_{},
+      bytesAllocated_(0), bytesReserved_(0), bytesRecycled_(0) {
+    for (auto& list : remoteFrees_) {
+        list.store(nullptr, std::memory_order_relaxed);
+    }
+    scopes_.store(0, std::memory_order_relaxed);
+}
+
+Arena::~Arena() {
+    reset();
+}
+
+void Arena::reset() noexcept {
+    ChunkHeader* chunk = chunks_;
+    while (chunk) {
+        ChunkHeader* next = chunk->next;
+        ::operator delete(chunk, std::align_val_t(ChunkSize));
+        chunk = next;
+    }
+    chunks_ = nullptr;
+    cursor_ = limit_ = nullptr;
+    for (auto& list : freeLists_) {
+        list = nullptr;
+    }
+    for (auto& list : remoteFrees_) {
+        list.store(nullptr, std::memory_order_relaxed);
+    }
+    bytesAllocated_ = bytesReserved_ = bytesRecycled_ = 0;
+}
+
+void Arena::absorb(Arena& other) noexcept {
+    ChunkHeader* chunk = other.chunks_;
+    while (chunk) {
+        ChunkHeader* next = chunk->next;
+        chunk->owner = this;
+        chunk->next = chunks_;
+        chunks_ = chunk;
+        chunk = next;
+    }
+    bytesAllocated_ += other.bytesAllocated_;
+    bytesReserved_ += other.bytesReserved_;
+
+    // Blocks on other's free lists are simply not reused.
+    other.chunks_ = nullptr;
+    other.reset();
+    other.absorbedBy_ = this;
+}
+
+Arena* Arena::current() noexcept {
+    if (current_) {
+        return current_;
+    }
+    static thread_local Arena fallback;
+    return &fallback;
+}
+
+Arena* Arena::owner(const void* ptr) noexcept {
+    auto address = reinterpret_cast<uintptr_t>(ptr) & ~(uintptr_t(ChunkSize) - 1);
+    return reinterpret_cast<const ChunkHeader*>(address)->owner;
+}
+
+Arena::ChunkHeader* Arena::newChunk(size_t payload) {
+    size_t total = HeaderSize + payload;
+    auto* chunk = static_cast<ChunkHeader*>(
+        ::operator new(total, std::align_val_t(ChunkSize)));
+    chunk->owner = this;
+    chunk->next = chunks_;
+    chunks_ = chunk;
+    bytesReserved_ += total;
+    return chunk;
+}
+
+void* Arena::allocateLarge(size_t bytes, size_t alignment) {
+    // Oversized blocks get a dedicated chunk. The block still starts inside the
+    // first ChunkSize bytes, so owner() keeps working for it.
+    ChunkHeader* chunk = newChunk(bytes + alignment);
+    char* base = reinterpret_cast<char*>(chunk) + HeaderSize;
+    auto offset = alignUp(reinterpret_cast<uintptr_t>(base), alignment) - reinterpret_cast<uintptr_t>(base);
+    bytesAllocated_ += bytes;
+    return base + offset;
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment) {
+    if (absorbedBy_) {
+        return absorbedBy_->allocate(bytes, alignment);
+    }
+    // Growing a container from another thread's arena races with that
+    // thread; build a new one in the current arena instead.
+    assert((current() == this || scopes_.load(std::memory_order_relaxed) == 0) &&
+           "allocating from an arena that is current on another thread");
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    if (alignment == 0 || (alignment & (alignment - 1)) || alignment > ChunkSize / 2) {
+        throw std::bad_alloc();
+    }
+
+    bool small = bytes <= MaxSmallSize && alignment <= Granularity;
+    if (small) {
+        bytes = alignUp(bytes, Granularity);
+        FreeBlock*& list = freeLists_[sizeClass(bytes)];
+        if (!list) {
+            list = drainRemoteFrees(sizeClass(bytes), bytes);
+        }
+        if (list) {
+            FreeBlock* block = list;
+            list = block->next;
+            bytesRecycled_ -= bytes;
+            return block;
+        }
+    }
+
+    if (bytes > ChunkSize - HeaderSize - alignment) {
+        return allocateLarge(bytes, alignment);
+    }
+
+    auto aligned = reinterpret_cast<char*>(
+        alignUp(reinterpret_cast<uintptr_t>(cursor_), alignment));
+    if (!cursor_ || aligned + bytes > limit_) {
+        ChunkHeader* chunk = newChunk(ChunkSize - HeaderSize);
+        cursor_ = reinterpret_cast<char*>(chunk) + HeaderSize;
+        limit_ = reinterpret_cast<char*>(chunk) + ChunkSize;
+        aligned = reinterpret_cast<char*>(
+            alignUp(reinterpret_cast<uintptr_t>(cursor_), alignment));
+    }
+
+    cursor_ = aligned + bytes;
+    bytesAllocated_ += bytes;
+    return aligned;
+}
+
+void Arena::do_deallocate(void* ptr, size_t bytes, size_t alignment) {
+    if (absorbedBy_) {
+        absorbedBy_->deallocate(ptr, bytes, alignment);
+        return;
+    }
+    if (!ptr || bytes == 0 || bytes > MaxSmallSize || alignment > Granularity) {
+        return;
+    }
+    bytes = alignUp(bytes, Granularity);
+    auto* block = static_cast<FreeBlock*>(ptr);
+    if (current() != this) {
+        std::atomic<FreeBlock*>& remote = remoteFrees_[sizeClass(bytes)];
+        block->next = remote.load(std::memory_order_relaxed);
+        while (!remote.compare_exchange_weak(block->next, block, std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+        }
+        return;
+    }
+    FreeBlock*& list = freeLists_[sizeClass(bytes)];
+    block->next = list;
+    list = block;
+    bytesRecycled_ += bytes;
+}
+
+Arena::FreeBlock* Arena::drainRemoteFrees(size_t index, size_t bytes) noexcept {
+    FreeBlock* list = remoteFrees_[index].exchange(nullptr, std::memory_order_acquire);
+    for (FreeBlock* block = list; block; block = block->next) {
+        bytesRecycled_ += bytes;
+    }
+    return list;
+}
+
+bool Arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+} // namespace js
@@ -1,18 +1,14 @@
 #include "../include/ast.hpp"
-#include "../include/memory_pool.hpp"
 
 namespace js {
 
-
-thread_local MemoryPool<ASTNode> nodePool;
-
 void* ASTNode::operator new(size_t size) {
-    return nodePool.allocate(1);
+    return Arena::current()->allocate(size, alignof(std::max_align_t));
 }
 
-void ASTNode::operator delete(void* ptr) noexcept {
+void ASTNode::operator delete(void* ptr, size_t size) noexcept {
     if (ptr) {
-        nodePool.deallocate(static_cast<ASTNode*>(ptr));
+        Arena::owner(ptr)->deallocate(ptr, size, alignof(std::max_align_t));
     }
 }
 
@@ -0,0 +1,114 @@
+#include "../include/atoms.hpp"
+#include "../include/hash.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace js {
+
+thread_local AtomTable* AtomTable::current_ = nullptr;
+
+AtomTable::AtomTable() : slots_(256, 0) {
+    intern("");
+    for (size_t i = 1; i < keywordNames.size(); i++) {
+        intern(keywordNames[i]);
+    }
+    intern("console");
+    intern("log");
+    intern("undefined");
+}
+
+AtomTable& AtomTable::current() noexcept {
+    if (current_) {
+        return *current_;
+    }
+    static thread_local AtomTable fallback;
+    return fallback;
+}
+
+Atom AtomTable::intern(std::string_view text) {
+    if (text.size() > UINT32_MAX) {
+        throw std::length_error("String too long to intern");
+    }
+    auto hash = static_cast<uint32_t>(hashString(text));
+    if (!concurrent_) {
+        uint32_t id = find(text, hash);
+        return id != UINT32_MAX ? Atom{id} : insert(text, hash);
+    }
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        uint32_t id = find(text, hash);
+        if (id != UINT32_MAX) return Atom{id};
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    uint32_t id = find(text, hash);
+    return id != UINT32_MAX ? Atom{id} : insert(text, hash);
+}
+
+uint32_t AtomTable::find(std::string_view text, uint32_t hash) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t slot = slots_[i];
+        if (slot == 0) {
+            return UINT32_MAX;
+        }
+        const Entry& entry = entries_[slot - 1];
+        if (entry.hash == hash && entry.length == text.size() &&
+            std::memcmp(entry.data, text.data(), text.size()) == 0) {
+            return slot - 1;
+        }
+    }
+}
+
+Atom AtomTable::insert(std::string_view text, uint32_t hash) {
+    char* data = static_cast<char*>(storage_.allocate(text.size() + 1, 1));
+    std::memcpy(data, text.data(), text.size());
+    data[text.size()] = '\0';
+
+    auto id = static_cast<uint32_t>(entries_.size());
+    entries_.push_back(Entry{data, static_cast<uint32_t>(text.size()), hash});
+    if (entries_.size() * 2 > slots_.size()) {
+        grow();
+    } else {
+        size_t mask = slots_.size() - 1;
+        size_t i = hash & mask;
+        while (slots_[i] != 0) i = (i + 1) & mask;
+        slots_[i] = id + 1;
+    }
+    return Atom{id};
+}
+
+void AtomTable::grow() {
+    std::vector<uint32_t> slots(slots_.size() * 2, 0);
+    size_t mask = slots.size() - 1;
+    for (uint32_t id = 0; id < entries_.size(); id++) {
+        size_t i = entries_[id].hash & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = id + 1;
+    }
+    slots_.swap(slots);
+}
+
+size_t AtomTable::bytesUsed() const noexcept {
+    return entries_.capacity() * sizeof(Entry) + slots_.capacity() * sizeof(uint32_t) +
+           storage_.bytesAllocated();
+}
+
+void NameSet::insert(Atom name) {
+    if (name.id >= bits_.size()) {
+        bits_.resize(std::max<size_t>(name.id + 1, bits_.size() * 2));
+    }
+    if (!bits_[name.id]) {
+        bits_[name.id] = true;
+        members_.push_back(name);
+    }
+}
+
+void NameSet::clear() {
+    for (Atom name : members_) {
+        bits_[name.id] = false;
+    }
+    members_.clear();
+}
+
+} // namespace js
@@ -0,0 +1,289 @@
+#include "../include/binary_ast.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace js {
+
+using namespace binary_ast;
+
+namespace {
+
+template<typename T>
+void writeArray(std::ostream& out, const std::vector<T>& items) {
+    out.write(reinterpret_cast<const char*>(items.data()), static_cast<std::streamsize>(items.size() * sizeof(T)));
+}
+
+uint32_t distance(NodeIndex from, NodeIndex to) {
+    return to == NoNode ? 0 : to - from;
+}
+
+bool isLittleEndian() {
+    uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+// Bytes from the start of the file to each section.
+struct Layout {
+    size_t nodes, functions, strings, numbers, stringBytes, end;
+
+    explicit Layout(const Header& header) {
+        nodes = sizeof(Header);
+        functions = nodes + size_t{header.nodeCount} * sizeof(Node);
+        strings = functions + size_t{header.functionCount} * sizeof(Function);
+        numbers = strings + size_t{header.stringCount} * sizeof(String);
+        stringBytes = numbers + size_t{header.numberCount} * sizeof(double);
+        end = stringBytes + header.stringBytes;
+    }
+};
+
+} // namespace
+
+void writeBinaryAST(const FlatAST& ast, std::ostream& out) {
+    if (!isLittleEndian()) {
+        throw std::runtime_error("Binary AST output needs a little-endian host");
+    }
+    const AtomTable& atoms = AtomTable::current();
+    std::vector<String> strings;
+    std::string stringBytes;
+    std::unordered_map<uint32_t, uint32_t> stringIndex;
+    auto intern = [&](Atom atom) {
+        auto [it, inserted] = stringIndex.try_emplace(atom.id, static_cast<uint32_t>(strings.size()));
+        if (inserted) {
+            std::string_view text = atoms.text(atom);
+            strings.push_back(String{static_cast<uint32_t>(stringBytes.size()), static_cast<uint32_t>(text.size())});
+            stringBytes.append(text);
+        }
+        return it->second;
+    };
+
+    std::vector<Node> nodes(ast.size());
+    for (NodeIndex i = 0; i < ast.size(); i++) {
+        uint32_t payload = ast.payloads[i];
+        switch (ast.kinds[i]) {
+            case NodeType::IDENTIFIER:
+            case NodeType::VARIABLE_DECLARATION:
+            case NodeType::MEMBER_EXPRESSION:
+            case NodeType::ASSIGNMENT_EXPRESSION:
+                payload = intern(Atom{payload});
+                break;
+            case NodeType::LITERAL:
+                if (ast.literalKind(i) == FlatAST::LiteralKind::STRING) {
+                    payload = intern(Atom{payload});
+                }
+                break;
+            default:
+                break;
+        }
+        nodes[i] = Node{ast.kinds[i], ast.ops[i], 0, payload, distance(i, ast.firstChild[i]),
+                        distance(i, ast.nextSibling[i])};
+    }
+
+    std::vector<Function> functions;
+    functions.reserve(ast.functions.size());
+    for (const auto& fn : ast.functions) {
+        functions.push_back(Function{intern(fn.name), fn.paramCount});
+    }
+
+    Header header{};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.byteOrder = ByteOrderMark;
+    header.nodeCount = static_cast<uint32_t>(nodes.size());
+    header.functionCount = static_cast<uint32_t>(functions.size());
+    header.stringCount = static_cast<uint32_t>(strings.size());
+    header.numberCount = static_cast<uint32_t>(ast.numbers.size());
+    header.stringBytes = static_cast<uint32_t>(stringBytes.size());
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeArray(out, nodes);
+    writeArray(out, functions);
+    writeArray(out, strings);
+    writeArray(out, ast.numbers);
+    out.write(stringBytes.data(), static_cast<std::streamsize>(stringBytes.size()));
+    if (!out) {
+        throw std::runtime_error("Could not write binary AST");
+    }
+}
+
+bool BinaryASTView::matches(const void* data, size_t size) noexcept {
+    return size >= sizeof(Magic) && std::memcmp(data, Magic, sizeof(Magic)) == 0;
+}
+
+BinaryASTView::BinaryASTView(const void* data, size_t size) {
+    if (size < sizeof(Header) || !matches(data, size)) {
+        throw std::runtime_error("Not a binary AST");
+    }
+    if (reinterpret_cast<uintptr_t>(data) % alignof(double) != 0) {
+        throw std::runtime_error("Binary AST buffer is not 8-byte aligned");
+    }
+    auto* base = static_cast<const char*>(data);
+    header_ = reinterpret_cast<const Header*>(base);
+    if (header_->version != Version || header_->byteOrder != ByteOrderMark) {
+        throw std::runtime_error("Unsupported binary AST version or byte order");
+    }
+    Layout layout(*header_);
+    if (layout.end > size) {
+        throw std::runtime_error("Truncated binary AST");
+    }
+    nodes_ = reinterpret_cast<const Node*>(base + layout.nodes);
+    functions_ = reinterpret_cast<const Function*>(base + layout.functions);
+    strings_ = reinterpret_cast<const String*>(base + layout.strings);
+    numbers_ = reinterpret_cast<const double*>(base + layout.numbers);
+    stringBytes_ = base + layout.stringBytes;
+    validate();
+}
+
+// Linear passes, so that no accessor has to check bounds.
+void BinaryASTView::validate() const {
+    auto fail = [](const char* what) { throw std::runtime_error(std::string("Malformed binary AST: ") + what); };
+
+    for (uint32_t i = 0; i < header_->stringCount; i++) {
+        if (strings_[i].offset > header_->stringBytes || strings_[i].length > header_->stringBytes - strings_[i].offset) {
+            fail("string out of range");
+        }
+    }
+    for (uint32_t i = 0; i < header_->functionCount; i++) {
+        if (functions_[i].name >= header_->stringCount) fail("function name out of range");
+    }
+
+    uint32_t count = header_->nodeCount;
+    for (uint32_t i = 0; i < count; i++) {
+        if (nodes_[i].firstChild >= count - i || nodes_[i].nextSibling >= count - i) {
+            fail("child offset out of range");
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const Node& node = nodes_[i];
+        switch (node.kind) {
+            case NodeType::PROGRAM:
+            case NodeType::RETURN_STATEMENT:
+            case NodeType::CALL_EXPRESSION:
+            case NodeType::BLOCK_STATEMENT:
+            case NodeType::IF_STATEMENT:
+            case NodeType::WHILE_STATEMENT:
+                break;
+            case NodeType::IDENTIFIER:
+            case NodeType::VARIABLE_DECLARATION:
+            case NodeType::MEMBER_EXPRESSION:
+            case NodeType::ASSIGNMENT_EXPRESSION:
+                if (node.payload >= header_->stringCount) fail("name out of range");
+                break;
+            case NodeType::FUNCTION_DECLARATION: {
+                if (node.payload >= header_->functionCount) fail("function out of range");
+                NodeIndex c = relative(i, node.firstChild);
+                for (uint32_t p = 0; p < functions_[node.payload].paramCount; p++, c = nextSibling(c)) {
+                    if (c == NoNode || nodes_[c].kind != NodeType::IDENTIFIER) fail("missing parameter");
+                }
+                break;
+            }
+            case NodeType::BINARY_EXPRESSION:
+                if (node.op >= static_cast<uint8_t>(BinaryOp::COUNT)) fail("bad binary operator");
+                break;
+            case NodeType::UNARY_EXPRESSION:
+                if (node.op >= static_cast<uint8_t>(UnaryOp::COUNT)) fail("bad unary operator");
+                break;
+            case NodeType::LITERAL:
+                switch (static_cast<LiteralKind>(node.op)) {
+                    case LiteralKind::NUMBER:
+                        if (node.payload >= header_->numberCount) fail("number out of range");
+                        break;
+                    case LiteralKind::STRING:
+                        if (node.payload >= header_->stringCount) fail("string out of range");
+                        break;
+                    case LiteralKind::BOOLEAN:
+                    case LiteralKind::NULL_VALUE:
+                    case LiteralKind::UNDEFINED:
+                        break;
+                    default:
+                        fail("bad literal kind");
+                }
+                break;
+            default:
+                fail("bad node kind");
+        }
+    }
+}
+
+NodeIndex BinaryASTView::child(NodeIndex node, size_t n) const {
+    NodeIndex current = firstChild(node);
+    while (n-- > 0 && current != NoNode) {
+        current = nextSibling(current);
+    }
+    return current;
+}
+
+void BinaryASTView::print(NodeIndex node, int indent, std::ostream& out) const {
+    if (node == NoNode || node >= size()) return;
+    std::string indentation(indent * 2, ' ');
+
+    switch (kind(node)) {
+        case NodeType::PROGRAM:
+            out << indentation << "Program" << std::endl;
+            break;
+        case NodeType::VARIABLE_DECLARATION:
+            out << indentation << "VariableDeclaration: " << text(node) << std::endl;
+            break;
+        case NodeType::FUNCTION_DECLARATION: {
+            out << indentation << "FunctionDeclaration: " << functionName(node) << std::endl;
+            NodeIndex c = firstChild(node);
+            for (uint32_t i = 0; i < paramCount(node); i++, c = nextSibling(c)) {
+                out << indentation << "  " << text(c) << std::endl;
+            }
+            for (; c != NoNode; c = nextSibling(c)) {
+                print(c, indent + 1, out);
+            }
+            return;
+        }
+        case NodeType::RETURN_STATEMENT:
+            out << indentation << "ReturnStatement" << std::endl;
+            break;
+        case NodeType::BINARY_EXPRESSION:
+            out << indentation << "BinaryExpression: " << opName(binaryOp(node)) << std::endl;
+            break;
+        case NodeType::CALL_EXPRESSION:
+            out << indentation << "CallExpression" << std::endl;
+            break;
+        case NodeType::IDENTIFIER:
+            out << indentation << "Identifier: " << text(node) << std::endl;
+            break;
+        case NodeType::LITERAL:
+            out << indentation << "Literal: ";
+            switch (literalKind(node)) {
+                case LiteralKind::NUMBER: out << number(node); break;
+                case LiteralKind::STRING: out << text(node); break;
+                case LiteralKind::BOOLEAN: out << boolean(node); break;
+                case LiteralKind::NULL_VALUE: out << "null"; break;
+                case LiteralKind::UNDEFINED: out << "undefined"; break;
+            }
+            out << std::endl;
+            break;
+        case NodeType::UNARY_EXPRESSION:
+            out << indentation << "UnaryExpression: " << opName(unaryOp(node)) << std::endl;
+            break;
+        case NodeType::MEMBER_EXPRESSION:
+            out << indentation << "MemberExpression: " << text(node) << std::endl;
+            break;
+        case NodeType::BLOCK_STATEMENT:
+            out << indentation << "BlockStatement" << std::endl;
+            break;
+        case NodeType::IF_STATEMENT:
+            out << indentation << "IfStatement" << std::endl;
+            break;
+        case NodeType::WHILE_STATEMENT:
+            out << indentation << "WhileStatement" << std::endl;
+            break;
+        case NodeType::ASSIGNMENT_EXPRESSION:
+            out << indentation << "AssignmentExpression: " << text(node) << std::endl;
+            break;
+    }
+
+    for (NodeIndex c = firstChild(node); c != NoNode; c = nextSibling(c)) {
+        print(c, indent + 1, out);
+    }
+}
+
+} // namespace js
@@ -0,0 +1,512 @@
+#include "../include/bytecode.hpp"
+#include "../include/visitor.hpp"
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace js {
+
+namespace {
+
+constexpr uint32_t MaxOperand = std::numeric_limits<uint16_t>::max();
+
+class FunctionCompiler;
+
+class ModuleCompiler {
+public:
+    BytecodeModule module;
+    std::unordered_map<Atom, uint16_t> globals;
+
+    uint16_t declareGlobal(Atom name) {
+        auto it = globals.find(name);
+        if (it != globals.end()) {
+            return it->second;
+        }
+        if (module.globals.size() >= MaxOperand) {
+            throw std::runtime_error("Too many global variables");
+        }
+        auto slot = static_cast<uint16_t>(module.globals.size());
+        module.globals.push_back(name);
+        globals.emplace(name, slot);
+        return slot;
+    }
+
+    void compileProgram(const ASTNode* root);
+    uint32_t compileFunction(const FunctionDeclaration& decl);
+};
+
+class FunctionCompiler {
+public:
+    FunctionCompiler(ModuleCompiler& module, BytecodeFunction& function)
+        : module_(module), function_(function), nextRegister_(0) {}
+
+    uint16_t declareLocal(Atom name) {
+        uint16_t reg = allocateRegister();
+        locals_[name] = reg;
+        return reg;
+    }
+
+    void compileStatement(const ASTNode* node, bool topLevel);
+    // Whether any expression of the body assigns; see compileExpression.
+    void setAssigns(bool assigns) { assigns_ = assigns; }
+    void finish() {
+        uint16_t reg = allocateRegister();
+        emit(Opcode::LOAD_UNDEFINED, reg);
+        emit(Opcode::RETURN, reg);
+    }
+
+    void emitFunctionBinding(uint32_t functionIndex, uint16_t globalSlot) {
+        uint16_t mark = nextRegister_;
+        uint16_t reg = allocateRegister();
+        emit(Opcode::LOAD_FUNCTION, reg, static_cast<uint16_t>(functionIndex));
+        emit(Opcode::SET_GLOBAL, reg, globalSlot);
+        nextRegister_ = mark;
+    }
+
+private:
+    ModuleCompiler& module_;
+    BytecodeFunction& function_;
+    std::unordered_map<Atom, uint16_t> locals_;
+    std::unordered_map<uint64_t, uint16_t> constantIndex_; // keyed by Value bits
+    uint16_t nextRegister_;
+    bool assigns_ = true;
+
+    uint16_t allocateRegister() {
+        if (nextRegister_ >= MaxOperand) {
+            throw std::runtime_error("Function needs too many registers");
+        }
+        uint16_t reg = nextRegister_++;
+        if (nextRegister_ > function_.registerCount) {
+            function_.registerCount = nextRegister_;
+        }
+        return reg;
+    }
+
+    size_t emit(Opcode op, uint16_t a = 0, uint16_t b = 0, uint16_t c = 0) {
+        function_.code.push_back(Instruction{op, a, b, c});
+        return function_.code.size() - 1;
+    }
+
+    void patchTarget(size_t jump, size_t target) {
+        function_.code[jump].b = static_cast<uint16_t>(target >> 16);
+        function_.code[jump].c = static_cast<uint16_t>(target & 0xFFFF);
+    }
+
+    void patchTarget(size_t jump) { patchTarget(jump, function_.code.size()); }
+
+    uint16_t addConstant(Value value) {
+        auto it = constantIndex_.find(value.bits());
+        if (it != constantIndex_.end()) {
+            return it->second;
+        }
+        if (function_.constants.size() >= MaxOperand) {
+            throw std::runtime_error("Function has too many constants");
+        }
+        auto index = static_cast<uint16_t>(function_.constants.size());
+        function_.constants.push_back(value);
+        constantIndex_.emplace(value.bits(), index);
+        return index;
+    }
+
+    uint16_t target(int dst) {
+        return dst >= 0 ? static_cast<uint16_t>(dst) : allocateRegister();
+    }
+
+    // Evaluates an expression. The result ends up in dst when dst >= 0;
+    // otherwise in the returned register, which may be a local's own register.
+    uint16_t compileExpression(const ASTNode* node, int dst = -1);
+    uint16_t compileCall(const CallExpression& call, int dst);
+    uint16_t compileAssignment(const AssignmentExpression& assignment, int dst);
+    void compileBlock(const NodeList& body);
+};
+
+class NameFinder : public ASTVisitor<NameFinder> {
+public:
+    explicit NameFinder(Atom name) : name_(name) {}
+    bool found = false;
+    void visitIdentifier(const Identifier& node) { found = found || node.name == name_; }
+
+private:
+    Atom name_;
+};
+
+bool mentions(const ASTNode* node, Atom name) {
+    NameFinder finder(name);
+    finder.visit(node);
+    return finder.found;
+}
+
+Opcode binaryOpcode(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::ADD: return Opcode::ADD;
+        case BinaryOp::SUB: return Opcode::SUB;
+        case BinaryOp::MUL: return Opcode::MUL;
+        case BinaryOp::DIV: return Opcode::DIV;
+        case BinaryOp::POW: return Opcode::POW;
+        case BinaryOp::LT: return Opcode::LT;
+        case BinaryOp::GT: return Opcode::GT;
+        case BinaryOp::LE: return Opcode::LE;
+        case BinaryOp::GE: return Opcode::GE;
+        case BinaryOp::EQ: return Opcode::EQ;
+        case BinaryOp::NE: return Opcode::NE;
+        case BinaryOp::BIT_AND: return Opcode::BIT_AND;
+        case BinaryOp::BIT_OR: return Opcode::BIT_OR;
+        default: break;
+    }
+    throw std::runtime_error("No opcode for operator");
+}
+
+Opcode unaryOpcode(UnaryOp op) {
+    switch (op) {
+        case UnaryOp::NOT: return Opcode::NOT;
+        case UnaryOp::NEG: return Opcode::NEG;
+        case UnaryOp::PLUS: return Opcode::PLUS;
+        default: break;
+    }
+    throw std::runtime_error("No opcode for operator");
+}
+
+bool isConsoleLog(const ASTNode* callee) {
+    auto* member = node_cast<MemberExpression>(callee);
+    if (!member || member->property != atoms::log) return false;
+    auto* object = node_cast<Identifier>(member->object.get());
+    return object && object->name == atoms::console;
+}
+
+uint16_t FunctionCompiler::compileExpression(const ASTNode* node, int dst) {
+    switch (node->type) {
+        case NodeType::LITERAL: {
+            uint16_t reg = target(dst);
+            emit(Opcode::LOAD_CONST, reg, addConstant(static_cast<const Literal*>(node)->value));
+            return reg;
+        }
+        case NodeType::IDENTIFIER: {
+            Atom name = static_cast<const Identifier*>(node)->name;
+            auto local = locals_.find(name);
+            if (local != locals_.end()) {
+                if (dst >= 0 && dst != local->second) {
+                    emit(Opcode::MOVE, static_cast<uint16_t>(dst), local->second);
+                    return static_cast<uint16_t>(dst);
+                }
+                return local->second;
+            }
+            uint16_t reg = target(dst);
+            auto global = module_.globals.find(name);
+            if (global != module_.globals.end()) {
+                emit(Opcode::GET_GLOBAL, reg, global->second);
+            } else {
+                emit(Opcode::THROW_REFERENCE, reg, static_cast<uint16_t>(name.id >> 16),
+                     static_cast<uint16_t>(name.id & 0xFFFF));
+            }
+            return reg;
+        }
+        case NodeType::UNARY_EXPRESSION: {
+            auto* unary = static_cast<const UnaryExpression*>(node);
+            uint16_t mark = nextRegister_;
+            uint16_t operand = compileExpression(unary->argument.get());
+            nextRegister_ = mark;
+            uint16_t reg = target(dst);
+            emit(unaryOpcode(unary->op), reg, operand);
+            return reg;
+        }
+        case NodeType::BINARY_EXPRESSION: {
+            auto* binary = static_cast<const BinaryExpression*>(node);
+            if (binary->op == BinaryOp::AND || binary->op == BinaryOp::OR) {
+                // Short-circuit: the result is whichever operand decided it.
+                uint16_t reg = target(dst);
+                compileExpression(binary->left.get(), reg);
+                size_t jump = emit(binary->op == BinaryOp::AND ? Opcode::JUMP_IF_FALSE : Opcode::JUMP_IF_TRUE, reg);
+                uint16_t mark = nextRegister_;
+                compileExpression(binary->right.get(), reg);
+                nextRegister_ = mark;
+                patchTarget(jump);
+                return reg;
+            }
+            uint16_t mark = nextRegister_;
+            uint16_t left = compileExpression(binary->left.get());
+            // A local read as the left operand must not see an assignment
+            // made by the right one.
+            if (left < mark && assigns_ && containsAssignment(binary->right.get())) {
+                uint16_t copy = allocateRegister();
+                emit(Opcode::MOVE, copy, left);
+                left = copy;
+            }
+            uint16_t right = compileExpression(binary->right.get());
+            nextRegister_ = mark;
+            uint16_t reg = target(dst);
+            emit(binaryOpcode(binary->op), reg, left, right);
+            return reg;
+        }
+        case NodeType::CALL_EXPRESSION:
+            return compileCall(*static_cast<const CallExpression*>(node), dst);
+        case NodeType::ASSIGNMENT_EXPRESSION:
+            return compileAssignment(*static_cast<const AssignmentExpression*>(node), dst);
+        default:
+            break;
+    }
+    throw std::runtime_error("Unsupported expression in bytecode compiler");
+}
+
+uint16_t FunctionCompiler::compileAssignment(const AssignmentExpression& assignment, int dst) {
+    auto local = locals_.find(assignment.name);
+    if (local != locals_.end()) {
+        // && and || write their result early, so a value that reads the
+        // local is built elsewhere first.
+        uint16_t reg = local->second;
+        if (mentions(assignment.value.get(), assignment.name)) {
+            uint16_t mark = nextRegister_;
+            uint16_t value = compileExpression(assignment.value.get());
+            nextRegister_ = mark;
+            if (value != reg) emit(Opcode::MOVE, reg, value);
+        } else {
+            compileExpression(assignment.value.get(), reg);
+        }
+        if (dst >= 0 && dst != reg) {
+            emit(Opcode::MOVE, static_cast<uint16_t>(dst), reg);
+            return static_cast<uint16_t>(dst);
+        }
+        return reg;
+    }
+    uint16_t reg = compileExpression(assignment.value.get(), dst);
+    auto global = module_.globals.find(assignment.name);
+    if (global != module_.globals.end()) {
+        emit(Opcode::SET_GLOBAL, reg, global->second);
+    } else {
+        emit(Opcode::THROW_REFERENCE, reg, static_cast<uint16_t>(assignment.name.id >> 16),
+             static_cast<uint16_t>(assignment.name.id & 0xFFFF));
+    }
+    return reg;
+}
+
+// Declarations in the block go out of scope, and free their registers, at
+// its end.
+void FunctionCompiler::compileBlock(const NodeList& body) {
+    uint16_t mark = nextRegister_;
+    auto outer = locals_;
+    for (const auto& stmt : body) {
+        compileStatement(stmt.get(), false);
+    }
+    locals_ = std::move(outer);
+    nextRegister_ = mark;
+}
+
+uint16_t FunctionCompiler::compileCall(const CallExpression& call, int dst) {
+    uint16_t mark = nextRegister_;
+    auto argc = call.arguments.size();
+    if (argc >= MaxOperand) {
+        throw std::runtime_error("Too many call arguments");
+    }
+
+    if (isConsoleLog(call.callee.get())) {
+        uint16_t base = nextRegister_;
+        for (size_t i = 0; i < argc; i++) {
+            uint16_t reg = allocateRegister();
+            compileExpression(call.arguments[i].get(), reg);
+            nextRegister_ = static_cast<uint16_t>(reg + 1);
+        }
+        emit(Opcode::PRINT, base, static_cast<uint16_t>(argc));
+        nextRegister_ = mark;
+        uint16_t reg = target(dst);
+        emit(Opcode::LOAD_UNDEFINED, reg);
+        return reg;
+    }
+
+    uint16_t base = allocateRegister();
+    compileExpression(call.callee.get(), base);
+    for (size_t i = 0; i < argc; i++) {
+        uint16_t reg = allocateRegister();
+        compileExpression(call.arguments[i].get(), reg);
+        nextRegister_ = static_cast<uint16_t>(reg + 1);
+    }
+    nextRegister_ = mark;
+    uint16_t reg = target(dst);
+    emit(Opcode::CALL, reg, base, static_cast<uint16_t>(argc));
+    return reg;
+}
+
+void FunctionCompiler::compileStatement(const ASTNode* node, bool topLevel) {
+    uint16_t mark = nextRegister_;
+
+    switch (node->type) {
+        case NodeType::VARIABLE_DECLARATION: {
+            auto* decl = static_cast<const VariableDeclaration*>(node);
+            if (topLevel) {
+                uint16_t reg = decl->init ? compileExpression(decl->init.get()) : target(-1);
+                if (!decl->init) emit(Opcode::LOAD_UNDEFINED, reg);
+                emit(Opcode::SET_GLOBAL, reg, module_.globals.at(decl->name));
+                nextRegister_ = mark;
+            } else {
+                // The local's register is reserved past this statement.
+                uint16_t reg = declareLocal(decl->name);
+                if (decl->init) {
+                    compileExpression(decl->init.get(), reg);
+                } else {
+                    emit(Opcode::LOAD_UNDEFINED, reg);
+                }
+            }
+            return;
+        }
+        case NodeType::FUNCTION_DECLARATION:
+            // Top-level functions are bound before any statement runs.
+            if (!topLevel) {
+                throw std::runtime_error("Nested function declarations are not supported");
+            }
+            return;
+        case NodeType::RETURN_STATEMENT: {
+            auto* ret = static_cast<const ReturnStatement*>(node);
+            uint16_t reg;
+            if (ret->argument) {
+                reg = compileExpression(ret->argument.get());
+            } else {
+                reg = target(-1);
+                emit(Opcode::LOAD_UNDEFINED, reg);
+            }
+            emit(Opcode::RETURN, reg);
+            nextRegister_ = mark;
+            return;
+        }
+        case NodeType::BLOCK_STATEMENT:
+            compileBlock(static_cast<const BlockStatement*>(node)->body);
+            return;
+        case NodeType::IF_STATEMENT: {
+            auto* branch = static_cast<const IfStatement*>(node);
+            uint16_t test = compileExpression(branch->test.get());
+            size_t skip = emit(Opcode::JUMP_IF_FALSE, test);
+            nextRegister_ = mark;
+            compileStatement(branch->consequent.get(), false);
+            if (branch->alternate) {
+                size_t end = emit(Opcode::JUMP);
+                patchTarget(skip);
+                compileStatement(branch->alternate.get(), false);
+                patchTarget(end);
+            } else {
+                patchTarget(skip);
+            }
+            nextRegister_ = mark;
+            return;
+        }
+        case NodeType::WHILE_STATEMENT: {
+            auto* loop = static_cast<const WhileStatement*>(node);
+            size_t start = function_.code.size();
+            uint16_t test = compileExpression(loop->test.get());
+            size_t exit = emit(Opcode::JUMP_IF_FALSE, test);
+            nextRegister_ = mark;
+            compileStatement(loop->body.get(), false);
+            patchTarget(emit(Opcode::JUMP), start);
+            patchTarget(exit);
+            nextRegister_ = mark;
+            return;
+        }
+        default:
+            compileExpression(node);
+            nextRegister_ = mark;
+            return;
+    }
+}
+
+uint32_t ModuleCompiler::compileFunction(const FunctionDeclaration& decl) {
+    if (decl.params.size() >= MaxOperand) {
+        throw std::runtime_error("Too many parameters");
+    }
+    auto index = static_cast<uint32_t>(module.functions.size());
+    module.functions.emplace_back();
+    BytecodeFunction function;
+    function.name = decl.name;
+    function.paramCount = static_cast<uint16_t>(decl.params.size());
+
+    FunctionCompiler compiler(*this, function);
+    compiler.setAssigns(containsAssignment(&decl));
+    for (Atom param : decl.params) {
+        compiler.declareLocal(param);
+    }
+    for (const auto& stmt : decl.body) {
+        compiler.compileStatement(stmt.get(), false);
+    }
+    compiler.finish();
+
+    module.functions[index] = std::move(function);
+    return index;
+}
+
+void ModuleCompiler::compileProgram(const ASTNode* root) {
+    module.functions.emplace_back();
+    BytecodeFunction main;
+    main.name = atoms::empty;
+
+    const NodeList* statements = nullptr;
+    NodeList single;
+    if (auto* program = node_cast<Program>(root)) {
+        statements = &program->body;
+    } else {
+        statements = &single;
+    }
+
+    // Declare every top-level name first so function bodies can refer to
+    // globals defined after them.
+    auto each = [&](auto&& fn) {
+        if (statements == &single) {
+            if (root) fn(root);
+        } else {
+            for (const auto& stmt : *statements) fn(stmt.get());
+        }
+    };
+    each([&](const ASTNode* stmt) {
+        if (auto* var = node_cast<VariableDeclaration>(stmt)) declareGlobal(var->name);
+        if (auto* fn = node_cast<FunctionDeclaration>(stmt)) declareGlobal(fn->name);
+    });
+
+    FunctionCompiler compiler(*this, main);
+    each([&](const ASTNode* stmt) {
+        if (auto* fn = node_cast<FunctionDeclaration>(stmt)) {
+            uint32_t index = compileFunction(*fn);
+            if (index >= MaxOperand) {
+                throw std::runtime_error("Too many functions");
+            }
+            compiler.emitFunctionBinding(index, globals.at(fn->name));
+        }
+    });
+    each([&](const ASTNode* stmt) { compiler.compileStatement(stmt, true); });
+    compiler.finish();
+
+    module.functions[0] = std::move(main);
+}
+
+const char* const opcodeNames[] = {
+#define JS_OPCODE_NAME(name) #name,
+    JS_OPCODES(JS_OPCODE_NAME)
+#undef JS_OPCODE_NAME
+};
+
+} // namespace
+
+const char* opcodeName(Opcode op) {
+    return opcodeNames[static_cast<size_t>(op)];
+}
+
+BytecodeModule compileToBytecode(const ASTNode* program) {
+    ModuleCompiler compiler;
+    compiler.compileProgram(program);
+    return std::move(compiler.module);
+}
+
+void BytecodeModule::disassemble(std::ostream& out) const {
+    const AtomTable& atoms = AtomTable::current();
+    for (size_t i = 0; i < functions.size(); i++) {
+        const BytecodeFunction& fn = functions[i];
+        out << "function #" << i << " " << (i == 0 ? "<main>" : atoms.text(fn.name))
+            << " (params " << fn.paramCount << ", registers " << fn.registerCount << ")\n";
+        for (size_t pc = 0; pc < fn.code.size(); pc++) {
+            const Instruction& ins = fn.code[pc];
+            out << "  " << pc << "\t" << opcodeName(ins.op) << "\t" << ins.a << ", " << ins.b << ", " << ins.c;
+            if (ins.op == Opcode::LOAD_CONST) {
+                out << "\t; " << toString(fn.constants[ins.b]);
+            } else if (ins.op == Opcode::GET_GLOBAL || ins.op == Opcode::SET_GLOBAL) {
+                out << "\t; " << atoms.text(globals[ins.b]);
+            }
+            out << "\n";
+        }
+    }
+}
+
+} // namespace js
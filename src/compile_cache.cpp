@@ -0,0 +1,172 @@
+#include "../include/compile_cache.hpp"
+#include "../include/hash.hpp"
+#include "../include/source_buffer.hpp"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef JS_COMPILER_VERSION
+#define JS_COMPILER_VERSION "unknown"
+#endif
+
+namespace js {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr const char* ManifestHeader = "js_compiler-cache 1";
+
+std::string hex(uint64_t value) {
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+    return buffer;
+}
+
+long processId() {
+#ifdef _WIN32
+    return _getpid();
+#else
+    return static_cast<long>(getpid());
+#endif
+}
+
+// Writes through a temporary file and a rename, so concurrent compilers
+// never see a partial file. The temporary is named after the process and
+// thread, so no other writer shares it.
+bool writeAtomically(const fs::path& path, std::string_view data) {
+    std::ostringstream suffix;
+    suffix << ".tmp" << processId() << "-" << std::this_thread::get_id();
+    fs::path temporary = path;
+    temporary += suffix.str();
+    std::error_code error;
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size());
+    // Closing flushes, so a full disk only shows up here.
+    out.close();
+    if (!out) {
+        fs::remove(temporary, error);
+        return false;
+    }
+    fs::rename(temporary, path, error);
+    if (error) {
+        fs::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+CompileCache::CompileCache(fs::path directory, std::string_view configuration)
+    : directory_(std::move(directory)), configuration_(hashString(configuration)) {
+    std::error_code error;
+    fs::create_directories(directory_ / "objects", error);
+    if (error) {
+        throw std::runtime_error("Could not create cache directory " + directory_.string() + ": " +
+                                 error.message());
+    }
+    loadManifest();
+}
+
+void CompileCache::loadManifest() {
+    std::ifstream in(manifestPath());
+    std::string line;
+    if (!std::getline(in, line) || line != ManifestHeader) {
+        return;
+    }
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        FileState state;
+        std::string hash;
+        if (!(fields >> state.size >> state.modified >> hash)) continue;
+        state.hash = std::strtoull(hash.c_str(), nullptr, 16);
+        std::string path;
+        fields.get();
+        std::getline(fields, path);
+        if (!path.empty()) {
+            manifest_[path] = state;
+        }
+    }
+}
+
+void CompileCache::save() {
+    std::string data;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!dirty_) return;
+        data = std::string(ManifestHeader) + "\n";
+        for (const auto& [path, state] : manifest_) {
+            data += std::to_string(state.size) + " " + std::to_string(state.modified) + " " +
+                    hex(state.hash) + " " + path + "\n";
+        }
+        dirty_ = false;
+    }
+    writeAtomically(manifestPath(), data);
+}
+
+CompileCache::Key CompileCache::keyFor(const std::string& path) {
+    std::error_code error;
+    std::string absolute = fs::absolute(path, error).lexically_normal().string();
+    uint64_t size = fs::file_size(path, error);
+    int64_t modified = error ? 0 : fs::last_write_time(path, error).time_since_epoch().count();
+    if (!error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = manifest_.find(absolute);
+        if (it != manifest_.end() && it->second.size == size && it->second.modified == modified) {
+            return Key{hashBytes(&it->second.hash, sizeof(uint64_t), configuration_), size};
+        }
+    }
+
+    SourceBuffer source(path);
+    uint64_t contentHash = hashBytes(source.data(), source.size());
+    if (!error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        manifest_[absolute] = FileState{size, modified, contentHash};
+        dirty_ = true;
+    }
+    return Key{hashBytes(&contentHash, sizeof(contentHash), configuration_), source.size()};
+}
+
+fs::path CompileCache::entryPath(Key key) const {
+    return directory_ / "objects" / (hex(key.hash) + "-" + hex(key.size));
+}
+
+std::optional<std::string> CompileCache::load(Key key) const {
+    std::ifstream in(entryPath(key), std::ios::binary);
+    if (!in) {
+        return std::nullopt;
+    }
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    if (!in) {
+        return std::nullopt;
+    }
+    return contents.str();
+}
+
+void CompileCache::store(Key key, std::string_view output) {
+    writeAtomically(entryPath(key), output);
+}
+
+std::string compilerBuildId() {
+    std::string id = "js_compiler " JS_COMPILER_VERSION;
+#ifdef __linux__
+    try {
+        SourceBuffer executable("/proc/self/exe");
+        id += " " + hex(hashBytes(executable.data(), executable.size()));
+    } catch (const std::exception&) {
+    }
+#endif
+    return id;
+}
+
+} // namespace js
@@ -0,0 +1,327 @@
+#include "../include/evaluator.hpp"
+#include "../include/hash.hpp"
+#include "../include/operations.hpp"
+#include "../include/visitor.hpp"
+#include <memory_resource>
+
+namespace js {
+
+namespace {
+
+constexpr uint32_t NoFunction = UINT32_MAX;
+
+class Declarations : public ASTVisitor<Declarations> {
+public:
+    explicit Declarations(NameSet& names) : names_(names) {}
+    void visitVariableDeclaration(const VariableDeclaration& node) {
+        names_.insert(node.name);
+        visitChild(node.init);
+    }
+
+private:
+    NameSet& names_;
+};
+
+// Whether a body stays within its own variables, and which functions it
+// calls. Any other name it mentions is a global, which a pure function
+// may neither read nor assign.
+class PurityScan : public ASTVisitor<PurityScan> {
+public:
+    bool pure = true;
+
+    PurityScan(const FunctionDeclaration& function, const std::vector<uint32_t>& callable, NameSet& locals,
+               std::vector<uint32_t>& callees)
+        : callable_(callable), locals_(locals), callees_(callees) {
+        locals_.clear();
+        for (Atom param : function.params) locals_.insert(param);
+        Declarations declarations(locals_);
+        for (const auto& stmt : function.body) declarations.visit(stmt.get());
+        visitList(function.body);
+    }
+
+    void visitIdentifier(const Identifier& node) { pure = pure && locals_.contains(node.name); }
+    void visitAssignmentExpression(const AssignmentExpression& node) {
+        pure = pure && locals_.contains(node.name);
+        visitChild(node.value);
+    }
+    void visitMemberExpression(const MemberExpression&) { pure = false; }
+    void visitFunctionDeclaration(const FunctionDeclaration&) { pure = false; }
+    void visitCallExpression(const CallExpression& node) {
+        auto* callee = node_cast<Identifier>(node.callee.get());
+        if (callee && !locals_.contains(callee->name) && callee->name.id < callable_.size() &&
+            callable_[callee->name.id] != NoFunction) {
+            callees_.push_back(callable_[callee->name.id]);
+        } else {
+            pure = false;
+        }
+        visitList(node.arguments);
+    }
+
+private:
+    const std::vector<uint32_t>& callable_;
+    NameSet& locals_;
+    std::vector<uint32_t>& callees_;
+};
+
+// Kept per thread between programs, like the SSA workspace.
+struct PurityWorkspace {
+    NameSet locals;
+    // Callees of f are callees[calleeStart[f], calleeStart[f + 1]).
+    std::vector<uint32_t> calleeStart;
+    std::vector<uint32_t> callees;
+};
+
+} // namespace
+
+void findPureFunctions(const std::vector<NodePtr*>& functions, const std::vector<uint32_t>& callable,
+                       std::vector<bool>& pure) {
+    thread_local PurityWorkspace ws;
+    ws.calleeStart.clear();
+    ws.callees.clear();
+    pure.assign(functions.size(), false);
+    for (size_t f = 0; f < functions.size(); f++) {
+        ws.calleeStart.push_back(static_cast<uint32_t>(ws.callees.size()));
+        PurityScan scan(static_cast<const FunctionDeclaration&>(**functions[f]), callable, ws.locals, ws.callees);
+        pure[f] = scan.pure;
+    }
+    ws.calleeStart.push_back(static_cast<uint32_t>(ws.callees.size()));
+    ws.locals.clear();
+    // Calling an impure function is impure, and so is calling that caller.
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t f = 0; f < functions.size(); f++) {
+            if (!pure[f]) continue;
+            for (uint32_t e = ws.calleeStart[f]; e < ws.calleeStart[f + 1]; e++) {
+                if (!pure[ws.callees[e]]) {
+                    pure[f] = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+size_t CallEvaluator::CallKeyHash::operator()(const CallKey& key) const {
+    return hashBytes(key.arguments.data(), key.arguments.size() * sizeof(Value),
+                     reinterpret_cast<uintptr_t>(key.function));
+}
+
+// One outermost call and the calls it makes, sharing its fuel. Variables
+// live on one stack; each call only sees the part above its frame. Kept
+// per thread between outermost calls, with the memo's nodes pooled.
+class Evaluation {
+public:
+    std::optional<Value> run(const FunctionTargets& targets, const CallEvaluator::CallKey& key) {
+        targets_ = &targets;
+        memo_.clear();
+        variables_.clear();
+        fuel_ = CallEvaluator::Fuel;
+        depth_ = 0;
+        frame_ = 0;
+        return call(key);
+    }
+
+private:
+    // Once fuel runs out every call fails, so a failure is memoized either
+    // way. A call is memoized as failing while it runs: a pure call that
+    // reaches itself with the same arguments never returns.
+    std::optional<Value> call(const CallEvaluator::CallKey& key) {
+        auto [entry, inserted] = memo_.try_emplace(key);
+        if (!inserted || depth_ == CallEvaluator::MaxDepth) return entry->second;
+        std::optional<Value>& result = entry->second;
+        const FunctionDeclaration& function = *key.function;
+        size_t outerFrame = frame_;
+        frame_ = variables_.size();
+        depth_++;
+        const auto& params = function.params;
+        for (size_t i = 0; i < params.size(); i++) {
+            variables_.push_back(Variable{params[i], i < key.arguments.size() ? key.arguments[i] : Value(), true});
+        }
+        Value returned;
+        Flow flow = list(function.body, returned);
+        variables_.resize(frame_);
+        frame_ = outerFrame;
+        depth_--;
+        if (flow != Flow::FAIL) result = flow == Flow::RETURN ? returned : Value();
+        return result;
+    }
+
+    enum class Flow { NEXT, RETURN, FAIL };
+    struct Variable {
+        Atom name;
+        Value value;
+        bool initialized; // reading a `let` before its declaration runs throws
+    };
+
+    const FunctionTargets* targets_ = nullptr;
+    std::pmr::unsynchronized_pool_resource pool_;
+    CallEvaluator::Memo memo_{&pool_};
+    size_t fuel_ = CallEvaluator::Fuel;
+    size_t depth_ = 0;
+    std::vector<Variable> variables_;
+    size_t frame_ = 0;
+
+    bool spend(size_t amount) {
+        if (fuel_ < amount) {
+            fuel_ = 0;
+            return false;
+        }
+        fuel_ -= amount;
+        return true;
+    }
+
+    Variable* find(Atom name) {
+        for (size_t i = variables_.size(); i-- > frame_;) {
+            if (variables_[i].name == name) return &variables_[i];
+        }
+        return nullptr;
+    }
+
+    // A block's `let`s exist from its start.
+    Flow list(const NodeList& body, Value& returned) {
+        size_t scope = variables_.size();
+        for (const auto& stmt : body) {
+            if (auto* decl = node_cast<VariableDeclaration>(stmt.get())) {
+                variables_.push_back(Variable{decl->name, Value(), false});
+            }
+        }
+        Flow flow = Flow::NEXT;
+        for (const auto& stmt : body) {
+            flow = statement(stmt.get(), returned);
+            if (flow != Flow::NEXT) break;
+        }
+        variables_.resize(scope);
+        return flow;
+    }
+
+    Flow statement(const ASTNode* node, Value& returned) {
+        if (!spend(1)) return Flow::FAIL;
+        switch (node->type) {
+            case NodeType::VARIABLE_DECLARATION: {
+                auto* decl = static_cast<const VariableDeclaration*>(node);
+                Value value;
+                if (decl->init && !expression(decl->init.get(), value)) return Flow::FAIL;
+                Variable* variable = find(decl->name);
+                if (!variable || variable->initialized) return Flow::FAIL;
+                variable->value = value;
+                variable->initialized = true;
+                return Flow::NEXT;
+            }
+            case NodeType::RETURN_STATEMENT: {
+                auto* ret = static_cast<const ReturnStatement*>(node);
+                returned = Value();
+                if (ret->argument && !expression(ret->argument.get(), returned)) return Flow::FAIL;
+                return Flow::RETURN;
+            }
+            case NodeType::BLOCK_STATEMENT:
+                return list(static_cast<const BlockStatement*>(node)->body, returned);
+            case NodeType::IF_STATEMENT: {
+                auto* branch = static_cast<const IfStatement*>(node);
+                Value test;
+                if (!expression(branch->test.get(), test)) return Flow::FAIL;
+                const ASTNode* taken = isTruthy(test) ? branch->consequent.get() : branch->alternate.get();
+                return taken ? statement(taken, returned) : Flow::NEXT;
+            }
+            case NodeType::WHILE_STATEMENT: {
+                auto* loop = static_cast<const WhileStatement*>(node);
+                for (;;) {
+                    Value test;
+                    if (!expression(loop->test.get(), test)) return Flow::FAIL;
+                    if (!isTruthy(test)) return Flow::NEXT;
+                    Flow flow = statement(loop->body.get(), returned);
+                    if (flow != Flow::NEXT) return flow;
+                }
+            }
+            case NodeType::FUNCTION_DECLARATION:
+            case NodeType::PROGRAM:
+                return Flow::FAIL;
+            default: {
+                Value ignored;
+                return expression(node, ignored) ? Flow::NEXT : Flow::FAIL;
+            }
+        }
+    }
+
+    bool expression(const ASTNode* node, Value& result) {
+        if (!spend(1)) return false;
+        switch (node->type) {
+            case NodeType::LITERAL:
+                result = static_cast<const Literal*>(node)->value;
+                return true;
+            case NodeType::IDENTIFIER: {
+                Variable* variable = find(static_cast<const Identifier*>(node)->name);
+                if (!variable || !variable->initialized) return false;
+                result = variable->value;
+                return true;
+            }
+            case NodeType::UNARY_EXPRESSION: {
+                auto* unary = static_cast<const UnaryExpression*>(node);
+                if (!expression(unary->argument.get(), result)) return false;
+                result = evaluateUnary(unary->op, result);
+                return true;
+            }
+            case NodeType::BINARY_EXPRESSION: {
+                auto* binary = static_cast<const BinaryExpression*>(node);
+                Value left, right;
+                if (!expression(binary->left.get(), left)) return false;
+                if (binary->op == BinaryOp::AND || binary->op == BinaryOp::OR) {
+                    if (isTruthy(left) == (binary->op == BinaryOp::OR)) {
+                        result = left;
+                        return true;
+                    }
+                    return expression(binary->right.get(), result);
+                }
+                if (!expression(binary->right.get(), right)) return false;
+                result = evaluateBinary(binary->op, left, right);
+                if (result.isString()) {
+                    // Building a string costs fuel by its length.
+                    size_t length = AtomTable::current().text(result.asAtom()).size();
+                    if (length > CallEvaluator::MaxStringLength || !spend(length / 64)) return false;
+                }
+                return true;
+            }
+            case NodeType::ASSIGNMENT_EXPRESSION: {
+                auto* assignment = static_cast<const AssignmentExpression*>(node);
+                if (!expression(assignment->value.get(), result)) return false;
+                Variable* variable = find(assignment->name);
+                if (!variable || !variable->initialized) return false;
+                variable->value = result;
+                return true;
+            }
+            case NodeType::CALL_EXPRESSION: {
+                auto* call = static_cast<const CallExpression*>(node);
+                auto* callee = node_cast<Identifier>(call->callee.get());
+                if (!callee || find(callee->name)) return false;
+                const FunctionTargets& targets = *targets_;
+                if (callee->name.id >= targets.size() || !targets[callee->name.id]) return false;
+                CallEvaluator::CallKey key{targets[callee->name.id],
+                                           std::pmr::vector<Value>(call->arguments.size(), &pool_)};
+                for (size_t i = 0; i < key.arguments.size(); i++) {
+                    if (!expression(call->arguments[i].get(), key.arguments[i])) return false;
+                }
+                std::optional<Value> value = this->call(key);
+                if (!value) return false;
+                result = *value;
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+};
+
+std::optional<Value> CallEvaluator::call(const FunctionDeclaration& function, const std::vector<Value>& arguments) {
+    CallKey key{&function, {arguments.begin(), arguments.end()}};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (auto it = memo_.find(key); it != memo_.end()) return it->second;
+    }
+    thread_local Evaluation evaluation;
+    std::optional<Value> result = evaluation.run(targets_, key);
+    std::lock_guard<std::mutex> lock(mutex_);
+    memo_.emplace(std::move(key), result);
+    return result;
+}
+
+} // namespace js
@@ -0,0 +1,410 @@
+#include "../include/flat_ast.hpp"
+#include "../include/visitor.hpp"
+#include <iostream>
+#include <string>
+
+namespace js {
+
+namespace {
+
+// Sizes the arrays exactly before conversion.
+class NodeCounter : public ASTVisitor<NodeCounter> {
+public:
+    size_t nodes = 0;
+    size_t numbers = 0;
+    size_t functions = 0;
+
+    void visitProgram(const Program& node) { nodes++; ASTVisitor::visitProgram(node); }
+    void visitVariableDeclaration(const VariableDeclaration& node) {
+        nodes++;
+        ASTVisitor::visitVariableDeclaration(node);
+    }
+    void visitFunctionDeclaration(const FunctionDeclaration& node) {
+        nodes += 1 + node.params.size();
+        functions++;
+        ASTVisitor::visitFunctionDeclaration(node);
+    }
+    void visitReturnStatement(const ReturnStatement& node) { nodes++; ASTVisitor::visitReturnStatement(node); }
+    void visitBinaryExpression(const BinaryExpression& node) { nodes++; ASTVisitor::visitBinaryExpression(node); }
+    void visitCallExpression(const CallExpression& node) { nodes++; ASTVisitor::visitCallExpression(node); }
+    void visitIdentifier(const Identifier&) { nodes++; }
+    void visitLiteral(const Literal& node) {
+        nodes++;
+        if (node.value.isNumber()) numbers++;
+    }
+    void visitUnaryExpression(const UnaryExpression& node) { nodes++; ASTVisitor::visitUnaryExpression(node); }
+    void visitMemberExpression(const MemberExpression& node) { nodes++; ASTVisitor::visitMemberExpression(node); }
+    void visitBlockStatement(const BlockStatement& node) { nodes++; ASTVisitor::visitBlockStatement(node); }
+    void visitIfStatement(const IfStatement& node) { nodes++; ASTVisitor::visitIfStatement(node); }
+    void visitWhileStatement(const WhileStatement& node) { nodes++; ASTVisitor::visitWhileStatement(node); }
+    void visitAssignmentExpression(const AssignmentExpression& node) {
+        nodes++;
+        ASTVisitor::visitAssignmentExpression(node);
+    }
+};
+
+template<typename T>
+size_t vectorBytes(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+} // namespace
+
+FlatAST FlatAST::fromTree(const ASTNode* root) {
+    FlatAST ast;
+    if (root) {
+        NodeCounter counter;
+        counter.visit(root);
+        ast.kinds.reserve(counter.nodes);
+        ast.ops.reserve(counter.nodes);
+        ast.payloads.reserve(counter.nodes);
+        ast.firstChild.reserve(counter.nodes);
+        ast.nextSibling.reserve(counter.nodes);
+        ast.numbers.reserve(counter.numbers);
+        ast.functions.reserve(counter.functions);
+        ast.appendTree(root);
+    }
+    return ast;
+}
+
+NodeIndex FlatAST::append(NodeType kind, uint8_t op, uint32_t payload) {
+    auto index = static_cast<NodeIndex>(kinds.size());
+    kinds.push_back(kind);
+    ops.push_back(op);
+    payloads.push_back(payload);
+    firstChild.push_back(NoNode);
+    nextSibling.push_back(NoNode);
+    return index;
+}
+
+void FlatAST::link(NodeIndex parent, NodeIndex& last, NodeIndex child) {
+    if (last == NoNode) {
+        firstChild[parent] = child;
+    } else {
+        nextSibling[last] = child;
+    }
+    last = child;
+}
+
+NodeIndex FlatAST::appendTree(const ASTNode* node) {
+    NodeIndex index = NoNode;
+    NodeIndex last = NoNode;
+    auto appendChild = [&](const NodePtr& child) {
+        if (child) {
+            NodeIndex childIndex = appendTree(child.get());
+            link(index, last, childIndex);
+        }
+    };
+
+    switch (node->type) {
+        case NodeType::PROGRAM: {
+            index = append(node->type, 0, 0);
+            for (const auto& stmt : static_cast<const Program*>(node)->body) appendChild(stmt);
+            break;
+        }
+        case NodeType::VARIABLE_DECLARATION: {
+            auto* decl = static_cast<const VariableDeclaration*>(node);
+            index = append(node->type, 0, decl->name.id);
+            appendChild(decl->init);
+            break;
+        }
+        case NodeType::FUNCTION_DECLARATION: {
+            auto* decl = static_cast<const FunctionDeclaration*>(node);
+            index = append(node->type, 0, static_cast<uint32_t>(functions.size()));
+            functions.push_back(Function{decl->name, static_cast<uint32_t>(decl->params.size())});
+            for (Atom param : decl->params) {
+                link(index, last, append(NodeType::IDENTIFIER, 0, param.id));
+            }
+            for (const auto& stmt : decl->body) appendChild(stmt);
+            break;
+        }
+        case NodeType::RETURN_STATEMENT:
+            index = append(node->type, 0, 0);
+            appendChild(static_cast<const ReturnStatement*>(node)->argument);
+            break;
+        case NodeType::BINARY_EXPRESSION: {
+            auto* binary = static_cast<const BinaryExpression*>(node);
+            index = append(node->type, static_cast<uint8_t>(binary->op), 0);
+            appendChild(binary->left);
+            appendChild(binary->right);
+            break;
+        }
+        case NodeType::CALL_EXPRESSION: {
+            auto* call = static_cast<const CallExpression*>(node);
+            index = append(node->type, 0, 0);
+            appendChild(call->callee);
+            for (const auto& arg : call->arguments) appendChild(arg);
+            break;
+        }
+        case NodeType::IDENTIFIER:
+            index = append(node->type, 0, static_cast<const Identifier*>(node)->name.id);
+            break;
+        case NodeType::LITERAL: {
+            Value value = static_cast<const Literal*>(node)->value;
+            if (value.isNumber()) {
+                index = append(node->type, static_cast<uint8_t>(LiteralKind::NUMBER),
+                               static_cast<uint32_t>(numbers.size()));
+                numbers.push_back(value.asNumber());
+            } else if (value.isString()) {
+                index = append(node->type, static_cast<uint8_t>(LiteralKind::STRING), value.asAtom().id);
+            } else if (value.isBoolean()) {
+                index = append(node->type, static_cast<uint8_t>(LiteralKind::BOOLEAN), value.asBool());
+            } else if (value.isNull()) {
+                index = append(node->type, static_cast<uint8_t>(LiteralKind::NULL_VALUE), 0);
+            } else {
+                index = append(node->type, static_cast<uint8_t>(LiteralKind::UNDEFINED), 0);
+            }
+            break;
+        }
+        case NodeType::UNARY_EXPRESSION: {
+            auto* unary = static_cast<const UnaryExpression*>(node);
+            index = append(node->type, static_cast<uint8_t>(unary->op), 0);
+            appendChild(unary->argument);
+            break;
+        }
+        case NodeType::MEMBER_EXPRESSION: {
+            auto* member = static_cast<const MemberExpression*>(node);
+            index = append(node->type, 0, member->property.id);
+            appendChild(member->object);
+            break;
+        }
+        case NodeType::BLOCK_STATEMENT:
+            index = append(node->type, 0, 0);
+            for (const auto& stmt : static_cast<const BlockStatement*>(node)->body) appendChild(stmt);
+            break;
+        case NodeType::IF_STATEMENT: {
+            auto* branch = static_cast<const IfStatement*>(node);
+            index = append(node->type, 0, 0);
+            appendChild(branch->test);
+            appendChild(branch->consequent);
+            appendChild(branch->alternate);
+            break;
+        }
+        case NodeType::WHILE_STATEMENT: {
+            auto* loop = static_cast<const WhileStatement*>(node);
+            index = append(node->type, 0, 0);
+            appendChild(loop->test);
+            appendChild(loop->body);
+            break;
+        }
+        case NodeType::ASSIGNMENT_EXPRESSION: {
+            auto* assignment = static_cast<const AssignmentExpression*>(node);
+            index = append(node->type, 0, assignment->name.id);
+            appendChild(assignment->value);
+            break;
+        }
+    }
+    return index;
+}
+
+Value FlatAST::literal(NodeIndex node) const {
+    switch (literalKind(node)) {
+        case LiteralKind::NUMBER: return Value::fromNumber(numbers[payloads[node]]);
+        case LiteralKind::STRING: return Value::fromAtom(Atom{payloads[node]});
+        case LiteralKind::BOOLEAN: return Value::fromBool(payloads[node] != 0);
+        case LiteralKind::NULL_VALUE: return Value::null();
+        case LiteralKind::UNDEFINED: return Value::undefined();
+    }
+    return Value::undefined();
+}
+
+NodeIndex FlatAST::child(NodeIndex node, size_t n) const {
+    NodeIndex current = firstChild[node];
+    while (n-- > 0 && current != NoNode) {
+        current = nextSibling[current];
+    }
+    return current;
+}
+
+size_t FlatAST::childCount(NodeIndex node) const {
+    size_t count = 0;
+    for (NodeIndex c = firstChild[node]; c != NoNode; c = nextSibling[c]) count++;
+    return count;
+}
+
+NodePtr FlatAST::toTree(NodeIndex index) const {
+    if (index == NoNode || index >= size()) return nullptr;
+
+    switch (kinds[index]) {
+        case NodeType::PROGRAM: {
+            auto program = std::make_unique<Program>();
+            for (NodeIndex c : children(index)) program->body.push_back(toTree(c));
+            return std::move(program);
+        }
+        case NodeType::VARIABLE_DECLARATION: {
+            auto decl = std::make_unique<VariableDeclaration>();
+            decl->name = atom(index);
+            decl->init = toTree(firstChild[index]);
+            return std::move(decl);
+        }
+        case NodeType::FUNCTION_DECLARATION: {
+            auto decl = std::make_unique<FunctionDeclaration>();
+            const Function& fn = function(index);
+            decl->name = fn.name;
+            uint32_t n = 0;
+            for (NodeIndex c : children(index)) {
+                if (n++ < fn.paramCount) {
+                    decl->params.push_back(atom(c));
+                } else {
+                    decl->body.push_back(toTree(c));
+                }
+            }
+            return std::move(decl);
+        }
+        case NodeType::RETURN_STATEMENT: {
+            auto ret = std::make_unique<ReturnStatement>();
+            ret->argument = toTree(firstChild[index]);
+            return std::move(ret);
+        }
+        case NodeType::BINARY_EXPRESSION: {
+            auto binary = std::make_unique<BinaryExpression>();
+            binary->op = binaryOp(index);
+            binary->left = toTree(child(index, 0));
+            binary->right = toTree(child(index, 1));
+            return std::move(binary);
+        }
+        case NodeType::CALL_EXPRESSION: {
+            auto call = std::make_unique<CallExpression>();
+            bool first = true;
+            for (NodeIndex c : children(index)) {
+                if (first) {
+                    call->callee = toTree(c);
+                    first = false;
+                } else {
+                    call->arguments.push_back(toTree(c));
+                }
+            }
+            return std::move(call);
+        }
+        case NodeType::IDENTIFIER: {
+            auto identifier = std::make_unique<Identifier>();
+            identifier->name = atom(index);
+            return std::move(identifier);
+        }
+        case NodeType::LITERAL: {
+            auto lit = std::make_unique<Literal>();
+            lit->value = literal(index);
+            return std::move(lit);
+        }
+        case NodeType::UNARY_EXPRESSION: {
+            auto unary = std::make_unique<UnaryExpression>();
+            unary->op = unaryOp(index);
+            unary->argument = toTree(firstChild[index]);
+            return std::move(unary);
+        }
+        case NodeType::MEMBER_EXPRESSION: {
+            auto member = std::make_unique<MemberExpression>();
+            member->property = atom(index);
+            member->object = toTree(firstChild[index]);
+            return std::move(member);
+        }
+        case NodeType::BLOCK_STATEMENT: {
+            auto block = std::make_unique<BlockStatement>();
+            for (NodeIndex c : children(index)) block->body.push_back(toTree(c));
+            return std::move(block);
+        }
+        case NodeType::IF_STATEMENT: {
+            auto branch = std::make_unique<IfStatement>();
+            branch->test = toTree(child(index, 0));
+            branch->consequent = toTree(child(index, 1));
+            branch->alternate = toTree(child(index, 2));
+            return std::move(branch);
+        }
+        case NodeType::WHILE_STATEMENT: {
+            auto loop = std::make_unique<WhileStatement>();
+            loop->test = toTree(child(index, 0));
+            loop->body = toTree(child(index, 1));
+            return std::move(loop);
+        }
+        case NodeType::ASSIGNMENT_EXPRESSION: {
+            auto assignment = std::make_unique<AssignmentExpression>();
+            assignment->name = atom(index);
+            assignment->value = toTree(firstChild[index]);
+            return std::move(assignment);
+        }
+    }
+    return nullptr;
+}
+
+size_t FlatAST::bytesUsed() const noexcept {
+    return vectorBytes(kinds) + vectorBytes(ops) + vectorBytes(payloads) + vectorBytes(firstChild) +
+           vectorBytes(nextSibling) + vectorBytes(numbers) + vectorBytes(functions);
+}
+
+void FlatAST::print(NodeIndex node, int indent, std::ostream& out) const {
+    if (node == NoNode || node >= size()) return;
+    std::string indentation(indent * 2, ' ');
+    const AtomTable& atoms = AtomTable::current();
+
+    switch (kinds[node]) {
+        case NodeType::PROGRAM:
+            out << indentation << "Program" << std::endl;
+            break;
+        case NodeType::VARIABLE_DECLARATION:
+            out << indentation << "VariableDeclaration: " << atoms.text(atom(node)) << std::endl;
+            break;
+        case NodeType::FUNCTION_DECLARATION: {
+            const Function& fn = function(node);
+            out << indentation << "FunctionDeclaration: " << atoms.text(fn.name) << std::endl;
+            NodeIndex c = firstChild[node];
+            for (uint32_t i = 0; i < fn.paramCount; i++, c = nextSibling[c]) {
+                out << indentation << "  " << atoms.text(atom(c)) << std::endl;
+            }
+            for (; c != NoNode; c = nextSibling[c]) {
+                print(c, indent + 1, out);
+            }
+            return;
+        }
+        case NodeType::RETURN_STATEMENT:
+            out << indentation << "ReturnStatement" << std::endl;
+            break;
+        case NodeType::BINARY_EXPRESSION:
+            out << indentation << "BinaryExpression: " << opName(binaryOp(node)) << std::endl;
+            break;
+        case NodeType::CALL_EXPRESSION:
+            out << indentation << "CallExpression" << std::endl;
+            break;
+        case NodeType::IDENTIFIER:
+            out << indentation << "Identifier: " << atoms.text(atom(node)) << std::endl;
+            break;
+        case NodeType::LITERAL: {
+            Value value = literal(node);
+            out << indentation << "Literal: ";
+            if (value.isNumber()) {
+                out << value.asNumber();
+            } else if (value.isString()) {
+                out << atoms.text(value.asAtom());
+            } else if (value.isBoolean()) {
+                out << value.asBool();
+            } else {
+                out << toString(value);
+            }
+            out << std::endl;
+            break;
+        }
+        case NodeType::UNARY_EXPRESSION:
+            out << indentation << "UnaryExpression: " << opName(unaryOp(node)) << std::endl;
+            break;
+        case NodeType::MEMBER_EXPRESSION:
+            out << indentation << "MemberExpression: " << atoms.text(atom(node)) << std::endl;
+            break;
+        case NodeType::BLOCK_STATEMENT:
+            out << indentation << "BlockStatement" << std::endl;
+            break;
+        case NodeType::IF_STATEMENT:
+            out << indentation << "IfStatement" << std::endl;
+            break;
+        case NodeType::WHILE_STATEMENT:
+            out << indentation << "WhileStatement" << std::endl;
+            break;
+        case NodeType::ASSIGNMENT_EXPRESSION:
+            out << indentation << "AssignmentExpression: " << atoms.text(atom(node)) << std::endl;
+            break;
+    }
+
+    for (NodeIndex c : children(node)) {
+        print(c, indent + 1, out);
+    }
+}
+
+} // namespace js
@@ -0,0 +1,242 @@
+#include "../include/interpreter.hpp"
+#include "../include/jit.hpp"
+#include "../include/operations.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#if defined(__GNUC__)
+#define JS_COMPUTED_GOTO 1
+#else
+#define JS_COMPUTED_GOTO 0
+#endif
+
+namespace js {
+
+namespace {
+
+bool allNumbers(const Value* values, uint16_t count) {
+    for (uint16_t i = 0; i < count; i++) {
+        if (!values[i].isNumber()) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+Interpreter::Interpreter(const BytecodeModule& module, std::ostream& out)
+    : module_(module), out_(out), stack_(new Value[StackSize]), globals_(module.globals.size()), jit_(nullptr) {
+    frames_.reserve(64);
+}
+
+void Interpreter::setJit(Jit* jit) {
+    jit_ = jit;
+    callCounts_.assign(module_.functions.size(), 0);
+    native_.assign(module_.functions.size(), nullptr);
+}
+
+Value Interpreter::run() {
+    const Value* const stackEnd = stack_.get() + StackSize;
+    const BytecodeFunction* function = &module_.functions[0];
+    if (function->registerCount > StackSize) {
+        throw std::runtime_error("RangeError: Maximum call stack size exceeded");
+    }
+
+    Value* R = stack_.get();
+    const Value* K = function->constants.data();
+    const Instruction* code = function->code.data();
+    const Instruction* pc = code;
+    Value* G = globals_.data();
+    Instruction ins;
+
+    std::fill(R, R + function->registerCount, Value::undefined());
+    frames_.clear();
+    frames_.push_back(Frame{function, nullptr, R, 0});
+
+#if JS_COMPUTED_GOTO
+    static const void* const dispatchTable[] = {
+#define JS_OPCODE_LABEL(name) &&op_##name,
+        JS_OPCODES(JS_OPCODE_LABEL)
+#undef JS_OPCODE_LABEL
+    };
+#define DISPATCH()                                                  \
+    do {                                                            \
+        ins = *pc++;                                                \
+        goto *dispatchTable[static_cast<size_t>(ins.op)];           \
+    } while (0)
+#define OP(name) op_##name
+    DISPATCH();
+#else
+#define DISPATCH() goto dispatch
+#define OP(name) case Opcode::name
+dispatch:
+    ins = *pc++;
+    switch (ins.op) {
+#endif
+
+    OP(LOAD_CONST):
+        R[ins.a] = K[ins.b];
+        DISPATCH();
+    OP(LOAD_UNDEFINED):
+        R[ins.a] = Value::undefined();
+        DISPATCH();
+    OP(LOAD_FUNCTION):
+        R[ins.a] = Value::fromFunction(ins.b);
+        DISPATCH();
+    OP(MOVE):
+        R[ins.a] = R[ins.b];
+        DISPATCH();
+    OP(GET_GLOBAL):
+        R[ins.a] = G[ins.b];
+        DISPATCH();
+    OP(SET_GLOBAL):
+        G[ins.b] = R[ins.a];
+        DISPATCH();
+
+    OP(ADD): {
+        Value l = R[ins.b], r = R[ins.c];
+        R[ins.a] = l.isNumber() && r.isNumber() ? Value::fromNumber(l.asNumber() + r.asNumber())
+                                                 : evaluateBinary(BinaryOp::ADD, l, r);
+        DISPATCH();
+    }
+#define JS_ARITHMETIC(name, expr)                                                   \
+    OP(name): {                                                                     \
+        Value lv = R[ins.b], rv = R[ins.c];                                         \
+        double l = lv.isNumber() ? lv.asNumber() : toNumber(lv);                    \
+        double r = rv.isNumber() ? rv.asNumber() : toNumber(rv);                    \
+        R[ins.a] = Value::fromNumber(expr);                                         \
+        DISPATCH();                                                                 \
+    }
+    JS_ARITHMETIC(SUB, l - r)
+    JS_ARITHMETIC(MUL, l * r)
+    JS_ARITHMETIC(DIV, l / r)
+    JS_ARITHMETIC(POW, std::pow(l, r))
+    JS_ARITHMETIC(BIT_AND, static_cast<double>(toInt32(l) & toInt32(r)))
+    JS_ARITHMETIC(BIT_OR, static_cast<double>(toInt32(l) | toInt32(r)))
+#undef JS_ARITHMETIC
+
+#define JS_RELATIONAL(name, op)                                                     \
+    OP(name): {                                                                     \
+        Value l = R[ins.b], r = R[ins.c];                                           \
+        bool result = l.isNumber() && r.isNumber()                                  \
+            ? l.asNumber() op r.asNumber()                                          \
+            : evaluateBinary(BinaryOp::name, l, r).asBool();                        \
+        R[ins.a] = Value::fromBool(result);                                         \
+        DISPATCH();                                                                 \
+    }
+    JS_RELATIONAL(LT, <)
+    JS_RELATIONAL(GT, >)
+    JS_RELATIONAL(LE, <=)
+    JS_RELATIONAL(GE, >=)
+#undef JS_RELATIONAL
+
+    OP(EQ):
+        R[ins.a] = Value::fromBool(looselyEquals(R[ins.b], R[ins.c]));
+        DISPATCH();
+    OP(NE):
+        R[ins.a] = Value::fromBool(!looselyEquals(R[ins.b], R[ins.c]));
+        DISPATCH();
+
+    OP(NOT):
+        R[ins.a] = Value::fromBool(!isTruthy(R[ins.b]));
+        DISPATCH();
+    OP(NEG):
+        R[ins.a] = Value::fromNumber(-toNumber(R[ins.b]));
+        DISPATCH();
+    OP(PLUS):
+        R[ins.a] = Value::fromNumber(toNumber(R[ins.b]));
+        DISPATCH();
+
+    OP(JUMP):
+        pc = code + ins.target();
+        DISPATCH();
+    OP(JUMP_IF_FALSE):
+        if (!isTruthy(R[ins.a])) pc = code + ins.target();
+        DISPATCH();
+    OP(JUMP_IF_TRUE):
+        if (isTruthy(R[ins.a])) pc = code + ins.target();
+        DISPATCH();
+
+    OP(CALL): {
+        Value callee = R[ins.b];
+        if (!callee.isFunction()) {
+            throw std::runtime_error("TypeError: " + toString(callee) + " is not a function");
+        }
+        if (jit_) {
+            uint32_t index = callee.asFunction();
+            if (callCounts_[index] < Jit::HotCallCount && ++callCounts_[index] == Jit::HotCallCount) {
+                native_[index] = jit_->entry(index);
+            }
+            const JitEntry* native = native_[index];
+            if (native && ins.c == native->paramCount && allNumbers(R + ins.b + 1, ins.c)) {
+                if (jit_->invoke(*native, R + ins.b + 1, R[ins.a])) {
+                    DISPATCH();
+                }
+                // Out of native stack: this function stays interpreted.
+                native_[index] = nullptr;
+            }
+        }
+        const BytecodeFunction* target = &module_.functions[callee.asFunction()];
+        Value* frame = R + frames_.back().function->registerCount;
+        if (frames_.size() >= MaxFrames || frame + target->registerCount > stackEnd) {
+            throw std::runtime_error("RangeError: Maximum call stack size exceeded");
+        }
+
+        // Arguments sit below the new frame, so copying cannot overlap.
+        const Value* args = R + ins.b + 1;
+        uint16_t passed = ins.c < target->paramCount ? ins.c : target->paramCount;
+        std::copy(args, args + passed, frame);
+        std::fill(frame + passed, frame + target->registerCount, Value::undefined());
+
+        frames_.push_back(Frame{target, pc, frame, ins.a});
+        R = frame;
+        K = target->constants.data();
+        code = target->code.data();
+        pc = code;
+        DISPATCH();
+    }
+
+    OP(PRINT): {
+        for (uint16_t i = 0; i < ins.b; i++) {
+            if (i > 0) out_ << ' ';
+            out_ << toString(R[ins.a + i]);
+        }
+        out_ << '\n';
+        DISPATCH();
+    }
+
+    OP(THROW_REFERENCE): {
+        Atom name{static_cast<uint32_t>(ins.b) << 16 | ins.c};
+        throw std::runtime_error("ReferenceError: " + std::string(AtomTable::current().text(name)) +
+                                 " is not defined");
+    }
+
+    OP(RETURN): {
+        Value result = R[ins.a];
+        Frame done = frames_.back();
+        frames_.pop_back();
+        if (frames_.empty()) {
+            out_.flush();
+            return result;
+        }
+        const Frame& caller = frames_.back();
+        R = caller.registers;
+        K = caller.function->constants.data();
+        code = caller.function->code.data();
+        pc = done.returnPc;
+        R[done.resultRegister] = result;
+        DISPATCH();
+    }
+
+#if !JS_COMPUTED_GOTO
+    default:
+        break;
+    }
+    throw std::runtime_error("Invalid opcode");
+#endif
+#undef DISPATCH
+#undef OP
+}
+
+} // namespace js
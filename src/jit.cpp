@@ -0,0 +1,403 @@
+#include "../include/jit.hpp"
+#include "../include/x64.hpp"
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#if defined(__x86_64__) && !defined(_WIN32) && (defined(__unix__) || defined(__APPLE__))
+#define JS_JIT_AVAILABLE 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define JS_JIT_AVAILABLE 0
+#endif
+
+namespace js {
+
+namespace {
+
+using namespace x64;
+
+constexpr uint8_t REX = 0x40;
+constexpr uint8_t REX_W = 0x08;
+constexpr uint8_t PREFIX_66 = 0x66;
+constexpr uint8_t PREFIX_F2 = 0xF2;
+constexpr uint8_t RBP = 5;
+constexpr uint32_t Unbound = UINT32_MAX;
+
+// (prefix, opcode) of each SseOp, register forms.
+const uint8_t sseEncoding[][2] = {
+    {PREFIX_66, 0x28}, // movapd
+    {PREFIX_F2, 0x58}, // addsd
+    {PREFIX_F2, 0x5C}, // subsd
+    {PREFIX_F2, 0x59}, // mulsd
+    {PREFIX_F2, 0x5E}, // divsd
+    {PREFIX_66, 0x54}, // andpd
+    {PREFIX_66, 0x56}, // orpd
+    {PREFIX_66, 0x57}, // xorpd
+};
+
+double powHelper(double base, double exponent) {
+    return std::pow(base, exponent);
+}
+
+// Encodes X64Codegen output as machine code. Intra-buffer references (jumps,
+// calls and the constant pool) are rip-relative and patched by finish(), so
+// the result can be copied anywhere.
+class MachineCodeEmitter : public X64Emitter {
+public:
+    MachineCodeEmitter(size_t functionCount, const uintptr_t* stackLimit, const void* overflowHandler,
+                       const void* handlerArgument)
+        : functionOffsets_(functionCount, Unbound), stackLimit_(stackLimit) {
+        // Shared stack-overflow stub: handler(argument) never returns.
+        rex(true, 0, 7);
+        byte(0xB8 + 7); // mov rdi, imm64
+        imm64(reinterpret_cast<uint64_t>(handlerArgument));
+        rex(true, 0, 0);
+        byte(0xB8); // mov rax, imm64
+        imm64(reinterpret_cast<uint64_t>(overflowHandler));
+        byte(0xFF);
+        byte(0xD0); // call rax
+        byte(0x0F);
+        byte(0x0B); // ud2
+    }
+
+    uint32_t functionOffset(uint32_t index) const { return functionOffsets_[index]; }
+
+    void beginFunction(uint32_t index, uint32_t frameBytes) override {
+        if (index == TopLevel) {
+            throw std::runtime_error("JIT: top-level code is interpreted");
+        }
+        while (code_.size() % 16 != 0) byte(0xCC);
+        functionOffsets_[index] = static_cast<uint32_t>(code_.size());
+
+        byte(0x55); // push rbp
+        byte(0x48);
+        byte(0x89);
+        byte(0xE5); // mov rbp, rsp
+        if (frameBytes > 0) {
+            byte(0x48);
+            byte(0x81);
+            byte(0xEC); // sub rsp, imm32
+            imm32(frameBytes);
+        }
+        // mov r11, &stackLimit; cmp rsp, [r11]; jb overflow stub
+        byte(REX | REX_W | 1);
+        byte(0xB8 + 3);
+        imm64(reinterpret_cast<uint64_t>(stackLimit_));
+        byte(REX | REX_W | 1);
+        byte(0x3B);
+        byte(0x23);
+        byte(0x0F);
+        byte(0x82);
+        imm32(static_cast<uint32_t>(0 - (code_.size() + 4)));
+    }
+
+    void endFunction() override {}
+
+    void ret() override {
+        byte(0xC9); // leave
+        byte(0xC3);
+    }
+
+    Label newLabel() override {
+        labelOffsets_.push_back(Unbound);
+        return static_cast<Label>(labelOffsets_.size() - 1);
+    }
+
+    void bind(Label label) override { labelOffsets_[label] = static_cast<uint32_t>(code_.size()); }
+
+    void jump(Label label) override {
+        byte(0xE9);
+        labelFixups_.push_back({here(), label});
+        imm32(0);
+    }
+
+    void jumpIf(Condition condition, Label label) override {
+        byte(0x0F);
+        byte(condition == Condition::EQUAL ? 0x84 : 0x85);
+        labelFixups_.push_back({here(), label});
+        imm32(0);
+    }
+
+    void sse(SseOp op, Xmm dst, Xmm src) override {
+        if (op == SseOp::MOVE && dst.id == src.id) return;
+        const uint8_t* encoding = sseEncoding[static_cast<size_t>(op)];
+        registerForm(encoding[0], encoding[1], dst.id, src.id, false);
+    }
+
+    void compare(Predicate predicate, Xmm dst, Xmm src) override {
+        registerForm(PREFIX_F2, 0xC2, dst.id, src.id, false);
+        byte(static_cast<uint8_t>(predicate));
+    }
+
+    void ucomisd(Xmm left, Xmm right) override {
+        registerForm(PREFIX_66, 0x2E, left.id, right.id, false);
+    }
+
+    void bitwise(bool isOr, Xmm dst, Xmm src) override {
+        registerForm(PREFIX_F2, 0x2C, 0, dst.id, true); // cvttsd2si rax, dst
+        registerForm(PREFIX_F2, 0x2C, 1, src.id, true); // cvttsd2si rcx, src
+        byte(isOr ? 0x09 : 0x21);
+        byte(0xC8); // or/and eax, ecx
+        registerForm(PREFIX_F2, 0x2A, dst.id, 0, false); // cvtsi2sd dst, eax
+    }
+
+    void loadConstant(Xmm dst, uint64_t bits) override {
+        if (bits == 0) {
+            sse(SseOp::XOR, dst, dst);
+            return;
+        }
+        auto inserted = constants_.emplace(bits, static_cast<uint32_t>(constantBits_.size()));
+        if (inserted.second) constantBits_.push_back(bits);
+        byte(PREFIX_F2);
+        rex(false, dst.id, 0);
+        byte(0x0F);
+        byte(0x10);
+        byte(static_cast<uint8_t>(0x05 | (dst.id & 7) << 3)); // [rip + disp32]
+        constantFixups_.push_back({here(), inserted.first->second});
+        imm32(0);
+    }
+
+    void loadString(Xmm, Atom) override { throw std::runtime_error("JIT: strings are interpreted"); }
+    void loadGlobal(Xmm, uint32_t) override { throw std::runtime_error("JIT: globals are interpreted"); }
+    void storeGlobal(uint32_t, Xmm) override { throw std::runtime_error("JIT: globals are interpreted"); }
+
+    void loadSlot(Xmm dst, uint32_t slot) override { frameForm(0x10, dst.id, slot); }
+    void storeSlot(uint32_t slot, Xmm src) override { frameForm(0x11, src.id, slot); }
+
+    void callFunction(uint32_t index) override {
+        byte(0xE8);
+        callFixups_.push_back({here(), index});
+        imm32(0);
+    }
+
+    void callHelper(Helper helper) override {
+        if (helper != Helper::POW) {
+            throw std::runtime_error("JIT: printing is interpreted");
+        }
+        rex(true, 0, 0);
+        byte(0xB8); // mov rax, imm64
+        imm64(reinterpret_cast<uint64_t>(&powHelper));
+        byte(0xFF);
+        byte(0xD0); // call rax
+    }
+
+    // Resolves every fixup and appends the constant pool.
+    std::vector<uint8_t> finish() {
+        for (const Fixup& fixup : labelFixups_) {
+            patch(fixup.at, labelOffsets_[fixup.target]);
+        }
+        for (const Fixup& fixup : callFixups_) {
+            patch(fixup.at, functionOffsets_[fixup.target]);
+        }
+        while (code_.size() % 8 != 0) byte(0xCC);
+        auto pool = static_cast<uint32_t>(code_.size());
+        for (uint64_t bits : constantBits_) {
+            imm64(bits);
+        }
+        for (const Fixup& fixup : constantFixups_) {
+            patch(fixup.at, pool + 8 * fixup.target);
+        }
+        return std::move(code_);
+    }
+
+private:
+    struct Fixup {
+        uint32_t at;     // offset of a rel32 field
+        uint32_t target; // label, function or constant index
+    };
+
+    std::vector<uint8_t> code_;
+    std::vector<uint32_t> functionOffsets_;
+    std::vector<uint32_t> labelOffsets_;
+    std::vector<Fixup> labelFixups_;
+    std::vector<Fixup> callFixups_;
+    std::vector<Fixup> constantFixups_;
+    std::unordered_map<uint64_t, uint32_t> constants_;
+    std::vector<uint64_t> constantBits_;
+    const uintptr_t* stackLimit_;
+
+    uint32_t here() const { return static_cast<uint32_t>(code_.size()); }
+    void byte(uint8_t value) { code_.push_back(value); }
+
+    void imm32(uint32_t value) {
+        for (int i = 0; i < 4; i++) byte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    void imm64(uint64_t value) {
+        for (int i = 0; i < 8; i++) byte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    void patch(uint32_t at, uint32_t target) {
+        uint32_t rel = target - (at + 4);
+        std::memcpy(&code_[at], &rel, sizeof(rel));
+    }
+
+    void rex(bool wide, uint8_t reg, uint8_t rm) {
+        uint8_t prefix = REX | (wide ? REX_W : 0) | (reg >> 3) << 2 | (rm >> 3);
+        if (prefix != REX) byte(prefix);
+    }
+
+    // prefix [REX] 0F opcode ModRM(reg, rm) with both operands registers.
+    void registerForm(uint8_t prefix, uint8_t opcode, uint8_t reg, uint8_t rm, bool wide) {
+        byte(prefix);
+        rex(wide, reg, rm);
+        byte(0x0F);
+        byte(opcode);
+        byte(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7)));
+    }
+
+    // movsd to or from [rbp - 8 * (slot + 1)].
+    void frameForm(uint8_t opcode, uint8_t reg, uint32_t slot) {
+        int32_t disp = -8 * static_cast<int32_t>(slot + 1);
+        byte(PREFIX_F2);
+        rex(false, reg, RBP);
+        byte(0x0F);
+        byte(opcode);
+        if (disp >= -128) {
+            byte(static_cast<uint8_t>(0x40 | (reg & 7) << 3 | RBP));
+            byte(static_cast<uint8_t>(disp));
+        } else {
+            byte(static_cast<uint8_t>(0x80 | (reg & 7) << 3 | RBP));
+            imm32(static_cast<uint32_t>(disp));
+        }
+    }
+};
+
+// Functions whose machine code can be built: lowerable, free of globals and
+// strings, and calling only other such functions.
+std::vector<bool> selectFunctions(const NumericAnalysis& analysis) {
+    const auto& functions = analysis.functions();
+    std::vector<bool> selected(functions.size());
+    for (size_t i = 0; i < functions.size(); i++) {
+        const NumericFunction& fn = functions[i];
+        selected[i] = fn.lowerable && !fn.usesGlobals && !fn.usesStrings;
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < functions.size(); i++) {
+            if (!selected[i]) continue;
+            for (uint32_t callee : functions[i].callees) {
+                if (!selected[callee]) {
+                    selected[i] = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+    return selected;
+}
+
+// The interpreter can only box results whose type fixes the encoding.
+bool returnsBoxable(TypeSet type) {
+    return isPrintable(type) && type != TYPE_STRING;
+}
+
+} // namespace
+
+bool Jit::supported() {
+    return JS_JIT_AVAILABLE != 0;
+}
+
+Jit::Jit(const Program& program)
+    : program_(program), compiled_(false), memory_(nullptr), memorySize_(0), compiledFunctions_(0),
+      codeBytes_(0), stackLimit_(0) {}
+
+Jit::~Jit() {
+#if JS_JIT_AVAILABLE
+    if (memory_) {
+        munmap(memory_, memorySize_);
+    }
+#endif
+}
+
+void Jit::onStackOverflow(Jit* jit) {
+    std::longjmp(jit->overflow_, 1);
+}
+
+void Jit::compile() {
+    compiled_ = true;
+    NumericAnalysis analysis(program_);
+    entries_.assign(analysis.functions().size() + 1, JitEntry{nullptr, 0, 0});
+#if JS_JIT_AVAILABLE
+    std::vector<bool> selected = selectFunctions(analysis);
+    MachineCodeEmitter emitter(analysis.functions().size(), &stackLimit_,
+                               reinterpret_cast<const void*>(&Jit::onStackOverflow), this);
+    X64Codegen codegen(analysis, emitter);
+    for (size_t i = 0; i < selected.size(); i++) {
+        if (selected[i]) codegen.function(static_cast<uint32_t>(i));
+    }
+    std::vector<uint8_t> code = emitter.finish();
+
+    // Write while the pages are only writable, then make them only
+    // executable. A host that forbids this simply keeps interpreting.
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = (code.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return;
+    }
+    memory_ = memory;
+    memorySize_ = size;
+    codeBytes_ = code.size();
+
+    for (size_t i = 0; i < selected.size(); i++) {
+        const NumericFunction& fn = analysis.functions()[i];
+        if (!selected[i]) continue;
+        compiledFunctions_++;
+        if (returnsBoxable(fn.returns)) {
+            entries_[i + 1] = JitEntry{static_cast<const uint8_t*>(memory) + emitter.functionOffset(i),
+                                       static_cast<uint16_t>(fn.decl->params.size()), fn.returns};
+        }
+    }
+#endif
+}
+
+const JitEntry* Jit::entry(uint32_t function) {
+    if (!compiled_) {
+        compile();
+    }
+    if (function >= entries_.size() || !entries_[function].code) {
+        return nullptr;
+    }
+    return &entries_[function];
+}
+
+bool Jit::invoke(const JitEntry& entry, const Value* args, Value& result) {
+    double a[NumericAnalysis::MaxParameters] = {};
+    for (uint16_t i = 0; i < entry.paramCount; i++) {
+        a[i] = args[i].asNumber();
+    }
+
+    char marker = 0;
+    stackLimit_ = reinterpret_cast<uintptr_t>(&marker) - StackBudget;
+    if (setjmp(overflow_)) {
+        return false;
+    }
+
+    // SysV passes the first eight doubles in xmm0-xmm7 whatever the callee's
+    // arity, so one signature serves every entry.
+    using Native = double (*)(double, double, double, double, double, double, double, double);
+    auto native = reinterpret_cast<Native>(const_cast<void*>(entry.code));
+    double value = native(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+
+    if (entry.returns == TYPE_NUMBER) {
+        result = Value::fromNumber(value);
+    } else if (entry.returns == TYPE_UNDEFINED) {
+        result = Value::undefined();
+    } else {
+        result = Value::fromBool(value != 0);
+    }
+    return true;
+}
+
+} // namespace js
@@ -1,19 +1,10 @@
 #include "../include/lexer.hpp"
-#include <cctype>
+#include "../include/arena.hpp"
+#include <cstring>
 #include <stdexcept>
 
-js::Lexer::Lexer(const std::string& source) : input(source), position(0) {
-    keywords = {
-        {"let", TokenType::KEYWORD},
-        {"const", TokenType::KEYWORD},
-        {"var", TokenType::KEYWORD},
-        {"function", TokenType::KEYWORD},
-        {"return", TokenType::KEYWORD},
-        {"if", TokenType::KEYWORD},
-        {"else", TokenType::KEYWORD},
-        {"while", TokenType::KEYWORD},
-        {"for", TokenType::KEYWORD}
-    };
+js::Lexer::Lexer(std::string_view source)
+    : input(source), position(0), kernels(scanKernels()), atoms(AtomTable::current()) {
     current_char = input.empty() ? '\0' : input[0];
 }
 
@@ -22,125 +13,192 @@ void js::Lexer::advance() {
     current_char = position < input.length() ? input[position] : '\0';
 }
 
+void js::Lexer::seek(const char* p) {
+    position = static_cast<size_t>(p - input.data());
+    current_char = position < input.length() ? input[position] : '\0';
+}
+
 void js::Lexer::skip_whitespace() {
-    while (current_char && std::isspace(current_char)) {
-        advance();
-    }
+    seek(kernels.whitespace(input.data() + position, input.data() + input.size()));
 }
 
-std::string js::Lexer::get_number() {
-    std::string result;
-    bool hasDecimal = false;
+std::string_view js::Lexer::get_number() {
+    size_t start = position;
+    const char* end = input.data() + input.size();
     
-    while (current_char && (std::isdigit(current_char) || current_char == '.')) {
-        if (current_char == '.') {
-            if (hasDecimal) break;
-            hasDecimal = true;
-        }
-        result += current_char;
+    seek(kernels.digits(input.data() + position, end));
+    if (current_char == '.') {
         advance();
+        seek(kernels.digits(input.data() + position, end));
     }
     
-    return result;
+    return input.substr(start, position - start);
 }
 
-std::string js::Lexer::get_identifier() {
-    std::string result;
-    
-    while (current_char && (std::isalnum(current_char) || current_char == '_')) {
-        result += current_char;
-        advance();
-    }
-    
-    return result;
+std::string_view js::Lexer::get_identifier() {
+    size_t start = position;
+    seek(kernels.identifier(input.data() + position, input.data() + input.size()));
+    return input.substr(start, position - start);
 }
 
-std::string js::Lexer::get_string() {
+std::string_view js::Lexer::get_string() {
     char quote = current_char;
     advance();
-    std::string result;
+    size_t start = position;
+    const char* p = input.data() + position;
+    const char* end = input.data() + input.size();
+    bool escaped = false;
     
-    while (current_char && current_char != quote) {
-        if (current_char == '\\') {
-            advance();
-            switch (current_char) {
-                case 'n': result += '\n'; break;
-                case 't': result += '\t'; break;
-                case 'r': result += '\r'; break;
-                default: result += current_char;
-            }
-        } else {
-            result += current_char;
-        }
-        advance();
+    while ((p = kernels.stringBody(p, end, quote)) < end && *p == '\\') {
+        escaped = true;
+        p += end - p >= 2 ? 2 : 1;
     }
     
+    seek(p);
+    size_t stop = position;
     if (current_char == quote) {
         advance();
     }
     
-    return result;
+    return escaped ? unescape(start, stop) : input.substr(start, stop - start);
+}
+
+std::string_view js::Lexer::unescape(size_t start, size_t end) {
+    // The unescaped text is never longer than the raw body.
+    char* buffer = static_cast<char*>(Arena::current()->allocate(end - start, 1));
+    size_t length = 0;
+    const char* p = input.data() + start;
+    const char* last = input.data() + end;
+    
+    while (p < last) {
+        // Using the backslash as the "quote" finds the next escape.
+        const char* slash = kernels.stringBody(p, last, '\\');
+        std::memcpy(buffer + length, p, static_cast<size_t>(slash - p));
+        length += static_cast<size_t>(slash - p);
+        if (slash + 1 >= last) {
+            if (slash < last) buffer[length++] = *slash;
+            break;
+        }
+        char c = slash[1];
+        switch (c) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            default: break;
+        }
+        buffer[length++] = c;
+        p = slash + 2;
+    }
+    
+    return std::string_view(buffer, length);
+}
+
+// An upper bound on the tokens in the source, so the token vector never
+// regrows: every character outside a string starts a token unless it is
+// space or continues an identifier or a run of digits, and a string is one
+// token.
+size_t js::Lexer::count_tokens() const {
+    const char* p = input.data();
+    const char* end = p + input.size();
+    size_t count = 1; // the EOF token
+    uint8_t run = 0;  // the classes that continue the current token
+    while (p < end) {
+        uint8_t cls = charClass(*p);
+        if (cls & CHAR_QUOTE) {
+            char quote = *p++;
+            while ((p = kernels.stringBody(p, end, quote)) < end && *p == '\\') {
+                p += end - p >= 2 ? 2 : 1;
+            }
+            if (p < end) p++;
+            count++;
+            run = 0;
+            continue;
+        }
+        if (!(cls & (run | CHAR_SPACE))) {
+            count++;
+            run = (cls & CHAR_IDENT_START) ? CHAR_IDENT : cls & CHAR_DIGIT;
+        } else if (cls & CHAR_SPACE) {
+            run = 0;
+        }
+        p++;
+    }
+    return count;
 }
 
 std::vector<js::Token> js::Lexer::tokenize() {
     std::vector<js::Token> tokens;
+    tokens.reserve(count_tokens());
     
     while (current_char) {
-        if (std::isspace(current_char)) {
+        uint8_t cls = charClass(current_char);
+        
+        if (cls & CHAR_SPACE) {
             skip_whitespace();
             continue;
         }
         
-        if (std::isdigit(current_char)) {
+        if (cls & CHAR_DIGIT) {
             tokens.emplace_back(TokenType::NUMBER, get_number());
             continue;
         }
         
-        if (std::isalpha(current_char) || current_char == '_') {
-            std::string identifier = get_identifier();
-            auto it = keywords.find(identifier);
-            if (it != keywords.end()) {
-                tokens.emplace_back(it->second, identifier);
+        if (cls & CHAR_IDENT_START) {
+            std::string_view identifier = get_identifier();
+            Keyword keyword = lookupKeyword(identifier);
+            if (keyword != Keyword::NONE) {
+                tokens.emplace_back(TokenType::KEYWORD, identifier, keyword, atoms::fromKeyword(keyword));
             } else {
-                tokens.emplace_back(TokenType::IDENTIFIER, identifier);
+                tokens.emplace_back(TokenType::IDENTIFIER, identifier, Keyword::NONE, atoms.intern(identifier));
             }
             continue;
         }
         
-        if (current_char == '"' || current_char == '\'') {
-            tokens.emplace_back(TokenType::STRING, get_string());
+        if (cls & CHAR_QUOTE) {
+            std::string_view text = get_string();
+            tokens.emplace_back(TokenType::STRING, text, Keyword::NONE, atoms.intern(text));
             continue;
         }
         
         if (current_char == '.') {
+            tokens.emplace_back(TokenType::DOT, input.substr(position, 1));
             advance();
-            tokens.emplace_back(TokenType::DOT, ".");
             continue;
         }
         
-        if (std::string("+-*/()=;{}[],<>!&|").find(current_char) != std::string::npos) {
-            std::string op(1, current_char);
+        if (cls & CHAR_OPERATOR) {
+            size_t start = position;
+            char first = current_char;
             advance();
             
             if (current_char) {
-                if ((op == "=" && current_char == '=') ||
-                    (op == "!" && current_char == '=') ||
-                    (op == "<" && current_char == '=') ||
-                    (op == ">" && current_char == '=') ||
-                    (op == "&" && current_char == '&') ||
-                    (op == "|" && current_char == '|')) {
-                    op += current_char;
+                if ((first == '=' && current_char == '=') ||
+                    (first == '!' && current_char == '=') ||
+                    (first == '<' && current_char == '=') ||
+                    (first == '>' && current_char == '=') ||
+                    (first == '&' && current_char == '&') ||
+                    (first == '|' && current_char == '|') ||
+                    (first == '*' && current_char == '*') ||
+                    (first == '+' && (current_char == '+' || current_char == '=')) ||
+                    (first == '-' && (current_char == '-' || current_char == '=')) ||
+                    (first == '*' && current_char == '=') ||
+                    (first == '/' && current_char == '=')) {
                     advance();
                 }
             }
             
-            tokens.emplace_back(TokenType::OPERATOR, op);
+            TokenType type = TokenType::OPERATOR;
+            if (position - start == 1) {
+                if (first == '(') type = TokenType::LEFT_PAREN;
+                else if (first == ')') type = TokenType::RIGHT_PAREN;
+                else if (first == ',') type = TokenType::COMMA;
+            }
+            tokens.emplace_back(type, input.substr(start, position - start));
             continue;
         }
         
         throw std::runtime_error("Invalid character encountered: " + std::string(1, current_char));
     }
     
-    tokens.emplace_back(TokenType::EOF_TOKEN, "");
+    tokens.emplace_back(TokenType::EOF_TOKEN, input.substr(input.size()));
     return tokens;
 }
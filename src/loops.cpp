@@ -0,0 +1,677 @@
+#include "../include/loops.hpp"
+#include "../include/operations.hpp"
+#include "../include/visitor.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <string>
+
+namespace js {
+
+namespace {
+
+constexpr size_t MaxUnrolledTrips = 8;
+constexpr size_t MaxUnrolledNodes = 64;
+// Integers up to 2^53 add and multiply exactly.
+constexpr double MaxExactInteger = 9007199254740992.0;
+
+// Copies a statement or expression. Nested functions are never copied.
+NodePtr clone(const ASTNode* node) {
+    if (!node) return nullptr;
+    switch (node->type) {
+        case NodeType::LITERAL:
+            return std::make_unique<Literal>(static_cast<const Literal*>(node)->value);
+        case NodeType::IDENTIFIER: {
+            auto copy = std::make_unique<Identifier>();
+            copy->name = static_cast<const Identifier*>(node)->name;
+            return copy;
+        }
+        case NodeType::UNARY_EXPRESSION: {
+            auto* unary = static_cast<const UnaryExpression*>(node);
+            auto copy = std::make_unique<UnaryExpression>();
+            copy->op = unary->op;
+            copy->argument = clone(unary->argument.get());
+            return copy;
+        }
+        case NodeType::BINARY_EXPRESSION: {
+            auto* binary = static_cast<const BinaryExpression*>(node);
+            auto copy = std::make_unique<BinaryExpression>();
+            copy->op = binary->op;
+            copy->left = clone(binary->left.get());
+            copy->right = clone(binary->right.get());
+            return copy;
+        }
+        case NodeType::CALL_EXPRESSION: {
+            auto* call = static_cast<const CallExpression*>(node);
+            auto copy = std::make_unique<CallExpression>();
+            copy->callee = clone(call->callee.get());
+            for (const auto& arg : call->arguments) copy->arguments.push_back(clone(arg.get()));
+            return copy;
+        }
+        case NodeType::MEMBER_EXPRESSION: {
+            auto* member = static_cast<const MemberExpression*>(node);
+            auto copy = std::make_unique<MemberExpression>();
+            copy->object = clone(member->object.get());
+            copy->property = member->property;
+            return copy;
+        }
+        case NodeType::ASSIGNMENT_EXPRESSION: {
+            auto* assignment = static_cast<const AssignmentExpression*>(node);
+            auto copy = std::make_unique<AssignmentExpression>();
+            copy->name = assignment->name;
+            copy->value = clone(assignment->value.get());
+            return copy;
+        }
+        case NodeType::VARIABLE_DECLARATION: {
+            auto* decl = static_cast<const VariableDeclaration*>(node);
+            auto copy = std::make_unique<VariableDeclaration>();
+            copy->name = decl->name;
+            copy->init = clone(decl->init.get());
+            return copy;
+        }
+        case NodeType::RETURN_STATEMENT: {
+            auto copy = std::make_unique<ReturnStatement>();
+            copy->argument = clone(static_cast<const ReturnStatement*>(node)->argument.get());
+            return copy;
+        }
+        case NodeType::BLOCK_STATEMENT: {
+            auto copy = std::make_unique<BlockStatement>();
+            for (const auto& stmt : static_cast<const BlockStatement*>(node)->body) {
+                copy->body.push_back(clone(stmt.get()));
+            }
+            return copy;
+        }
+        case NodeType::IF_STATEMENT: {
+            auto* branch = static_cast<const IfStatement*>(node);
+            auto copy = std::make_unique<IfStatement>();
+            copy->test = clone(branch->test.get());
+            copy->consequent = clone(branch->consequent.get());
+            copy->alternate = clone(branch->alternate.get());
+            return copy;
+        }
+        case NodeType::WHILE_STATEMENT: {
+            auto* loop = static_cast<const WhileStatement*>(node);
+            auto copy = std::make_unique<WhileStatement>();
+            copy->test = clone(loop->test.get());
+            copy->body = clone(loop->body.get());
+            return copy;
+        }
+        default:
+            return nullptr;
+    }
+}
+
+bool sameTree(const ASTNode* a, const ASTNode* b) {
+    if (!a || !b || a->type != b->type) return a == b;
+    switch (a->type) {
+        case NodeType::LITERAL:
+            return static_cast<const Literal*>(a)->value == static_cast<const Literal*>(b)->value;
+        case NodeType::IDENTIFIER:
+            return static_cast<const Identifier*>(a)->name == static_cast<const Identifier*>(b)->name;
+        case NodeType::UNARY_EXPRESSION: {
+            auto* x = static_cast<const UnaryExpression*>(a);
+            auto* y = static_cast<const UnaryExpression*>(b);
+            return x->op == y->op && sameTree(x->argument.get(), y->argument.get());
+        }
+        case NodeType::BINARY_EXPRESSION: {
+            auto* x = static_cast<const BinaryExpression*>(a);
+            auto* y = static_cast<const BinaryExpression*>(b);
+            return x->op == y->op && sameTree(x->left.get(), y->left.get()) && sameTree(x->right.get(), y->right.get());
+        }
+        default:
+            return false;
+    }
+}
+
+class LoopFinder : public ASTVisitor<LoopFinder> {
+public:
+    bool found = false;
+    void visitWhileStatement(const WhileStatement&) { found = true; }
+};
+
+// Everything a loop may change: the variables it assigns or declares, and
+// whether it calls user code.
+class LoopEffects : public ASTVisitor<LoopEffects> {
+public:
+    NameSet& changed;
+    Atom counter;
+    size_t counterAssignments = 0;
+    size_t nodes = 0;
+    bool calls = false;
+    bool functions = false;
+
+    LoopEffects(NameSet& changed, Atom counter) : changed(changed), counter(counter) {}
+
+    void visitVariableDeclaration(const VariableDeclaration& node) {
+        nodes++;
+        changed.insert(node.name);
+        visitChild(node.init);
+    }
+    void visitFunctionDeclaration(const FunctionDeclaration&) { functions = true; }
+    void visitAssignmentExpression(const AssignmentExpression& node) {
+        nodes++;
+        changed.insert(node.name);
+        if (node.name == counter) counterAssignments++;
+        visitChild(node.value);
+    }
+    void visitCallExpression(const CallExpression& node) {
+        nodes++;
+        calls = calls || !node_cast<MemberExpression>(node.callee.get());
+        visitChild(node.callee);
+        visitList(node.arguments);
+    }
+    void visitIdentifier(const Identifier&) { nodes++; }
+    void visitLiteral(const Literal&) { nodes++; }
+    void visitUnaryExpression(const UnaryExpression& node) {
+        nodes++;
+        visitChild(node.argument);
+    }
+    void visitBinaryExpression(const BinaryExpression& node) {
+        nodes++;
+        visitChild(node.left);
+        visitChild(node.right);
+    }
+    void visitMemberExpression(const MemberExpression& node) {
+        nodes++;
+        visitChild(node.object);
+    }
+    void visitReturnStatement(const ReturnStatement& node) {
+        nodes++;
+        visitChild(node.argument);
+    }
+    void visitBlockStatement(const BlockStatement& node) {
+        nodes++;
+        visitList(node.body);
+    }
+    void visitIfStatement(const IfStatement& node) {
+        nodes++;
+        visitChild(node.test);
+        visitChild(node.consequent);
+        visitChild(node.alternate);
+    }
+    void visitWhileStatement(const WhileStatement& node) {
+        nodes++;
+        visitChild(node.test);
+        visitChild(node.body);
+    }
+};
+
+// The value of an expression over literals and one variable of known value.
+bool evaluate(const ASTNode* node, Atom name, Value value, Value& result) {
+    switch (node->type) {
+        case NodeType::LITERAL:
+            result = static_cast<const Literal*>(node)->value;
+            return true;
+        case NodeType::IDENTIFIER:
+            result = value;
+            return static_cast<const Identifier*>(node)->name == name;
+        case NodeType::UNARY_EXPRESSION: {
+            auto* unary = static_cast<const UnaryExpression*>(node);
+            if (!evaluate(unary->argument.get(), name, value, result)) return false;
+            result = evaluateUnary(unary->op, result);
+            return true;
+        }
+        case NodeType::BINARY_EXPRESSION: {
+            auto* binary = static_cast<const BinaryExpression*>(node);
+            Value left, right;
+            if (!evaluate(binary->left.get(), name, value, left)) return false;
+            if (binary->op == BinaryOp::AND || binary->op == BinaryOp::OR) {
+                if (isTruthy(left) == (binary->op == BinaryOp::OR)) {
+                    result = left;
+                    return true;
+                }
+                return evaluate(binary->right.get(), name, value, result);
+            }
+            if (!evaluate(binary->right.get(), name, value, right)) return false;
+            result = evaluateBinary(binary->op, left, right);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+bool isInteger(Value value) {
+    if (!value.isNumber()) return false;
+    double n = value.asNumber();
+    return std::isfinite(n) && std::floor(n) == n && !(n == 0 && std::signbit(n));
+}
+
+// `i`, or `+i`, which is what ++ and -- read.
+bool isRead(const ASTNode* node, Atom name) {
+    if (auto* unary = node_cast<UnaryExpression>(node); unary && unary->op == UnaryOp::PLUS) {
+        node = unary->argument.get();
+    }
+    auto* identifier = node_cast<Identifier>(node);
+    return identifier && identifier->name == name;
+}
+
+// A while loop counting a variable: the statement right before it sets the
+// variable to a literal, and the body only assigns it as its last statement.
+struct Counter {
+    Atom name;
+    Value start;
+    AssignmentExpression* update = nullptr;
+};
+
+// Kept per thread between units, so that its containers are reused.
+class LoopOptimizer {
+public:
+    LoopRewrites rewrites;
+
+    void begin(const NameSet* globals, const NameSet* clobbered, bool topLevel) {
+        rewrites = LoopRewrites{};
+        globals_ = globals;
+        clobbered_ = clobbered;
+        topLevel_ = topLevel;
+        depth_ = 0;
+        scope_.clear();
+    }
+
+    void declare(Atom name) { scope_.push_back(Scope{name, !topLevel_ || depth_ > 0}); }
+
+    void list(NodeList& body) {
+        size_t scope = scope_.size();
+        for (size_t i = 0; i < body.size(); i++) {
+            statement(body[i], i ? body[i - 1].get() : nullptr);
+        }
+        scope_.resize(scope);
+    }
+
+    // Past the largest %tN the unit already declares.
+    void reserveTemporaries(const NodeList& body) {
+        class Temporaries : public ASTVisitor<Temporaries> {
+        public:
+            uint32_t next = 0;
+            void visitVariableDeclaration(const VariableDeclaration& node) {
+                std::string_view text = AtomTable::current().text(node.name);
+                uint32_t n = 0;
+                if (text.size() > 2 && text.substr(0, 2) == "%t" &&
+                    std::from_chars(text.data() + 2, text.data() + text.size(), n).ec == std::errc()) {
+                    next = std::max(next, n + 1);
+                }
+            }
+        } temporaries;
+        for (const auto& stmt : body) {
+            if (stmt) temporaries.visit(stmt.get());
+        }
+        nextTemporary_ = temporaries.next;
+    }
+
+private:
+    struct Scope {
+        Atom name;
+        bool local; // rather than a top-level variable
+    };
+
+    const NameSet* globals_ = nullptr;
+    const NameSet* clobbered_ = nullptr;
+    bool topLevel_ = false;
+    uint32_t depth_ = 0;
+    uint32_t nextTemporary_ = 0;
+    // The names declared where the statement being visited runs.
+    std::vector<Scope> scope_;
+    NameSet changed_;
+    // Invariant expressions hoisted from the current loop, and their names.
+    std::vector<std::pair<const ASTNode*, Atom>> hoisted_;
+
+    void statement(NodePtr& slot, const ASTNode* previous) {
+        if (!slot) return;
+        switch (slot->type) {
+            case NodeType::VARIABLE_DECLARATION:
+                declare(static_cast<VariableDeclaration&>(*slot).name);
+                break;
+            case NodeType::BLOCK_STATEMENT:
+                depth_++;
+                list(static_cast<BlockStatement&>(*slot).body);
+                depth_--;
+                break;
+            case NodeType::IF_STATEMENT: {
+                auto& branch = static_cast<IfStatement&>(*slot);
+                statement(branch.consequent, nullptr);
+                statement(branch.alternate, nullptr);
+                break;
+            }
+            case NodeType::WHILE_STATEMENT:
+                statement(static_cast<WhileStatement&>(*slot).body, nullptr);
+                optimizeLoop(slot, previous);
+                break;
+            default:
+                break;
+        }
+    }
+
+    const Scope* find(Atom name) const {
+        for (size_t i = scope_.size(); i-- > 0;) {
+            if (scope_[i].name == name) return &scope_[i];
+        }
+        return nullptr;
+    }
+
+    // Whether a call of a user function can leave the variable as it was.
+    bool survivesCalls(Atom name) const {
+        const Scope* scope = find(name);
+        return (scope && scope->local) || (clobbered_ && !clobbered_->contains(name));
+    }
+
+    Atom temporary() {
+        return AtomTable::current().intern("%t" + std::to_string(nextTemporary_++));
+    }
+
+    static NodePtr declaration(Atom name, NodePtr init) {
+        auto decl = std::make_unique<VariableDeclaration>();
+        decl->name = name;
+        decl->init = std::move(init);
+        return decl;
+    }
+
+    static NodePtr identifier(Atom name) {
+        auto node = std::make_unique<Identifier>();
+        node->name = name;
+        return node;
+    }
+
+    static AssignmentExpression* lastAssignment(WhileStatement& loop) {
+        auto* body = node_cast<BlockStatement>(loop.body.get());
+        return body && !body->body.empty() ? node_cast<AssignmentExpression>(body->body.back().get()) : nullptr;
+    }
+
+    bool findCounter(WhileStatement& loop, const ASTNode* previous, const LoopEffects& effects, Counter& counter) {
+        AssignmentExpression* update = lastAssignment(loop);
+        if (!update || !previous || effects.counterAssignments != 1) return false;
+        const ASTNode* start = nullptr;
+        bool local = false;
+        if (auto* decl = node_cast<VariableDeclaration>(previous); decl && decl->name == update->name) {
+            start = decl->init.get();
+            local = !topLevel_ || depth_ > 0;
+        } else if (auto* assignment = node_cast<AssignmentExpression>(previous);
+                   assignment && assignment->name == update->name) {
+            start = assignment->value.get();
+        }
+        auto* literal = node_cast<Literal>(start);
+        if (!literal) return false;
+        // The loop must not declare a variable of the same name either.
+        class Shadowing : public ASTVisitor<Shadowing> {
+        public:
+            Atom name;
+            bool found = false;
+            void visitVariableDeclaration(const VariableDeclaration& node) {
+                found = found || node.name == name;
+                visitChild(node.init);
+            }
+        } shadowing;
+        shadowing.name = update->name;
+        shadowing.visit(loop.body.get());
+        if (shadowing.found) return false;
+        if (effects.calls && !local && !survivesCalls(update->name)) return false;
+        counter = Counter{update->name, literal->value, update};
+        return true;
+    }
+
+    bool unroll(NodePtr& slot, WhileStatement& loop, const Counter& counter, size_t bodyNodes) {
+        Value value = counter.start;
+        size_t trips = 0;
+        for (;;) {
+            Value test;
+            if (!evaluate(loop.test.get(), counter.name, value, test)) return false;
+            if (!isTruthy(test)) break;
+            if (++trips > MaxUnrolledTrips || trips * bodyNodes > MaxUnrolledNodes) return false;
+            if (!evaluate(counter.update->value.get(), counter.name, value, value)) return false;
+        }
+        auto copies = std::make_unique<BlockStatement>();
+        for (size_t i = 0; i + 1 < trips; i++) copies->body.push_back(clone(loop.body.get()));
+        if (trips > 0) copies->body.push_back(std::move(loop.body));
+        slot = std::move(copies);
+        return true;
+    }
+
+    bool invariant(const ASTNode* node, const LoopEffects& effects) const {
+        switch (node->type) {
+            case NodeType::LITERAL:
+                return true;
+            case NodeType::IDENTIFIER: {
+                // Reading an undeclared name throws, so it must not run early.
+                Atom name = static_cast<const Identifier*>(node)->name;
+                if (changed_.contains(name)) return false;
+                if (!find(name) && !(globals_ && globals_->contains(name))) return false;
+                return !effects.calls || survivesCalls(name);
+            }
+            case NodeType::UNARY_EXPRESSION:
+                return invariant(static_cast<const UnaryExpression*>(node)->argument.get(), effects);
+            case NodeType::BINARY_EXPRESSION: {
+                auto* binary = static_cast<const BinaryExpression*>(node);
+                return invariant(binary->left.get(), effects) && invariant(binary->right.get(), effects);
+            }
+            default:
+                return false;
+        }
+    }
+
+    // Replaces the largest invariant expressions under `slot`.
+    void hoistFrom(NodePtr& slot, const LoopEffects& effects, NodeList& prelude) {
+        ASTNode* node = slot.get();
+        if (!node) return;
+        switch (node->type) {
+            case NodeType::UNARY_EXPRESSION:
+            case NodeType::BINARY_EXPRESSION: {
+                if (invariant(node, effects)) {
+                    auto same = std::find_if(hoisted_.begin(), hoisted_.end(),
+                                             [&](const auto& entry) { return sameTree(entry.first, node); });
+                    Atom name;
+                    if (same != hoisted_.end()) {
+                        name = same->second;
+                    } else {
+                        name = temporary();
+                        hoisted_.emplace_back(node, name);
+                        prelude.push_back(declaration(name, std::move(slot)));
+                    }
+                    slot = identifier(name);
+                    rewrites.hoisted++;
+                    return;
+                }
+                if (auto* unary = node_cast<UnaryExpression>(node)) {
+                    hoistFrom(unary->argument, effects, prelude);
+                } else {
+                    auto* binary = static_cast<BinaryExpression*>(node);
+                    hoistFrom(binary->left, effects, prelude);
+                    hoistFrom(binary->right, effects, prelude);
+                }
+                return;
+            }
+            case NodeType::CALL_EXPRESSION: {
+                auto* call = static_cast<CallExpression*>(node);
+                hoistFrom(call->callee, effects, prelude);
+                for (auto& arg : call->arguments) hoistFrom(arg, effects, prelude);
+                return;
+            }
+            case NodeType::MEMBER_EXPRESSION:
+                hoistFrom(static_cast<MemberExpression*>(node)->object, effects, prelude);
+                return;
+            case NodeType::ASSIGNMENT_EXPRESSION:
+                hoistFrom(static_cast<AssignmentExpression*>(node)->value, effects, prelude);
+                return;
+            case NodeType::VARIABLE_DECLARATION:
+                hoistFrom(static_cast<VariableDeclaration*>(node)->init, effects, prelude);
+                return;
+            case NodeType::RETURN_STATEMENT:
+                hoistFrom(static_cast<ReturnStatement*>(node)->argument, effects, prelude);
+                return;
+            case NodeType::BLOCK_STATEMENT:
+                for (auto& stmt : static_cast<BlockStatement*>(node)->body) hoistFrom(stmt, effects, prelude);
+                return;
+            case NodeType::IF_STATEMENT: {
+                auto* branch = static_cast<IfStatement*>(node);
+                hoistFrom(branch->test, effects, prelude);
+                hoistFrom(branch->consequent, effects, prelude);
+                hoistFrom(branch->alternate, effects, prelude);
+                return;
+            }
+            case NodeType::WHILE_STATEMENT: {
+                auto* loop = static_cast<WhileStatement*>(node);
+                hoistFrom(loop->test, effects, prelude);
+                hoistFrom(loop->body, effects, prelude);
+                return;
+            }
+            default:
+                return;
+        }
+    }
+
+    // `i * k` for a positive integer k becomes a variable set to start * k
+    // before the loop and stepped by step * k after each update, when the
+    // counter moves by a constant integer step towards a literal bound and
+    // every value on the way is exact.
+    void reduce(WhileStatement& loop, const Counter& counter, NodeList& prelude) {
+        auto* update = node_cast<BinaryExpression>(counter.update->value.get());
+        auto* test = node_cast<BinaryExpression>(loop.test.get());
+        if (!update || !test || !isInteger(counter.start)) return;
+        if (update->op != BinaryOp::ADD && update->op != BinaryOp::SUB) return;
+        auto* stepLiteral = node_cast<Literal>(update->right.get());
+        if (!isRead(update->left.get(), counter.name) || !stepLiteral || !isInteger(stepLiteral->value)) return;
+        double step = stepLiteral->value.asNumber() * (update->op == BinaryOp::SUB ? -1 : 1);
+        auto* bound = node_cast<Literal>(test->right.get());
+        if (step == 0 || !isRead(test->left.get(), counter.name) || !bound || !bound->value.isNumber()) return;
+        bool upwards = test->op == BinaryOp::LT || test->op == BinaryOp::LE;
+        bool downwards = test->op == BinaryOp::GT || test->op == BinaryOp::GE;
+        if (!(step > 0 ? upwards : downwards) || !std::isfinite(bound->value.asNumber())) return;
+        double reach = std::max(std::fabs(counter.start.asNumber()), std::fabs(bound->value.asNumber()) + std::fabs(step)) +
+                       std::fabs(step);
+
+        struct Reduced {
+            double factor;
+            Atom name;
+        };
+        std::vector<Reduced> reduced;
+        auto visit = [&](auto& self, NodePtr& slot) -> void {
+            ASTNode* node = slot.get();
+            if (!node || node == counter.update) return;
+            if (auto* binary = node_cast<BinaryExpression>(node); binary && binary->op == BinaryOp::MUL) {
+                NodePtr* other = isRead(binary->left.get(), counter.name)    ? &binary->right
+                                 : isRead(binary->right.get(), counter.name) ? &binary->left
+                                                                             : nullptr;
+                auto* factor = node_cast<Literal>(other ? other->get() : nullptr);
+                if (factor) {
+                    if (isInteger(factor->value) && factor->value.asNumber() > 0 &&
+                        reach * factor->value.asNumber() <= MaxExactInteger) {
+                        double k = factor->value.asNumber();
+                        auto it = std::find_if(reduced.begin(), reduced.end(),
+                                               [&](const Reduced& entry) { return entry.factor == k; });
+                        if (it == reduced.end()) it = reduced.insert(reduced.end(), Reduced{k, temporary()});
+                        slot = identifier(it->name);
+                        rewrites.reduced++;
+                        return;
+                    }
+                }
+            }
+            switch (node->type) {
+                case NodeType::UNARY_EXPRESSION:
+                    self(self, static_cast<UnaryExpression*>(node)->argument);
+                    break;
+                case NodeType::BINARY_EXPRESSION:
+                    self(self, static_cast<BinaryExpression*>(node)->left);
+                    self(self, static_cast<BinaryExpression*>(node)->right);
+                    break;
+                case NodeType::CALL_EXPRESSION:
+                    self(self, static_cast<CallExpression*>(node)->callee);
+                    for (auto& arg : static_cast<CallExpression*>(node)->arguments) self(self, arg);
+                    break;
+                case NodeType::MEMBER_EXPRESSION:
+                    self(self, static_cast<MemberExpression*>(node)->object);
+                    break;
+                case NodeType::ASSIGNMENT_EXPRESSION:
+                    self(self, static_cast<AssignmentExpression*>(node)->value);
+                    break;
+                case NodeType::VARIABLE_DECLARATION:
+                    self(self, static_cast<VariableDeclaration*>(node)->init);
+                    break;
+                case NodeType::RETURN_STATEMENT:
+                    self(self, static_cast<ReturnStatement*>(node)->argument);
+                    break;
+                case NodeType::BLOCK_STATEMENT:
+                    for (auto& stmt : static_cast<BlockStatement*>(node)->body) self(self, stmt);
+                    break;
+                case NodeType::IF_STATEMENT:
+                    self(self, static_cast<IfStatement*>(node)->test);
+                    self(self, static_cast<IfStatement*>(node)->consequent);
+                    self(self, static_cast<IfStatement*>(node)->alternate);
+                    break;
+                case NodeType::WHILE_STATEMENT:
+                    self(self, static_cast<WhileStatement*>(node)->test);
+                    self(self, static_cast<WhileStatement*>(node)->body);
+                    break;
+                default:
+                    break;
+            }
+        };
+        visit(visit, loop.test);
+        visit(visit, loop.body);
+
+        if (reduced.empty()) return;
+        // The body's list may belong to another thread's arena, so the
+        // steps go into a new one rather than growing it.
+        auto body = std::make_unique<BlockStatement>();
+        auto& old = static_cast<BlockStatement&>(*loop.body).body;
+        body->body.reserve(old.size() + reduced.size());
+        for (auto& stmt : old) body->body.push_back(std::move(stmt));
+        for (const Reduced& entry : reduced) {
+            prelude.push_back(declaration(entry.name,
+                                          std::make_unique<Literal>(Value::fromNumber(counter.start.asNumber() * entry.factor))));
+            auto sum = std::make_unique<BinaryExpression>();
+            sum->op = BinaryOp::ADD;
+            sum->left = identifier(entry.name);
+            sum->right = std::make_unique<Literal>(Value::fromNumber(step * entry.factor));
+            auto next = std::make_unique<AssignmentExpression>();
+            next->name = entry.name;
+            next->value = std::move(sum);
+            body->body.push_back(std::move(next));
+        }
+        loop.body = std::move(body);
+    }
+
+    void optimizeLoop(NodePtr& slot, const ASTNode* previous) {
+        auto& loop = static_cast<WhileStatement&>(*slot);
+        AssignmentExpression* update = lastAssignment(loop);
+        changed_.clear();
+        LoopEffects effects(changed_, update ? update->name : atoms::empty);
+        effects.visit(&loop);
+        if (effects.functions) return;
+        Counter counter;
+        bool counted = findCounter(loop, previous, effects, counter);
+        if (counted && unroll(slot, loop, counter, effects.nodes)) {
+            rewrites.unrolled++;
+            return;
+        }
+
+        NodeList prelude{Arena::current()};
+        hoisted_.clear();
+        hoistFrom(loop.test, effects, prelude);
+        hoistFrom(loop.body, effects, prelude);
+        if (counted) reduce(loop, counter, prelude);
+        if (prelude.empty()) return;
+        auto block = std::make_unique<BlockStatement>();
+        block->body = std::move(prelude);
+        block->body.push_back(std::move(slot));
+        slot = std::move(block);
+    }
+};
+
+} // namespace
+
+LoopRewrites optimizeLoops(NodeList& body, const std::pmr::vector<Atom>* params, const NameSet* globals,
+                           const NameSet* clobbered) {
+    LoopFinder finder;
+    for (const auto& stmt : body) {
+        if (stmt) finder.visit(stmt.get());
+    }
+    if (!finder.found) return LoopRewrites{};
+    thread_local LoopOptimizer optimizer;
+    optimizer.begin(globals, clobbered, params == nullptr);
+    optimizer.reserveTemporaries(body);
+    if (params) {
+        for (Atom param : *params) optimizer.declare(param);
+    }
+    optimizer.list(body);
+    return optimizer.rewrites;
+}
+
+} // namespace js
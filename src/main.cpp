@@ -2,54 +2,504 @@
 #include "../include/parser.hpp"
 #include "../include/optimizer.hpp"
 #include "../include/thread_pool.hpp"
-#include "../include/memory_pool.hpp"
+#include "../include/arena.hpp"
+#include "../include/source_buffer.hpp"
+#include "../include/flat_ast.hpp"
+#include "../include/bytecode.hpp"
+#include "../include/interpreter.hpp"
+#include "../include/x64.hpp"
+#include "../include/jit.hpp"
+#include "../include/visitor.hpp"
+#include "../include/compile_cache.hpp"
+#include "../include/binary_ast.hpp"
+#include "../include/stats.hpp"
+#include "../include/trace.hpp"
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <memory>
 #include <sstream>
-#include <chrono>
+#include <string>
 #include <vector>
 
-std::string read_file(const std::string& filename) {
-    std::ifstream file(filename);
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace {
+
+struct Options {
+    std::vector<std::string> inputs;
+    size_t jobs = 0; // 0: one per hardware thread
+    bool flat = false;
+    bool dumpBytecode = false;
+    bool verifyAsm = false;
+    bool jit = false;
+    std::string emitAsm;
+    std::string cacheDir;
+    std::string emitBinaryAst;
+    bool stats = false;
+    std::string trace;
+};
+
+// Appends the paths listed in a response file, one per line.
+bool readResponseFile(const char* path, std::vector<std::string>& inputs) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Could not read response file: " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) continue;
+        size_t end = line.find_last_not_of(" \t\r") + 1;
+        inputs.push_back(line.substr(begin, end - begin));
+    }
+    return true;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--flat") == 0) {
+            options.flat = true;
+        } else if (std::strcmp(argv[i], "--dump-bytecode") == 0) {
+            options.dumpBytecode = true;
+        } else if (std::strncmp(argv[i], "--emit-asm=", 11) == 0) {
+            options.emitAsm = argv[i] + 11;
+        } else if (std::strcmp(argv[i], "--verify-asm") == 0) {
+            options.verifyAsm = true;
+        } else if (std::strcmp(argv[i], "--jit") == 0) {
+            options.jit = true;
+        } else if (std::strncmp(argv[i], "--jobs=", 7) == 0) {
+            options.jobs = std::strtoul(argv[i] + 7, nullptr, 10);
+            if (options.jobs == 0) {
+                std::cerr << "Invalid job count: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (std::strncmp(argv[i], "--emit-binary-ast=", 18) == 0) {
+            options.emitBinaryAst = argv[i] + 18;
+        } else if (std::strcmp(argv[i], "--stats") == 0) {
+            options.stats = true;
+        } else if (std::strncmp(argv[i], "--trace=", 8) == 0) {
+            options.trace = argv[i] + 8;
+        } else if (std::strncmp(argv[i], "--cache-dir=", 12) == 0) {
+            options.cacheDir = argv[i] + 12;
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return false;
+        } else if (argv[i][0] == '@') {
+            if (!readResponseFile(argv[i] + 1, options.inputs)) return false;
+        } else {
+            options.inputs.push_back(argv[i]);
+        }
+    }
+    if ((options.inputs.size() > 1 || !options.cacheDir.empty()) &&
+        (options.dumpBytecode || options.jit || options.verifyAsm || !options.emitAsm.empty() ||
+         !options.emitBinaryAst.empty())) {
+        std::cerr << "--dump-bytecode, --emit-asm, --emit-binary-ast, --verify-asm and --jit take a single input file"
+                  << " and no --cache-dir" << std::endl;
+        return false;
+    }
+    return !options.inputs.empty();
+}
+
+// Builds the generated assembly with the system compiler driver, runs it and
+// compares its output with the interpreter's. Returns false on a mismatch.
+bool verifyAssembly(const js::Program& program, const std::string& expected) {
+    namespace fs = std::filesystem;
+    std::string stem = "js_compiler_" +
+        std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    fs::path asmPath = fs::temp_directory_path() / (stem + ".s");
+    fs::path exePath = fs::temp_directory_path() / stem;
+
+    js::AssemblyReport report;
+    {
+        std::ofstream out(asmPath);
+        report = js::emitGasAssembly(program, out);
+    }
+    if (!report.hasMain) {
+        fs::remove(asmPath);
+        std::cout << "Native check skipped: " << report.mainSkippedReason << std::endl;
+        return true;
+    }
+
+    std::string build = "cc -o \"" + exePath.string() + "\" \"" + asmPath.string() + "\" -lm";
+    if (std::system(build.c_str()) != 0) {
+        throw std::runtime_error("Could not assemble " + asmPath.string());
+    }
+    std::string actual;
+    if (FILE* pipe = popen(("\"" + exePath.string() + "\"").c_str(), "r")) {
+        char buffer[4096];
+        size_t n;
+        while ((n = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+            actual.append(buffer, n);
+        }
+        pclose(pipe);
+    }
+    fs::remove(asmPath);
+    fs::remove(exePath);
+
+    if (actual != expected) {
+        std::cout << "Native check FAILED\n--- interpreter\n" << expected
+                  << "--- native\n" << actual << std::endl;
+        return false;
+    }
+    std::cout << "Native check: output matches the interpreter (" << report.functionsLowered
+              << " functions native, " << report.functionsSkipped << " skipped)" << std::endl;
+    return true;
 }
 
+size_t threadCount(const Options& options) {
+    return options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+}
+
+struct FileResult {
+    std::string output;
+    std::string error;
+    bool cached = false;
+    js::CompileStats stats;
+};
+
+// Everything besides the source that changes a file's output.
+std::string cacheConfiguration(const Options& options) {
+    return js::compilerBuildId() + (options.flat ? " --flat" : "");
+}
+
+// Lexes, parses and optimizes one file of a batch and renders its optimized
+// AST. Runs on a pool thread with its own arena and atom table, so files
+// share no mutable state. With a cache, unchanged files are served from it
+// and successful outputs are stored; errors are never cached.
+FileResult compileFile(const std::string& path, const Options& options, js::CompileCache* cache,
+                       js::Trace* trace) {
+    FileResult result;
+    js::CompileStats& stats = result.stats;
+    stats.files = 1;
+    js::TraceSpan fileSpan(trace, path, "file");
+    try {
+        js::CompileCache::Key key{};
+        if (cache) {
+            key = cache->keyFor(path);
+            if (auto output = cache->load(key)) {
+                result.output = std::move(*output);
+                result.cached = true;
+                return result;
+            }
+        }
+
+        js::Arena arena;
+        js::ArenaScope arenaScope(arena);
+        js::AtomTable atoms;
+        js::AtomScope atomScope(atoms);
+
+        std::unique_ptr<js::SourceBuffer> source;
+        {
+            js::PhaseTimer timer(stats, js::Phase::READ, trace);
+            source = std::make_unique<js::SourceBuffer>(path);
+        }
+        stats.sourceBytes = source->size();
+        std::vector<js::Token> tokens;
+        {
+            js::PhaseTimer timer(stats, js::Phase::LEX, trace);
+            tokens = js::Lexer(source->view()).tokenize();
+        }
+        stats.tokens = tokens.size();
+        js::NodePtr ast;
+        {
+            js::PhaseTimer timer(stats, js::Phase::PARSE, trace);
+            ast = js::Parser(std::move(tokens)).parse();
+        }
+        if (options.stats) {
+            stats.parsedNodes = js::countNodes(ast.get());
+        }
+        {
+            js::PhaseTimer timer(stats, js::Phase::OPTIMIZE, trace);
+            js::Optimizer optimizer;
+            ast = optimizer.optimizeProgram(std::move(ast));
+            stats.passRewrites = optimizer.passCounts();
+        }
+        if (options.stats) {
+            stats.optimizedNodes = js::countNodes(ast.get());
+        }
+
+        {
+            js::PhaseTimer timer(stats, js::Phase::PRINT, trace);
+            std::ostringstream out;
+            if (options.flat) {
+                js::FlatAST::fromTree(ast.get()).print(0, 0, out);
+            } else {
+                ast->print(0, out);
+            }
+            result.output = out.str();
+        }
+        arena.adopt(std::move(ast));
+        stats.arenaAllocated = arena.bytesAllocated();
+        stats.arenaReserved = arena.bytesReserved();
+        stats.arenaRecycled = arena.bytesRecycled();
+        stats.atomBytes = atoms.bytesUsed();
+        if (cache) {
+            cache->store(key, result.output);
+        }
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    return result;
+}
+
+// Compiles every input on the thread pool. Output and diagnostics appear in
+// input order whatever order the files finish in.
+int compileBatch(const Options& options, js::Trace* trace) {
+    js::TraceSpan batchSpan(trace, "batch");
+    auto start = std::chrono::steady_clock::now();
+    size_t threads = threadCount(options);
+    std::unique_ptr<js::CompileCache> cache;
+    if (!options.cacheDir.empty()) {
+        try {
+            cache = std::make_unique<js::CompileCache>(options.cacheDir, cacheConfiguration(options));
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: " << e.what() << "; compiling without a cache" << std::endl;
+        }
+    }
+    js::ThreadPool threadPool(std::min(threads, options.inputs.size()));
+
+    std::vector<std::future<FileResult>> results;
+    results.reserve(options.inputs.size());
+    for (const auto& path : options.inputs) {
+        results.push_back(threadPool.enqueue([&options, &cache, trace, path] {
+            return compileFile(path, options, cache.get(), trace);
+        }));
+    }
+
+    size_t failed = 0;
+    size_t cached = 0;
+    js::CompileStats stats;
+    for (size_t i = 0; i < results.size(); i++) {
+        FileResult result = results[i].get();
+        cached += result.cached;
+        stats.add(result.stats);
+        if (!result.error.empty()) {
+            std::cerr << options.inputs[i] << ": Error: " << result.error << std::endl;
+            failed++;
+            continue;
+        }
+        std::cout << "== " << options.inputs[i] << " ==\n" << result.output;
+    }
+    if (cache) {
+        cache->save();
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Compiled " << results.size() - failed << " of " << results.size() << " files in "
+              << duration.count() << "ms on " << threads << (threads == 1 ? " thread" : " threads");
+    if (cache) {
+        std::cout << " (" << cached << " from cache)";
+    }
+    std::cout << std::endl;
+    if (options.stats) {
+        stats.print(std::cout);
+    }
+    return failed ? 1 : 0;
+}
+
+// Writes the trace collected for --trace, if any. Returns false on failure.
+bool writeTrace(const Options& options, const js::Trace* trace) {
+    if (!trace) return true;
+    std::ofstream out(options.trace);
+    trace->write(out);
+    if (!out) {
+        std::cerr << "Could not write trace " << options.trace << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// A precompiled AST is printed straight from the mapped file.
+int printBinaryAST(const js::SourceBuffer& source) {
+    auto start = std::chrono::steady_clock::now();
+    js::BinaryASTView ast(source.data(), source.size());
+    std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - start;
+    std::cout << "Optimized AST:" << std::endl;
+    ast.print();
+    std::cout << "Binary AST: " << ast.size() << " nodes, " << source.size() << " bytes, loaded in "
+              << loadTime.count() * 1e3 << "ms" << std::endl;
+    return 0;
+}
+
+} // namespace
+
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <input_file.js>" << std::endl;
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--flat] [--dump-bytecode] [--emit-asm=<file.s>] [--verify-asm] [--jit] [--emit-binary-ast=<file.jsast>] [--stats] [--trace=<out.json>] [--jobs=<n>] [--cache-dir=<dir>] <input_file.js>... [@<response_file>]" << std::endl;
         return 1;
     }
+    std::unique_ptr<js::Trace> trace;
+    if (!options.trace.empty()) {
+        trace = std::make_unique<js::Trace>();
+    }
+    if (options.inputs.size() > 1 || !options.cacheDir.empty()) {
+        int status = compileBatch(options, trace.get());
+        return writeTrace(options, trace.get()) ? status : 1;
+    }
 
+    js::CompileStats stats;
+    stats.files = 1;
     try {
-        auto start = std::chrono::high_resolution_clock::now();
+        auto start = std::chrono::steady_clock::now();
+        
+        js::Arena arena;
+        js::ArenaScope arenaScope(arena);
+        js::AtomTable atoms;
+        js::AtomScope atomScope(atoms);
         
-        js::ThreadPool threadPool;
-        js::MemoryPool<js::ASTNode> nodePool;
+        std::unique_ptr<js::SourceBuffer> source;
+        {
+            js::PhaseTimer timer(stats, js::Phase::READ, trace.get());
+            source = std::make_unique<js::SourceBuffer>(options.inputs[0]);
+        }
+        if (js::BinaryASTView::matches(source->data(), source->size())) {
+            return printBinaryAST(*source);
+        }
+        stats.sourceBytes = source->size();
         
-        std::string source = read_file(argv[1]);
+        std::vector<js::Token> tokens;
+        {
+            js::PhaseTimer timer(stats, js::Phase::LEX, trace.get());
+            tokens = js::Lexer(source->view()).tokenize();
+        }
+        stats.tokens = tokens.size();
         
-        js::Lexer lexer(source);
-        auto tokens = lexer.tokenize();
+        js::NodePtr ast;
+        size_t nodesCreated;
+        {
+            js::PhaseTimer timer(stats, js::Phase::PARSE, trace.get());
+            js::Parser parser(std::move(tokens));
+            ast = parser.parse();
+            nodesCreated = parser.nodes_created();
+        }
+        size_t treeBytes = arena.bytesAllocated();
+        auto* program = js::node_cast<js::Program>(ast.get());
+        if (options.stats) {
+            stats.parsedNodes = js::countNodes(ast.get());
+        }
         
-        js::Parser parser(tokens);
-        auto ast = parser.parse();
+        {
+            js::PhaseTimer timer(stats, js::Phase::OPTIMIZE, trace.get());
+            // Large programs optimize their function bodies in parallel.
+            std::unique_ptr<js::ThreadPool> optimizerPool;
+            size_t functionCount = std::count_if(program->body.begin(), program->body.end(),
+                [](const js::NodePtr& stmt) { return stmt->type == js::NodeType::FUNCTION_DECLARATION; });
+            if (threadCount(options) > 1 && functionCount >= js::Optimizer::MinParallelFunctions) {
+                optimizerPool = std::make_unique<js::ThreadPool>(threadCount(options));
+            }
+            js::Optimizer optimizer(optimizerPool.get());
+            ast = optimizer.optimizeProgram(std::move(ast));
+            stats.passRewrites = optimizer.passCounts();
+        }
+        if (options.stats) {
+            stats.optimizedNodes = js::countNodes(ast.get());
+        }
         
-        js::Optimizer optimizer;
-        ast = optimizer.optimizeExpression(std::move(ast));
+        js::BytecodeModule module;
+        {
+            js::PhaseTimer timer(stats, js::Phase::BYTECODE, trace.get());
+            module = js::compileToBytecode(ast.get());
+        }
+        if (options.dumpBytecode) {
+            module.disassemble(std::cout);
+        }
+        std::ostringstream captured;
+        js::Interpreter interpreter(module, options.verifyAsm ? captured : std::cout);
+        std::unique_ptr<js::Jit> jit;
+        if (options.jit) {
+            if (js::Jit::supported()) {
+                jit = std::make_unique<js::Jit>(*program);
+                interpreter.setJit(jit.get());
+            } else {
+                std::cerr << "Note: --jit is not supported on this platform; interpreting" << std::endl;
+            }
+        }
+        {
+            js::PhaseTimer timer(stats, js::Phase::RUN, trace.get());
+            interpreter.run();
+        }
+        std::cout << captured.str();
         
+        if (!options.emitAsm.empty()) {
+            std::ofstream out(options.emitAsm);
+            if (!out) {
+                throw std::runtime_error("Could not write " + options.emitAsm);
+            }
+            auto report = js::emitGasAssembly(*program, out);
+            if (!report.hasMain) {
+                std::cerr << "Note: no main() emitted: " << report.mainSkippedReason << std::endl;
+            }
+        }
+        if (!options.emitBinaryAst.empty()) {
+            std::ofstream out(options.emitBinaryAst, std::ios::binary);
+            if (!out) {
+                throw std::runtime_error("Could not write " + options.emitBinaryAst);
+            }
+            js::writeBinaryAST(js::FlatAST::fromTree(ast.get()), out);
+        }
+        bool nativeOk = !options.verifyAsm || verifyAssembly(*program, captured.str());
         
-        std::cout << "\nOptimized AST:" << std::endl;
-        ast->print();  
+        size_t flatBytes = 0;
+        {
+            js::PhaseTimer timer(stats, js::Phase::PRINT, trace.get());
+            std::cout << "\nOptimized AST:" << std::endl;
+            if (options.flat) {
+                auto flat = js::FlatAST::fromTree(ast.get());
+                flat.print();
+                flatBytes = flat.bytesUsed();
+            } else {
+                ast->print();
+            }
+        }
+        arena.adopt(std::move(ast));
         
-        auto end = std::chrono::high_resolution_clock::now();
+        auto end = std::chrono::steady_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
         
         std::cout << "Compilation successful! Time taken: " << duration.count() << "ms" << std::endl;
+        if (uint64_t lexNanos = stats.nanos(js::Phase::LEX)) {
+            std::cout << "Lexer: " << stats.tokens << " tokens, "
+                      << source->size() * 1e3 / lexNanos << " MB/s ("
+                      << js::scanKernels().name << ")" << std::endl;
+        }
+        if (uint64_t parseNanos = stats.nanos(js::Phase::PARSE)) {
+            std::cout << "Parser: " << nodesCreated << " nodes, "
+                      << nodesCreated * 1e9 / parseNanos << " nodes/s" << std::endl;
+        }
+        std::cout << "Interpreter: " << stats.nanos(js::Phase::RUN) / 1e6 << "ms" << std::endl;
+        if (jit) {
+            std::cout << "JIT: " << jit->compiledFunctions() << " functions, "
+                      << jit->codeBytes() << " bytes of machine code" << std::endl;
+        }
+        if (options.flat) {
+            std::cout << "AST footprint: tree (arena) " << treeBytes << " bytes, flat "
+                      << flatBytes << " bytes" << std::endl;
+        }
+        if (options.stats) {
+            stats.arenaAllocated = arena.bytesAllocated();
+            stats.arenaReserved = arena.bytesReserved();
+            stats.arenaRecycled = arena.bytesRecycled();
+            stats.atomBytes = atoms.bytesUsed();
+            stats.print(std::cout);
+        }
+        if (!writeTrace(options, trace.get()) || !nativeOk) {
+            return 1;
+        }
         
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
+        writeTrace(options, trace.get());
         return 1;
     }
     
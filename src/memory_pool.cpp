@@ -0,0 +1,358 @@
+#include "../include/memory_pool.hpp"
+#include <unordered_set>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace js {
+
+namespace {
+
+struct PoolRegistry {
+    std::mutex mutex;
+    std::unordered_set<uint64_t> live;
+};
+
+// Pools alive in the process. Ids are never reused, so a stale id in a
+// thread's cache list can never match a newer pool.
+PoolRegistry& registry() {
+    static PoolRegistry instance;
+    return instance;
+}
+
+std::atomic<uint64_t> nextPoolId{1};
+
+// Set once the calling thread has started tearing down its caches.
+thread_local bool threadExiting = false;
+
+constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+} // namespace
+
+// The caches the calling thread owns, one per pool it has used. On thread
+// exit they go back to every pool that is still alive.
+struct PoolThreadCaches {
+    struct Entry {
+        uint64_t pool;
+        FixedSizePool* owner;
+        FixedSizePool::Cache* cache;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t lastPool = 0;
+    FixedSizePool::Cache* lastCache = nullptr;
+
+    ~PoolThreadCaches() {
+        threadExiting = true;
+        PoolRegistry& pools = registry();
+        std::lock_guard<std::mutex> lock(pools.mutex);
+        for (const Entry& entry : entries) {
+            if (pools.live.count(entry.pool)) {
+                entry.owner->releaseCache(entry.cache);
+            }
+        }
+    }
+
+    // Forgets caches of pools that have been destroyed.
+    void prune() {
+        PoolRegistry& pools = registry();
+        std::lock_guard<std::mutex> lock(pools.mutex);
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [&](const Entry& entry) { return !pools.live.count(entry.pool); }),
+                      entries.end());
+    }
+};
+
+namespace {
+thread_local PoolThreadCaches threadCaches;
+} // namespace
+
+FixedSizePool::FixedSizePool(size_t slotSize, size_t slotAlignment, size_t slotsPerBlock, bool hugePages)
+    : slotAlignment_(std::max(slotAlignment, alignof(FreeSlot))), hugePages_(hugePages),
+      id_(nextPoolId.fetch_add(1, std::memory_order_relaxed)) {
+    slotSize_ = (std::max(slotSize, sizeof(FreeSlot)) + slotAlignment_ - 1) / slotAlignment_ * slotAlignment_;
+    blockBytes_ = slotSize_ * std::max<size_t>(slotsPerBlock, 1);
+    PoolRegistry& pools = registry();
+    std::lock_guard<std::mutex> lock(pools.mutex);
+    pools.live.insert(id_);
+}
+
+FixedSizePool::~FixedSizePool() {
+    {
+        // After this no exiting thread touches the pool.
+        PoolRegistry& pools = registry();
+        std::lock_guard<std::mutex> lock(pools.mutex);
+        pools.live.erase(id_);
+    }
+    for (const Block& block : blocks_) {
+#ifdef __linux__
+        if (block.mapped) {
+            ::munmap(block.memory, block.bytes);
+            continue;
+        }
+#endif
+        ::operator delete(block.memory, std::align_val_t(slotAlignment_));
+    }
+}
+
+FixedSizePool::Cache* FixedSizePool::cache() {
+    if (threadExiting) return nullptr;
+    PoolThreadCaches& caches = threadCaches;
+    if (caches.lastPool == id_) return caches.lastCache;
+
+    Cache* found = nullptr;
+    for (const auto& entry : caches.entries) {
+        if (entry.pool == id_) {
+            found = entry.cache;
+            break;
+        }
+    }
+    if (!found) {
+        found = adoptCache();
+        if (caches.entries.size() >= 16 && (caches.entries.size() & (caches.entries.size() - 1)) == 0) {
+            caches.prune();
+        }
+        caches.entries.push_back({id_, this, found});
+    }
+    caches.lastPool = id_;
+    caches.lastCache = found;
+    return found;
+}
+
+// Reuses the cache of a thread that has exited, if there is one.
+FixedSizePool::Cache* FixedSizePool::adoptCache() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& cache : caches_) {
+        if (cache->orphaned) {
+            cache->orphaned = false;
+            return cache.get();
+        }
+    }
+    caches_.push_back(std::make_unique<Cache>());
+    return caches_.back().get();
+}
+
+void FixedSizePool::releaseCache(Cache* cache) noexcept {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t runSlots = (cache->run.limit - cache->run.cursor) / slotSize_;
+    try {
+        if (cache->free) {
+            depot_.push_back(Batch{cache->free, cache->freeCount});
+            depotSlots_ += cache->freeCount;
+            subOutstanding(cache->freeCount);
+        }
+        if (runSlots) {
+            spareRuns_.push_back(cache->run);
+            subOutstanding(runSlots);
+        }
+    } catch (...) {
+        // Out of memory for the bookkeeping: the slots stay unused until
+        // the pool is destroyed.
+    }
+    cache->free = nullptr;
+    cache->freeCount = 0;
+    cache->run = Run{nullptr, nullptr};
+    cache->orphaned = true;
+}
+
+void* FixedSizePool::allocate() {
+    Cache* cache = this->cache();
+    if (!cache) return allocateDirect();
+
+    void* result;
+    if (FreeSlot* slot = cache->free) {
+        cache->free = slot->next;
+        cache->freeCount--;
+        result = slot;
+    } else if (cache->run.cursor != cache->run.limit) {
+        result = cache->run.cursor;
+        cache->run.cursor += slotSize_;
+    } else {
+        result = refill(*cache);
+    }
+    cache->allocations.store(cache->allocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return result;
+}
+
+// Called with an empty cache: takes remote frees, then a depot batch, then a
+// spare or freshly carved run. Returns one slot and keeps the rest.
+void* FixedSizePool::refill(Cache& cache) {
+    size_t count;
+    if (FreeSlot* remote = takeRemoteFrees(count)) {
+        addOutstanding(count);
+        cache.free = remote->next;
+        cache.freeCount = count - 1;
+        return remote;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!depot_.empty()) {
+        Batch batch = depot_.back();
+        depot_.pop_back();
+        depotSlots_ -= batch.count;
+        addOutstanding(batch.count);
+        cache.free = batch.head->next;
+        cache.freeCount = batch.count - 1;
+        return batch.head;
+    }
+
+    Run run;
+    if (!spareRuns_.empty()) {
+        run = spareRuns_.back();
+        spareRuns_.pop_back();
+    } else {
+        run = carve(BatchSize);
+    }
+    addOutstanding((run.limit - run.cursor) / slotSize_);
+    void* result = run.cursor;
+    run.cursor += slotSize_;
+    cache.run = run;
+    return result;
+}
+
+// Allocation on a thread that is exiting, straight from the shared state.
+void* FixedSizePool::allocateDirect() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    void* result;
+    if (!depot_.empty()) {
+        Batch& batch = depot_.back();
+        result = batch.head;
+        batch.head = batch.head->next;
+        depotSlots_--;
+        if (--batch.count == 0) depot_.pop_back();
+    } else if (!spareRuns_.empty()) {
+        Run& run = spareRuns_.back();
+        result = run.cursor;
+        run.cursor += slotSize_;
+        if (run.cursor == run.limit) spareRuns_.pop_back();
+    } else {
+        result = carve(1).cursor;
+    }
+    addOutstanding(1);
+    directAllocations_.fetch_add(1, std::memory_order_relaxed);
+    return result;
+}
+
+void FixedSizePool::deallocate(void* ptr) noexcept {
+    Cache* cache = nullptr;
+    try {
+        cache = this->cache();
+    } catch (...) {
+        // No memory for a new cache: fall through to the remote list.
+    }
+    if (!cache) {
+        pushRemote(ptr);
+        return;
+    }
+
+    auto* slot = static_cast<FreeSlot*>(ptr);
+    slot->next = cache->free;
+    cache->free = slot;
+    cache->frees.store(cache->frees.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (++cache->freeCount > 2 * BatchSize) {
+        returnBatch(*cache);
+    }
+}
+
+// Hands the most recently freed BatchSize slots to the depot.
+void FixedSizePool::returnBatch(Cache& cache) {
+    FreeSlot* head = cache.free;
+    FreeSlot* tail = head;
+    for (size_t i = 1; i < BatchSize; i++) {
+        tail = tail->next;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    try {
+        depot_.push_back(Batch{head, BatchSize});
+    } catch (...) {
+        return; // keep the slots in the cache
+    }
+    cache.free = tail->next;
+    tail->next = nullptr;
+    cache.freeCount -= BatchSize;
+    depotSlots_ += BatchSize;
+    subOutstanding(BatchSize);
+}
+
+// Takes up to `slots` slots off the current block. Called with mutex_ held.
+FixedSizePool::Run FixedSizePool::carve(size_t slots) {
+    if (block_.limit - block_.cursor < static_cast<ptrdiff_t>(slotSize_)) {
+        newBlock();
+    }
+    size_t available = (block_.limit - block_.cursor) / slotSize_;
+    Run run{block_.cursor, block_.cursor + std::min(slots, available) * slotSize_};
+    block_.cursor = run.limit;
+    return run;
+}
+
+void FixedSizePool::newBlock() {
+    blocks_.reserve(blocks_.size() + 1);
+#ifdef __linux__
+    if (hugePages_) {
+        size_t bytes = (blockBytes_ + HugePageSize - 1) / HugePageSize * HugePageSize;
+        void* memory = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        bool huge = memory != MAP_FAILED;
+        if (!huge) {
+            // No reserved huge pages: ask for transparent ones instead.
+            memory = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) throw std::bad_alloc();
+            huge = ::madvise(memory, bytes, MADV_HUGEPAGE) == 0;
+        }
+        hugePagesUsed_ = hugePagesUsed_ || huge;
+        blocks_.push_back(Block{memory, bytes, true});
+        block_ = Run{static_cast<char*>(memory), static_cast<char*>(memory) + bytes};
+        return;
+    }
+#endif
+    void* memory = ::operator new(blockBytes_, std::align_val_t(slotAlignment_));
+    blocks_.push_back(Block{memory, blockBytes_, false});
+    block_ = Run{static_cast<char*>(memory), static_cast<char*>(memory) + blockBytes_};
+}
+
+FixedSizePool::FreeSlot* FixedSizePool::takeRemoteFrees(size_t& count) noexcept {
+    if (!remoteFrees_.load(std::memory_order_relaxed)) return nullptr;
+    FreeSlot* list = remoteFrees_.exchange(nullptr, std::memory_order_acquire);
+    count = 0;
+    for (FreeSlot* slot = list; slot; slot = slot->next) count++;
+    return list;
+}
+
+void FixedSizePool::pushRemote(void* ptr) noexcept {
+    auto* slot = static_cast<FreeSlot*>(ptr);
+    FreeSlot* head = remoteFrees_.load(std::memory_order_relaxed);
+    do {
+        slot->next = head;
+    } while (!remoteFrees_.compare_exchange_weak(head, slot, std::memory_order_release, std::memory_order_relaxed));
+    remoteFreeCount_.fetch_add(1, std::memory_order_relaxed);
+    subOutstanding(1);
+}
+
+void FixedSizePool::addOutstanding(size_t slots) noexcept {
+    size_t now = outstanding_.fetch_add(slots, std::memory_order_relaxed) + slots;
+    size_t peak = highWater_.load(std::memory_order_relaxed);
+    while (now > peak && !highWater_.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+    }
+}
+
+MemoryPoolStats FixedSizePool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MemoryPoolStats stats{};
+    stats.slotSize = slotSize_;
+    stats.blocks = blocks_.size();
+    for (const Block& block : blocks_) stats.bytesReserved += block.bytes;
+    size_t allocations = directAllocations_.load(std::memory_order_relaxed);
+    size_t frees = remoteFreeCount_.load(std::memory_order_relaxed);
+    for (const auto& cache : caches_) {
+        allocations += cache->allocations.load(std::memory_order_relaxed);
+        frees += cache->frees.load(std::memory_order_relaxed);
+    }
+    stats.inUse = allocations > frees ? allocations - frees : 0;
+    stats.highWater = highWater_.load(std::memory_order_relaxed);
+    stats.depotSlots = depotSlots_;
+    stats.remoteFrees = remoteFreeCount_.load(std::memory_order_relaxed);
+    stats.hugePages = hugePagesUsed_;
+    return stats;
+}
+
+} // namespace js
@@ -0,0 +1,349 @@
+#include "../include/numeric_analysis.hpp"
+#include "../include/visitor.hpp"
+#include <algorithm>
+#include <unordered_set>
+
+namespace js {
+
+namespace {
+
+struct Unsupported {
+    std::string reason;
+};
+
+struct ExprInfo {
+    TypeSet type;
+    int registers;
+};
+
+// What a && b yields when a decides the result (a is falsy), and what a || b
+// yields when a is truthy.
+TypeSet falsyPart(TypeSet type) { return type & (TYPE_NUMBER | TYPE_FALSE | TYPE_UNDEFINED); }
+TypeSet truthyPart(TypeSet type) { return type & (TYPE_NUMBER | TYPE_TRUE); }
+
+bool isConsoleLog(const ASTNode* callee) {
+    auto* member = node_cast<MemberExpression>(callee);
+    if (!member || member->property != atoms::log) return false;
+    auto* object = node_cast<Identifier>(member->object.get());
+    return object && object->name == atoms::console;
+}
+
+std::string nameOf(Atom atom) {
+    return std::string(AtomTable::current().text(atom));
+}
+
+} // namespace
+
+// Types expressions of one function body, or of the top level when function
+// is null.
+class NumericTyper {
+public:
+    NumericTyper(NumericAnalysis& analysis, NumericFunction* function)
+        : analysis_(analysis), function_(function) {}
+
+    std::unordered_map<Atom, TypeSet> locals;
+    std::unordered_set<Atom> declaredGlobals;
+
+    ExprInfo expression(const ASTNode* node) {
+        switch (node->type) {
+            case NodeType::LITERAL: {
+                Value value = static_cast<const Literal*>(node)->value;
+                switch (value.tag()) {
+                    case Value::Tag::NUMBER: return {TYPE_NUMBER, 1};
+                    case Value::Tag::BOOLEAN: return {value.asBool() ? TYPE_TRUE : TYPE_FALSE, 1};
+                    case Value::Tag::UNDEFINED: return {TYPE_UNDEFINED, 1};
+                    case Value::Tag::STRING:
+                        if (function_) function_->usesStrings = true;
+                        return {TYPE_STRING, 1};
+                    default:
+                        throw Unsupported{"null value"};
+                }
+            }
+            case NodeType::IDENTIFIER:
+                return {identifier(static_cast<const Identifier*>(node)->name), 1};
+            case NodeType::UNARY_EXPRESSION: {
+                auto* unary = static_cast<const UnaryExpression*>(node);
+                ExprInfo argument = operand(unary->argument.get());
+                TypeSet type = unary->op == UnaryOp::NOT ? TYPE_BOOLEAN : TYPE_NUMBER;
+                return {type, argument.registers};
+            }
+            case NodeType::BINARY_EXPRESSION:
+                return binary(*static_cast<const BinaryExpression*>(node));
+            case NodeType::CALL_EXPRESSION:
+                return call(*static_cast<const CallExpression*>(node));
+            case NodeType::ASSIGNMENT_EXPRESSION:
+                throw Unsupported{"assignment"};
+            default:
+                break;
+        }
+        throw Unsupported{"unsupported expression"};
+    }
+
+    TypeSet statementExpression(const ASTNode* node) {
+        ExprInfo info = expression(node);
+        if (info.registers > NumericAnalysis::MaxTemporaries) {
+            throw Unsupported{"expression needs too many registers"};
+        }
+        return info.type;
+    }
+
+private:
+    NumericAnalysis& analysis_;
+    NumericFunction* function_;
+
+    TypeSet identifier(Atom name) {
+        if (function_) {
+            auto local = locals.find(name);
+            if (local != locals.end()) return local->second;
+        }
+        if (analysis_.functionIndex(name) >= 0) {
+            throw Unsupported{"function '" + nameOf(name) + "' used as a value"};
+        }
+        int global = analysis_.globalIndex(name);
+        if (global < 0) {
+            throw Unsupported{"reference to undeclared '" + nameOf(name) + "'"};
+        }
+        TypeSet type = analysis_.globalTypes_[global];
+        if (function_) {
+            function_->usesGlobals = true;
+            return type | TYPE_UNDEFINED;
+        }
+        return declaredGlobals.count(name) ? type : static_cast<TypeSet>(TYPE_UNDEFINED);
+    }
+
+    ExprInfo operand(const ASTNode* node) {
+        ExprInfo info = expression(node);
+        if (info.type & TYPE_STRING) {
+            throw Unsupported{"string operand"};
+        }
+        return info;
+    }
+
+    ExprInfo binary(const BinaryExpression& node) {
+        ExprInfo left = operand(node.left.get());
+        ExprInfo right = operand(node.right.get());
+        switch (node.op) {
+            case BinaryOp::AND:
+                return {static_cast<TypeSet>(falsyPart(left.type) | right.type),
+                        std::max(left.registers, right.registers)};
+            case BinaryOp::OR:
+                return {static_cast<TypeSet>(truthyPart(left.type) | right.type),
+                        std::max(left.registers, right.registers)};
+            case BinaryOp::POW:
+                if (function_) function_->leaf = false;
+                break;
+            default:
+                break;
+        }
+        bool comparison = node.op >= BinaryOp::LT && node.op <= BinaryOp::NE;
+        return {comparison ? TYPE_BOOLEAN : TYPE_NUMBER, std::max(left.registers, right.registers + 1)};
+    }
+
+    ExprInfo call(const CallExpression& node) {
+        if (isConsoleLog(node.callee.get())) {
+            throw Unsupported{"console.log outside a top-level statement"};
+        }
+        auto* callee = node_cast<Identifier>(node.callee.get());
+        if (!callee || (function_ && locals.count(callee->name))) {
+            throw Unsupported{"call through a value"};
+        }
+        int index = analysis_.functionIndex(callee->name);
+        if (index < 0) {
+            throw Unsupported{"call to unknown function '" + nameOf(callee->name) + "'"};
+        }
+        const NumericFunction& target = analysis_.functions_[index];
+        if (!target.lowerable) {
+            throw Unsupported{"calls '" + nameOf(callee->name) + "': " + target.reason};
+        }
+        if (node.arguments.size() != target.decl->params.size()) {
+            throw Unsupported{"argument count mismatch calling '" + nameOf(callee->name) + "'"};
+        }
+
+        int registers = 1;
+        for (size_t i = 0; i < node.arguments.size(); i++) {
+            ExprInfo argument = expression(node.arguments[i].get());
+            // Parameters are numbers; an argument still typed as nothing may
+            // become one once the callee's return type is known.
+            if (argument.type & ~TYPE_NUMBER) {
+                throw Unsupported{"non-numeric argument to '" + nameOf(callee->name) + "'"};
+            }
+            registers = std::max(registers, static_cast<int>(i) + argument.registers);
+        }
+        if (function_) {
+            function_->leaf = false;
+            function_->callees.push_back(static_cast<uint32_t>(index));
+        }
+        return {target.returns, registers};
+    }
+};
+
+NumericAnalysis::NumericAnalysis(const Program& program) : program_(program) {
+    for (const auto& stmt : program.body) {
+        if (auto* fn = node_cast<FunctionDeclaration>(stmt.get())) {
+            functionIndex_[fn->name] = static_cast<int>(functions_.size());
+            functions_.emplace_back();
+            functions_.back().decl = fn;
+        } else if (auto* var = node_cast<VariableDeclaration>(stmt.get())) {
+            if (globalIndex_.emplace(var->name, static_cast<int>(globals_.size())).second) {
+                globals_.push_back(var->name);
+            }
+        }
+    }
+    globalTypes_.assign(globals_.size(), 0);
+
+    // Return and global types only grow and functions only ever become
+    // unlowerable, so this reaches a fixed point.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto& function : functions_) {
+            changed |= analyzeFunction(function);
+        }
+        changed |= analyzeTopLevel();
+    }
+}
+
+int NumericAnalysis::functionIndex(Atom name) const {
+    auto it = functionIndex_.find(name);
+    return it == functionIndex_.end() ? -1 : it->second;
+}
+
+int NumericAnalysis::globalIndex(Atom name) const {
+    auto it = globalIndex_.find(name);
+    return it == globalIndex_.end() ? -1 : it->second;
+}
+
+TypeSet NumericAnalysis::argumentType(const ASTNode* argument) const {
+    auto it = argumentTypes_.find(argument);
+    return it == argumentTypes_.end() ? 0 : it->second;
+}
+
+bool NumericAnalysis::analyzeFunction(NumericFunction& function) {
+    if (!function.lowerable) {
+        return false;
+    }
+    const FunctionDeclaration& decl = *function.decl;
+    TypeSet returns = function.returns;
+    function.locals.clear();
+    function.callees.clear();
+    function.leaf = true;
+    function.usesGlobals = false;
+    function.usesStrings = false;
+
+    NumericTyper typer(*this, &function);
+    try {
+        if (decl.params.size() > MaxParameters) {
+            throw Unsupported{"too many parameters"};
+        }
+        for (Atom param : decl.params) {
+            if (typer.locals.emplace(param, TYPE_NUMBER).second) {
+                function.locals.push_back(param);
+            }
+        }
+
+        bool returnsExplicitly = false;
+        for (const auto& stmt : decl.body) {
+            switch (stmt->type) {
+                case NodeType::VARIABLE_DECLARATION: {
+                    auto* var = static_cast<const VariableDeclaration*>(stmt.get());
+                    TypeSet type = var->init ? typer.statementExpression(var->init.get())
+                                             : static_cast<TypeSet>(TYPE_UNDEFINED);
+                    if (type & TYPE_STRING) {
+                        throw Unsupported{"string local"};
+                    }
+                    auto inserted = typer.locals.emplace(var->name, type);
+                    if (inserted.second) {
+                        function.locals.push_back(var->name);
+                    } else {
+                        inserted.first->second |= type;
+                    }
+                    break;
+                }
+                case NodeType::RETURN_STATEMENT: {
+                    auto* ret = static_cast<const ReturnStatement*>(stmt.get());
+                    returns |= ret->argument ? typer.statementExpression(ret->argument.get())
+                                             : static_cast<TypeSet>(TYPE_UNDEFINED);
+                    returnsExplicitly = true;
+                    break;
+                }
+                case NodeType::FUNCTION_DECLARATION:
+                    throw Unsupported{"nested function"};
+                case NodeType::BLOCK_STATEMENT:
+                case NodeType::IF_STATEMENT:
+                case NodeType::WHILE_STATEMENT:
+                    throw Unsupported{"control flow"};
+                default:
+                    typer.statementExpression(stmt.get());
+                    break;
+            }
+        }
+        if (!returnsExplicitly) {
+            returns |= TYPE_UNDEFINED;
+        }
+    } catch (const Unsupported& unsupported) {
+        function.lowerable = false;
+        function.reason = unsupported.reason;
+        return true;
+    }
+
+    bool changed = returns != function.returns;
+    function.returns = returns;
+    return changed;
+}
+
+bool NumericAnalysis::analyzeTopLevel() {
+    bool changed = false;
+    topLevelReason_.clear();
+    argumentTypes_.clear();
+
+    NumericTyper typer(*this, nullptr);
+    try {
+        for (const auto& stmt : program_.body) {
+            switch (stmt->type) {
+                case NodeType::VARIABLE_DECLARATION: {
+                    auto* var = static_cast<const VariableDeclaration*>(stmt.get());
+                    TypeSet type = var->init ? typer.statementExpression(var->init.get())
+                                             : static_cast<TypeSet>(TYPE_UNDEFINED);
+                    TypeSet& slot = globalTypes_[globalIndex(var->name)];
+                    if ((slot | type) != slot) {
+                        slot |= type;
+                        changed = true;
+                    }
+                    typer.declaredGlobals.insert(var->name);
+                    break;
+                }
+                case NodeType::FUNCTION_DECLARATION:
+                    break;
+                case NodeType::RETURN_STATEMENT:
+                    throw Unsupported{"top-level return"};
+                case NodeType::BLOCK_STATEMENT:
+                case NodeType::IF_STATEMENT:
+                case NodeType::WHILE_STATEMENT:
+                    throw Unsupported{"control flow"};
+                case NodeType::CALL_EXPRESSION: {
+                    auto* call = static_cast<const CallExpression*>(stmt.get());
+                    if (isConsoleLog(call->callee.get())) {
+                        for (const auto& argument : call->arguments) {
+                            TypeSet type = typer.statementExpression(argument.get());
+                            if (!isPrintable(type)) {
+                                throw Unsupported{"console.log argument of mixed type"};
+                            }
+                            argumentTypes_[argument.get()] = type;
+                        }
+                        break;
+                    }
+                    typer.statementExpression(stmt.get());
+                    break;
+                }
+                default:
+                    typer.statementExpression(stmt.get());
+                    break;
+            }
+        }
+    } catch (const Unsupported& unsupported) {
+        topLevelReason_ = unsupported.reason;
+    }
+    return changed;
+}
+
+} // namespace js
@@ -0,0 +1,66 @@
+#include "../include/operations.hpp"
+#include <cmath>
+
+namespace js {
+
+namespace {
+
+std::string_view stringOf(Value value) {
+    return AtomTable::current().text(value.asAtom());
+}
+
+// Relational comparison: strings compare by code unit, everything else as
+// numbers (where NaN makes every comparison false).
+template<typename Compare>
+bool compare(Value left, Value right, Compare cmp) {
+    if (left.isString() && right.isString()) {
+        return cmp(stringOf(left).compare(stringOf(right)), 0);
+    }
+    return cmp(toNumber(left), toNumber(right));
+}
+
+} // namespace
+
+Value evaluateBinary(BinaryOp op, Value left, Value right) {
+    switch (op) {
+        case BinaryOp::ADD:
+            if (left.isString() || right.isString()) {
+                std::string text = toString(left);
+                text += toString(right);
+                return Value::fromAtom(AtomTable::current().intern(text));
+            }
+            return Value::fromNumber(toNumber(left) + toNumber(right));
+        case BinaryOp::SUB: return Value::fromNumber(toNumber(left) - toNumber(right));
+        case BinaryOp::MUL: return Value::fromNumber(toNumber(left) * toNumber(right));
+        case BinaryOp::DIV: return Value::fromNumber(toNumber(left) / toNumber(right));
+        case BinaryOp::POW: return Value::fromNumber(std::pow(toNumber(left), toNumber(right)));
+        case BinaryOp::LT: return Value::fromBool(compare(left, right, [](auto x, auto y) { return x < y; }));
+        case BinaryOp::GT: return Value::fromBool(compare(left, right, [](auto x, auto y) { return x > y; }));
+        case BinaryOp::LE: return Value::fromBool(compare(left, right, [](auto x, auto y) { return x <= y; }));
+        case BinaryOp::GE: return Value::fromBool(compare(left, right, [](auto x, auto y) { return x >= y; }));
+        case BinaryOp::EQ: return Value::fromBool(looselyEquals(left, right));
+        case BinaryOp::NE: return Value::fromBool(!looselyEquals(left, right));
+        case BinaryOp::AND: return isTruthy(left) ? right : left;
+        case BinaryOp::OR: return isTruthy(left) ? left : right;
+        case BinaryOp::BIT_AND:
+            return Value::fromNumber(toInt32(toNumber(left)) & toInt32(toNumber(right)));
+        case BinaryOp::BIT_OR:
+            return Value::fromNumber(toInt32(toNumber(left)) | toInt32(toNumber(right)));
+        case BinaryOp::COUNT:
+            break;
+    }
+    return Value::undefined();
+}
+
+Value evaluateUnary(UnaryOp op, Value argument) {
+    switch (op) {
+        case UnaryOp::NOT: return Value::fromBool(!isTruthy(argument));
+        case UnaryOp::NEG: return Value::fromNumber(-toNumber(argument));
+        case UnaryOp::PLUS: return Value::fromNumber(toNumber(argument));
+        case UnaryOp::COUNT:
+            break;
+    }
+    return Value::undefined();
+}
+
+} // namespace js
@@ -1,378 +1,1015 @@
 #include "../include/optimizer.hpp"
-#include <stdexcept>
-#include <cmath>
-#include <iostream>
+#include "../include/loops.hpp"
+#include "../include/operations.hpp"
+#include "../include/thread_pool.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <utility>
 
 namespace js {
 
-NodePtr Optimizer::optimizeExpression(NodePtr node) {
-    if (!node) return nullptr;
-    
-    if (auto* unary = dynamic_cast<UnaryExpression*>(node.get())) {
-        unary->argument = optimizeExpression(std::move(unary->argument));
-        optimizeUnary(node);
-    }
-    else if (auto* binary = dynamic_cast<BinaryExpression*>(node.get())) {
-        binary->left = optimizeExpression(std::move(binary->left));
-        binary->right = optimizeExpression(std::move(binary->right));
-        constantFolding(node);
-        deadCodeElimination(node);
-    }
-    else if (auto* call = dynamic_cast<CallExpression*>(node.get())) {
-        // Handle console.log
-        if (auto* member = dynamic_cast<MemberExpression*>(call->callee.get())) {
-            if (auto* obj = dynamic_cast<Identifier*>(member->object.get())) {
-                if (obj->name == "console" && member->property == "log") {
-                    // Evaluate and print arguments
-                    for (size_t i = 0; i < call->arguments.size(); i++) {
-                        auto arg = optimizeExpression(std::move(call->arguments[i]));
-                        if (auto* lit = dynamic_cast<Literal*>(arg.get())) {
-                            if (i > 0) std::cout << " ";
-                            if (std::holds_alternative<std::string>(lit->value)) {
-                                std::cout << std::get<std::string>(lit->value);
-                            } else if (std::holds_alternative<double>(lit->value)) {
-                                std::cout << std::get<double>(lit->value);
-                            } else if (std::holds_alternative<bool>(lit->value)) {
-                                std::cout << (std::get<bool>(lit->value) ? "true" : "false");
-                            }
-                        }
-                    }
-                    std::cout << std::endl;
-                    return node;
-                }
-            }
+namespace {
+
+class NameReads : public ASTVisitor<NameReads> {
+public:
+    explicit NameReads(const NameSet& names) : names_(names) {}
+    bool found = false;
+    void visitIdentifier(const Identifier& node) { found = found || names_.contains(node.name); }
+
+private:
+    const NameSet& names_;
+};
+
+// Assigning a variable needs its declaration as much as reading it does.
+class ReadMarker : public ASTVisitor<ReadMarker> {
+public:
+    explicit ReadMarker(NameSet& names) : names_(names) {}
+    void visitIdentifier(const Identifier& node) { names_.insert(node.name); }
+    void visitAssignmentExpression(const AssignmentExpression& node) {
+        names_.insert(node.name);
+        visitChild(node.value);
+    }
+
+private:
+    NameSet& names_;
+};
+
+class AssignmentTargets : public ASTVisitor<AssignmentTargets> {
+public:
+    explicit AssignmentTargets(NameSet& names) : names_(names) {}
+    void visitAssignmentExpression(const AssignmentExpression& node) {
+        names_.insert(node.name);
+        visitChild(node.value);
+    }
+
+private:
+    NameSet& names_;
+};
+
+template<typename Match>
+class NameMatcher : public ASTVisitor<NameMatcher<Match>> {
+public:
+    explicit NameMatcher(Match match) : match_(match) {}
+    bool found = false;
+    void visitIdentifier(const Identifier& node) { found = found || match_(node.name); }
+
+private:
+    Match match_;
+};
+
+// Whether the expression yields a number whatever its operands are.
+bool isNumber(const ASTNode* node) {
+    if (auto* literal = node_cast<Literal>(node)) return literal->value.isNumber();
+    if (auto* unary = node_cast<UnaryExpression>(node)) return unary->op != UnaryOp::NOT;
+    if (auto* binary = node_cast<BinaryExpression>(node)) {
+        switch (binary->op) {
+            case BinaryOp::ADD:
+                return isNumber(binary->left.get()) && isNumber(binary->right.get());
+            case BinaryOp::SUB:
+            case BinaryOp::MUL:
+            case BinaryOp::DIV:
+            case BinaryOp::POW:
+            case BinaryOp::BIT_AND:
+            case BinaryOp::BIT_OR:
+                return true;
+            default:
+                return false;
         }
-        
-        // Handle other function calls
-        call->callee = optimizeExpression(std::move(call->callee));
-        for (auto& arg : call->arguments) {
-            arg = optimizeExpression(std::move(arg));
+    }
+    return false;
+}
+
+bool isBoolean(const ASTNode* node) {
+    if (auto* literal = node_cast<Literal>(node)) return literal->value.isBoolean();
+    if (auto* unary = node_cast<UnaryExpression>(node)) return unary->op == UnaryOp::NOT;
+    if (auto* binary = node_cast<BinaryExpression>(node)) {
+        switch (binary->op) {
+            case BinaryOp::LT:
+            case BinaryOp::GT:
+            case BinaryOp::LE:
+            case BinaryOp::GE:
+            case BinaryOp::EQ:
+            case BinaryOp::NE:
+                return true;
+            default:
+                return false;
         }
     }
-    
-    return std::move(node);
+    return false;
 }
 
-NodePtr Optimizer::optimizeStatement(NodePtr node) {
-    if (!node) return nullptr;
-    
-    if (auto* ret = dynamic_cast<ReturnStatement*>(node.get())) {
-        ret->argument = optimizeExpression(std::move(ret->argument));
+// Compares bits, so 0 does not match -0.
+bool isNumberLiteral(const Literal* literal, double n) {
+    return literal && literal->value == Value::fromNumber(n);
+}
+
+size_t treeSize(const ASTNode* node) {
+    if (!node) return 0;
+    switch (node->type) {
+        case NodeType::UNARY_EXPRESSION:
+            return 1 + treeSize(static_cast<const UnaryExpression*>(node)->argument.get());
+        case NodeType::BINARY_EXPRESSION: {
+            auto* binary = static_cast<const BinaryExpression*>(node);
+            return 1 + treeSize(binary->left.get()) + treeSize(binary->right.get());
+        }
+        case NodeType::CALL_EXPRESSION: {
+            auto* call = static_cast<const CallExpression*>(node);
+            size_t size = 1 + treeSize(call->callee.get());
+            for (const auto& arg : call->arguments) size += treeSize(arg.get());
+            return size;
+        }
+        case NodeType::MEMBER_EXPRESSION:
+            return 1 + treeSize(static_cast<const MemberExpression*>(node)->object.get());
+        case NodeType::ASSIGNMENT_EXPRESSION:
+            return 1 + treeSize(static_cast<const AssignmentExpression*>(node)->value.get());
+        case NodeType::VARIABLE_DECLARATION:
+            return 1 + treeSize(static_cast<const VariableDeclaration*>(node)->init.get());
+        case NodeType::RETURN_STATEMENT:
+            return 1 + treeSize(static_cast<const ReturnStatement*>(node)->argument.get());
+        case NodeType::FUNCTION_DECLARATION: {
+            size_t size = 1;
+            for (const auto& stmt : static_cast<const FunctionDeclaration*>(node)->body) size += treeSize(stmt.get());
+            return size;
+        }
+        default:
+            return 1;
     }
-    
-    return std::move(node);
 }
 
-NodePtr Optimizer::optimizeDeclaration(NodePtr node) {
-    if (!node) return nullptr;
-    
-    if (auto* varDecl = dynamic_cast<VariableDeclaration*>(node.get())) {
-        varDecl->init = optimizeExpression(std::move(varDecl->init));
-    }
-    else if (auto* funcDecl = dynamic_cast<FunctionDeclaration*>(node.get())) {
-        auto newFuncDecl = std::make_unique<FunctionDeclaration>();
-        newFuncDecl->name = funcDecl->name;
-        newFuncDecl->params = funcDecl->params;
-        
-        for (auto& stmt : funcDecl->body) {
-            newFuncDecl->body.push_back(optimizeStatement(std::move(stmt)));
-        }
-        
-        functionMap[funcDecl->name] = std::move(newFuncDecl);
-    }
-    
-    return std::move(node);
-}
-
-void Optimizer::optimizeUnary(NodePtr& node) {
-    if (auto* unary = dynamic_cast<UnaryExpression*>(node.get())) {
-        if (auto* lit = dynamic_cast<Literal*>(unary->argument.get())) {
-            try {
-                auto result = std::make_unique<Literal>();
-                
-                if (unary->op == "!") {
-                    result->value = !isTruthy(lit);
-                }
-                else if (unary->op == "-") {
-                    if (std::holds_alternative<double>(lit->value)) {
-                        result->value = -std::get<double>(lit->value);
-                    }
+// Parameters and `let` locals feeding at most one final `return`, small
+// enough to copy into a call site.
+bool isInlineCandidate(const FunctionDeclaration& function) {
+    const auto& params = function.params;
+    for (size_t i = 0; i < params.size(); i++) {
+        if (std::find(params.begin(), params.begin() + i, params[i]) != params.begin() + i) return false;
+    }
+    for (size_t i = 0; i < function.body.size(); i++) {
+        NodeType type = function.body[i]->type;
+        bool last = i + 1 == function.body.size();
+        if (type != NodeType::VARIABLE_DECLARATION && !(last && type == NodeType::RETURN_STATEMENT)) return false;
+    }
+    return treeSize(&function) <= Optimizer::MaxInlineBody;
+}
+
+class MentionCollector : public ASTVisitor<MentionCollector> {
+public:
+    explicit MentionCollector(std::vector<Atom>& names) : names_(names) {}
+    void visitIdentifier(const Identifier& node) { names_.push_back(node.name); }
+
+private:
+    std::vector<Atom>& names_;
+};
+
+constexpr uint32_t NoFunction = UINT32_MAX;
+constexpr size_t NoBinding = SIZE_MAX;
+
+// Whether some call of a function could end up with only literal
+// arguments. Top-level variables count, since propagation may replace them.
+class LiteralCalls : public ASTVisitor<LiteralCalls> {
+public:
+    LiteralCalls(const std::vector<uint32_t>& callable, const NameSet& variables)
+        : callable_(callable), variables_(variables) {}
+    bool found = false;
+    void visitCallExpression(const CallExpression& node) {
+        auto* callee = node_cast<Identifier>(node.callee.get());
+        if (callee && callee->name.id < callable_.size() && callable_[callee->name.id] != NoFunction &&
+            std::all_of(node.arguments.begin(), node.arguments.end(),
+                        [&](const NodePtr& argument) { return constant(argument.get()); })) {
+            found = true;
+            return;
+        }
+        visitChild(node.callee);
+        visitList(node.arguments);
+    }
+
+private:
+    const std::vector<uint32_t>& callable_;
+    const NameSet& variables_;
+
+    bool constant(const ASTNode* node) const {
+        if (node_cast<Literal>(node)) return true;
+        if (auto* name = node_cast<Identifier>(node)) return variables_.contains(name->name);
+        if (auto* unary = node_cast<UnaryExpression>(node)) return constant(unary->argument.get());
+        if (auto* binary = node_cast<BinaryExpression>(node)) {
+            return constant(binary->left.get()) && constant(binary->right.get());
+        }
+        return false;
+    }
+};
+
+// The top-level functions, with an edge wherever a body mentions a
+// function's name, since a function value can be called from anywhere it
+// flows. Functions are grouped by level: a body only mentions functions of
+// lower levels, or of its own strongly connected component, whose members
+// are recursive.
+struct CallGraph {
+    std::vector<uint32_t> level;
+    std::vector<bool> recursive;
+    // Callers of f are callers[callerStart[f], callerStart[f + 1]).
+    std::vector<uint32_t> callerStart;
+    std::vector<uint32_t> callers;
+
+    CallGraph(const std::vector<NodePtr*>& functions, const std::vector<uint32_t>& functionOf);
+};
+
+CallGraph::CallGraph(const std::vector<NodePtr*>& functions, const std::vector<uint32_t>& functionOf) {
+    auto n = static_cast<uint32_t>(functions.size());
+    if (n == 0) return;
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    std::vector<Atom> names;
+    for (uint32_t f = 0; f < n; f++) {
+        names.clear();
+        MentionCollector(names).visit(functions[f]->get());
+        for (Atom name : names) {
+            if (name.id < functionOf.size() && functionOf[name.id] != NoFunction) {
+                edges.emplace_back(f, functionOf[name.id]);
+            }
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    std::vector<uint32_t> calleeStart(n + 1, 0);
+    callerStart.assign(n + 1, 0);
+    for (const auto& edge : edges) {
+        calleeStart[edge.first + 1]++;
+        callerStart[edge.second + 1]++;
+    }
+    for (uint32_t f = 0; f < n; f++) {
+        calleeStart[f + 1] += calleeStart[f];
+        callerStart[f + 1] += callerStart[f];
+    }
+    callers.resize(edges.size());
+    std::vector<uint32_t> fill(callerStart.begin(), callerStart.end() - 1);
+    for (const auto& edge : edges) {
+        callers[fill[edge.second]++] = edge.first;
+    }
+
+    // Tarjan's algorithm without recursion. A component is complete before
+    // any component that reaches it, so callees get their level first.
+    constexpr uint32_t Unvisited = UINT32_MAX;
+    std::vector<uint32_t> index(n, Unvisited), low(n), component(n, Unvisited), stack;
+    std::vector<bool> onStack(n, false);
+    std::vector<std::pair<uint32_t, uint32_t>> frames; // function, next edge
+    level.assign(n, 0);
+    recursive.assign(n, false);
+    uint32_t visited = 0;
+    auto enter = [&](uint32_t f) {
+        index[f] = low[f] = visited++;
+        stack.push_back(f);
+        onStack[f] = true;
+        frames.emplace_back(f, calleeStart[f]);
+    };
+    for (uint32_t root = 0; root < n; root++) {
+        if (index[root] != Unvisited) continue;
+        enter(root);
+        while (!frames.empty()) {
+            uint32_t f = frames.back().first;
+            uint32_t& next = frames.back().second;
+            if (next < calleeStart[f + 1]) {
+                uint32_t callee = edges[next++].second;
+                if (index[callee] == Unvisited) {
+                    enter(callee);
+                } else if (onStack[callee]) {
+                    low[f] = std::min(low[f], index[callee]);
                 }
-                else if (unary->op == "+") {
-                    if (std::holds_alternative<double>(lit->value)) {
-                        result->value = std::get<double>(lit->value);
-                    }
-                    else if (std::holds_alternative<std::string>(lit->value)) {
-                        try {
-                            result->value = std::stod(std::get<std::string>(lit->value));
-                        } catch (...) {
-                            result->value = std::numeric_limits<double>::quiet_NaN();
-                        }
+                continue;
+            }
+            frames.pop_back();
+            if (!frames.empty()) {
+                uint32_t parent = frames.back().first;
+                low[parent] = std::min(low[parent], low[f]);
+            }
+            if (low[f] != index[f]) continue;
+
+            size_t begin = stack.size();
+            while (stack[--begin] != f) {}
+            uint32_t componentLevel = 0;
+            bool cyclic = stack.size() - begin > 1;
+            for (size_t i = begin; i < stack.size(); i++) component[stack[i]] = f;
+            for (size_t i = begin; i < stack.size(); i++) {
+                uint32_t member = stack[i];
+                for (uint32_t e = calleeStart[member]; e < calleeStart[member + 1]; e++) {
+                    uint32_t callee = edges[e].second;
+                    if (callee == member) {
+                        cyclic = true;
+                    } else if (component[callee] != f) {
+                        componentLevel = std::max(componentLevel, level[callee] + 1);
                     }
                 }
-                
-                node = std::move(result);
-            } catch (const std::bad_variant_access&) {}
-        }
-        else if (auto* nestedUnary = dynamic_cast<UnaryExpression*>(unary->argument.get())) {
-            if (unary->op == "!" && nestedUnary->op == "!") {
-                node = std::move(nestedUnary->argument);
             }
-            else if (unary->op == "-" && nestedUnary->op == "-") {
-                node = std::move(nestedUnary->argument);
+            for (size_t i = begin; i < stack.size(); i++) {
+                level[stack[i]] = componentLevel;
+                recursive[stack[i]] = cyclic;
+                onStack[stack[i]] = false;
             }
+            stack.resize(begin);
         }
     }
 }
 
-void Optimizer::constantFolding(NodePtr& node) {
-    if (auto* binary = dynamic_cast<BinaryExpression*>(node.get())) {
-        auto* leftLit = dynamic_cast<Literal*>(binary->left.get());
-        auto* rightLit = dynamic_cast<Literal*>(binary->right.get());
-        
-        if (leftLit && rightLit) {
-            try {
-                auto result = std::make_unique<Literal>();
-                
-                if (std::holds_alternative<double>(leftLit->value) && 
-                    std::holds_alternative<double>(rightLit->value)) {
-                    auto leftNum = std::get<double>(leftLit->value);
-                    auto rightNum = std::get<double>(rightLit->value);
-                    
-                    if (binary->op == "+") {
-                        result->value = leftNum + rightNum;
-                    }
-                    else if (binary->op == "-") {
-                        result->value = leftNum - rightNum;
-                    }
-                    else if (binary->op == "*") {
-                        result->value = leftNum * rightNum;
-                    }
-                    else if (binary->op == "/") {
-                        if (rightNum == 0) {
-                            throw std::runtime_error("Division by zero");
-                        }
-                        result->value = leftNum / rightNum;
-                    }
-                    else if (binary->op == "**") {
-                        result->value = std::pow(leftNum, rightNum);
-                    }
-                    else if (binary->op == "<") {
-                        result->value = leftNum < rightNum;
-                    }
-                    else if (binary->op == ">") {
-                        result->value = leftNum > rightNum;
-                    }
-                    else if (binary->op == "<=") {
-                        result->value = leftNum <= rightNum;
-                    }
-                    else if (binary->op == ">=") {
-                        result->value = leftNum >= rightNum;
-                    }
-                    else if (binary->op == "==") {
-                        result->value = leftNum == rightNum;
-                    }
-                    else if (binary->op == "!=") {
-                        result->value = leftNum != rightNum;
-                    }
+} // namespace
+
+NodePtr Optimizer::optimizeProgram(NodePtr node) {
+    auto* program = node_cast<Program>(node.get());
+    if (!program) {
+        rewrite(node);
+        return node;
+    }
+
+    // A call of a name reaches its last function declaration, unless a
+    // variable of the same name can replace the function.
+    std::vector<NodePtr*> functions;
+    std::vector<uint32_t> functionOf;
+    NameSet& declared = declaredNames;
+    NameSet variables;
+    for (auto& stmt : program->body) {
+        if (auto* function = node_cast<FunctionDeclaration>(stmt.get())) {
+            if (function->name.id >= functionOf.size()) functionOf.resize(function->name.id + 1, NoFunction);
+            functionOf[function->name.id] = static_cast<uint32_t>(functions.size());
+            functions.push_back(&stmt);
+            declared.insert(function->name);
+            AssignmentTargets(programClobbered).visit(function);
+        } else if (auto* var = node_cast<VariableDeclaration>(stmt.get())) {
+            declared.insert(var->name);
+            variables.insert(var->name);
+        }
+    }
+    AssignmentTargets(programAssigned).visit(program);
+    CallGraph graph(functions, functionOf);
+
+    // Calls of a pure function are evaluated once its level is optimized,
+    // and not while it is being optimized again. Without a call that could
+    // get literal arguments, as when the program is already optimized,
+    // there is nothing to evaluate.
+    std::vector<uint32_t>& callable = callableFunctions;
+    callable.assign(functionOf.begin(), functionOf.end());
+    for (uint32_t f = 0; f < functions.size(); f++) {
+        Atom name = static_cast<const FunctionDeclaration&>(**functions[f]).name;
+        if (variables.contains(name) || programAssigned.contains(name)) callable[name.id] = NoFunction;
+    }
+    LiteralCalls literalCalls(callable, variables);
+    literalCalls.visit(program);
+    std::vector<bool>& pure = pureFunctions;
+    FunctionTargets& evaluable = evaluableFunctions;
+    std::optional<CallEvaluator> calls;
+    if (literalCalls.found) {
+        findPureFunctions(functions, callable, pure);
+        evaluable.assign(functionOf.size(), nullptr);
+        evaluator = &calls.emplace(evaluable);
+    }
+
+    InlineTargets targets(functionOf.size(), nullptr);
+    ConstantBindings globals;
+    inlineTargets = &targets;
+    globalNames = &declared;
+    globalConstants = &globals;
+    assignedNames = &programAssigned;
+    clobberedNames = &programClobbered;
+
+    // Optimizes the selected functions a level at a time, callees first,
+    // so each call is inlined from an optimized body.
+    auto optimizeLevels = [&](std::vector<uint32_t>& selected) {
+        std::sort(selected.begin(), selected.end(), [&](uint32_t a, uint32_t b) {
+            return graph.level[a] != graph.level[b] ? graph.level[a] < graph.level[b] : a < b;
+        });
+        std::vector<NodePtr*> batch;
+        for (size_t i = 0, end; i < selected.size(); i = end) {
+            batch.clear();
+            for (end = i; end < selected.size() && graph.level[selected[end]] == graph.level[selected[i]]; end++) {
+                auto& function = static_cast<FunctionDeclaration&>(**functions[selected[end]]);
+                if (evaluator && callable[function.name.id] == selected[end]) evaluable[function.name.id] = nullptr;
+                batch.push_back(functions[selected[end]]);
+            }
+            optimizeFunctions(batch);
+            for (size_t k = i; k < end; k++) {
+                auto& function = static_cast<FunctionDeclaration&>(**functions[selected[k]]);
+                if (evaluator && callable[function.name.id] == selected[k] && pure[selected[k]]) {
+                    evaluable[function.name.id] = &function;
                 }
-                else if (binary->op == "&&") {
-                    result->value = isTruthy(leftLit) && isTruthy(rightLit);
+                if (functionOf[function.name.id] == selected[k] && !variables.contains(function.name) &&
+                    !programAssigned.contains(function.name) && !graph.recursive[selected[k]]) {
+                    targets[function.name.id] = isInlineCandidate(function) ? &function : nullptr;
                 }
-                else if (binary->op == "||") {
-                    result->value = isTruthy(leftLit) || isTruthy(rightLit);
+            }
+        }
+    };
+
+    // From then on the top level and the bodies feed each other: the top
+    // level inlines bodies, and its constants flow into them. A body goes
+    // back on the worklist whenever a name it reads gains a known value, and
+    // so do the functions calling it, until nothing changes.
+    std::vector<uint32_t> selected(functions.size());
+    for (uint32_t f = 0; f < selected.size(); f++) selected[f] = f;
+    optimizeLevels(selected);
+    NameSet& known = knownNames;
+    std::vector<bool> queued;
+    for (;;) {
+        rewriteTopLevel(*program);
+        ConstantBindings exported;
+        for (bool loops = false;; loops = true) {
+            exported.clear();
+            if (size_t replaced = propagateConstants(program->body, nullptr, nullptr, clobberedNames, &exported)) {
+                counts[static_cast<size_t>(Pass::PROPAGATE)] += replaced;
+                rewriteTopLevel(*program);
+            }
+            if (loops || !optimizeLoops(program->body, nullptr)) break;
+            rewriteTopLevel(*program);
+        }
+        known.clear();
+        // A variable assigned anywhere is not the same everywhere.
+        for (const auto& entry : exported) {
+            if (!programAssigned.contains(entry.first) && globals.insert(entry).second) known.insert(entry.first);
+        }
+        if (known.empty()) break;
+
+        selected.clear();
+        queued.assign(functions.size(), false);
+        for (uint32_t f = 0; f < functions.size(); f++) {
+            NameReads reads(known);
+            reads.visit(functions[f]->get());
+            if (reads.found) {
+                queued[f] = true;
+                selected.push_back(f);
+            }
+        }
+        for (size_t i = 0; i < selected.size(); i++) {
+            uint32_t f = selected[i];
+            for (uint32_t e = graph.callerStart[f]; e < graph.callerStart[f + 1]; e++) {
+                if (!queued[graph.callers[e]]) {
+                    queued[graph.callers[e]] = true;
+                    selected.push_back(graph.callers[e]);
                 }
-                else if (binary->op == "+") {
-                    if (std::holds_alternative<std::string>(leftLit->value) || 
-                        std::holds_alternative<std::string>(rightLit->value)) {
-                        result->value = toString(leftLit) + toString(rightLit);
-                    }
+            }
+        }
+        if (selected.empty()) break;
+        optimizeLevels(selected);
+    }
+    known.clear();
+    prune(program->body, *program);
+    declared.clear();
+    programAssigned.clear();
+    programClobbered.clear();
+    assignedNames = nullptr;
+    clobberedNames = nullptr;
+    globalConstants = nullptr;
+    globalNames = nullptr;
+    evaluator = nullptr;
+    inlineTargets = nullptr;
+    return node;
+}
+
+void Optimizer::rewriteTopLevel(Program& program) {
+    for (auto& stmt : program.body) {
+        if (stmt->type != NodeType::FUNCTION_DECLARATION) {
+            rewrite(stmt);
+        }
+    }
+}
+
+void Optimizer::prune(NodeList& body, const ASTNode& scope) {
+    ReadMarker(readNames).visit(&scope);
+    auto unused = [&](const NodePtr& stmt) {
+        auto* var = node_cast<VariableDeclaration>(stmt.get());
+        return var && (!var->init || var->init->type == NodeType::LITERAL) && !readNames.contains(var->name);
+    };
+    size_t before = body.size();
+    body.erase(std::remove_if(body.begin(), body.end(), unused), body.end());
+    counts[static_cast<size_t>(Pass::PRUNE)] += before - body.size();
+    readNames.clear();
+}
+
+void Optimizer::optimizeFunctions(const std::vector<NodePtr*>& functions) {
+    if (!pool || pool->size() < 2 || functions.size() < MinParallelFunctions) {
+        for (NodePtr* function : functions) {
+            rewrite(*function);
+        }
+        return;
+    }
+
+    // Each chunk of functions gets its own optimizer and arena; the arenas
+    // join the current one once every chunk is done. A worker allocates only
+    // from its own arena: lists of the tree it rewrites belong to the
+    // current arena, so a rewrite may replace such a list with a new one but
+    // never grow it. The chunk arenas live in the current arena, since the
+    // lists a worker built keep allocating through its arena, which forwards
+    // to the current one after absorb().
+    size_t chunks = std::min(functions.size(), pool->size() * 4);
+    std::vector<Arena*> arenas(chunks);
+    for (auto& arena : arenas) {
+        arena = new (Arena::current()->allocate(sizeof(Arena), alignof(Arena))) Arena();
+    }
+    std::vector<PassCounts> chunkCounts(chunks);
+    AtomTable& atoms = AtomTable::current();
+    std::exception_ptr error;
+    {
+        ConcurrentAtomScope sharedAtoms(atoms);
+        try {
+            pool->parallel_for(0, chunks, 1, [&](size_t chunk) {
+                ArenaScope arenaScope(*arenas[chunk]);
+                AtomScope atomScope(atoms);
+                Optimizer worker;
+                worker.inlineTargets = inlineTargets;
+                worker.evaluator = evaluator;
+                worker.globalNames = globalNames;
+                worker.globalConstants = globalConstants;
+                worker.assignedNames = assignedNames;
+                worker.clobberedNames = clobberedNames;
+                size_t end = (chunk + 1) * functions.size() / chunks;
+                for (size_t i = chunk * functions.size() / chunks; i < end; i++) {
+                    worker.rewrite(*functions[i]);
                 }
-                
-                node = std::move(result);
-            } catch (const std::bad_variant_access&) {}
+                chunkCounts[chunk] = worker.counts;
+            });
+        } catch (...) {
+            error = std::current_exception();
         }
     }
+    for (auto& arena : arenas) {
+        Arena::current()->absorb(*arena);
+    }
+    for (const PassCounts& chunk : chunkCounts) {
+        for (size_t i = 0; i < counts.size(); i++) counts[i] += chunk[i];
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+NodePtr Optimizer::optimizeExpression(NodePtr node) {
+    rewrite(node);
+    return node;
 }
 
-bool Optimizer::isTruthy(const Literal* lit) {
-    if (std::holds_alternative<bool>(lit->value)) {
-        return std::get<bool>(lit->value);
+NodePtr Optimizer::optimizeStatement(NodePtr node) {
+    rewrite(node);
+    return node;
+}
+
+NodePtr Optimizer::optimizeDeclaration(NodePtr node) {
+    rewrite(node);
+    return node;
+}
+
+void Optimizer::rewriteUnaryExpression(NodePtr& slot, UnaryExpression& node) {
+    ASTRewriter::rewriteUnaryExpression(slot, node);
+    simplify(slot);
+}
+
+void Optimizer::rewriteBinaryExpression(NodePtr& slot, BinaryExpression& node) {
+    ASTRewriter::rewriteBinaryExpression(slot, node);
+    simplify(slot);
+}
+
+void Optimizer::rewriteCallExpression(NodePtr& slot, CallExpression& node) {
+    ASTRewriter::rewriteCallExpression(slot, node);
+    simplify(slot);
+}
+
+void Optimizer::rewriteFunctionDeclaration(NodePtr& slot, FunctionDeclaration& node) {
+    size_t outer = localNames.size();
+    localNames.insert(localNames.end(), node.params.begin(), node.params.end());
+    for (const auto& stmt : node.body) {
+        if (auto* var = node_cast<VariableDeclaration>(stmt.get())) {
+            localNames.push_back(var->name);
+        } else if (auto* function = node_cast<FunctionDeclaration>(stmt.get())) {
+            localNames.push_back(function->name);
+        }
+    }
+    ASTRewriter::rewriteFunctionDeclaration(slot, node);
+    if (outer == 0) {
+        // Loop rewrites leave constants and copies for another round.
+        for (bool loops = false;; loops = true) {
+            if (size_t replaced = propagateConstants(node.body, &node.params, globalConstants, clobberedNames, nullptr)) {
+                counts[static_cast<size_t>(Pass::PROPAGATE)] += replaced;
+                ASTRewriter::rewriteFunctionDeclaration(slot, node);
+            }
+            if (loops || !optimizeLoops(node.body, &node.params)) break;
+            ASTRewriter::rewriteFunctionDeclaration(slot, node);
+        }
+        prune(node.body, node);
     }
-    else if (std::holds_alternative<double>(lit->value)) {
-        return std::get<double>(lit->value) != 0;
+    localNames.resize(outer);
+}
+
+bool Optimizer::optimizeLoops(NodeList& body, const std::pmr::vector<Atom>* params) {
+    LoopRewrites rewrites = js::optimizeLoops(body, params, globalNames, clobberedNames);
+    counts[static_cast<size_t>(Pass::HOIST)] += rewrites.hoisted;
+    counts[static_cast<size_t>(Pass::REDUCE)] += rewrites.reduced;
+    counts[static_cast<size_t>(Pass::UNROLL)] += rewrites.unrolled;
+    return rewrites.any();
+}
+
+void Optimizer::rewriteBlockStatement(NodePtr& slot, BlockStatement& node) {
+    size_t outer = localNames.size();
+    for (const auto& stmt : node.body) {
+        if (auto* var = node_cast<VariableDeclaration>(stmt.get())) localNames.push_back(var->name);
     }
-    else if (std::holds_alternative<std::string>(lit->value)) {
-        return !std::get<std::string>(lit->value).empty();
+    ASTRewriter::rewriteBlockStatement(slot, node);
+    localNames.resize(outer);
+}
+
+// A literal test decides the branch, or that the loop never runs.
+void Optimizer::rewriteIfStatement(NodePtr& slot, IfStatement& node) {
+    ASTRewriter::rewriteIfStatement(slot, node);
+    auto* test = node_cast<Literal>(node.test.get());
+    if (!test) return;
+    NodePtr taken = std::move(isTruthy(test->value) ? node.consequent : node.alternate);
+    slot = taken ? std::move(taken) : std::make_unique<BlockStatement>();
+    count(Pass::SIMPLIFY);
+}
+
+void Optimizer::rewriteWhileStatement(NodePtr& slot, WhileStatement& node) {
+    ASTRewriter::rewriteWhileStatement(slot, node);
+    auto* test = node_cast<Literal>(node.test.get());
+    if (!test || isTruthy(test->value)) return;
+    slot = std::make_unique<BlockStatement>();
+    count(Pass::SIMPLIFY);
+}
+
+// Every rewrite leaves a smaller tree in the slot, so this ends.
+void Optimizer::simplify(NodePtr& slot) {
+    for (;;) {
+        bool changed = false;
+        switch (slot->type) {
+            case NodeType::UNARY_EXPRESSION:
+                changed = optimizeUnary(slot);
+                break;
+            case NodeType::BINARY_EXPRESSION:
+                changed = constantFolding(slot) || deadCodeElimination(slot);
+                break;
+            case NodeType::CALL_EXPRESSION:
+                changed = evaluateCall(slot) || inlineFunctionCall(slot);
+                break;
+            default:
+                break;
+        }
+        if (!changed) return;
     }
-    return false;
 }
 
-std::string Optimizer::toString(const Literal* lit) {
-    if (std::holds_alternative<std::string>(lit->value)) {
-        return std::get<std::string>(lit->value);
+bool Optimizer::isLocal(Atom name) const {
+    return std::find(localNames.begin(), localNames.end(), name) != localNames.end();
+}
+
+bool Optimizer::hasNoEffects(const ASTNode* node) const {
+    switch (node->type) {
+        case NodeType::LITERAL:
+            return true;
+        case NodeType::IDENTIFIER: {
+            // Reading an undeclared global throws.
+            Atom name = static_cast<const Identifier*>(node)->name;
+            return isLocal(name) || (globalNames && globalNames->contains(name));
+        }
+        case NodeType::UNARY_EXPRESSION:
+            return hasNoEffects(static_cast<const UnaryExpression*>(node)->argument.get());
+        case NodeType::BINARY_EXPRESSION: {
+            auto* binary = static_cast<const BinaryExpression*>(node);
+            return hasNoEffects(binary->left.get()) && hasNoEffects(binary->right.get());
+        }
+        default:
+            return false;
     }
-    else if (std::holds_alternative<double>(lit->value)) {
-        return std::to_string(std::get<double>(lit->value));
+}
+
+bool Optimizer::readsAssignedGlobal(const ASTNode* node) const {
+    if (!assignedNames) return false;
+    NameMatcher matcher([&](Atom name) { return assignedNames->contains(name) && !isLocal(name); });
+    matcher.visit(node);
+    return matcher.found;
+}
+
+bool Optimizer::optimizeUnary(NodePtr& node) {
+    auto* unary = node_cast<UnaryExpression>(node.get());
+    if (!unary) return false;
+    if (auto* lit = node_cast<Literal>(unary->argument.get())) {
+        lit->value = evaluateUnary(unary->op, lit->value);
+        node = std::move(unary->argument);
+        count(Pass::FOLD);
+        return true;
     }
-    else if (std::holds_alternative<bool>(lit->value)) {
-        return std::get<bool>(lit->value) ? "true" : "false";
+
+    // +x is x only for numbers, and so is -(-x); !!x is x only for booleans.
+    NodePtr* result = nullptr;
+    if (unary->op == UnaryOp::PLUS) {
+        if (isNumber(unary->argument.get())) result = &unary->argument;
+    } else if (auto* nested = node_cast<UnaryExpression>(unary->argument.get())) {
+        if (nested->op == unary->op) {
+            const ASTNode* inner = nested->argument.get();
+            if (unary->op == UnaryOp::NOT ? isBoolean(inner) : isNumber(inner)) result = &nested->argument;
+        }
     }
-    return "undefined";
+    if (!result) return false;
+    node = std::move(*result);
+    count(Pass::SIMPLIFY);
+    return true;
 }
 
-void Optimizer::deadCodeElimination(NodePtr& node) {
-    if (auto* binary = dynamic_cast<BinaryExpression*>(node.get())) {
-        auto* leftLit = dynamic_cast<Literal*>(binary->left.get());
-        auto* rightLit = dynamic_cast<Literal*>(binary->right.get());
-        
-        if (binary->op == "*") {
-            bool isZero = false;
-            if (leftLit) {
-                try {
-                    auto leftNum = std::get<double>(leftLit->value);
-                    if (leftNum == 0) isZero = true;
-                    else if (leftNum == 1) {
-                        node = std::move(binary->right);
-                        return;
-                    }
-                } catch (const std::bad_variant_access&) {}
+// The left literal becomes the result, so folding allocates nothing.
+bool Optimizer::constantFolding(NodePtr& node) {
+    auto* binary = node_cast<BinaryExpression>(node.get());
+    if (!binary) return false;
+    auto* leftLit = node_cast<Literal>(binary->left.get());
+    auto* rightLit = node_cast<Literal>(binary->right.get());
+    if (!leftLit || !rightLit) return false;
+    leftLit->value = evaluateBinary(binary->op, leftLit->value, rightLit->value);
+    node = std::move(binary->left);
+    count(Pass::FOLD);
+    return true;
+}
+
+// Only identities that hold for every operand value: x * 0 is not 0 for NaN,
+// infinities or negative x, x + 0 is not x for strings or -0, and dropping
+// an operand must not drop its effects.
+bool Optimizer::deadCodeElimination(NodePtr& node) {
+    auto* binary = node_cast<BinaryExpression>(node.get());
+    if (!binary) return false;
+    auto* leftLit = node_cast<Literal>(binary->left.get());
+    auto* rightLit = node_cast<Literal>(binary->right.get());
+
+    NodePtr* result = nullptr;
+    switch (binary->op) {
+        case BinaryOp::MUL:
+            if (isNumberLiteral(rightLit, 1) && isNumber(binary->left.get())) {
+                result = &binary->left;
+            } else if (isNumberLiteral(leftLit, 1) && isNumber(binary->right.get())) {
+                result = &binary->right;
             }
-            if (rightLit) {
-                try {
-                    auto rightNum = std::get<double>(rightLit->value);
-                    if (rightNum == 0) isZero = true;
-                    else if (rightNum == 1) {
-                        node = std::move(binary->left);
-                        return;
-                    }
-                } catch (const std::bad_variant_access&) {}
+            break;
+        case BinaryOp::DIV:
+        case BinaryOp::SUB:
+            if (isNumberLiteral(rightLit, binary->op == BinaryOp::DIV ? 1 : 0) && isNumber(binary->left.get())) {
+                result = &binary->left;
             }
-            
-            if (isZero) {
-                auto result = std::make_unique<Literal>();
-                result->value = 0.0;
-                node = std::move(result);
-                return;
-            }
-        }
-        
-        if (binary->op == "/") {
-            if (rightLit) {
-                try {
-                    auto rightNum = std::get<double>(rightLit->value);
-                    if (rightNum == 1) {
-                        node = std::move(binary->left);
-                        return;
-                    }
-                } catch (const std::bad_variant_access&) {}
-            }
-        }
-        
-        if (binary->op == "**") {
-            if (rightLit) {
-                try {
-                    auto rightNum = std::get<double>(rightLit->value);
-                    if (rightNum == 0) {
-                        auto result = std::make_unique<Literal>();
-                        result->value = 1.0;
-                        node = std::move(result);
-                        return;
-                    }
-                    else if (rightNum == 1) {
-                        node = std::move(binary->left);
-                        return;
-                    }
-                } catch (const std::bad_variant_access&) {}
+            break;
+        case BinaryOp::POW:
+            if (isNumberLiteral(rightLit, 1) && isNumber(binary->left.get())) {
+                result = &binary->left;
+            } else if (isNumberLiteral(rightLit, 0) && hasNoEffects(binary->left.get())) {
+                rightLit->value = Value::fromNumber(1);
+                result = &binary->right;
             }
+            break;
+        case BinaryOp::AND:
+        case BinaryOp::OR:
+            // A literal left operand decides which operand && and || yield.
             if (leftLit) {
-                try {
-                    auto leftNum = std::get<double>(leftLit->value);
-                    if (leftNum == 1) {
-                        auto result = std::make_unique<Literal>();
-                        result->value = 1.0;
-                        node = std::move(result);
-                        return;
-                    }
-                } catch (const std::bad_variant_access&) {}
+                bool yieldsLeft = isTruthy(leftLit->value) == (binary->op == BinaryOp::OR);
+                result = yieldsLeft ? &binary->left : &binary->right;
             }
+            break;
+        default:
+            break;
+    }
+    if (!result) return false;
+    node = std::move(*result);
+    count(Pass::SIMPLIFY);
+    return true;
+}
+
+// A call of a pure function with literal arguments becomes its result. The
+// first argument's literal holds it, if there is one.
+bool Optimizer::evaluateCall(NodePtr& node) {
+    if (!evaluator) return false;
+    auto* call = node_cast<CallExpression>(node.get());
+    if (!call) return false;
+    auto* callee = node_cast<Identifier>(call->callee.get());
+    const FunctionTargets& targets = evaluator->targets();
+    if (!callee || callee->name.id >= targets.size() || !targets[callee->name.id] || isLocal(callee->name)) {
+        return false;
+    }
+    std::vector<Value> arguments;
+    arguments.reserve(call->arguments.size());
+    for (const auto& arg : call->arguments) {
+        auto* literal = node_cast<Literal>(arg.get());
+        if (!literal) return false;
+        arguments.push_back(literal->value);
+    }
+    std::optional<Value> result = evaluator->call(*targets[callee->name.id], arguments);
+    if (!result) return false;
+    if (call->arguments.empty()) {
+        node = std::make_unique<Literal>(*result);
+    } else {
+        static_cast<Literal&>(*call->arguments[0]).value = *result;
+        node = std::move(call->arguments[0]);
+    }
+    count(Pass::EVALUATE);
+    return true;
+}
+
+// A call of a small top-level function becomes its body, with the
+// arguments in place of the parameters and the initializers in place of
+// the locals. The result must do what the call did: an argument or local
+// with effects is used exactly once, unconditionally, and all effects keep
+// their order. Nothing is allocated unless the call is inlined.
+bool Optimizer::inlineFunctionCall(NodePtr& node) {
+    if (!inlineTargets) return false;
+    auto* call = node_cast<CallExpression>(node.get());
+    if (!call) return false;
+    auto* callee = node_cast<Identifier>(call->callee.get());
+    if (!callee || callee->name.id >= inlineTargets->size() || isLocal(callee->name)) return false;
+    const FunctionDeclaration* target = (*inlineTargets)[callee->name.id];
+    if (!target || std::find(inlineStack.begin(), inlineStack.end(), target) != inlineStack.end()) return false;
+
+    // Arguments past the parameters are evaluated and dropped. One that
+    // assigns could change what the others read.
+    size_t literals = 0;
+    for (size_t i = 0; i < call->arguments.size(); i++) {
+        const ASTNode* arg = call->arguments[i].get();
+        if (arg->type == NodeType::LITERAL) literals++;
+        if (i >= target->params.size() && !hasNoEffects(arg)) return false;
+        if (containsAssignment(arg)) return false;
+    }
+    inlineBindings.clear();
+    for (size_t i = 0; i < target->params.size(); i++) {
+        const ASTNode* arg = i < call->arguments.size() ? call->arguments[i].get() : nullptr;
+        // A read of a variable that a call may assign cannot move past one.
+        inlineBindings.push_back(InlineBinding{target->params[i], arg, static_cast<uint32_t>(i),
+                                               static_cast<uint32_t>(arg ? treeSize(arg) : 1), 0,
+                                               !arg || (hasNoEffects(arg) && !readsAssignedGlobal(arg)), false});
+    }
+    const ASTNode* result = nullptr;
+    for (const auto& stmt : target->body) {
+        if (auto* var = node_cast<VariableDeclaration>(stmt.get())) {
+            inlineBindings.push_back(InlineBinding{var->name, var->init.get(), 0, 0, 0, false, true});
+        } else {
+            result = static_cast<const ReturnStatement&>(*stmt).argument.get();
         }
-        
-        if (binary->op == "+" || binary->op == "-") {
-            if (leftLit) {
-                try {
-                    auto leftNum = std::get<double>(leftLit->value);
-                    if (leftNum == 0 && binary->op == "+") {
-                        node = std::move(binary->right);
-                        return;
-                    }
-                } catch (const std::bad_variant_access&) {}
-            }
-            if (rightLit) {
-                try {
-                    auto rightNum = std::get<double>(rightLit->value);
-                    if (rightNum == 0) {
-                        node = std::move(binary->left);
-                        return;
-                    }
-                } catch (const std::bad_variant_access&) {}
-            }
+    }
+
+    size_t bindings = inlineBindings.size();
+    size_t size = 0, lastOrigin = 0, events = 0;
+    if (!scanInline(result, bindings, bindings, false, size, lastOrigin, events)) return false;
+    for (size_t i = 0; i < bindings; i++) {
+        const InlineBinding& binding = inlineBindings[i];
+        if (binding.uses > 0) continue;
+        if (!binding.local) {
+            if (!binding.pure) return false;
+            continue;
+        }
+        // An unused local is dropped, so its initializer must be pure.
+        size_t unusedSize = 0, unusedOrigin = 0, unusedEvents = 0;
+        if (!scanInline(binding.value, i, i, false, unusedSize, unusedOrigin, unusedEvents) || unusedEvents) {
+            return false;
         }
-        
-        if (binary->op == "&&") {
-            if (leftLit && !isTruthy(leftLit)) {
-                auto result = std::make_unique<Literal>();
-                result->value = false;
-                node = std::move(result);
-                return;
+    }
+    size_t callSize = treeSize(call);
+    size_t growth = size > callSize ? size - callSize : 0;
+    if (size > callSize + MaxInlineGrowth + LiteralArgumentBonus * literals) return false;
+    if (inlineStack.empty()) {
+        inlineBudget = MaxInlineBody;
+    } else if (growth > inlineBudget) {
+        return false;
+    } else {
+        inlineBudget -= growth;
+    }
+
+    node = substitute(result, bindings, call->arguments);
+    count(Pass::INLINE);
+    // Substituted arguments often fold with the body.
+    inlineStack.push_back(target);
+    rewrite(node);
+    inlineStack.pop_back();
+    return true;
+}
+
+size_t Optimizer::resolveBinding(Atom name, size_t visible) const {
+    for (size_t i = visible; i-- > 0;) {
+        if (inlineBindings[i].name == name) return i;
+    }
+    return NoBinding;
+}
+
+// Walks part of an inlined body in the order it would run at the call site,
+// adding up its size. Every effect counts in `events` and comes from an
+// origin: the binding whose argument or initializer causes it, or the
+// return value past the last binding. Origins may never go back, since the
+// call ran the arguments, then the initializers, then the return value.
+bool Optimizer::scanInline(const ASTNode* node, size_t visible, size_t origin, bool conditional, size_t& size,
+                           size_t& lastOrigin, size_t& events) {
+    auto effect = [&](size_t from) {
+        events++;
+        if (from < lastOrigin) return false;
+        lastOrigin = from;
+        return true;
+    };
+    if (!node) {
+        size++; // undefined
+        return true;
+    }
+    switch (node->type) {
+        case NodeType::LITERAL:
+            size++;
+            return true;
+        case NodeType::IDENTIFIER: {
+            Atom name = static_cast<const Identifier*>(node)->name;
+            // A local's initializer that reads the local sees it uninitialized.
+            if (origin < inlineBindings.size() && inlineBindings[origin].name == name) return false;
+            size_t index = resolveBinding(name, visible);
+            if (index == NoBinding) {
+                // The call site may declare a local of the same name.
+                if (isLocal(name)) return false;
+                size++;
+                bool stable = globalNames && globalNames->contains(name) &&
+                              !(assignedNames && assignedNames->contains(name));
+                return stable || effect(origin);
             }
-            if (rightLit && !isTruthy(rightLit)) {
-                auto result = std::make_unique<Literal>();
-                result->value = false;
-                node = std::move(result);
-                return;
+            InlineBinding& binding = inlineBindings[index];
+            binding.uses++;
+            if (!binding.local) {
+                size += binding.size;
+                return binding.pure || (!conditional && binding.uses == 1 && effect(index));
             }
+            size_t before = events;
+            if (!scanInline(binding.value, index, index, conditional, size, lastOrigin, events)) return false;
+            return events == before || (!conditional && binding.uses == 1);
         }
-        
-        if (binary->op == "||") {
-            if (leftLit && isTruthy(leftLit)) {
-                auto result = std::make_unique<Literal>();
-                result->value = true;
-                node = std::move(result);
-                return;
-            }
-            if (rightLit && isTruthy(rightLit)) {
-                auto result = std::make_unique<Literal>();
-                result->value = true;
-                node = std::move(result);
-                return;
+        case NodeType::UNARY_EXPRESSION:
+            size++;
+            return scanInline(static_cast<const UnaryExpression*>(node)->argument.get(), visible, origin, conditional,
+                              size, lastOrigin, events);
+        case NodeType::BINARY_EXPRESSION: {
+            auto* binary = static_cast<const BinaryExpression*>(node);
+            bool logical = binary->op == BinaryOp::AND || binary->op == BinaryOp::OR;
+            size++;
+            return scanInline(binary->left.get(), visible, origin, conditional, size, lastOrigin, events) &&
+                   scanInline(binary->right.get(), visible, origin, conditional || logical, size, lastOrigin, events);
+        }
+        case NodeType::CALL_EXPRESSION: {
+            auto* call = static_cast<const CallExpression*>(node);
+            size++;
+            if (!scanInline(call->callee.get(), visible, origin, conditional, size, lastOrigin, events)) return false;
+            for (const auto& arg : call->arguments) {
+                if (!scanInline(arg.get(), visible, origin, conditional, size, lastOrigin, events)) return false;
             }
+            return effect(origin);
         }
+        case NodeType::MEMBER_EXPRESSION:
+            size++;
+            return scanInline(static_cast<const MemberExpression*>(node)->object.get(), visible, origin, conditional,
+                              size, lastOrigin, events) &&
+                   effect(origin);
+        default:
+            return false;
     }
 }
 
-void Optimizer::inlineSimpleFunctions(NodePtr& node) {
-    if (auto* call = dynamic_cast<CallExpression*>(node.get())) {
-        auto* callee = dynamic_cast<Identifier*>(call->callee.get());
-        if (!callee) return;
-        
-        auto it = functionMap.find(callee->name);
-        if (it == functionMap.end()) return;
-        
-        auto* funcDecl = dynamic_cast<FunctionDeclaration*>(it->second.get());
-        if (!funcDecl) return;
-        
-        if (funcDecl->body.size() != 1) return;
-        
-        auto* ret = dynamic_cast<ReturnStatement*>(funcDecl->body[0].get());
-        if (!ret) return;
-        
-        if (auto* literal = dynamic_cast<Literal*>(ret->argument.get())) {
-            auto result = std::make_unique<Literal>();
-            result->value = literal->value;
-            node = std::move(result);
+// Copies part of an inlined body with the bindings in [0, visible)
+// replaced; with none visible, it just copies.
+NodePtr Optimizer::substitute(const ASTNode* node, size_t visible, NodeList& arguments) {
+    if (!node) return std::make_unique<Literal>(Value::undefined());
+    switch (node->type) {
+        case NodeType::LITERAL:
+            return std::make_unique<Literal>(static_cast<const Literal*>(node)->value);
+        case NodeType::IDENTIFIER: {
+            Atom name = static_cast<const Identifier*>(node)->name;
+            size_t index = resolveBinding(name, visible);
+            if (index != NoBinding) {
+                const InlineBinding& binding = inlineBindings[index];
+                if (binding.local) return substitute(binding.value, index, arguments);
+                // The first use takes the argument itself, later ones copy it.
+                if (binding.value && arguments[binding.argument]) return std::move(arguments[binding.argument]);
+                return substitute(binding.value, 0, arguments);
+            }
+            auto identifier = std::make_unique<Identifier>();
+            identifier->name = name;
+            return identifier;
+        }
+        case NodeType::UNARY_EXPRESSION: {
+            auto* unary = static_cast<const UnaryExpression*>(node);
+            auto copy = std::make_unique<UnaryExpression>();
+            copy->op = unary->op;
+            copy->argument = substitute(unary->argument.get(), visible, arguments);
+            return copy;
+        }
+        case NodeType::BINARY_EXPRESSION: {
+            auto* binary = static_cast<const BinaryExpression*>(node);
+            auto copy = std::make_unique<BinaryExpression>();
+            copy->op = binary->op;
+            copy->left = substitute(binary->left.get(), visible, arguments);
+            copy->right = substitute(binary->right.get(), visible, arguments);
+            return copy;
+        }
+        case NodeType::CALL_EXPRESSION: {
+            auto* call = static_cast<const CallExpression*>(node);
+            auto copy = std::make_unique<CallExpression>();
+            copy->callee = substitute(call->callee.get(), visible, arguments);
+            copy->arguments.reserve(call->arguments.size());
+            for (const auto& arg : call->arguments) {
+                copy->arguments.push_back(substitute(arg.get(), visible, arguments));
+            }
+            return copy;
+        }
+        default: {
+            auto* member = static_cast<const MemberExpression*>(node);
+            auto copy = std::make_unique<MemberExpression>();
+            copy->object = substitute(member->object.get(), visible, arguments);
+            copy->property = member->property;
+            return copy;
         }
     }
 }
 
-} 
+}
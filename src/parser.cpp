@@ -1,20 +1,87 @@
 #include "../include/parser.hpp"
+#include "../include/visitor.hpp"
+#include <algorithm>
+#include <charconv>
 #include <stdexcept>
 
-js::Parser::Parser(std::vector<Token> tokens) : tokens(std::move(tokens)), current(0) {}
+namespace {
 
-js::Token js::Parser::peek() {
-    if (current >= tokens.size()) {
-        return Token(TokenType::EOF_TOKEN, "");
+struct BinaryOperator {
+    js::BinaryOp op;
+    int precedence;
+};
+
+// Maps operator text to its binary operator and binding power. A precedence
+// of 0 means the token is not a binary operator.
+BinaryOperator lookupBinary(std::string_view text) {
+    using js::BinaryOp;
+    switch (text.size()) {
+        case 1:
+            switch (text[0]) {
+                case '|': return {BinaryOp::BIT_OR, 3};
+                case '&': return {BinaryOp::BIT_AND, 5};
+                case '<': return {BinaryOp::LT, 7};
+                case '>': return {BinaryOp::GT, 7};
+                case '+': return {BinaryOp::ADD, 9};
+                case '-': return {BinaryOp::SUB, 9};
+                case '*': return {BinaryOp::MUL, 10};
+                case '/': return {BinaryOp::DIV, 10};
+                default: return {BinaryOp::ADD, 0};
+            }
+        case 2:
+            if (text == "||") return {BinaryOp::OR, 1};
+            if (text == "&&") return {BinaryOp::AND, 2};
+            if (text == "==") return {BinaryOp::EQ, 6};
+            if (text == "!=") return {BinaryOp::NE, 6};
+            if (text == "<=") return {BinaryOp::LE, 7};
+            if (text == ">=") return {BinaryOp::GE, 7};
+            if (text == "**") return {BinaryOp::POW, 11};
+            return {BinaryOp::ADD, 0};
+        default:
+            return {BinaryOp::ADD, 0};
+    }
+}
+
+// `x += y` and friends; `=` alone maps to COUNT.
+bool lookupAssignment(std::string_view text, js::BinaryOp& op) {
+    using js::BinaryOp;
+    if (text == "=") op = BinaryOp::COUNT;
+    else if (text == "+=") op = BinaryOp::ADD;
+    else if (text == "-=") op = BinaryOp::SUB;
+    else if (text == "*=") op = BinaryOp::MUL;
+    else if (text == "/=") op = BinaryOp::DIV;
+    else return false;
+    return true;
+}
+
+bool lookupUnary(std::string_view text, js::UnaryOp& op) {
+    if (text.size() != 1) return false;
+    switch (text[0]) {
+        case '!': op = js::UnaryOp::NOT; return true;
+        case '-': op = js::UnaryOp::NEG; return true;
+        case '+': op = js::UnaryOp::PLUS; return true;
+        default: return false;
+    }
+}
+
+} // namespace
+
+js::Parser::Parser(std::vector<Token> tokens) : tokens(std::move(tokens)), current(0), nodeCount(0) {
+    if (this->tokens.empty() || this->tokens.back().type != TokenType::EOF_TOKEN) {
+        this->tokens.emplace_back(TokenType::EOF_TOKEN, std::string_view());
     }
+}
+
+const js::Token& js::Parser::peek() const {
     return tokens[current];
 }
 
-js::Token js::Parser::advance() {
-    if (current < tokens.size()) {
-        return tokens[current++];
+const js::Token& js::Parser::advance() {
+    const Token& token = tokens[current];
+    if (current + 1 < tokens.size()) {
+        current++;
     }
-    return Token(TokenType::EOF_TOKEN, "");
+    return token;
 }
 
 bool js::Parser::match(TokenType type) {
@@ -25,195 +92,444 @@ bool js::Parser::match(TokenType type) {
     return false;
 }
 
+bool js::Parser::matchOperator(std::string_view op) {
+    if (peek().type == TokenType::OPERATOR && peek().value == op) {
+        advance();
+        return true;
+    }
+    return false;
+}
+
+void js::Parser::expect(TokenType type, const char* message) {
+    if (!match(type)) {
+        throw std::runtime_error(message);
+    }
+}
+
+void js::Parser::expectOperator(std::string_view op, const char* message) {
+    if (!matchOperator(op)) {
+        throw std::runtime_error(message);
+    }
+}
+
+void js::Parser::skipSemicolon() {
+    matchOperator(";");
+}
+
 js::NodePtr js::Parser::parse() {
-    if (peek().type == TokenType::EOF_TOKEN) {
-        return std::make_unique<Expression>(NodeType::PROGRAM);
+    auto program = make<Program>();
+    
+    while (peek().type != TokenType::EOF_TOKEN) {
+        if (matchOperator(";")) {
+            continue;
+        }
+        program->body.push_back(parse_statement());
     }
-    return parse_statement();
+    
+    return std::move(program);
 }
 
 js::NodePtr js::Parser::parse_statement() {
-    Token token = peek();
+    const Token& token = peek();
     
-    if (token.type == TokenType::KEYWORD) {
-        if (token.value == "let" || token.value == "const" || token.value == "var") {
+    switch (token.keyword) {
+        case Keyword::LET:
+        case Keyword::CONST:
+        case Keyword::VAR: {
             advance();
-            return parse_variable_declaration();
+            auto decl = parse_variable_declaration();
+            skipSemicolon();
+            return decl;
         }
-        if (token.value == "function") {
+        case Keyword::IF:
+            advance();
+            return parse_if_statement();
+        case Keyword::WHILE:
+            advance();
+            return parse_while_statement();
+        case Keyword::FOR:
+            advance();
+            return parse_for_statement();
+        case Keyword::FUNCTION:
             advance();
             return parse_function_declaration();
-        }
-        if (token.value == "return") {
+        case Keyword::RETURN: {
             advance();
-            auto expr = parse_expression();
-            if (peek().type == TokenType::OPERATOR && peek().value == ";") {
-                advance();
+            auto ret = make<ReturnStatement>();
+            const Token& next = peek();
+            bool empty = next.type == TokenType::EOF_TOKEN ||
+                (next.type == TokenType::OPERATOR && (next.value == ";" || next.value == "}"));
+            if (!empty) {
+                ret->argument = parse_expression();
+                checkPostfixUpdates(nullptr);
             }
-            auto ret = std::make_unique<ReturnStatement>();
-            ret->argument = std::move(expr);
+            skipSemicolon();
             return std::move(ret);
         }
+        default:
+            break;
+    }
+    if (matchOperator("{")) {
+        return parse_block();
     }
     
     auto expr = parse_expression();
-    if (peek().type == TokenType::OPERATOR && peek().value == ";") {
+    checkPostfixUpdates(expr.get());
+    skipSemicolon();
+    return expr;
+}
+
+// The body of an if, while or for: one statement, but not a declaration.
+js::NodePtr js::Parser::parse_substatement() {
+    if (matchOperator(";")) {
+        return make<BlockStatement>();
+    }
+    const Token& token = peek();
+    if (token.keyword == Keyword::LET || token.keyword == Keyword::CONST || token.keyword == Keyword::VAR ||
+        token.keyword == Keyword::FUNCTION) {
+        throw std::runtime_error("Declarations are not allowed as the body of if, while or for");
+    }
+    return parse_statement();
+}
+
+js::NodePtr js::Parser::parse_block() {
+    auto block = make<BlockStatement>();
+    while (!matchOperator("}")) {
+        if (peek().type == TokenType::EOF_TOKEN) {
+            throw std::runtime_error("Expected '}' after block");
+        }
+        if (matchOperator(";")) {
+            continue;
+        }
+        block->body.push_back(parse_statement());
+    }
+    return std::move(block);
+}
+
+js::NodePtr js::Parser::parse_if_statement() {
+    auto stmt = make<IfStatement>();
+    expect(TokenType::LEFT_PAREN, "Expected '(' after if");
+    stmt->test = parse_expression();
+    checkPostfixUpdates(nullptr);
+    expect(TokenType::RIGHT_PAREN, "Expected ')' after if condition");
+    stmt->consequent = parse_substatement();
+    if (peek().keyword == Keyword::ELSE) {
         advance();
+        stmt->alternate = parse_substatement();
     }
-    return expr;
+    return std::move(stmt);
+}
+
+js::NodePtr js::Parser::parse_while_statement() {
+    auto loop = make<WhileStatement>();
+    expect(TokenType::LEFT_PAREN, "Expected '(' after while");
+    loop->test = parse_expression();
+    checkPostfixUpdates(nullptr);
+    expect(TokenType::RIGHT_PAREN, "Expected ')' after while condition");
+    loop->body = parse_substatement();
+    return std::move(loop);
+}
+
+// `for (init; test; update) body` becomes `{ init; while (test) { body
+// update } }`. The body keeps its own block if it declares anything, so
+// the update cannot see its declarations.
+js::NodePtr js::Parser::parse_for_statement() {
+    expect(TokenType::LEFT_PAREN, "Expected '(' after for");
+    auto block = make<BlockStatement>();
+    if (!matchOperator(";")) {
+        Keyword keyword = peek().keyword;
+        if (keyword == Keyword::LET || keyword == Keyword::CONST || keyword == Keyword::VAR) {
+            advance();
+            block->body.push_back(parse_variable_declaration());
+        } else {
+            auto init = parse_expression();
+            checkPostfixUpdates(init.get());
+            block->body.push_back(std::move(init));
+        }
+        expectOperator(";", "Expected ';' after for initializer");
+    }
+
+    auto loop = make<WhileStatement>();
+    if (matchOperator(";")) {
+        auto always = make<Literal>();
+        always->value = Value::fromBool(true);
+        loop->test = std::move(always);
+    } else {
+        loop->test = parse_expression();
+        checkPostfixUpdates(nullptr);
+        expectOperator(";", "Expected ';' after for condition");
+    }
+    NodePtr update;
+    if (peek().type != TokenType::RIGHT_PAREN) {
+        update = parse_expression();
+        checkPostfixUpdates(update.get());
+    }
+    expect(TokenType::RIGHT_PAREN, "Expected ')' after for clauses");
+
+    NodePtr body = parse_substatement();
+    if (update) {
+        auto* inner = node_cast<BlockStatement>(body.get());
+        bool declares = inner && std::any_of(inner->body.begin(), inner->body.end(), [](const NodePtr& stmt) {
+            return stmt->type == NodeType::VARIABLE_DECLARATION;
+        });
+        if (!inner || declares) {
+            auto wrapper = make<BlockStatement>();
+            wrapper->body.push_back(std::move(body));
+            body = std::move(wrapper);
+        }
+        static_cast<BlockStatement&>(*body).body.push_back(std::move(update));
+    }
+    loop->body = std::move(body);
+    if (block->body.empty()) {
+        return std::move(loop);
+    }
+    block->body.push_back(std::move(loop));
+    return std::move(block);
+}
+
+// A postfix update yields the old value, which the desugared form cannot
+// produce, so it is only accepted where the value is dropped.
+void js::Parser::checkPostfixUpdates(const ASTNode* statement) {
+    bool dropped = postfixUpdates.size() == 1 && postfixUpdates[0] == statement;
+    if (!postfixUpdates.empty() && !dropped) {
+        throw std::runtime_error("Postfix ++ and -- are only supported as statements");
+    }
+    postfixUpdates.clear();
 }
 
-js::NodePtr js::Parser::parse_expression() {
-    auto left = parse_primary();
+js::NodePtr js::Parser::parse_expression(int minPrecedence) {
+    auto left = parse_unary();
     
     while (peek().type == TokenType::OPERATOR) {
-        std::string op = peek().value;
-        if (op != "+" && op != "-" && op != "*" && op != "/") {
+        BinaryOperator binaryOp = lookupBinary(peek().value);
+        if (binaryOp.precedence == 0 || binaryOp.precedence < minPrecedence) {
             break;
         }
         advance();
         
-        auto right = parse_primary();
-        auto binary = std::make_unique<BinaryExpression>();
+        // ** is the only right-associative binary operator.
+        bool rightAssociative = binaryOp.op == BinaryOp::POW;
+        auto binary = make<BinaryExpression>();
         binary->left = std::move(left);
-        binary->right = std::move(right);
-        binary->op = op;
+        binary->right = parse_expression(binaryOp.precedence + (rightAssociative ? 0 : 1));
+        binary->op = binaryOp.op;
         left = std::move(binary);
     }
     
+    BinaryOp compound;
+    if (minPrecedence == 0 && peek().type == TokenType::OPERATOR && lookupAssignment(peek().value, compound)) {
+        advance();
+        auto* target = node_cast<Identifier>(left.get());
+        if (!target) {
+            throw std::runtime_error("Invalid assignment target");
+        }
+        auto assignment = make<AssignmentExpression>();
+        assignment->name = target->name;
+        // Right-associative: a = b = c assigns c to both.
+        NodePtr value = parse_expression();
+        if (compound != BinaryOp::COUNT) {
+            auto binary = make<BinaryExpression>();
+            binary->op = compound;
+            binary->left = std::move(left);
+            binary->right = std::move(value);
+            value = std::move(binary);
+        }
+        assignment->value = std::move(value);
+        return std::move(assignment);
+    }
     return left;
 }
 
+js::NodePtr js::Parser::parse_unary() {
+    const Token& token = peek();
+    UnaryOp op;
+    
+    if (token.type == TokenType::OPERATOR && (token.value == "++" || token.value == "--")) {
+        bool increment = token.value == "++";
+        advance();
+        return parseUpdate(parse_unary(), increment);
+    }
+    if (token.type == TokenType::OPERATOR && lookupUnary(token.value, op)) {
+        advance();
+        auto unary = make<UnaryExpression>();
+        unary->op = op;
+        unary->argument = parse_unary();
+        return std::move(unary);
+    }
+    
+    return parse_postfix(parse_primary());
+}
+
+js::NodePtr js::Parser::parse_postfix(NodePtr expr) {
+    while (true) {
+        if (match(TokenType::DOT)) {
+            expr = parseMemberExpression(std::move(expr));
+        } else if (match(TokenType::LEFT_PAREN)) {
+            expr = parseCallExpression(std::move(expr));
+        } else if (peek().type == TokenType::OPERATOR && (peek().value == "++" || peek().value == "--")) {
+            bool increment = peek().value == "++";
+            advance();
+            expr = parseUpdate(std::move(expr), increment);
+            postfixUpdates.push_back(expr.get());
+        } else {
+            return expr;
+        }
+    }
+}
+
 js::NodePtr js::Parser::parse_primary() {
-    Token token = peek();
+    const Token& token = advance();
     
     if (token.type == TokenType::NUMBER) {
-        advance();
-        auto literal = std::make_unique<Literal>();
-        literal->value = std::stod(token.value);
+        auto literal = make<Literal>();
+        double number = 0;
+        std::from_chars(token.value.data(), token.value.data() + token.value.size(), number);
+        literal->value = Value::fromNumber(number);
         return std::move(literal);
     }
     if (token.type == TokenType::STRING) {
-        advance();
-        auto literal = std::make_unique<Literal>();
-        literal->value = token.value;
+        auto literal = make<Literal>();
+        literal->value = Value::fromAtom(token.atom);
         return std::move(literal);
     }
-    if (token.type == TokenType::IDENTIFIER) {
-        advance();
-        auto identifier = std::make_unique<Identifier>();
-        identifier->name = token.value;
-        
-        // Check for member access
-        if (match(TokenType::DOT)) {
-            return parseMemberExpression(std::move(identifier));
-        }
-        
-        // Check for function call
-        if (match(TokenType::LEFT_PAREN)) {
-            return parseCallExpression(std::move(identifier));
-        }
-        
+    if (token.keyword == Keyword::TRUE_LITERAL || token.keyword == Keyword::FALSE_LITERAL) {
+        auto literal = make<Literal>();
+        literal->value = Value::fromBool(token.keyword == Keyword::TRUE_LITERAL);
+        return std::move(literal);
+    }
+    // The global undefined cannot be reassigned, so it reads as a literal.
+    bool undefinedName = token.type == TokenType::IDENTIFIER && token.atom == atoms::undefined;
+    if (token.keyword == Keyword::NULL_LITERAL || undefinedName) {
+        auto literal = make<Literal>();
+        literal->value = token.keyword == Keyword::NULL_LITERAL ? Value::null() : Value::undefined();
+        return std::move(literal);
+    }
+    // There is no this binding yet; it keeps its old identifier meaning.
+    if (token.type == TokenType::IDENTIFIER || token.keyword == Keyword::THIS) {
+        auto identifier = make<Identifier>();
+        identifier->name = token.atom;
         return std::move(identifier);
     }
+    if (token.type == TokenType::LEFT_PAREN) {
+        auto expr = parse_expression();
+        expect(TokenType::RIGHT_PAREN, "Expected ')' after expression");
+        return expr;
+    }
     
-    throw std::runtime_error("Unexpected token: " + token.value);
+    if (token.type == TokenType::EOF_TOKEN) {
+        throw std::runtime_error("Unexpected end of input");
+    }
+    throw std::runtime_error("Unexpected token: " + std::string(token.value));
+}
+
+// ++x is x = +x + 1, which also yields the new value.
+js::NodePtr js::Parser::parseUpdate(NodePtr target, bool increment) {
+    auto* identifier = node_cast<Identifier>(target.get());
+    if (!identifier) {
+        throw std::runtime_error(increment ? "Invalid operand for ++" : "Invalid operand for --");
+    }
+    auto assignment = make<AssignmentExpression>();
+    assignment->name = identifier->name;
+    auto number = make<UnaryExpression>();
+    number->op = UnaryOp::PLUS;
+    number->argument = std::move(target);
+    auto one = make<Literal>();
+    one->value = Value::fromNumber(1);
+    auto binary = make<BinaryExpression>();
+    binary->op = increment ? BinaryOp::ADD : BinaryOp::SUB;
+    binary->left = std::move(number);
+    binary->right = std::move(one);
+    assignment->value = std::move(binary);
+    return std::move(assignment);
 }
 
 js::NodePtr js::Parser::parseCallExpression(NodePtr callee) {
-    auto call = std::make_unique<CallExpression>();
+    auto call = make<CallExpression>();
     call->callee = std::move(callee);
     
-    while (!match(TokenType::RIGHT_PAREN)) {
+    if (match(TokenType::RIGHT_PAREN)) {
+        return std::move(call);
+    }
+    
+    while (true) {
         call->arguments.push_back(parse_expression());
-        if (!match(TokenType::COMMA)) {
-            if (peek().type != TokenType::RIGHT_PAREN) {
-                throw std::runtime_error("Expected ',' or ')' in argument list");
-            }
-            match(TokenType::RIGHT_PAREN);
-            break;
+        if (match(TokenType::COMMA)) {
+            continue;
         }
+        expect(TokenType::RIGHT_PAREN, "Expected ',' or ')' in argument list");
+        break;
     }
     
     return std::move(call);
 }
 
 js::NodePtr js::Parser::parseMemberExpression(NodePtr object) {
-    auto member = std::make_unique<MemberExpression>();
+    auto member = make<MemberExpression>();
     member->object = std::move(object);
     
-    // Get property name
-    auto token = peek();
-    if (token.type != TokenType::IDENTIFIER) {
+    // Keywords are valid property names (e.g. obj.default).
+    const Token& token = peek();
+    if (token.type != TokenType::IDENTIFIER && token.type != TokenType::KEYWORD) {
         throw std::runtime_error("Expected property name after dot");
     }
-    member->property = token.value;
+    member->property = token.atom;
     advance();
     
     return std::move(member);
 }
 
 js::NodePtr js::Parser::parse_variable_declaration() {
-    Token identifier = peek();
+    const Token& identifier = peek();
     if (identifier.type != TokenType::IDENTIFIER) {
         throw std::runtime_error("Expected variable name");
     }
     advance();
     
-    auto decl = std::make_unique<VariableDeclaration>();
-    decl->name = identifier.value;
+    auto decl = make<VariableDeclaration>();
+    decl->name = identifier.atom;
     
-    if (peek().type == TokenType::OPERATOR && peek().value == "=") {
-        advance();
+    if (matchOperator("=")) {
         decl->init = parse_expression();
-    }
-    
-    if (peek().type == TokenType::OPERATOR && peek().value == ";") {
-        advance();
+        checkPostfixUpdates(nullptr);
     }
     
     return std::move(decl);
 }
 
 js::NodePtr js::Parser::parse_function_declaration() {
-    Token name = peek();
+    const Token& name = peek();
     if (!match(TokenType::IDENTIFIER)) {
         throw std::runtime_error("Expected function name");
     }
     
-    auto decl = std::make_unique<FunctionDeclaration>();
-    decl->name = name.value;
+    auto decl = make<FunctionDeclaration>();
+    decl->name = name.atom;
     
-    if (peek().type != TokenType::OPERATOR || peek().value != "(") {
-        throw std::runtime_error("Expected '(' after function name");
-    }
-    advance();
+    expect(TokenType::LEFT_PAREN, "Expected '(' after function name");
     
-    while (peek().type != TokenType::OPERATOR || peek().value != ")") {
+    while (!match(TokenType::RIGHT_PAREN)) {
         if (!decl->params.empty()) {
-            if (peek().type != TokenType::OPERATOR || peek().value != ",") {
-                throw std::runtime_error("Expected ',' between parameters");
-            }
-            advance();
+            expect(TokenType::COMMA, "Expected ',' between parameters");
         }
         
-        Token param = peek();
+        const Token& param = peek();
         if (!match(TokenType::IDENTIFIER)) {
             throw std::runtime_error("Expected parameter name");
         }
-        decl->params.push_back(param.value);
+        decl->params.push_back(param.atom);
     }
-    advance();
     
-    if (peek().type != TokenType::OPERATOR || peek().value != "{") {
-        throw std::runtime_error("Expected '{' after function parameters");
-    }
-    advance();
+    expectOperator("{", "Expected '{' after function parameters");
     
-    while (peek().type != TokenType::OPERATOR || peek().value != "}") {
+    while (!matchOperator("}")) {
+        if (peek().type == TokenType::EOF_TOKEN) {
+            throw std::runtime_error("Expected '}' after function body");
+        }
+        if (matchOperator(";")) {
+            continue;
+        }
         decl->body.push_back(parse_statement());
     }
-    advance();
     
     return std::move(decl);
 }
@@ -0,0 +1,219 @@
+#include "../include/scan.hpp"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JS_SCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define JS_TARGET_AVX2
+#else
+#define JS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace js {
+
+namespace {
+
+const char* scalarWhitespace(const char* p, const char* end) {
+    while (p < end && (charClass(*p) & CHAR_SPACE)) p++;
+    return p;
+}
+
+const char* scalarIdentifier(const char* p, const char* end) {
+    while (p < end && (charClass(*p) & CHAR_IDENT)) p++;
+    return p;
+}
+
+const char* scalarDigits(const char* p, const char* end) {
+    while (p < end && (charClass(*p) & CHAR_DIGIT)) p++;
+    return p;
+}
+
+const char* scalarStringBody(const char* p, const char* end, char quote) {
+    while (p < end && *p != quote && *p != '\\') p++;
+    return p;
+}
+
+#ifdef JS_SCAN_X86
+
+inline unsigned firstSetBit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+// Unsigned "x - lo <= span" for every byte lane.
+inline __m128i inRange128(__m128i x, char lo, char span) {
+    __m128i shifted = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(span)), shifted);
+}
+
+inline __m128i isSpace128(__m128i x) {
+    return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), inRange128(x, '\t', '\r' - '\t'));
+}
+
+inline __m128i isDigit128(__m128i x) {
+    return inRange128(x, '0', 9);
+}
+
+inline __m128i isIdent128(__m128i x) {
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    return _mm_or_si128(_mm_or_si128(inRange128(lower, 'a', 25), isDigit128(x)),
+                        _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+}
+
+template<__m128i (*Matches)(__m128i)>
+const char* sse2Run(const char* p, const char* end) {
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t stop = ~static_cast<uint32_t>(_mm_movemask_epi8(Matches(block))) & 0xFFFF;
+        if (stop) return p + firstSetBit(stop);
+        p += 16;
+    }
+    return p;
+}
+
+const char* sse2Whitespace(const char* p, const char* end) {
+    return scalarWhitespace(sse2Run<isSpace128>(p, end), end);
+}
+
+const char* sse2Identifier(const char* p, const char* end) {
+    return scalarIdentifier(sse2Run<isIdent128>(p, end), end);
+}
+
+const char* sse2Digits(const char* p, const char* end) {
+    return scalarDigits(sse2Run<isDigit128>(p, end), end);
+}
+
+const char* sse2StringBody(const char* p, const char* end, char quote) {
+    __m128i quotes = _mm_set1_epi8(quote);
+    __m128i slashes = _mm_set1_epi8('\\');
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, quotes), _mm_cmpeq_epi8(block, slashes));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+        if (mask) return p + firstSetBit(mask);
+        p += 16;
+    }
+    return scalarStringBody(p, end, quote);
+}
+
+JS_TARGET_AVX2 inline __m256i inRange256(__m256i x, char lo, char span) {
+    __m256i shifted = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(span)), shifted);
+}
+
+JS_TARGET_AVX2 inline __m256i isSpace256(__m256i x) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), inRange256(x, '\t', '\r' - '\t'));
+}
+
+JS_TARGET_AVX2 inline __m256i isDigit256(__m256i x) {
+    return inRange256(x, '0', 9);
+}
+
+JS_TARGET_AVX2 inline __m256i isIdent256(__m256i x) {
+    __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    return _mm256_or_si256(_mm256_or_si256(inRange256(lower, 'a', 25), isDigit256(x)),
+                           _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+}
+
+// Tokens are short, so a 16-byte probe decides most runs before the 32-byte
+// loop is entered.
+#define JS_AVX2_RUN(NAME, MATCH128, MATCH256, TAIL)                                        \
+    JS_TARGET_AVX2 const char* NAME(const char* p, const char* end) {                      \
+        if (end - p >= 16) {                                                               \
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));          \
+            uint32_t stop = ~static_cast<uint32_t>(_mm_movemask_epi8(MATCH128(block))) & 0xFFFF; \
+            if (stop) return p + firstSetBit(stop);                                        \
+            p += 16;                                                                       \
+        }                                                                                  \
+        while (end - p >= 32) {                                                            \
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));       \
+            uint32_t stop = ~static_cast<uint32_t>(_mm256_movemask_epi8(MATCH256(block))); \
+            if (stop) return p + firstSetBit(stop);                                        \
+            p += 32;                                                                       \
+        }                                                                                  \
+        return TAIL(sse2Run<MATCH128>(p, end), end);                                       \
+    }
+
+JS_AVX2_RUN(avx2Whitespace, isSpace128, isSpace256, scalarWhitespace)
+JS_AVX2_RUN(avx2Identifier, isIdent128, isIdent256, scalarIdentifier)
+JS_AVX2_RUN(avx2Digits, isDigit128, isDigit256, scalarDigits)
+
+#undef JS_AVX2_RUN
+
+JS_TARGET_AVX2 const char* avx2StringBody(const char* p, const char* end, char quote) {
+    __m256i quotes = _mm256_set1_epi8(quote);
+    __m256i slashes = _mm256_set1_epi8('\\');
+    while (end - p >= 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(block, quotes), _mm256_cmpeq_epi8(block, slashes));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+        if (mask) return p + firstSetBit(mask);
+        p += 32;
+    }
+    return sse2StringBody(p, end, quote);
+}
+
+bool cpuHasAvx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // JS_SCAN_X86
+
+const ScanKernels scalarKernels = {
+    "scalar", scalarWhitespace, scalarIdentifier, scalarDigits, scalarStringBody
+};
+
+#ifdef JS_SCAN_X86
+const ScanKernels sse2Kernels = {
+    "sse2", sse2Whitespace, sse2Identifier, sse2Digits, sse2StringBody
+};
+
+const ScanKernels avx2Kernels = {
+    "avx2", avx2Whitespace, avx2Identifier, avx2Digits, avx2StringBody
+};
+#endif
+
+const ScanKernels& selectKernels() {
+    const char* forced = std::getenv("JS_SCAN_KERNELS");
+    if (forced && std::strcmp(forced, "scalar") == 0) {
+        return scalarKernels;
+    }
+#ifdef JS_SCAN_X86
+    if (forced && std::strcmp(forced, "sse2") == 0) {
+        return sse2Kernels;
+    }
+    if (cpuHasAvx2()) {
+        return avx2Kernels;
+    }
+    return sse2Kernels;
+#else
+    return scalarKernels;
+#endif
+}
+
+} // namespace
+
+const ScanKernels& scanKernels() {
+    static const ScanKernels& kernels = selectKernels();
+    return kernels;
+}
+
+} // namespace js
@@ -0,0 +1,93 @@
+#include "../include/source_buffer.hpp"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace js {
+
+#ifdef _WIN32
+
+SourceBuffer::SourceBuffer(const std::string& path) : data_(""), size_(0) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        throw std::runtime_error("Could not stat file: " + path);
+    }
+    if (fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) {
+        throw std::runtime_error("Could not map file: " + path);
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view) {
+        throw std::runtime_error("Could not map file: " + path);
+    }
+
+    data_ = static_cast<const char*>(view);
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+}
+
+SourceBuffer::~SourceBuffer() {
+    if (size_) {
+        UnmapViewOfFile(data_);
+    }
+}
+
+#else
+
+SourceBuffer::SourceBuffer(const std::string& path) : data_(""), size_(0) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not stat file: " + path);
+    }
+    if (info.st_size == 0) {
+        ::close(fd);
+        return;
+    }
+
+    void* view = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        throw std::runtime_error("Could not map file: " + path);
+    }
+    ::madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+
+    data_ = static_cast<const char*>(view);
+    size_ = static_cast<size_t>(info.st_size);
+}
+
+SourceBuffer::~SourceBuffer() {
+    if (size_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+#endif
+
+} // namespace js
@@ -0,0 +1,987 @@
+#include "../include/ssa.hpp"
+#include "../include/operations.hpp"
+#include "../include/visitor.hpp"
+#include <algorithm>
+
+namespace js {
+
+namespace ssa {
+
+void Function::clear() {
+    values.clear();
+    blocks.clear();
+    operandList_.clear();
+    userList_.clear();
+}
+
+BlockId Function::addBlock() {
+    Block block;
+    block.first = block.end = static_cast<ValueId>(values.size());
+    blocks.push_back(block);
+    return static_cast<BlockId>(blocks.size() - 1);
+}
+
+ValueId Function::add(Instr instr, const ValueId* operands, size_t count) {
+    auto id = static_cast<ValueId>(values.size());
+    instr.block = static_cast<BlockId>(blocks.size() - 1);
+    instr.firstOperand = static_cast<uint32_t>(operandList_.size());
+    instr.operandCount = static_cast<uint32_t>(count);
+    operandList_.insert(operandList_.end(), operands, operands + count);
+    values.push_back(instr);
+    blocks.back().end = id + 1;
+    return id;
+}
+
+void Function::addEdge(BlockId from, BlockId to) {
+    Block& source = blocks[from];
+    Block& target = blocks[to];
+    source.succs[source.succCount++] = to;
+    target.preds[target.predCount++] = from;
+}
+
+void Function::finish() {
+    for (Instr& instr : values) instr.userCount = 0;
+    for (const Instr& instr : values) {
+        for (uint32_t k = 0; k < instr.operandCount; k++) values[operands(instr)[k]].userCount++;
+    }
+    uint32_t next = 0;
+    for (Instr& instr : values) {
+        instr.firstUser = next;
+        next += instr.userCount;
+        instr.userCount = 0;
+    }
+    userList_.resize(next);
+    for (ValueId id = 0; id < values.size(); id++) {
+        const Instr& instr = values[id];
+        for (uint32_t k = 0; k < instr.operandCount; k++) {
+            Instr& operand = values[operands(instr)[k]];
+            userList_[operand.firstUser + operand.userCount++] = id;
+        }
+    }
+    computeOrder();
+    computeDominators();
+}
+
+void Function::computeOrder() {
+    order.clear();
+    position_.assign(blocks.size(), UINT32_MAX);
+    stack_.clear();
+    stack_.push_back({0, 0});
+    position_[0] = 0;
+    while (!stack_.empty()) {
+        auto& [block, next] = stack_.back();
+        if (next < blocks[block].succCount) {
+            BlockId succ = blocks[block].succs[next++];
+            if (position_[succ] == UINT32_MAX) {
+                position_[succ] = 0;
+                stack_.push_back({succ, 0});
+            }
+        } else {
+            order.push_back(block);
+            stack_.pop_back();
+        }
+    }
+    std::reverse(order.begin(), order.end());
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+void Function::computeDominators() {
+    for (uint32_t i = 0; i < order.size(); i++) position_[order[i]] = i;
+    idom.assign(blocks.size(), NoBlock);
+    idom[0] = 0;
+    auto intersect = [&](BlockId a, BlockId b) {
+        while (a != b) {
+            while (position_[a] > position_[b]) a = idom[a];
+            while (position_[b] > position_[a]) b = idom[b];
+        }
+        return a;
+    };
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = 1; i < order.size(); i++) {
+            BlockId block = order[i];
+            BlockId dominator = NoBlock;
+            for (uint8_t k = 0; k < blocks[block].predCount; k++) {
+                BlockId pred = blocks[block].preds[k];
+                if (idom[pred] == NoBlock) continue;
+                dominator = dominator == NoBlock ? pred : intersect(pred, dominator);
+            }
+            if (idom[block] != dominator) {
+                idom[block] = dominator;
+                changed = true;
+            }
+        }
+    }
+
+    childStart.assign(blocks.size() + 1, 0);
+    for (BlockId b = 1; b < blocks.size(); b++) {
+        if (idom[b] != NoBlock) childStart[idom[b] + 1]++;
+    }
+    for (size_t b = 0; b < blocks.size(); b++) childStart[b + 1] += childStart[b];
+    children.resize(childStart.back());
+    for (size_t b = 0; b < blocks.size(); b++) position_[b] = childStart[b];
+    for (BlockId b = 1; b < blocks.size(); b++) {
+        if (idom[b] != NoBlock) children[position_[idom[b]]++] = b;
+    }
+}
+
+namespace {
+
+// Longer strings are left to run time rather than grown at compile time.
+constexpr size_t MaxFoldedString = 4096;
+
+bool sameLattice(const Lattice& a, const Lattice& b) {
+    return a.kind == b.kind && (a.kind != Lattice::CONSTANT || a.value == b.value);
+}
+
+Lattice meet(const Lattice& a, const Lattice& b) {
+    if (a.kind == Lattice::UNKNOWN) return b;
+    if (b.kind == Lattice::UNKNOWN) return a;
+    if (a.kind == Lattice::CONSTANT && b.kind == Lattice::CONSTANT && a.value == b.value) return a;
+    return Lattice{Lattice::VARYING, Value()};
+}
+
+Lattice constant(Value value) {
+    if (value.isString() && AtomTable::current().text(value.asAtom()).size() > MaxFoldedString) {
+        return Lattice{Lattice::VARYING, Value()};
+    }
+    return Lattice{Lattice::CONSTANT, value};
+}
+
+bool isCommutative(BinaryOp op) {
+    return op == BinaryOp::MUL || op == BinaryOp::EQ || op == BinaryOp::NE || op == BinaryOp::BIT_AND ||
+           op == BinaryOp::BIT_OR;
+}
+
+} // namespace
+
+Lattice ConstantSolver::evaluate(const Function& function, const ConstantBindings* globals, ValueId id) const {
+    const Instr& instr = function.values[id];
+    const ValueId* operands = function.operands(instr);
+    switch (instr.op) {
+        case Op::CONST:
+            return Lattice{Lattice::CONSTANT, instr.constant};
+        case Op::GLOBAL:
+            if (globals) {
+                auto it = globals->find(instr.name);
+                if (it != globals->end()) return Lattice{Lattice::CONSTANT, it->second};
+            }
+            break;
+        case Op::UNARY: {
+            const Lattice& argument = values_[operands[0]];
+            if (argument.kind != Lattice::CONSTANT) return argument;
+            return constant(evaluateUnary(static_cast<UnaryOp>(instr.subop), argument.value));
+        }
+        case Op::BINARY: {
+            const Lattice& left = values_[operands[0]];
+            const Lattice& right = values_[operands[1]];
+            if (left.kind == Lattice::VARYING || right.kind == Lattice::VARYING) break;
+            if (left.kind == Lattice::UNKNOWN || right.kind == Lattice::UNKNOWN) return Lattice{};
+            return constant(evaluateBinary(static_cast<BinaryOp>(instr.subop), left.value, right.value));
+        }
+        case Op::PHI: {
+            Lattice result;
+            for (uint32_t k = 0; k < instr.operandCount; k++) {
+                if (liveEdges_[instr.block] & 1 << k) result = meet(result, values_[operands[k]]);
+            }
+            return result;
+        }
+        case Op::PARAM:
+        case Op::OPAQUE:
+        case Op::CALL:
+            break;
+    }
+    return Lattice{Lattice::VARYING, Value()};
+}
+
+void ConstantSolver::update(const Function& function, const ConstantBindings* globals, ValueId id) {
+    Lattice& current = values_[id];
+    // Values only ever move down.
+    Lattice next = meet(current, evaluate(function, globals, id));
+    if (!sameLattice(next, current)) {
+        current = next;
+        ssaWork_.push_back(id);
+    }
+}
+
+void ConstantSolver::visitExit(const Function& function, BlockId b) {
+    const Block& block = function.blocks[b];
+    if (block.exit == Exit::JUMP) {
+        flowWork_.push_back({b, block.succs[0]});
+    } else if (block.exit == Exit::BRANCH) {
+        const Lattice& condition = values_[block.value];
+        if (condition.kind == Lattice::CONSTANT) {
+            flowWork_.push_back({b, block.succs[isTruthy(condition.value) ? 0 : 1]});
+        } else if (condition.kind == Lattice::VARYING) {
+            flowWork_.push_back({b, block.succs[0]});
+            flowWork_.push_back({b, block.succs[1]});
+        }
+    }
+}
+
+void ConstantSolver::solve(const Function& function, const ConstantBindings* globals) {
+    const auto& values = function.values;
+    const auto& blocks = function.blocks;
+    values_.assign(values.size(), Lattice{});
+    reachable_.assign(blocks.size(), false);
+    liveEdges_.assign(blocks.size(), 0);
+    branchFirst_.assign(values.size(), NoBlock);
+    branchNext_.assign(blocks.size(), NoBlock);
+    for (BlockId b = 0; b < blocks.size(); b++) {
+        if (blocks[b].exit == Exit::BRANCH) {
+            branchNext_[b] = branchFirst_[blocks[b].value];
+            branchFirst_[blocks[b].value] = b;
+        }
+    }
+
+    flowWork_.clear();
+    ssaWork_.clear();
+    flowWork_.push_back({NoBlock, 0});
+    while (!flowWork_.empty() || !ssaWork_.empty()) {
+        while (!flowWork_.empty()) {
+            auto [from, to] = flowWork_.back();
+            flowWork_.pop_back();
+            const Block& block = blocks[to];
+            if (from != NoBlock) {
+                uint8_t edge = block.preds[0] == from ? 1 : 2;
+                if (liveEdges_[to] & edge) continue;
+                liveEdges_[to] |= edge;
+            }
+            if (!reachable_[to]) {
+                reachable_[to] = true;
+                for (ValueId id = block.first; id < block.end; id++) update(function, globals, id);
+                visitExit(function, to);
+            } else {
+                for (ValueId id = block.first; id < block.end && values[id].op == Op::PHI; id++) {
+                    update(function, globals, id);
+                }
+            }
+        }
+        while (!ssaWork_.empty()) {
+            ValueId id = ssaWork_.back();
+            ssaWork_.pop_back();
+            const Instr& instr = values[id];
+            for (uint32_t k = 0; k < instr.userCount; k++) {
+                ValueId user = function.users(instr)[k];
+                if (reachable_[values[user].block]) update(function, globals, user);
+            }
+            for (BlockId b = branchFirst_[id]; b != NoBlock; b = branchNext_[b]) {
+                if (reachable_[b]) visitExit(function, b);
+            }
+        }
+    }
+}
+
+bool ValueNumbering::keyOf(const Function& function, const ConstantSolver& constants, ValueId id, Key& key) const {
+    const Instr& instr = function.values[id];
+    const Lattice& lattice = constants.value(id);
+    key = Key{0, {NoValue, NoValue}, instr.op, instr.subop};
+    if (lattice.kind == Lattice::CONSTANT) {
+        key.op = Op::CONST;
+        key.subop = 0;
+        key.payload = lattice.value.bits();
+        return true;
+    }
+    switch (instr.op) {
+        case Op::GLOBAL:
+            key.payload = instr.name.id;
+            return instr.subop != VolatileGlobal;
+        case Op::UNARY:
+        case Op::BINARY:
+        case Op::PHI:
+            if (instr.op == Op::PHI && instr.subop == ControlPhi) return false;
+            for (uint32_t k = 0; k < instr.operandCount; k++) {
+                key.operands[k] = leaders_[function.operands(instr)[k]];
+            }
+            if (instr.op == Op::BINARY && isCommutative(static_cast<BinaryOp>(instr.subop)) &&
+                key.operands[0] > key.operands[1]) {
+                std::swap(key.operands[0], key.operands[1]);
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+void ValueNumbering::enter(const Function& function, const ConstantSolver& constants, BlockId b) {
+    const Block& block = function.blocks[b];
+    size_t mask = table_.size() - 1;
+    for (ValueId id = block.first; id < block.end; id++) {
+        Key key;
+        if (!keyOf(function, constants, id, key)) continue;
+        uint64_t h = key.payload * 0x9E3779B97F4A7C15ull;
+        h = (h ^ key.operands[0]) * 0x9E3779B97F4A7C15ull;
+        h = (h ^ key.operands[1]) * 0x9E3779B97F4A7C15ull;
+        h ^= static_cast<uint64_t>(key.op) << 8 | key.subop;
+        size_t slot = static_cast<size_t>(h ^ h >> 32) & mask;
+        while (table_[slot] != NoValue && !(keys_[slot] == key)) slot = (slot + 1) & mask;
+        if (table_[slot] != NoValue) {
+            leaders_[id] = table_[slot];
+        } else {
+            table_[slot] = id;
+            keys_[slot] = key;
+            undo_.push_back(static_cast<uint32_t>(slot));
+        }
+    }
+}
+
+void ValueNumbering::number(const Function& function, const ConstantSolver& constants) {
+    size_t count = function.values.size();
+    leaders_.resize(count);
+    for (ValueId id = 0; id < count; id++) leaders_[id] = id;
+
+    size_t capacity = 16;
+    while (capacity < count * 2) capacity *= 2;
+    table_.assign(capacity, NoValue);
+    keys_.resize(capacity);
+    undo_.clear();
+    stack_.clear();
+    if (!constants.reachable(0)) return;
+
+    // A value is available in the subtree of the block that computes it and
+    // nowhere else.
+    enter(function, constants, 0);
+    stack_.push_back(Frame{0, 0, 0});
+    while (!stack_.empty()) {
+        Frame& frame = stack_.back();
+        if (function.childStart[frame.block] + frame.next < function.childStart[frame.block + 1]) {
+            BlockId child = function.children[function.childStart[frame.block] + frame.next++];
+            if (!constants.reachable(child)) continue;
+            stack_.push_back(Frame{child, 0, static_cast<uint32_t>(undo_.size())});
+            enter(function, constants, child);
+        } else {
+            while (undo_.size() > frame.mark) {
+                table_[undo_.back()] = NoValue;
+                undo_.pop_back();
+            }
+            stack_.pop_back();
+        }
+    }
+}
+
+} // namespace ssa
+
+namespace {
+
+using namespace ssa;
+
+constexpr uint32_t NoBinding = UINT32_MAX;
+
+// An expression of the AST and the value it lowered to. Sites are recorded
+// in pre-order; `end` is one past the last site inside the expression. A
+// site that assigns, itself or inside, stays even where its value is known.
+struct Site {
+    NodePtr* slot;
+    ValueId value;
+    uint32_t seq;
+    uint32_t end;
+    BlockId block;
+    bool assigns;
+};
+
+struct Binding {
+    Atom name;
+    ValueId value;
+    uint32_t seq;
+    uint32_t nextSeq; // when the name stopped holding the value, if it has
+    bool first;
+    bool global; // of a top-level variable, which user calls may assign
+};
+
+// Undoes a binding: before it, the name was bound by `previous`.
+struct Rebinding {
+    Atom name;
+    uint32_t previous;
+};
+
+// A declaration in a block, and the binding its name hides until the end.
+struct Shadow {
+    Atom name;
+    uint32_t previous;
+    uint32_t userCalls; // lowered before the declaration
+};
+
+// A variable an if or a loop may change: its value at the end of each arm,
+// or its loop phi in values[0].
+struct Join {
+    Atom name;
+    ValueId values[2];
+    bool global;
+};
+
+// The variables a statement assigns, and whether it calls user code.
+// Bodies of nested functions do not run there.
+class Effects : public ASTVisitor<Effects> {
+public:
+    NameSet& assigned;
+    bool calls = false;
+
+    explicit Effects(NameSet& assigned) : assigned(assigned) {}
+
+    void visitFunctionDeclaration(const FunctionDeclaration&) {}
+    void visitAssignmentExpression(const AssignmentExpression& node) {
+        assigned.insert(node.name);
+        visitChild(node.value);
+    }
+    void visitCallExpression(const CallExpression& node) {
+        calls = calls || !node_cast<MemberExpression>(node.callee.get());
+        visitChild(node.callee);
+        visitList(node.arguments);
+    }
+};
+
+// Everything one unit needs, kept per thread between units.
+struct Workspace {
+    Function function;
+    ConstantSolver constants;
+    ValueNumbering numbering;
+    std::vector<Site> sites;
+    std::vector<Binding> bindings;
+    std::vector<Rebinding> rebindings;
+    std::vector<Shadow> shadows;
+    std::vector<Join> joins;
+    std::vector<ValueId> operandStack;
+    NameSet assigned;
+    NameSet written; // every name the unit assigns
+    // Indexed by atom id; only the entries of `touched` are set.
+    std::vector<uint32_t> lastBinding;
+    std::vector<Atom> touched;
+    // Bindings by the leader of their value, as linked lists in order.
+    std::vector<uint32_t> firstHolder;
+    std::vector<uint32_t> nextHolder;
+
+    void clear() {
+        function.clear();
+        sites.clear();
+        bindings.clear();
+        rebindings.clear();
+        shadows.clear();
+        joins.clear();
+        for (Atom name : touched) lastBinding[name.id] = NoBinding;
+        touched.clear();
+    }
+};
+
+// Lowers statements in execution order. Every expression and binding gets a
+// sequence number, and a binding records the number at which its name
+// stopped holding its value: when the name was bound again, or when control
+// left the branch or block that bound it. So a binding open at an
+// expression's number has run, and still holds, whenever the expression
+// runs. A loop rebinds every name its body may change to a phi first.
+class Lowering {
+public:
+    uint32_t firstUserCall = UINT32_MAX;
+
+    // `clobbered` holds the top-level names a user call may assign; null
+    // means any of them.
+    Lowering(Workspace& ws, bool topLevel, const NameSet* clobbered)
+        : ws_(ws), function_(ws.function), topLevel_(topLevel), clobbered_(clobbered) {
+        function_.addBlock();
+    }
+
+    void bind(Atom name, ValueId value, bool global) {
+        if (name.id >= ws_.lastBinding.size()) {
+            ws_.lastBinding.resize(std::max<size_t>(name.id + 1, ws_.lastBinding.size() * 2), NoBinding);
+        }
+        uint32_t& last = ws_.lastBinding[name.id];
+        if (last == NoBinding) {
+            ws_.touched.push_back(name);
+        } else {
+            close(last);
+        }
+        ws_.rebindings.push_back(Rebinding{name, last});
+        ws_.bindings.push_back(Binding{name, value, seq_++, UINT32_MAX, last == NoBinding, global});
+        last = static_cast<uint32_t>(ws_.bindings.size() - 1);
+    }
+
+    ValueId param(uint32_t index) {
+        Instr instr{Op::PARAM};
+        instr.index = index;
+        return function_.add(instr);
+    }
+
+    // Returns false once control cannot reach past the statement.
+    bool statement(NodePtr& slot) {
+        ASTNode* node = slot.get();
+        if (!node) return true;
+        switch (node->type) {
+            case NodeType::VARIABLE_DECLARATION: {
+                auto* decl = static_cast<VariableDeclaration*>(node);
+                bool local = !topLevel_ || depth_ > 0;
+                if (depth_ > 0) ws_.shadows.push_back(Shadow{decl->name, binding(decl->name), userCalls_});
+                // A local is declared before its initializer runs, which
+                // reads the new, unset local rather than any outer name.
+                if (local) bind(decl->name, opaque(), false);
+                ValueId value = decl->init ? expression(decl->init) : constant(Value::undefined());
+                bind(decl->name, value, !local);
+                return true;
+            }
+            case NodeType::FUNCTION_DECLARATION: {
+                // Top-level functions are bound before anything runs, so
+                // reads of their names stay global reads.
+                Atom name = static_cast<FunctionDeclaration*>(node)->name;
+                if (depth_ > 0) ws_.shadows.push_back(Shadow{name, binding(name), userCalls_});
+                if (!topLevel_ || depth_ > 0) bind(name, opaque(), false);
+                return true;
+            }
+            case NodeType::RETURN_STATEMENT: {
+                auto* ret = static_cast<ReturnStatement*>(node);
+                ValueId value = ret->argument ? expression(ret->argument) : constant(Value::undefined());
+                function_.blocks.back().exit = Exit::RETURN;
+                function_.blocks.back().value = value;
+                return false;
+            }
+            case NodeType::BLOCK_STATEMENT:
+                return block(static_cast<BlockStatement*>(node)->body);
+            case NodeType::IF_STATEMENT:
+                return ifStatement(*static_cast<IfStatement*>(node));
+            case NodeType::WHILE_STATEMENT:
+                whileStatement(*static_cast<WhileStatement*>(node));
+                return true;
+            default:
+                expression(slot);
+                return true;
+        }
+    }
+
+private:
+    Workspace& ws_;
+    Function& function_;
+    bool topLevel_;
+    const NameSet* clobbered_;
+    uint32_t seq_ = 0;
+    uint32_t depth_ = 0; // of nested blocks
+    uint32_t userCalls_ = 0;
+    uint32_t assignments_ = 0;
+
+    BlockId current() const { return static_cast<BlockId>(function_.blocks.size() - 1); }
+
+    uint32_t binding(Atom name) const {
+        return name.id < ws_.lastBinding.size() ? ws_.lastBinding[name.id] : NoBinding;
+    }
+
+    ValueId lookup(Atom name) const {
+        uint32_t index = binding(name);
+        return index == NoBinding ? NoValue : ws_.bindings[index].value;
+    }
+
+    void close(uint32_t index) {
+        Binding& binding = ws_.bindings[index];
+        if (binding.nextSeq == UINT32_MAX) binding.nextSeq = seq_;
+    }
+
+    void unbind(Atom name) {
+        uint32_t& last = ws_.lastBinding[name.id];
+        if (last == NoBinding) return;
+        close(last);
+        ws_.rebindings.push_back(Rebinding{name, last});
+        last = NoBinding;
+    }
+
+    // Back to the bindings in force when the log had `mark` entries.
+    void restore(size_t mark) {
+        while (ws_.rebindings.size() > mark) {
+            const Rebinding& undo = ws_.rebindings.back();
+            uint32_t& last = ws_.lastBinding[undo.name.id];
+            if (last != NoBinding) close(last);
+            last = undo.previous;
+            ws_.rebindings.pop_back();
+        }
+    }
+
+    bool clobberable(Atom name) const { return !clobbered_ || clobbered_->contains(name); }
+
+    // Calls `f` for every name bound to a top-level variable that a user
+    // call may assign.
+    template<typename F>
+    void forEachClobberable(F f) {
+        for (Atom name : clobbered_ ? clobbered_->members() : ws_.touched) {
+            uint32_t index = binding(name);
+            if (index != NoBinding && ws_.bindings[index].global) f(name);
+        }
+    }
+
+    ValueId constant(Value value) {
+        Instr instr{Op::CONST};
+        instr.constant = value;
+        return function_.add(instr);
+    }
+
+    ValueId opaque() { return function_.add(Instr{Op::OPAQUE}); }
+
+    ValueId global(Atom name) {
+        Instr instr{Op::GLOBAL};
+        instr.name = name;
+        if (clobberable(name) || ws_.written.contains(name)) instr.subop = VolatileGlobal;
+        return function_.add(instr);
+    }
+
+    // Gives every name `node` assigns a value before control splits, so
+    // that each arm has one to join. Returns whether `node` calls user code.
+    bool scanEffects(const ASTNode& node) {
+        ws_.assigned.clear();
+        Effects effects(ws_.assigned);
+        effects.visit(&node);
+        for (Atom name : ws_.assigned.members()) {
+            if (lookup(name) == NoValue) bind(name, global(name), true);
+        }
+        return effects.calls;
+    }
+
+    bool block(NodeList& body) {
+        size_t scope = ws_.shadows.size();
+        depth_++;
+        bool live = true;
+        for (auto& stmt : body) {
+            if (!(live = statement(stmt))) break;
+        }
+        depth_--;
+        while (ws_.shadows.size() > scope) {
+            Shadow shadow = ws_.shadows.back();
+            ws_.shadows.pop_back();
+            if (shadow.previous == NoBinding) {
+                unbind(shadow.name);
+                continue;
+            }
+            Binding outer = ws_.bindings[shadow.previous];
+            // The hidden variable may have been assigned by a call meanwhile.
+            bool clobbered = outer.global && userCalls_ != shadow.userCalls && clobberable(outer.name);
+            bind(shadow.name, clobbered ? opaque() : outer.value, outer.global);
+        }
+        return live;
+    }
+
+    // Records, for side `side` of a join, the names bound since `mark`.
+    void recordArm(size_t mark, size_t joins, int side) {
+        for (size_t i = mark; i < ws_.rebindings.size(); i++) {
+            Atom name = ws_.rebindings[i].name;
+            size_t k = joins;
+            while (k < ws_.joins.size() && !(ws_.joins[k].name == name)) k++;
+            if (k == ws_.joins.size()) ws_.joins.push_back(Join{name, {NoValue, NoValue}, false});
+            uint32_t index = binding(name);
+            ws_.joins[k].values[side] = index == NoBinding ? NoValue : ws_.bindings[index].value;
+            if (index != NoBinding) ws_.joins[k].global = ws_.bindings[index].global;
+        }
+    }
+
+    bool ifStatement(IfStatement& node) {
+        ValueId test = expression(node.test);
+        scanEffects(node);
+        BlockId from = current();
+        function_.blocks[from].exit = Exit::BRANCH;
+        function_.blocks[from].value = test;
+        size_t mark = ws_.rebindings.size();
+        size_t joins = ws_.joins.size();
+
+        function_.addEdge(from, function_.addBlock());
+        bool thenLive = statement(node.consequent);
+        BlockId thenEnd = current();
+        recordArm(mark, joins, 0);
+        restore(mark);
+        function_.addEdge(from, function_.addBlock());
+        bool elseLive = statement(node.alternate);
+        BlockId elseEnd = current();
+        recordArm(mark, joins, 1);
+        restore(mark);
+
+        if (thenLive || elseLive) {
+            BlockId join = function_.addBlock();
+            if (thenLive) {
+                function_.blocks[thenEnd].exit = Exit::JUMP;
+                function_.addEdge(thenEnd, join);
+            }
+            if (elseLive) {
+                function_.blocks[elseEnd].exit = Exit::JUMP;
+                function_.addEdge(elseEnd, join);
+            }
+            for (size_t k = joins; k < ws_.joins.size(); k++) {
+                Join entry = ws_.joins[k];
+                ValueId before = lookup(entry.name);
+                for (ValueId& value : entry.values) {
+                    if (value == NoValue) value = before;
+                }
+                ValueId value = !elseLive ? entry.values[0] : !thenLive ? entry.values[1] : NoValue;
+                if (value == NoValue) {
+                    if (entry.values[0] == NoValue || entry.values[1] == NoValue) continue;
+                    value = entry.values[0];
+                    if (entry.values[0] != entry.values[1]) {
+                        Instr phi{Op::PHI};
+                        phi.subop = ControlPhi;
+                        value = function_.add(phi, {entry.values[0], entry.values[1]});
+                    }
+                }
+                if (value != before) bind(entry.name, value, entry.global);
+            }
+        }
+        ws_.joins.resize(joins);
+        return thenLive || elseLive;
+    }
+
+    void whileStatement(WhileStatement& node) {
+        if (scanEffects(node)) {
+            forEachClobberable([&](Atom name) { ws_.assigned.insert(name); });
+        }
+        size_t joins = ws_.joins.size();
+        for (Atom name : ws_.assigned.members()) {
+            uint32_t index = binding(name);
+            ws_.joins.push_back(Join{name, {ws_.bindings[index].value, NoValue}, ws_.bindings[index].global});
+        }
+        BlockId preheader = current();
+        function_.blocks[preheader].exit = Exit::JUMP;
+        BlockId header = function_.addBlock();
+        function_.addEdge(preheader, header);
+        for (size_t k = joins; k < ws_.joins.size(); k++) {
+            Join& entry = ws_.joins[k];
+            Instr phi{Op::PHI};
+            phi.subop = ControlPhi;
+            entry.values[0] = function_.add(phi, {entry.values[0], entry.values[0]});
+        }
+        for (size_t k = joins; k < ws_.joins.size(); k++) {
+            bind(ws_.joins[k].name, ws_.joins[k].values[0], ws_.joins[k].global);
+        }
+
+        ValueId test = expression(node.test);
+        BlockId condition = current();
+        function_.blocks[condition].exit = Exit::BRANCH;
+        function_.blocks[condition].value = test;
+        // The test's own bindings still hold when the loop exits.
+        size_t mark = ws_.rebindings.size();
+        function_.addEdge(condition, function_.addBlock());
+        if (statement(node.body)) {
+            BlockId latch = current();
+            function_.blocks[latch].exit = Exit::JUMP;
+            function_.addEdge(latch, header);
+            for (size_t k = joins; k < ws_.joins.size(); k++) {
+                ValueId value = lookup(ws_.joins[k].name);
+                function_.setOperand(ws_.joins[k].values[0], 1, value == NoValue ? ws_.joins[k].values[0] : value);
+            }
+        }
+        restore(mark);
+        function_.addEdge(condition, function_.addBlock());
+        for (size_t k = joins; k < ws_.joins.size(); k++) {
+            uint32_t index = binding(ws_.joins[k].name);
+            if (index != NoBinding && ws_.bindings[index].nextSeq != UINT32_MAX) {
+                Binding held = ws_.bindings[index];
+                bind(held.name, held.value, held.global);
+            }
+        }
+        ws_.joins.resize(joins);
+    }
+
+    ValueId expression(NodePtr& slot) {
+        ASTNode* node = slot.get();
+        if (!node) return opaque();
+        size_t index = ws_.sites.size();
+        uint32_t assignments = assignments_;
+        ws_.sites.push_back(Site{&slot, NoValue, seq_++, 0, current(), false});
+
+        ValueId value;
+        switch (node->type) {
+            case NodeType::LITERAL:
+                value = constant(static_cast<Literal*>(node)->value);
+                break;
+            case NodeType::IDENTIFIER: {
+                Atom name = static_cast<Identifier*>(node)->name;
+                value = lookup(name);
+                if (value == NoValue) value = global(name);
+                break;
+            }
+            case NodeType::UNARY_EXPRESSION: {
+                auto* unary = static_cast<UnaryExpression*>(node);
+                Instr instr{Op::UNARY};
+                instr.subop = static_cast<uint8_t>(unary->op);
+                ValueId argument = expression(unary->argument);
+                value = function_.add(instr, {argument});
+                break;
+            }
+            case NodeType::BINARY_EXPRESSION: {
+                auto* binary = static_cast<BinaryExpression*>(node);
+                if (binary->op == BinaryOp::AND || binary->op == BinaryOp::OR) {
+                    value = logical(*binary);
+                    break;
+                }
+                Instr instr{Op::BINARY};
+                instr.subop = static_cast<uint8_t>(binary->op);
+                ValueId left = expression(binary->left);
+                ValueId right = expression(binary->right);
+                value = function_.add(instr, {left, right});
+                break;
+            }
+            case NodeType::CALL_EXPRESSION: {
+                auto* call = static_cast<CallExpression*>(node);
+                // Only member calls are known to be builtins.
+                bool user = !node_cast<MemberExpression>(call->callee.get());
+                if (user) firstUserCall = std::min(firstUserCall, ws_.sites[index].seq);
+                size_t mark = ws_.operandStack.size();
+                ValueId callee = expression(call->callee);
+                ws_.operandStack.push_back(callee);
+                for (auto& arg : call->arguments) {
+                    ValueId argument = expression(arg);
+                    ws_.operandStack.push_back(argument);
+                }
+                value = function_.add(Instr{Op::CALL}, ws_.operandStack.data() + mark,
+                                      ws_.operandStack.size() - mark);
+                ws_.operandStack.resize(mark);
+                if (user) {
+                    userCalls_++;
+                    forEachClobberable([&](Atom name) { bind(name, opaque(), true); });
+                }
+                break;
+            }
+            case NodeType::MEMBER_EXPRESSION: {
+                ValueId object = expression(static_cast<MemberExpression*>(node)->object);
+                value = function_.add(Instr{Op::OPAQUE}, {object});
+                break;
+            }
+            case NodeType::ASSIGNMENT_EXPRESSION: {
+                auto* assignment = static_cast<AssignmentExpression*>(node);
+                value = expression(assignment->value);
+                // An unbound name is a top-level one.
+                uint32_t previous = binding(assignment->name);
+                bind(assignment->name, value, previous == NoBinding || ws_.bindings[previous].global);
+                assignments_++;
+                break;
+            }
+            default:
+                value = opaque();
+                break;
+        }
+        Site& site = ws_.sites[index];
+        site.value = value;
+        site.end = static_cast<uint32_t>(ws_.sites.size());
+        site.assigns = assignments_ != assignments;
+        return value;
+    }
+
+    // `a && b` branches on a: truthy goes on to evaluate b, falsy skips to
+    // the join, where a phi picks the operand that was the result. A
+    // variable b assigns is joined like one an if assigns.
+    ValueId logical(BinaryExpression& binary) {
+        ValueId left = expression(binary.left);
+        BlockId from = current();
+        function_.blocks[from].exit = Exit::BRANCH;
+        function_.blocks[from].value = left;
+        size_t mark = ws_.rebindings.size();
+        size_t joins = ws_.joins.size();
+        BlockId rhs = function_.addBlock();
+        function_.addEdge(from, rhs);
+        ValueId right = expression(binary.right);
+        BlockId end = current();
+        recordArm(mark, joins, 0);
+        restore(mark);
+        function_.blocks[end].exit = Exit::JUMP;
+        BlockId join = function_.addBlock();
+        function_.addEdge(from, join);
+        if (binary.op == BinaryOp::OR) {
+            std::swap(function_.blocks[from].succs[0], function_.blocks[from].succs[1]);
+        }
+        function_.addEdge(end, join);
+        Instr phi{Op::PHI};
+        phi.subop = static_cast<uint8_t>(binary.op);
+        ValueId value = function_.add(phi, {left, right});
+        for (size_t k = joins; k < ws_.joins.size(); k++) {
+            const Join& entry = ws_.joins[k];
+            ValueId before = lookup(entry.name);
+            if (before == NoValue || entry.values[0] == NoValue || entry.values[0] == before) continue;
+            Instr variable{Op::PHI};
+            variable.subop = ControlPhi;
+            bind(entry.name, function_.add(variable, {before, entry.values[0]}), entry.global);
+        }
+        ws_.joins.resize(joins);
+        return value;
+    }
+};
+
+bool isPure(Op op) {
+    return op == Op::UNARY || op == Op::BINARY || op == Op::PHI;
+}
+
+} // namespace
+
+size_t propagateConstants(NodeList& body, const std::pmr::vector<Atom>* params, const ConstantBindings* globals,
+                          const NameSet* clobbered, ConstantBindings* exported) {
+    thread_local Workspace ws;
+    ws.clear();
+    ws.written.clear();
+    Effects effects(ws.written);
+    for (const auto& stmt : body) {
+        if (stmt) effects.visit(stmt.get());
+    }
+    Lowering lowering(ws, params == nullptr, clobbered);
+    if (params) {
+        for (uint32_t i = 0; i < params->size(); i++) {
+            lowering.bind((*params)[i], lowering.param(i), false);
+        }
+    }
+    for (auto& stmt : body) {
+        if (!lowering.statement(stmt)) break;
+    }
+
+    const Function& function = ws.function;
+    ws.function.finish();
+    ws.constants.solve(function, globals);
+    ws.numbering.number(function, ws.constants);
+
+    ws.firstHolder.assign(function.values.size(), NoBinding);
+    ws.nextHolder.resize(ws.bindings.size());
+    for (size_t i = ws.bindings.size(); i-- > 0;) {
+        ValueId leader = ws.numbering.leader(ws.bindings[i].value);
+        ws.nextHolder[i] = ws.firstHolder[leader];
+        ws.firstHolder[leader] = static_cast<uint32_t>(i);
+    }
+    // A variable that holds the value at `seq`: bound before it and not
+    // rebound or left since.
+    auto holder = [&](ValueId leader, uint32_t seq) -> const Binding* {
+        for (uint32_t i = ws.firstHolder[leader]; i != NoBinding; i = ws.nextHolder[i]) {
+            const Binding& binding = ws.bindings[i];
+            if (binding.seq >= seq) break;
+            if (binding.nextSeq > seq) return &binding;
+        }
+        return nullptr;
+    };
+
+    size_t replaced = 0;
+    for (size_t i = 0; i < ws.sites.size();) {
+        const Site& site = ws.sites[i];
+        if (!ws.constants.reachable(site.block)) {
+            i = site.end;
+            continue;
+        }
+        if (site.assigns) {
+            i++;
+            continue;
+        }
+        NodeType type = (*site.slot)->type;
+        const Lattice& lattice = ws.constants.value(site.value);
+        if (lattice.kind == Lattice::CONSTANT && type != NodeType::LITERAL) {
+            *site.slot = std::make_unique<Literal>(lattice.value);
+            replaced++;
+            i = site.end;
+            continue;
+        }
+        if (lattice.kind == Lattice::VARYING && type != NodeType::IDENTIFIER && isPure(function.values[site.value].op)) {
+            if (const Binding* binding = holder(ws.numbering.leader(site.value), site.seq)) {
+                auto identifier = std::make_unique<Identifier>();
+                identifier->name = binding->name;
+                *site.slot = std::move(identifier);
+                replaced++;
+                i = site.end;
+                continue;
+            }
+        }
+        i++;
+    }
+
+    if (exported) {
+        for (const Binding& binding : ws.bindings) {
+            const Lattice& lattice = ws.constants.value(binding.value);
+            if (binding.first && binding.global && binding.nextSeq == UINT32_MAX &&
+                binding.seq < lowering.firstUserCall && lattice.kind == Lattice::CONSTANT) {
+                (*exported)[binding.name] = lattice.value;
+            }
+        }
+    }
+    return replaced;
+}
+
+} // namespace js
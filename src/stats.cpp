@@ -0,0 +1,115 @@
+#include "../include/stats.hpp"
+#include "../include/visitor.hpp"
+#include <cstdio>
+#include <iterator>
+
+namespace js {
+
+namespace {
+
+const char* const nodeTypeNames[] = {
+    "Program", "VariableDeclaration", "FunctionDeclaration", "ReturnStatement", "BinaryExpression",
+    "CallExpression", "Identifier", "Literal", "UnaryExpression", "MemberExpression",
+    "BlockStatement", "IfStatement", "WhileStatement", "AssignmentExpression",
+};
+
+static_assert(std::size(nodeTypeNames) == NodeTypeCount, "one name per NodeType");
+
+class NodeTypeCounter : public ASTVisitor<NodeTypeCounter> {
+public:
+    NodeCounts counts{};
+
+    void visitProgram(const Program& node) { count(node); ASTVisitor::visitProgram(node); }
+    void visitVariableDeclaration(const VariableDeclaration& node) {
+        count(node);
+        ASTVisitor::visitVariableDeclaration(node);
+    }
+    void visitFunctionDeclaration(const FunctionDeclaration& node) {
+        count(node);
+        ASTVisitor::visitFunctionDeclaration(node);
+    }
+    void visitReturnStatement(const ReturnStatement& node) { count(node); ASTVisitor::visitReturnStatement(node); }
+    void visitBinaryExpression(const BinaryExpression& node) { count(node); ASTVisitor::visitBinaryExpression(node); }
+    void visitCallExpression(const CallExpression& node) { count(node); ASTVisitor::visitCallExpression(node); }
+    void visitIdentifier(const Identifier& node) { count(node); }
+    void visitLiteral(const Literal& node) { count(node); }
+    void visitUnaryExpression(const UnaryExpression& node) { count(node); ASTVisitor::visitUnaryExpression(node); }
+    void visitMemberExpression(const MemberExpression& node) { count(node); ASTVisitor::visitMemberExpression(node); }
+    void visitBlockStatement(const BlockStatement& node) { count(node); ASTVisitor::visitBlockStatement(node); }
+    void visitIfStatement(const IfStatement& node) { count(node); ASTVisitor::visitIfStatement(node); }
+    void visitWhileStatement(const WhileStatement& node) { count(node); ASTVisitor::visitWhileStatement(node); }
+    void visitAssignmentExpression(const AssignmentExpression& node) {
+        count(node);
+        ASTVisitor::visitAssignmentExpression(node);
+    }
+
+private:
+    void count(const ASTNode& node) { counts[static_cast<size_t>(node.type)]++; }
+};
+
+size_t total(const NodeCounts& counts) {
+    size_t sum = 0;
+    for (size_t n : counts) sum += n;
+    return sum;
+}
+
+} // namespace
+
+NodeCounts countNodes(const ASTNode* root) {
+    NodeTypeCounter counter;
+    if (root) counter.visit(root);
+    return counter.counts;
+}
+
+void CompileStats::add(const CompileStats& other) {
+    for (size_t i = 0; i < phaseNanos.size(); i++) phaseNanos[i] += other.phaseNanos[i];
+    for (size_t i = 0; i < NodeTypeCount; i++) {
+        parsedNodes[i] += other.parsedNodes[i];
+        optimizedNodes[i] += other.optimizedNodes[i];
+    }
+    for (size_t i = 0; i < passRewrites.size(); i++) passRewrites[i] += other.passRewrites[i];
+    files += other.files;
+    sourceBytes += other.sourceBytes;
+    tokens += other.tokens;
+    arenaAllocated += other.arenaAllocated;
+    arenaReserved += other.arenaReserved;
+    arenaRecycled += other.arenaRecycled;
+    atomBytes += other.atomBytes;
+}
+
+void CompileStats::print(std::ostream& out) const {
+    char line[128];
+    out << "Stats";
+    if (files > 1) out << " (sum over " << files << " files)";
+    out << ":\n";
+    uint64_t totalNanos = 0;
+    for (size_t i = 0; i < phaseNanos.size(); i++) {
+        if (!phaseNanos[i]) continue;
+        std::snprintf(line, sizeof(line), "  %-10s %15llu ns\n", phaseNames[i],
+                      static_cast<unsigned long long>(phaseNanos[i]));
+        out << line;
+        totalNanos += phaseNanos[i];
+    }
+    std::snprintf(line, sizeof(line), "  %-10s %15llu ns\n", "total", static_cast<unsigned long long>(totalNanos));
+    out << line;
+
+    out << "  source bytes " << sourceBytes << ", tokens " << tokens << "\n";
+    std::snprintf(line, sizeof(line), "  %-20s %10s %10s\n", "nodes", "parsed", "optimized");
+    out << line;
+    for (size_t i = 0; i < NodeTypeCount; i++) {
+        if (!parsedNodes[i] && !optimizedNodes[i]) continue;
+        std::snprintf(line, sizeof(line), "  %-20s %10zu %10zu\n", nodeTypeNames[i], parsedNodes[i], optimizedNodes[i]);
+        out << line;
+    }
+    std::snprintf(line, sizeof(line), "  %-20s %10zu %10zu\n", "total", total(parsedNodes), total(optimizedNodes));
+    out << line;
+    out << "  rewrites";
+    for (size_t i = 0; i < passRewrites.size(); i++) {
+        out << (i ? ", " : " ") << passNames[i] << " " << passRewrites[i];
+    }
+    out << "\n";
+    out << "  arena bytes allocated " << arenaAllocated << ", reserved " << arenaReserved << ", recycled "
+        << arenaRecycled << "; atom table bytes " << atomBytes << std::endl;
+}
+
+} // namespace js
@@ -0,0 +1,72 @@
+#include "../include/trace.hpp"
+#include <atomic>
+#include <cstdio>
+
+namespace js {
+
+namespace {
+
+// Small stable thread ids, in order of first use.
+uint32_t threadId() {
+    static std::atomic<uint32_t> next{0};
+    thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+void writeString(std::ostream& out, const std::string& text) {
+    out << '"';
+    for (char c : text) {
+        switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out << escaped;
+                } else {
+                    out << c;
+                }
+        }
+    }
+    out << '"';
+}
+
+// Trace timestamps are microseconds; keep the nanoseconds as a fraction.
+void writeMicros(std::ostream& out, uint64_t nanos) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%llu.%03llu", static_cast<unsigned long long>(nanos / 1000),
+                  static_cast<unsigned long long>(nanos % 1000));
+    out << text;
+}
+
+} // namespace
+
+void Trace::record(std::string name, const char* category, Clock::time_point begin, Clock::time_point end) {
+    auto since = [this](Clock::time_point t) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t - start_).count());
+    };
+    Event event{std::move(name), category, since(begin), since(end) - since(begin), threadId()};
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back(std::move(event));
+}
+
+void Trace::write(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    for (size_t i = 0; i < events_.size(); i++) {
+        const Event& event = events_[i];
+        out << (i ? ",\n" : "\n") << "{\"name\": ";
+        writeString(out, event.name);
+        out << ", \"cat\": \"" << event.category << "\", \"ph\": \"X\", \"ts\": ";
+        writeMicros(out, event.begin);
+        out << ", \"dur\": ";
+        writeMicros(out, event.duration);
+        out << ", \"pid\": 1, \"tid\": " << event.thread << "}";
+    }
+    out << "\n]}\n";
+}
+
+} // namespace js
@@ -0,0 +1,150 @@
+#include "../include/value.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+
+namespace js {
+
+bool isTruthy(Value value) {
+    switch (value.tag()) {
+        case Value::Tag::NUMBER: return value.asNumber() != 0 && !std::isnan(value.asNumber());
+        case Value::Tag::UNDEFINED:
+        case Value::Tag::NULL_VALUE: return false;
+        case Value::Tag::BOOLEAN: return value.asBool();
+        case Value::Tag::STRING: return value.asAtom() != atoms::empty;
+        case Value::Tag::FUNCTION:
+        case Value::Tag::OBJECT: return true;
+    }
+    return false;
+}
+
+namespace {
+
+double stringToNumber(std::string_view text) {
+    size_t begin = text.find_first_not_of(" \t\n\r\v\f");
+    if (begin == std::string_view::npos) {
+        return 0;
+    }
+    size_t end = text.find_last_not_of(" \t\n\r\v\f") + 1;
+    std::string trimmed(text.substr(begin, end - begin));
+    if (trimmed == "Infinity" || trimmed == "+Infinity") return INFINITY;
+    if (trimmed == "-Infinity") return -INFINITY;
+
+    char* parsed = nullptr;
+    double number = std::strtod(trimmed.c_str(), &parsed);
+    bool hexOrWord = trimmed.find_first_of("xXnN") != std::string::npos &&
+                     trimmed.compare(0, 2, "0x") != 0 && trimmed.compare(0, 2, "0X") != 0;
+    if (parsed != trimmed.c_str() + trimmed.size() || hexOrWord) {
+        return NAN;
+    }
+    return number;
+}
+
+} // namespace
+
+double toNumber(Value value) {
+    switch (value.tag()) {
+        case Value::Tag::NUMBER: return value.asNumber();
+        case Value::Tag::NULL_VALUE: return 0;
+        case Value::Tag::BOOLEAN: return value.asBool() ? 1 : 0;
+        case Value::Tag::STRING: return stringToNumber(AtomTable::current().text(value.asAtom()));
+        case Value::Tag::UNDEFINED:
+        case Value::Tag::FUNCTION:
+        case Value::Tag::OBJECT: return NAN;
+    }
+    return NAN;
+}
+
+int32_t toInt32(double number) {
+    if (!std::isfinite(number)) {
+        return 0;
+    }
+    double truncated = std::trunc(number);
+    double wrapped = std::fmod(truncated, 4294967296.0);
+    if (wrapped < 0) wrapped += 4294967296.0;
+    auto bits = static_cast<uint32_t>(wrapped);
+    return static_cast<int32_t>(bits);
+}
+
+std::string numberToString(double number) {
+    if (std::isnan(number)) return "NaN";
+    if (std::isinf(number)) return number > 0 ? "Infinity" : "-Infinity";
+    if (number == 0) return "0";
+
+    // Shortest round-trip digits, laid out as Number::toString does: plain
+    // notation when the decimal exponent n is in (-6, 21], exponent
+    // notation outside it.
+    char buffer[64];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), number, std::chars_format::scientific);
+    std::string_view text(buffer, static_cast<size_t>(result.ptr - buffer));
+    std::string out;
+    if (text.front() == '-') {
+        out += '-';
+        text.remove_prefix(1);
+    }
+    size_t e = text.find('e');
+    int n = 0;
+    const char* exponent = text.data() + e + 1;
+    std::from_chars(exponent + (*exponent == '+'), text.data() + text.size(), n);
+    n++;
+    std::string digits(1, text[0]);
+    if (e > 2) digits.append(text.substr(2, e - 2));
+    auto k = static_cast<int>(digits.size());
+    if (k <= n && n <= 21) {
+        out += digits;
+        out.append(static_cast<size_t>(n - k), '0');
+    } else if (0 < n && n <= 21) {
+        out.append(digits, 0, static_cast<size_t>(n));
+        out += '.';
+        out.append(digits, static_cast<size_t>(n));
+    } else if (-6 < n && n <= 0) {
+        out += "0.";
+        out.append(static_cast<size_t>(-n), '0');
+        out += digits;
+    } else {
+        out += digits[0];
+        if (k > 1) {
+            out += '.';
+            out.append(digits, 1);
+        }
+        out += n - 1 < 0 ? "e-" : "e+";
+        out += std::to_string(std::abs(n - 1));
+    }
+    return out;
+}
+
+std::string toString(Value value) {
+    switch (value.tag()) {
+        case Value::Tag::NUMBER: return numberToString(value.asNumber());
+        case Value::Tag::UNDEFINED: return "undefined";
+        case Value::Tag::NULL_VALUE: return "null";
+        case Value::Tag::BOOLEAN: return value.asBool() ? "true" : "false";
+        case Value::Tag::STRING: return std::string(AtomTable::current().text(value.asAtom()));
+        case Value::Tag::FUNCTION: return "function";
+        case Value::Tag::OBJECT: return "[object Object]";
+    }
+    return "undefined";
+}
+
+bool looselyEquals(Value left, Value right) {
+    if (left.isNumber() && right.isNumber()) {
+        return left.asNumber() == right.asNumber();
+    }
+    // Every other pair of values with one type is equal exactly when it has
+    // the same bits: atoms are interned, and there is one undefined and null.
+    if (left.tag() == right.tag()) {
+        return left == right;
+    }
+    bool leftNullish = left.isUndefined() || left.isNull();
+    bool rightNullish = right.isUndefined() || right.isNull();
+    if (leftNullish || rightNullish) {
+        return leftNullish && rightNullish;
+    }
+    if (left.isFunction() || right.isFunction() ||
+        left.is(Value::Tag::OBJECT) || right.is(Value::Tag::OBJECT)) {
+        return false;
+    }
+    return toNumber(left) == toNumber(right);
+}
+
+} // namespace js
@@ -0,0 +1,287 @@
+#include "../include/x64.hpp"
+#include "../include/visitor.hpp"
+#include <cstring>
+
+namespace js {
+namespace x64 {
+
+namespace {
+
+constexpr uint64_t NaNBits = 0x7FF8000000000000ull;
+constexpr uint64_t OneBits = 0x3FF0000000000000ull;
+constexpr uint64_t SignBit = 0x8000000000000000ull;
+
+uint64_t bitsOf(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+bool isConsoleLog(const ASTNode* callee) {
+    auto* member = node_cast<MemberExpression>(callee);
+    if (!member || member->property != atoms::log) return false;
+    auto* object = node_cast<Identifier>(member->object.get());
+    return object && object->name == atoms::console;
+}
+
+Helper printHelper(TypeSet type) {
+    if (type == TYPE_NUMBER) return Helper::PRINT_NUMBER;
+    if (type == TYPE_UNDEFINED) return Helper::PRINT_UNDEFINED;
+    if (type == TYPE_STRING) return Helper::PRINT_STRING;
+    return Helper::PRINT_BOOLEAN;
+}
+
+uint32_t frameBytes(uint32_t slots) {
+    return (slots * 8 + 15) & ~15u;
+}
+
+} // namespace
+
+void X64Codegen::load(Xmm dst, Location location) {
+    if (location.pinned) {
+        emitter_.sse(SseOp::MOVE, dst, Xmm{location.index});
+    } else {
+        emitter_.loadSlot(dst, location.index);
+    }
+}
+
+void X64Codegen::store(Location location, Xmm src) {
+    if (location.pinned) {
+        emitter_.sse(SseOp::MOVE, Xmm{location.index}, src);
+    } else {
+        emitter_.storeSlot(location.index, src);
+    }
+}
+
+// Turns a value into 1.0 when it is falsy (0, -0, NaN) and 0.0 otherwise.
+void X64Codegen::logicalNot(Xmm value) {
+    emitter_.sse(SseOp::XOR, Scratch1, Scratch1);
+    emitter_.compare(Predicate::EQ, Scratch1, value);
+    emitter_.compare(Predicate::UNORD, value, value);
+    emitter_.sse(SseOp::OR, value, Scratch1);
+    emitter_.loadConstant(Scratch1, OneBits);
+    emitter_.sse(SseOp::AND, value, Scratch1);
+}
+
+// Arguments are in xmm(depth)..xmm(depth + argc - 1); the result replaces
+// xmm(depth). Live temporaries below depth are saved around the call.
+void X64Codegen::call(uint8_t depth, uint8_t argc, bool helper, uint32_t target) {
+    for (uint8_t i = 0; i < depth; i++) {
+        emitter_.storeSlot(spillBase_ + i, Xmm{i});
+    }
+    if (depth > 0) {
+        for (uint8_t i = 0; i < argc; i++) {
+            emitter_.sse(SseOp::MOVE, Xmm{i}, Xmm{static_cast<uint8_t>(depth + i)});
+        }
+    }
+    if (helper) {
+        emitter_.callHelper(static_cast<Helper>(target));
+    } else {
+        emitter_.callFunction(target);
+    }
+    if (depth > 0) {
+        emitter_.sse(SseOp::MOVE, Xmm{depth}, Xmm{0});
+        for (uint8_t i = 0; i < depth; i++) {
+            emitter_.loadSlot(Xmm{i}, spillBase_ + i);
+        }
+    }
+}
+
+void X64Codegen::binary(const BinaryExpression& node, uint8_t depth) {
+    Xmm dst{depth};
+    if (node.op == BinaryOp::AND || node.op == BinaryOp::OR) {
+        Label done = emitter_.newLabel();
+        expression(node.left.get(), depth);
+        emitter_.sse(SseOp::XOR, Scratch0, Scratch0);
+        emitter_.ucomisd(dst, Scratch0);
+        emitter_.jumpIf(node.op == BinaryOp::AND ? Condition::EQUAL : Condition::NOT_EQUAL, done);
+        expression(node.right.get(), depth);
+        emitter_.bind(done);
+        return;
+    }
+
+    Xmm src{static_cast<uint8_t>(depth + 1)};
+    expression(node.left.get(), depth);
+    expression(node.right.get(), src.id);
+
+    Predicate predicate = Predicate::EQ;
+    bool swap = false;
+    switch (node.op) {
+        case BinaryOp::ADD: emitter_.sse(SseOp::ADD, dst, src); return;
+        case BinaryOp::SUB: emitter_.sse(SseOp::SUB, dst, src); return;
+        case BinaryOp::MUL: emitter_.sse(SseOp::MUL, dst, src); return;
+        case BinaryOp::DIV: emitter_.sse(SseOp::DIV, dst, src); return;
+        case BinaryOp::POW: call(depth, 2, true, static_cast<uint32_t>(Helper::POW)); return;
+        case BinaryOp::BIT_AND: emitter_.bitwise(false, dst, src); return;
+        case BinaryOp::BIT_OR: emitter_.bitwise(true, dst, src); return;
+        case BinaryOp::LT: predicate = Predicate::LT; break;
+        case BinaryOp::LE: predicate = Predicate::LE; break;
+        case BinaryOp::GT: predicate = Predicate::LT; swap = true; break;
+        case BinaryOp::GE: predicate = Predicate::LE; swap = true; break;
+        case BinaryOp::EQ: predicate = Predicate::EQ; break;
+        case BinaryOp::NE: predicate = Predicate::NEQ; break;
+        default: break;
+    }
+    if (swap) {
+        emitter_.compare(predicate, src, dst);
+        emitter_.sse(SseOp::MOVE, dst, src);
+    } else {
+        emitter_.compare(predicate, dst, src);
+    }
+    emitter_.loadConstant(Scratch0, OneBits);
+    emitter_.sse(SseOp::AND, dst, Scratch0);
+}
+
+void X64Codegen::expression(const ASTNode* node, uint8_t depth) {
+    Xmm dst{depth};
+    switch (node->type) {
+        case NodeType::LITERAL: {
+            Value value = static_cast<const Literal*>(node)->value;
+            if (value.isNumber()) {
+                emitter_.loadConstant(dst, bitsOf(value.asNumber()));
+            } else if (value.isBoolean()) {
+                emitter_.loadConstant(dst, value.asBool() ? OneBits : 0);
+            } else if (value.isString()) {
+                emitter_.loadString(dst, value.asAtom());
+            } else {
+                emitter_.loadConstant(dst, NaNBits);
+            }
+            return;
+        }
+        case NodeType::IDENTIFIER: {
+            Atom name = static_cast<const Identifier*>(node)->name;
+            auto local = locals_.find(name);
+            if (local != locals_.end()) {
+                load(dst, local->second);
+            } else {
+                emitter_.loadGlobal(dst, static_cast<uint32_t>(analysis_.globalIndex(name)));
+            }
+            return;
+        }
+        case NodeType::UNARY_EXPRESSION: {
+            auto* unary = static_cast<const UnaryExpression*>(node);
+            expression(unary->argument.get(), depth);
+            if (unary->op == UnaryOp::NEG) {
+                emitter_.loadConstant(Scratch0, SignBit);
+                emitter_.sse(SseOp::XOR, dst, Scratch0);
+            } else if (unary->op == UnaryOp::NOT) {
+                logicalNot(dst);
+            }
+            return;
+        }
+        case NodeType::BINARY_EXPRESSION:
+            binary(*static_cast<const BinaryExpression*>(node), depth);
+            return;
+        case NodeType::CALL_EXPRESSION: {
+            auto* callExpr = static_cast<const CallExpression*>(node);
+            Atom callee = static_cast<const Identifier*>(callExpr->callee.get())->name;
+            auto argc = static_cast<uint8_t>(callExpr->arguments.size());
+            for (uint8_t i = 0; i < argc; i++) {
+                expression(callExpr->arguments[i].get(), static_cast<uint8_t>(depth + i));
+            }
+            call(depth, argc, false, static_cast<uint32_t>(analysis_.functionIndex(callee)));
+            return;
+        }
+        default:
+            break;
+    }
+}
+
+void X64Codegen::statement(const ASTNode* node) {
+    Xmm result{0};
+    switch (node->type) {
+        case NodeType::VARIABLE_DECLARATION: {
+            auto* var = static_cast<const VariableDeclaration*>(node);
+            if (var->init) {
+                expression(var->init.get(), 0);
+            } else {
+                emitter_.loadConstant(result, NaNBits);
+            }
+            auto local = locals_.find(var->name);
+            if (local != locals_.end()) {
+                store(local->second, result);
+            } else {
+                emitter_.storeGlobal(static_cast<uint32_t>(analysis_.globalIndex(var->name)), result);
+            }
+            return;
+        }
+        case NodeType::RETURN_STATEMENT: {
+            auto* ret = static_cast<const ReturnStatement*>(node);
+            if (ret->argument) {
+                expression(ret->argument.get(), 0);
+            } else {
+                emitter_.loadConstant(result, NaNBits);
+            }
+            emitter_.ret();
+            return;
+        }
+        case NodeType::FUNCTION_DECLARATION:
+            return;
+        case NodeType::CALL_EXPRESSION: {
+            auto* callExpr = static_cast<const CallExpression*>(node);
+            if (isConsoleLog(callExpr->callee.get())) {
+                for (size_t i = 0; i < callExpr->arguments.size(); i++) {
+                    const ASTNode* argument = callExpr->arguments[i].get();
+                    if (i > 0) emitter_.callHelper(Helper::PRINT_SPACE);
+                    expression(argument, 0);
+                    emitter_.callHelper(printHelper(analysis_.argumentType(argument)));
+                }
+                emitter_.callHelper(Helper::PRINT_NEWLINE);
+                return;
+            }
+            expression(node, 0);
+            return;
+        }
+        default:
+            expression(node, 0);
+            return;
+    }
+}
+
+void X64Codegen::function(uint32_t index) {
+    const NumericFunction& fn = analysis_.functions()[index];
+    const FunctionDeclaration& decl = *fn.decl;
+
+    locals_.clear();
+    bool pin = fn.leaf && fn.locals.size() <= MaxPinned;
+    uint32_t slots = 0;
+    for (size_t i = 0; i < fn.locals.size(); i++) {
+        Location location = pin ? Location{true, static_cast<uint8_t>(FirstPinned + i)}
+                                : Location{false, static_cast<uint8_t>(slots++)};
+        locals_.emplace(fn.locals[i], location);
+    }
+    spillBase_ = slots;
+    uint32_t frameSlots = slots + (fn.leaf ? 0 : NumericAnalysis::MaxTemporaries);
+
+    emitter_.beginFunction(index, frameBytes(frameSlots));
+    for (size_t i = 0; i < decl.params.size(); i++) {
+        store(locals_.at(decl.params[i]), Xmm{static_cast<uint8_t>(i)});
+    }
+    bool returned = false;
+    for (const auto& stmt : decl.body) {
+        statement(stmt.get());
+        if (stmt->type == NodeType::RETURN_STATEMENT) {
+            returned = true;
+            break;
+        }
+    }
+    if (!returned) {
+        emitter_.loadConstant(Xmm{0}, NaNBits);
+        emitter_.ret();
+    }
+    emitter_.endFunction();
+}
+
+void X64Codegen::topLevel(const Program& program) {
+    locals_.clear();
+    spillBase_ = 0;
+    emitter_.beginFunction(TopLevel, frameBytes(NumericAnalysis::MaxTemporaries));
+    for (const auto& stmt : program.body) {
+        statement(stmt.get());
+    }
+    emitter_.ret();
+    emitter_.endFunction();
+}
+
+} // namespace x64
+} // namespace js
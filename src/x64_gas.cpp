@@ -0,0 +1,342 @@
+#include "../include/x64.hpp"
+#include <cstdio>
+#include <ostream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+namespace js {
+
+namespace {
+
+using namespace x64;
+
+const char* const sseMnemonics[] = {"movapd", "addsd", "subsd", "mulsd", "divsd", "andpd", "orpd", "xorpd"};
+const char* const predicateNames[] = {"eq", "lt", "le", "unord", "neq"};
+const char* const helperSymbols[] = {
+    "pow@PLT", "js_print_number", "js_print_boolean", "js_print_undefined",
+    "js_print_string", "js_print_space", "js_print_newline"
+};
+
+// Printing follows Number.prototype.toString: the shortest digit string that
+// reads back as the same double, in plain notation for exponents -6..20.
+const char* const runtimeSource = R"(    .text
+js_print_number:
+    pushq %rbx
+    pushq %r12
+    subq $72, %rsp
+    movsd %xmm0, 48(%rsp)
+    ucomisd %xmm0, %xmm0
+    jp .Ljs_pn_nan
+    movq %xmm0, %rax
+    addq %rax, %rax
+    jz .Ljs_pn_zero
+    movabsq $0xFFE0000000000000, %rcx
+    cmpq %rcx, %rax
+    je .Ljs_pn_infinity
+    xorl %ebx, %ebx
+.Ljs_pn_digits:
+    movq %rsp, %rdi
+    movl $48, %esi
+    leaq .Ljs_fmt_exp(%rip), %rdx
+    movl %ebx, %ecx
+    movsd 48(%rsp), %xmm0
+    movl $1, %eax
+    call snprintf@PLT
+    cmpl $16, %ebx
+    je .Ljs_pn_format
+    movq %rsp, %rdi
+    xorl %esi, %esi
+    call strtod@PLT
+    ucomisd 48(%rsp), %xmm0
+    jp .Ljs_pn_next
+    je .Ljs_pn_format
+.Ljs_pn_next:
+    incl %ebx
+    jmp .Ljs_pn_digits
+.Ljs_pn_format:
+    movq %rsp, %rdi
+    movl $101, %esi
+    call strchr@PLT
+    movq %rax, %r12
+    leaq 1(%rax), %rdi
+    xorl %esi, %esi
+    movl $10, %edx
+    call strtol@PLT
+    cmpl $-7, %eax
+    jle .Ljs_pn_exponent
+    cmpl $21, %eax
+    jge .Ljs_pn_exponent
+    movl %ebx, %esi
+    subl %eax, %esi
+    xorl %ecx, %ecx
+    testl %esi, %esi
+    cmovsl %ecx, %esi
+    leaq .Ljs_fmt_fixed(%rip), %rdi
+    movsd 48(%rsp), %xmm0
+    movl $1, %eax
+    call printf@PLT
+    jmp .Ljs_pn_done
+.Ljs_pn_exponent:
+    movb $0, (%r12)
+    movl %eax, %edx
+    movq %rsp, %rsi
+    leaq .Ljs_fmt_exponent(%rip), %rdi
+    xorl %eax, %eax
+    call printf@PLT
+    jmp .Ljs_pn_done
+.Ljs_pn_nan:
+    leaq .Ljs_str_nan(%rip), %rsi
+    jmp .Ljs_pn_text
+.Ljs_pn_infinity:
+    leaq .Ljs_str_infinity(%rip), %rsi
+    leaq .Ljs_str_minus_infinity(%rip), %rdx
+    movq 48(%rsp), %rax
+    testq %rax, %rax
+    cmovsq %rdx, %rsi
+    jmp .Ljs_pn_text
+.Ljs_pn_zero:
+    leaq .Ljs_str_zero(%rip), %rsi
+.Ljs_pn_text:
+    leaq .Ljs_fmt_string(%rip), %rdi
+    xorl %eax, %eax
+    call printf@PLT
+.Ljs_pn_done:
+    addq $72, %rsp
+    popq %r12
+    popq %rbx
+    ret
+
+js_print_boolean:
+    subq $8, %rsp
+    xorpd %xmm1, %xmm1
+    ucomisd %xmm1, %xmm0
+    leaq .Ljs_str_true(%rip), %rsi
+    leaq .Ljs_str_false(%rip), %rax
+    cmove %rax, %rsi
+    jmp .Ljs_print_text
+
+js_print_undefined:
+    subq $8, %rsp
+    leaq .Ljs_str_undefined(%rip), %rsi
+    jmp .Ljs_print_text
+
+js_print_string:
+    subq $8, %rsp
+    movq %xmm0, %rsi
+.Ljs_print_text:
+    leaq .Ljs_fmt_string(%rip), %rdi
+    xorl %eax, %eax
+    call printf@PLT
+    addq $8, %rsp
+    ret
+
+js_print_space:
+    subq $8, %rsp
+    movl $32, %edi
+    call putchar@PLT
+    addq $8, %rsp
+    ret
+
+js_print_newline:
+    subq $8, %rsp
+    movl $10, %edi
+    call putchar@PLT
+    addq $8, %rsp
+    ret
+
+    .section .rodata
+.Ljs_fmt_exp: .asciz "%.*e"
+.Ljs_fmt_fixed: .asciz "%.*f"
+.Ljs_fmt_exponent: .asciz "%se%+d"
+.Ljs_fmt_string: .asciz "%s"
+.Ljs_str_nan: .asciz "NaN"
+.Ljs_str_infinity: .asciz "Infinity"
+.Ljs_str_minus_infinity: .asciz "-Infinity"
+.Ljs_str_zero: .asciz "0"
+.Ljs_str_true: .asciz "true"
+.Ljs_str_false: .asciz "false"
+.Ljs_str_undefined: .asciz "undefined"
+)";
+
+std::string xmm(Xmm reg) {
+    return "%xmm" + std::to_string(reg.id);
+}
+
+std::string slotOperand(uint32_t slot) {
+    return "-" + std::to_string(8 * (slot + 1)) + "(%rbp)";
+}
+
+std::string escape(std::string_view text) {
+    std::string out;
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20 || c >= 0x7F) {
+            char octal[8];
+            std::snprintf(octal, sizeof(octal), "\\%03o", c);
+            out += octal;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    return out;
+}
+
+class GasEmitter : public X64Emitter {
+public:
+    explicit GasEmitter(const NumericAnalysis& analysis) : analysis_(analysis) {}
+
+    void beginFunction(uint32_t index, uint32_t frameBytes) override {
+        topLevel_ = index == TopLevel;
+        name_ = topLevel_ ? "main" : "js_fn_" + std::to_string(index);
+        text_ << "\n";
+        if (topLevel_) {
+            text_ << "    .globl main\n";
+        } else {
+            text_ << "# function " << AtomTable::current().text(analysis_.functions()[index].decl->name) << "\n";
+        }
+        text_ << "    .type " << name_ << ", @function\n" << name_ << ":\n";
+        line("pushq %rbp");
+        line("movq %rsp, %rbp");
+        if (frameBytes > 0) {
+            line("subq $" + std::to_string(frameBytes) + ", %rsp");
+        }
+    }
+
+    void endFunction() override {
+        text_ << "    .size " << name_ << ", .-" << name_ << "\n";
+    }
+
+    void ret() override {
+        if (topLevel_) line("xorl %eax, %eax");
+        line("leave");
+        line("ret");
+    }
+
+    Label newLabel() override { return labels_++; }
+    void bind(Label label) override { text_ << ".Ljs" << label << ":\n"; }
+    void jump(Label label) override { line("jmp .Ljs" + std::to_string(label)); }
+    void jumpIf(Condition condition, Label label) override {
+        line(std::string(condition == Condition::EQUAL ? "je" : "jne") + " .Ljs" + std::to_string(label));
+    }
+
+    void sse(SseOp op, Xmm dst, Xmm src) override {
+        if (op == SseOp::MOVE && dst.id == src.id) return;
+        line(std::string(sseMnemonics[static_cast<size_t>(op)]) + " " + xmm(src) + ", " + xmm(dst));
+    }
+
+    void compare(Predicate predicate, Xmm dst, Xmm src) override {
+        line(std::string("cmp") + predicateNames[static_cast<size_t>(predicate)] + "sd " + xmm(src) + ", " + xmm(dst));
+    }
+
+    void ucomisd(Xmm left, Xmm right) override {
+        line("ucomisd " + xmm(right) + ", " + xmm(left));
+    }
+
+    void bitwise(bool isOr, Xmm dst, Xmm src) override {
+        line("cvttsd2siq " + xmm(dst) + ", %rax");
+        line("cvttsd2siq " + xmm(src) + ", %rcx");
+        line(isOr ? "orl %ecx, %eax" : "andl %ecx, %eax");
+        line("cvtsi2sdl %eax, " + xmm(dst));
+    }
+
+    void loadConstant(Xmm dst, uint64_t bits) override {
+        if (bits == 0) {
+            line("xorpd " + xmm(dst) + ", " + xmm(dst));
+            return;
+        }
+        auto inserted = constants_.emplace(bits, static_cast<uint32_t>(constantBits_.size()));
+        if (inserted.second) constantBits_.push_back(bits);
+        line("movsd .LjsK" + std::to_string(inserted.first->second) + "(%rip), " + xmm(dst));
+    }
+
+    void loadString(Xmm dst, Atom text) override {
+        auto inserted = strings_.emplace(text, static_cast<uint32_t>(stringAtoms_.size()));
+        if (inserted.second) stringAtoms_.push_back(text);
+        line("leaq .LjsS" + std::to_string(inserted.first->second) + "(%rip), %rax");
+        line("movq %rax, " + xmm(dst));
+    }
+
+    void loadSlot(Xmm dst, uint32_t slot) override { line("movsd " + slotOperand(slot) + ", " + xmm(dst)); }
+    void storeSlot(uint32_t slot, Xmm src) override { line("movsd " + xmm(src) + ", " + slotOperand(slot)); }
+
+    void loadGlobal(Xmm dst, uint32_t global) override {
+        line("movsd js_global_" + std::to_string(global) + "(%rip), " + xmm(dst));
+    }
+    void storeGlobal(uint32_t global, Xmm src) override {
+        line("movsd " + xmm(src) + ", js_global_" + std::to_string(global) + "(%rip)");
+    }
+
+    void callFunction(uint32_t index) override { line("call js_fn_" + std::to_string(index)); }
+    void callHelper(Helper helper) override {
+        line(std::string("call ") + helperSymbols[static_cast<size_t>(helper)]);
+    }
+
+    void finish(std::ostream& out, bool withRuntime) {
+        const AtomTable& atoms = AtomTable::current();
+        out << "# Generated by js_compiler\n    .text\n" << text_.str();
+        if (withRuntime) {
+            out << "\n" << runtimeSource;
+        }
+        out << "\n    .section .rodata\n    .align 8\n";
+        for (size_t i = 0; i < constantBits_.size(); i++) {
+            char hex[24];
+            std::snprintf(hex, sizeof(hex), "0x%016llx", static_cast<unsigned long long>(constantBits_[i]));
+            out << ".LjsK" << i << ": .quad " << hex << "\n";
+        }
+        for (size_t i = 0; i < stringAtoms_.size(); i++) {
+            out << ".LjsS" << i << ": .asciz \"" << escape(atoms.text(stringAtoms_[i])) << "\"\n";
+        }
+        out << "\n    .data\n    .align 8\n";
+        for (size_t i = 0; i < analysis_.globals().size(); i++) {
+            out << "js_global_" << i << ": .quad 0x7ff8000000000000 # "
+                << atoms.text(analysis_.globals()[i]) << "\n";
+        }
+        out << "\n    .section .note.GNU-stack,\"\",@progbits\n";
+    }
+
+private:
+    const NumericAnalysis& analysis_;
+    std::ostringstream text_;
+    std::string name_;
+    bool topLevel_ = false;
+    Label labels_ = 0;
+    std::unordered_map<uint64_t, uint32_t> constants_;
+    std::vector<uint64_t> constantBits_;
+    std::unordered_map<Atom, uint32_t> strings_;
+    std::vector<Atom> stringAtoms_;
+
+    void line(const std::string& instruction) {
+        text_ << "    " << instruction << "\n";
+    }
+};
+
+} // namespace
+
+AssemblyReport emitGasAssembly(const Program& program, std::ostream& out) {
+    NumericAnalysis analysis(program);
+    GasEmitter emitter(analysis);
+    X64Codegen codegen(analysis, emitter);
+
+    AssemblyReport report;
+    for (size_t i = 0; i < analysis.functions().size(); i++) {
+        if (analysis.functions()[i].lowerable) {
+            codegen.function(static_cast<uint32_t>(i));
+            report.functionsLowered++;
+        } else {
+            report.functionsSkipped++;
+        }
+    }
+    if (analysis.topLevelLowerable()) {
+        codegen.topLevel(program);
+        report.hasMain = true;
+    } else {
+        report.mainSkippedReason = analysis.topLevelReason();
+    }
+    emitter.finish(out, report.hasMain);
+    return report;
+}
+
+} // namespace js